@@ -0,0 +1,520 @@
+/*
+@file config_store.c
+@brief Implementation for the configuration store component.
+
+This file implements the in-RAM copy of all settings, loaded with a single NVS
+read at boot and written back as one blob, only when its contents changed, along
+with the one-time migration of settings stored key by key by earlier firmware.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_bit_defs.h"
+#include "esp_rom_crc.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+
+#include "config_store.h"
+
+#define CONFIG_NVS_NAMESPACE "rio_config"
+#define CONFIG_NVS_KEY "settings"
+#define CONFIG_MAGIC 0x5243 //"CR"
+
+#define CONFIG_LEGACY_KEY_BSSID "bssid" //AP cache, not exposed as a field
+#define CONFIG_LEGACY_KEY_CHANNEL "channel"
+
+#define CONFIG_FIELD(group, key, type, section, section_type, member) \
+    { group, key, type, section, offsetof(section_type, member), sizeof(((section_type *)0)->member) }
+
+typedef struct {
+    esp32_rio_config_io_t io;
+    esp32_rio_config_wifi_t wifi;
+    esp32_rio_config_wifi_ap_t wifi_ap;
+    esp32_rio_config_mb_t mb;
+    esp32_rio_config_rbe_t rbe;
+    esp32_rio_config_dq_t dq; //Sections added later go last, blobs stored before them still load
+    esp32_rio_config_logic_t logic;
+    esp32_rio_config_gateway_t gateway;
+} config_settings_t;
+
+typedef struct {
+    uint16_t magic;
+    uint16_t version;
+    uint32_t length; //Size of the settings stored, less than their current size for blobs of earlier firmware
+    uint32_t sections; //Bit n set once section n has been written
+    uint32_t crc; //CRC32 of the section mask and settings
+    config_settings_t settings;
+} config_blob_t;
+
+static bool config_blob_valid(const config_blob_t *, size_t);
+static uint32_t config_crc(const config_blob_t *);
+static void *config_section_data(esp32_rio_config_section_t);
+static bool config_field_valid(const esp32_rio_config_field_t *);
+static uint64_t config_section_fields(esp32_rio_config_section_t);
+static void config_complete_section(esp32_rio_config_section_t, const void *);
+static void config_migrate_finish(void);
+static bool config_migrate(void);
+static void config_migrate_erase(void);
+
+static const char *TAG = "ESP32_RIO_CONFIG";
+
+static const struct {
+    size_t offset;
+    size_t size;
+} s_sections[ESP32_RIO_CONFIG_NUM_SECTIONS] = { //Indexed by esp32_rio_config_section_t
+    { offsetof(config_settings_t, io), sizeof(esp32_rio_config_io_t) },
+    { offsetof(config_settings_t, wifi), sizeof(esp32_rio_config_wifi_t) },
+    { offsetof(config_settings_t, wifi_ap), sizeof(esp32_rio_config_wifi_ap_t) },
+    { offsetof(config_settings_t, mb), sizeof(esp32_rio_config_mb_t) },
+    { offsetof(config_settings_t, rbe), sizeof(esp32_rio_config_rbe_t) },
+    { offsetof(config_settings_t, dq), sizeof(esp32_rio_config_dq_t) },
+    { offsetof(config_settings_t, logic), sizeof(esp32_rio_config_logic_t) },
+    { offsetof(config_settings_t, gateway), sizeof(esp32_rio_config_gateway_t) }
+};
+
+static const esp32_rio_config_field_t s_fields[] = {
+    CONFIG_FIELD("io_config", "di_filter_us", ESP32_RIO_CONFIG_FIELD_BLOB, ESP32_RIO_CONFIG_IO, esp32_rio_config_io_t, di_filter_us),
+    CONFIG_FIELD("io_config", "di_mode", ESP32_RIO_CONFIG_FIELD_BLOB, ESP32_RIO_CONFIG_IO, esp32_rio_config_io_t, di_modes),
+    CONFIG_FIELD("io_config", "cnt_window_ms", ESP32_RIO_CONFIG_FIELD_U32, ESP32_RIO_CONFIG_IO, esp32_rio_config_io_t, counter_window_ms),
+    CONFIG_FIELD("io_config", "wdog_ms", ESP32_RIO_CONFIG_FIELD_U32, ESP32_RIO_CONFIG_IO, esp32_rio_config_io_t, watchdog_ms),
+    CONFIG_FIELD("io_config", "dq_safe", ESP32_RIO_CONFIG_FIELD_BLOB, ESP32_RIO_CONFIG_IO, esp32_rio_config_io_t, dq_safe_states),
+    CONFIG_FIELD("wifi_config", "ssid", ESP32_RIO_CONFIG_FIELD_STR, ESP32_RIO_CONFIG_WIFI, esp32_rio_config_wifi_t, ssid),
+    CONFIG_FIELD("wifi_config", "password", ESP32_RIO_CONFIG_FIELD_STR, ESP32_RIO_CONFIG_WIFI, esp32_rio_config_wifi_t, password),
+    CONFIG_FIELD("wifi_config", "static_ip", ESP32_RIO_CONFIG_FIELD_BLOB, ESP32_RIO_CONFIG_WIFI, esp32_rio_config_wifi_t, static_ip),
+    CONFIG_FIELD("mb_config", "max_conn", ESP32_RIO_CONFIG_FIELD_U8, ESP32_RIO_CONFIG_MB, esp32_rio_config_mb_t, max_connections),
+    CONFIG_FIELD("mb_config", "sched", ESP32_RIO_CONFIG_FIELD_U8, ESP32_RIO_CONFIG_MB, esp32_rio_config_mb_t, sched_policy),
+    CONFIG_FIELD("mb_config", "primary_ip", ESP32_RIO_CONFIG_FIELD_U32, ESP32_RIO_CONFIG_MB, esp32_rio_config_mb_t, primary_ip),
+    CONFIG_FIELD("rbe_config", "target", ESP32_RIO_CONFIG_FIELD_STR, ESP32_RIO_CONFIG_RBE, esp32_rio_config_rbe_t, target),
+    CONFIG_FIELD("rbe_config", "coalesce_ms", ESP32_RIO_CONFIG_FIELD_U32, ESP32_RIO_CONFIG_RBE, esp32_rio_config_rbe_t, coalesce_ms),
+    CONFIG_FIELD("rbe_config", "heartbeat_s", ESP32_RIO_CONFIG_FIELD_U32, ESP32_RIO_CONFIG_RBE, esp32_rio_config_rbe_t, heartbeat_s),
+    CONFIG_FIELD("dq_config", "dq_mode", ESP32_RIO_CONFIG_FIELD_BLOB, ESP32_RIO_CONFIG_DQ, esp32_rio_config_dq_t, modes),
+    CONFIG_FIELD("dq_config", "dq_time_ms", ESP32_RIO_CONFIG_FIELD_BLOB, ESP32_RIO_CONFIG_DQ, esp32_rio_config_dq_t, times_ms),
+    CONFIG_FIELD("dq_config", "dq_pwm_hz", ESP32_RIO_CONFIG_FIELD_BLOB, ESP32_RIO_CONFIG_DQ, esp32_rio_config_dq_t, frequencies_hz),
+    CONFIG_FIELD("dq_config", "dq_pwm_duty", ESP32_RIO_CONFIG_FIELD_BLOB, ESP32_RIO_CONFIG_DQ, esp32_rio_config_dq_t, duties_permille),
+    CONFIG_FIELD("logic_config", "blocks", ESP32_RIO_CONFIG_FIELD_U8, ESP32_RIO_CONFIG_LOGIC, esp32_rio_config_logic_t, block_count),
+    CONFIG_FIELD("logic_config", "ops", ESP32_RIO_CONFIG_FIELD_BLOB, ESP32_RIO_CONFIG_LOGIC, esp32_rio_config_logic_t, ops),
+    CONFIG_FIELD("logic_config", "sources", ESP32_RIO_CONFIG_FIELD_BLOB, ESP32_RIO_CONFIG_LOGIC, esp32_rio_config_logic_t, sources),
+    CONFIG_FIELD("logic_config", "times_ms", ESP32_RIO_CONFIG_FIELD_BLOB, ESP32_RIO_CONFIG_LOGIC, esp32_rio_config_logic_t, times_ms),
+    CONFIG_FIELD("gw_config", "peers", ESP32_RIO_CONFIG_FIELD_U8, ESP32_RIO_CONFIG_GATEWAY, esp32_rio_config_gateway_t, peer_count),
+    CONFIG_FIELD("gw_config", "units", ESP32_RIO_CONFIG_FIELD_BLOB, ESP32_RIO_CONFIG_GATEWAY, esp32_rio_config_gateway_t, units),
+    CONFIG_FIELD("gw_config", "peer_ips", ESP32_RIO_CONFIG_FIELD_BLOB, ESP32_RIO_CONFIG_GATEWAY, esp32_rio_config_gateway_t, peer_ips),
+    CONFIG_FIELD("gw_config", "poll_ms", ESP32_RIO_CONFIG_FIELD_U32, ESP32_RIO_CONFIG_GATEWAY, esp32_rio_config_gateway_t, poll_ms),
+    CONFIG_FIELD("gw_config", "gateways", ESP32_RIO_CONFIG_FIELD_BLOB, ESP32_RIO_CONFIG_GATEWAY, esp32_rio_config_gateway_t, gateway_ips)
+};
+
+_Static_assert(sizeof(s_fields) / sizeof(s_fields[0]) <= 64, "Partial field mask must hold every field");
+
+static const char *s_legacy_groups[] = { "io_config", "wifi_config", "mb_config", "rbe_config" }; //Namespaces of earlier firmware
+
+/*
+ s_config holds the current settings and s_stored a copy of what NVS holds, so that a flush writes only when
+ something changed. Writes within a hold are gathered into a single flush at release.
+ Fields set one by one in a section never written (by migration, or by import before the owner of the section
+ read it) are kept apart as partial fields: the owner's first read lays them over the settings it passes, its
+ defaults, and only then is the section written, so the fields left out keep their defaults rather than zeros.
+*/
+static config_blob_t s_config;
+static config_blob_t s_stored;
+static nvs_handle_t s_nvs_handle;
+static bool s_nvs_open = false;
+static bool s_dirty = false; //Written since the last flush
+static unsigned int s_hold_depth = 0;
+static uint32_t s_commits = 0; //Blobs written to NVS since boot
+static uint32_t s_skipped = 0; //Flushes skipped since boot, settings written unchanged
+static uint32_t s_based = 0; //Sections never written, holding the defaults their owner passed on its first read
+static uint64_t s_partial_fields = 0; //Bit n set once s_fields[n] was set in a section neither written nor based
+static bool s_migration_pending = false; //Settings of earlier firmware kept until the sections migrated are complete
+static config_settings_t s_section_scratch; //Section being completed, under the mutex
+static StaticSemaphore_t s_config_mutex_buffer;
+static SemaphoreHandle_t s_config_mutex = NULL;
+
+
+/*
+ Initialize NVS and load all settings with a single read, migrating settings of earlier firmware on first boot
+*/
+esp_err_t esp32_rio_config_init(void) {
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_RETURN_ON_ERROR(nvs_flash_erase(), TAG, "nvs_flash_erase fail.");
+        err = nvs_flash_init();
+    }
+    ESP_RETURN_ON_ERROR(err, TAG, "nvs_flash_init fail.");
+    if (s_config_mutex == NULL) {
+        s_config_mutex = xSemaphoreCreateMutexStatic(&s_config_mutex_buffer);
+    }
+    ESP_RETURN_ON_ERROR(nvs_open(CONFIG_NVS_NAMESPACE, NVS_READWRITE, &s_nvs_handle),
+                        TAG,
+                        "Error opening NVS namespace '%s'.", CONFIG_NVS_NAMESPACE);
+    s_nvs_open = true;
+    
+    size_t length = sizeof(s_config);
+    err = nvs_get_blob(s_nvs_handle, CONFIG_NVS_KEY, &s_config, &length);
+    if (err == ESP_OK && config_blob_valid(&s_config, length)) {
+        s_stored = s_config;
+        ESP_LOGI(TAG, "Settings loaded from NVS (sections 0x%02" PRIx32 ").", s_config.sections);
+        return ESP_OK;
+    }
+    if (err == ESP_OK) {
+        ESP_LOGW(TAG, "Ignoring invalid stored settings (version %u).", (unsigned int)s_config.version);
+    } else if (err != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGW(TAG, "Failed to read settings from NVS: %s", esp_err_to_name(err));
+    }
+    memset(&s_config, 0, sizeof(s_config));
+    s_stored = s_config; //Nothing worth writing yet
+    
+    if (err == ESP_ERR_NVS_NOT_FOUND && config_migrate()) {
+        s_migration_pending = true; //Migrated sections are completed as their owners read them
+        config_migrate_finish();
+    }
+    return ESP_OK;
+}
+
+
+/*
+ Copy a section of settings. The caller passes its current settings, its defaults at boot: a section never written
+ takes them as the base for fields set later and is left unchanged (ESP_ERR_NOT_FOUND), and a section holding only
+ some fields set is completed from them
+*/
+esp_err_t esp32_rio_config_read(esp32_rio_config_section_t section, void *data, size_t size) {
+    ESP_RETURN_ON_FALSE(section < ESP32_RIO_CONFIG_NUM_SECTIONS && size == s_sections[section].size,
+                        ESP_ERR_INVALID_ARG, TAG, "Invalid settings section %d.", (int)section);
+    esp_err_t err = ESP_OK;
+    bool completed = false;
+    xSemaphoreTake(s_config_mutex, portMAX_DELAY);
+    if (!(s_config.sections & BIT(section)) && (s_partial_fields & config_section_fields(section))) {
+        config_complete_section(section, data);
+        completed = true;
+    }
+    if (s_config.sections & BIT(section)) {
+        memcpy(data, config_section_data(section), size);
+    } else {
+        memcpy(config_section_data(section), data, size);
+        s_based |= BIT(section);
+        err = ESP_ERR_NOT_FOUND;
+    }
+    bool flush = completed && s_hold_depth == 0;
+    xSemaphoreGive(s_config_mutex);
+    if (flush) {
+        esp32_rio_config_flush();
+        config_migrate_finish();
+    }
+    return err;
+}
+
+
+/*
+ Replace a section of settings and store all settings, unless held
+*/
+esp_err_t esp32_rio_config_write(esp32_rio_config_section_t section, const void *data, size_t size) {
+    ESP_RETURN_ON_FALSE(section < ESP32_RIO_CONFIG_NUM_SECTIONS && size == s_sections[section].size,
+                        ESP_ERR_INVALID_ARG, TAG, "Invalid settings section %d.", (int)section);
+    xSemaphoreTake(s_config_mutex, portMAX_DELAY);
+    memcpy(config_section_data(section), data, size);
+    s_config.sections |= BIT(section);
+    s_partial_fields &= ~config_section_fields(section); //Superseded by the whole section
+    s_dirty = true;
+    bool flush = s_hold_depth == 0;
+    xSemaphoreGive(s_config_mutex);
+    if (!flush) {
+        return ESP_OK;
+    }
+    esp_err_t err = esp32_rio_config_flush();
+    config_migrate_finish();
+    return err;
+}
+
+
+/*
+ Defer storing settings until the matching release, gathering all writes in between into one NVS commit
+*/
+void esp32_rio_config_hold(void) {
+    xSemaphoreTake(s_config_mutex, portMAX_DELAY);
+    s_hold_depth++;
+    xSemaphoreGive(s_config_mutex);
+}
+
+
+/*
+ End a hold, storing the settings written during it once the last hold ends
+*/
+esp_err_t esp32_rio_config_release(void) {
+    xSemaphoreTake(s_config_mutex, portMAX_DELAY);
+    if (s_hold_depth > 0) {
+        s_hold_depth--;
+    }
+    bool flush = s_hold_depth == 0;
+    xSemaphoreGive(s_config_mutex);
+    if (!flush) {
+        return ESP_OK;
+    }
+    esp_err_t err = esp32_rio_config_flush();
+    config_migrate_finish();
+    return err;
+}
+
+
+/*
+ Store the settings written since the last flush now, even when held. Nothing is written if they are unchanged
+*/
+esp_err_t esp32_rio_config_flush(void) {
+    esp_err_t err = ESP_OK;
+    xSemaphoreTake(s_config_mutex, portMAX_DELAY);
+    if (!s_dirty) {
+        xSemaphoreGive(s_config_mutex);
+        return ESP_OK;
+    }
+    if (s_config.sections == s_stored.sections && memcmp(&s_config.settings, &s_stored.settings, sizeof(s_config.settings)) == 0) {
+        s_dirty = false;
+        s_skipped++; //Spares a flash write
+        xSemaphoreGive(s_config_mutex);
+        return ESP_OK;
+    }
+    
+    s_config.magic = CONFIG_MAGIC;
+    s_config.version = ESP32_RIO_CONFIG_VERSION;
+    s_config.length = sizeof(s_config.settings);
+    s_config.crc = config_crc(&s_config);
+    err = s_nvs_open ? nvs_set_blob(s_nvs_handle, CONFIG_NVS_KEY, &s_config, sizeof(s_config)) : ESP_ERR_INVALID_STATE;
+    if (err == ESP_OK) {
+        err = nvs_commit(s_nvs_handle);
+    }
+    if (err == ESP_OK) {
+        s_stored = s_config;
+        s_dirty = false;
+        s_commits++;
+        ESP_LOGI(TAG, "Settings saved to NVS.");
+    } else {
+        ESP_LOGE(TAG, "Error storing settings to NVS: %s", esp_err_to_name(err)); //Retried on the next flush
+    }
+    xSemaphoreGive(s_config_mutex);
+    return err;
+}
+
+
+/*
+ Retrieve the table of settings exposed by name
+*/
+const esp32_rio_config_field_t *esp32_rio_config_get_fields(size_t *count) {
+    *count = sizeof(s_fields) / sizeof(s_fields[0]);
+    return s_fields;
+}
+
+
+/*
+ Copy the value of a setting (field->size bytes; ESP_ERR_NOT_FOUND if neither it nor its section was ever set)
+*/
+esp_err_t esp32_rio_config_get_field(const esp32_rio_config_field_t *field, void *value) {
+    ESP_RETURN_ON_FALSE(config_field_valid(field), ESP_ERR_INVALID_ARG, TAG, "Invalid settings field.");
+    esp_err_t err = ESP_OK;
+    xSemaphoreTake(s_config_mutex, portMAX_DELAY);
+    if ((s_config.sections & BIT(field->section)) || (s_partial_fields & (1ULL << (field - s_fields)))) {
+        memcpy(value, (uint8_t *)config_section_data(field->section) + field->offset, field->size);
+    } else {
+        err = ESP_ERR_NOT_FOUND;
+    }
+    xSemaphoreGive(s_config_mutex);
+    return err;
+}
+
+
+/*
+ Set the value of a setting (field->size bytes) and store all settings, unless held. The other fields of a section
+ never written keep the defaults its owner passed on its first read, or, before that read, the setting waits for it
+*/
+esp_err_t esp32_rio_config_set_field(const esp32_rio_config_field_t *field, const void *value) {
+    ESP_RETURN_ON_FALSE(config_field_valid(field), ESP_ERR_INVALID_ARG, TAG, "Invalid settings field.");
+    xSemaphoreTake(s_config_mutex, portMAX_DELAY);
+    memcpy((uint8_t *)config_section_data(field->section) + field->offset, value, field->size);
+    bool flush = false;
+    if ((s_config.sections | s_based) & BIT(field->section)) {
+        s_config.sections |= BIT(field->section);
+        s_dirty = true;
+        flush = s_hold_depth == 0;
+    } else {
+        s_partial_fields |= 1ULL << (field - s_fields);
+    }
+    xSemaphoreGive(s_config_mutex);
+    return flush ? esp32_rio_config_flush() : ESP_OK;
+}
+
+
+/*
+ Retrieve the number of settings blobs written to NVS and of flushes skipped for unchanged settings since boot
+*/
+void esp32_rio_config_get_stats(uint32_t *commits, uint32_t *skipped) {
+    xSemaphoreTake(s_config_mutex, portMAX_DELAY);
+    *commits = s_commits;
+    *skipped = s_skipped;
+    xSemaphoreGive(s_config_mutex);
+}
+
+
+/*
+ A blob stored before the last sections were added is shorter, those sections are then left unwritten
+*/
+static bool config_blob_valid(const config_blob_t *blob, size_t length) {
+    if (length < offsetof(config_blob_t, settings) || blob->magic != CONFIG_MAGIC || blob->version != ESP32_RIO_CONFIG_VERSION ||
+        blob->length > sizeof(blob->settings) || length != offsetof(config_blob_t, settings) + blob->length) {
+        return false;
+    }
+    for (int section = 0; section < ESP32_RIO_CONFIG_NUM_SECTIONS; section++) {
+        if ((blob->sections & BIT(section)) && s_sections[section].offset + s_sections[section].size > blob->length) {
+            return false;
+        }
+    }
+    return blob->crc == config_crc(blob);
+}
+
+
+static uint32_t config_crc(const config_blob_t *blob) {
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)&blob->sections, sizeof(blob->sections));
+    return esp_rom_crc32_le(crc, (const uint8_t *)&blob->settings, blob->length);
+}
+
+
+static void *config_section_data(esp32_rio_config_section_t section) {
+    return (uint8_t *)&s_config.settings + s_sections[section].offset;
+}
+
+
+static bool config_field_valid(const esp32_rio_config_field_t *field) {
+    return field >= s_fields && field < &s_fields[sizeof(s_fields) / sizeof(s_fields[0])];
+}
+
+
+/*
+ Mask of the fields of a section, as in s_partial_fields
+*/
+static uint64_t config_section_fields(esp32_rio_config_section_t section) {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < sizeof(s_fields) / sizeof(s_fields[0]); i++) {
+        if (s_fields[i].section == section) {
+            mask |= 1ULL << i;
+        }
+    }
+    return mask;
+}
+
+
+/*
+ Write a section from the owner's settings with its partial fields laid over them. Called with the mutex held
+*/
+static void config_complete_section(esp32_rio_config_section_t section, const void *base) {
+    uint8_t *scratch = (uint8_t *)&s_section_scratch;
+    const uint8_t *data = config_section_data(section);
+    memcpy(scratch, base, s_sections[section].size);
+    for (size_t i = 0; i < sizeof(s_fields) / sizeof(s_fields[0]); i++) {
+        if (s_fields[i].section == section && (s_partial_fields & (1ULL << i))) {
+            memcpy(&scratch[s_fields[i].offset], &data[s_fields[i].offset], s_fields[i].size);
+        }
+    }
+    memcpy(config_section_data(section), scratch, s_sections[section].size);
+    s_partial_fields &= ~config_section_fields(section);
+    s_config.sections |= BIT(section);
+    s_dirty = true;
+}
+
+
+/*
+ Drop the settings of earlier firmware once every section migrated is complete and stored. Until then they stay,
+ and are migrated again on the next boot should one never be
+*/
+static void config_migrate_finish(void) {
+    xSemaphoreTake(s_config_mutex, portMAX_DELAY);
+    bool finish = s_migration_pending && s_partial_fields == 0;
+    xSemaphoreGive(s_config_mutex);
+    if (finish && esp32_rio_config_flush() == ESP_OK) {
+        s_migration_pending = false;
+        config_migrate_erase();
+        ESP_LOGI(TAG, "Settings of earlier firmware migrated.");
+    }
+}
+
+
+/*
+ Bring in the settings stored key by key by earlier firmware, under the group and key of each field.
+ Returns whether any was found
+*/
+static bool config_migrate(void) {
+    bool found = false;
+    for (size_t g = 0; g < sizeof(s_legacy_groups) / sizeof(s_legacy_groups[0]); g++) {
+        nvs_handle_t nvs_handle;
+        if (nvs_open(s_legacy_groups[g], NVS_READONLY, &nvs_handle) != ESP_OK) {
+            continue;
+        }
+        for (size_t i = 0; i < sizeof(s_fields) / sizeof(s_fields[0]); i++) {
+            const esp32_rio_config_field_t *field = &s_fields[i];
+            if (strcmp(field->group, s_legacy_groups[g]) != 0) {
+                continue;
+            }
+            uint8_t *value = (uint8_t *)config_section_data(field->section) + field->offset;
+            size_t length = field->size;
+            esp_err_t err;
+            switch (field->type) {
+                case ESP32_RIO_CONFIG_FIELD_U8:
+                    err = nvs_get_u8(nvs_handle, field->key, value);
+                    break;
+                case ESP32_RIO_CONFIG_FIELD_U32:
+                    err = nvs_get_u32(nvs_handle, field->key, (uint32_t *)value);
+                    break;
+                case ESP32_RIO_CONFIG_FIELD_STR:
+                    err = nvs_get_str(nvs_handle, field->key, (char *)value, &length);
+                    break;
+                default:
+                    err = nvs_get_blob(nvs_handle, field->key, value, &length);
+                    break;
+            }
+            if (err == ESP_OK && field->offset == offsetof(esp32_rio_config_io_t, dq_safe_states) && field->section == ESP32_RIO_CONFIG_IO) {
+                // Safe states were stored as two banks of as many outputs as the board has
+                uint8_t bank_1[ESP32_RIO_CONFIG_MAX_DQ] = { 0 };
+                memcpy(bank_1, &value[length / 2], length / 2);
+                memset(&value[length / 2], 0, field->size - length / 2);
+                memcpy(&value[ESP32_RIO_CONFIG_MAX_DQ], bank_1, length / 2);
+            }
+            if (err == ESP_OK) {
+                s_partial_fields |= 1ULL << i; //Other fields of the section are left to its owner's defaults
+                found = true;
+            }
+        }
+        if (strcmp(s_legacy_groups[g], "wifi_config") == 0) {
+            size_t length = sizeof(s_config.settings.wifi_ap.bssid);
+            if (nvs_get_blob(nvs_handle, CONFIG_LEGACY_KEY_BSSID, s_config.settings.wifi_ap.bssid, &length) == ESP_OK &&
+                nvs_get_u8(nvs_handle, CONFIG_LEGACY_KEY_CHANNEL, &s_config.settings.wifi_ap.channel) == ESP_OK) {
+                s_config.sections |= BIT(ESP32_RIO_CONFIG_WIFI_AP);
+            } else {
+                memset(&s_config.settings.wifi_ap, 0, sizeof(s_config.settings.wifi_ap));
+            }
+        }
+        nvs_close(nvs_handle);
+    }
+    s_dirty = found;
+    return found;
+}
+
+
+/*
+ Drop the settings of earlier firmware, once migrated
+*/
+static void config_migrate_erase(void) {
+    for (size_t g = 0; g < sizeof(s_legacy_groups) / sizeof(s_legacy_groups[0]); g++) {
+        nvs_handle_t nvs_handle;
+        if (nvs_open(s_legacy_groups[g], NVS_READWRITE, &nvs_handle) == ESP_OK) {
+            if (nvs_erase_all(nvs_handle) == ESP_OK) {
+                nvs_commit(nvs_handle);
+            }
+            nvs_close(nvs_handle);
+        }
+    }
+}
@@ -0,0 +1,129 @@
+/*
+@file config_store.h
+@brief Header for the configuration store component.
+
+This file defines the public interface for the settings of all components, kept
+in RAM as typed sections and stored on NVS together as a single versioned blob.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define ESP32_RIO_CONFIG_VERSION 1 //Bump on any change to existing section layouts (new sections are appended)
+#define ESP32_RIO_CONFIG_MAX_DI 16 //Largest board supported, see remote_io.h
+#define ESP32_RIO_CONFIG_MAX_DQ 16 //Per bank
+#define ESP32_RIO_CONFIG_SSID_MAX_LENGTH 32
+#define ESP32_RIO_CONFIG_PASSWORD_MAX_LENGTH 64
+#define ESP32_RIO_CONFIG_RBE_TARGET_MAX_LENGTH 64
+#define ESP32_RIO_CONFIG_LOGIC_MAX_BLOCKS 32
+#define ESP32_RIO_CONFIG_GATEWAY_MAX_PEERS 20
+#define ESP32_RIO_CONFIG_GATEWAY_MAX_SERVED 2
+
+typedef enum {
+    ESP32_RIO_CONFIG_IO = 0, //esp32_rio_config_io_t
+    ESP32_RIO_CONFIG_WIFI, //esp32_rio_config_wifi_t
+    ESP32_RIO_CONFIG_WIFI_AP, //esp32_rio_config_wifi_ap_t
+    ESP32_RIO_CONFIG_MB, //esp32_rio_config_mb_t
+    ESP32_RIO_CONFIG_RBE, //esp32_rio_config_rbe_t
+    ESP32_RIO_CONFIG_DQ, //esp32_rio_config_dq_t
+    ESP32_RIO_CONFIG_LOGIC, //esp32_rio_config_logic_t
+    ESP32_RIO_CONFIG_GATEWAY, //esp32_rio_config_gateway_t
+    ESP32_RIO_CONFIG_NUM_SECTIONS
+} esp32_rio_config_section_t;
+
+typedef struct {
+    uint32_t di_filter_us[ESP32_RIO_CONFIG_MAX_DI];
+    uint8_t di_modes[ESP32_RIO_CONFIG_MAX_DI];
+    uint8_t dq_safe_states[2][ESP32_RIO_CONFIG_MAX_DQ];
+    uint32_t counter_window_ms;
+    uint32_t watchdog_ms;
+} esp32_rio_config_io_t;
+
+typedef struct {
+    char ssid[ESP32_RIO_CONFIG_SSID_MAX_LENGTH + 1];
+    char password[ESP32_RIO_CONFIG_PASSWORD_MAX_LENGTH + 1];
+    uint32_t static_ip[3]; //Address, netmask and gateway in network order, all zero for DHCP
+} esp32_rio_config_wifi_t;
+
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t channel; //0 when no AP is cached
+} esp32_rio_config_wifi_ap_t;
+
+typedef struct {
+    uint8_t max_connections;
+    uint8_t sched_policy;
+    uint32_t primary_ip;
+} esp32_rio_config_mb_t;
+
+typedef struct {
+    char target[ESP32_RIO_CONFIG_RBE_TARGET_MAX_LENGTH + 1];
+    uint32_t coalesce_ms;
+    uint32_t heartbeat_s;
+} esp32_rio_config_rbe_t;
+
+typedef struct {
+    uint8_t modes[2][ESP32_RIO_CONFIG_MAX_DQ];
+    uint16_t times_ms[2][ESP32_RIO_CONFIG_MAX_DQ];
+    uint16_t frequencies_hz[2][ESP32_RIO_CONFIG_MAX_DQ];
+    uint16_t duties_permille[2][ESP32_RIO_CONFIG_MAX_DQ];
+} esp32_rio_config_dq_t;
+
+typedef struct {
+    uint8_t block_count;
+    uint8_t ops[ESP32_RIO_CONFIG_LOGIC_MAX_BLOCKS][2]; //Operation and destination
+    uint8_t sources[ESP32_RIO_CONFIG_LOGIC_MAX_BLOCKS][2];
+    uint16_t times_ms[ESP32_RIO_CONFIG_LOGIC_MAX_BLOCKS];
+} esp32_rio_config_logic_t;
+
+typedef struct {
+    uint8_t peer_count;
+    uint8_t units[ESP32_RIO_CONFIG_GATEWAY_MAX_PEERS];
+    uint32_t peer_ips[ESP32_RIO_CONFIG_GATEWAY_MAX_PEERS]; //Network order
+    uint32_t poll_ms;
+    uint32_t gateway_ips[ESP32_RIO_CONFIG_GATEWAY_MAX_SERVED]; //Gateways answered, network order, 0 for none
+} esp32_rio_config_gateway_t;
+
+/*
+ Settings exposed by name for export and import, under the NVS namespace and key they were stored with before
+ the store existed
+*/
+typedef enum {
+    ESP32_RIO_CONFIG_FIELD_U8 = 0,
+    ESP32_RIO_CONFIG_FIELD_U32,
+    ESP32_RIO_CONFIG_FIELD_STR,
+    ESP32_RIO_CONFIG_FIELD_BLOB
+} esp32_rio_config_field_type_t;
+
+typedef struct {
+    const char *group;
+    const char *key;
+    esp32_rio_config_field_type_t type;
+    esp32_rio_config_section_t section;
+    size_t offset; //Within the section
+    size_t size;
+} esp32_rio_config_field_t;
+
+esp_err_t esp32_rio_config_init(void);
+esp_err_t esp32_rio_config_read(esp32_rio_config_section_t, void *, size_t);
+esp_err_t esp32_rio_config_write(esp32_rio_config_section_t, const void *, size_t);
+void esp32_rio_config_hold(void);
+esp_err_t esp32_rio_config_release(void);
+esp_err_t esp32_rio_config_flush(void);
+const esp32_rio_config_field_t *esp32_rio_config_get_fields(size_t *);
+esp_err_t esp32_rio_config_get_field(const esp32_rio_config_field_t *, void *);
+esp_err_t esp32_rio_config_set_field(const esp32_rio_config_field_t *, const void *);
+void esp32_rio_config_get_stats(uint32_t *, uint32_t *);
+
+#endif //CONFIG_STORE_H
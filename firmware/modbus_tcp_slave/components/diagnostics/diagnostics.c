@@ -0,0 +1,219 @@
+/*
+@file diagnostics.c
+@brief Implementation for the diagnostics component.
+
+This file implements lock-free event counters and latency histograms meant to be
+updated on hot paths, along with a periodic timer computing rates and publishing
+snapshots of all figures.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+
+#include "diagnostics.h"
+
+static void rate_timer_callback(void *);
+
+static const char *TAG = "ESP32_RIO_DIAG";
+
+/*
+ Each latency histogram has a single writer (the task measuring it), so recording takes no lock. Resets are
+ requested through a flag and carried out by the writer on its next sample. Snapshots taken while a sample is
+ being recorded may be off by that one sample.
+*/
+typedef struct {
+    volatile uint32_t count;
+    volatile uint32_t min_us;
+    volatile uint32_t max_us;
+    volatile uint64_t sum_us;
+    volatile uint32_t buckets[ESP32_RIO_DIAG_HISTOGRAM_BUCKETS];
+    atomic_bool reset_requested;
+} latency_histogram_t;
+
+static atomic_uint s_counters[ESP32_RIO_DIAG_NUM_COUNTERS];
+static latency_histogram_t s_latencies[ESP32_RIO_DIAG_NUM_LATENCIES];
+
+static esp_timer_handle_t s_rate_timer = NULL;
+static uint32_t s_last_request_count = 0;
+static volatile uint32_t s_request_rate = 0;
+static diag_update_cb_t s_diag_update_callback = NULL;
+
+
+/*
+ Initialize diagnostics, starting rate computation (and snapshot publishing, if a callback is given)
+*/
+esp_err_t esp32_rio_diag_init(diag_update_cb_t diag_update_callback) {
+    for (int i = 0; i < ESP32_RIO_DIAG_NUM_LATENCIES; i++) {
+        s_latencies[i].min_us = UINT32_MAX;
+    }
+    s_diag_update_callback = diag_update_callback;
+    
+    const esp_timer_create_args_t rate_timer_args = {
+        .callback = rate_timer_callback,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "diag_rates"
+    };
+    ESP_RETURN_ON_ERROR(esp_timer_create(&rate_timer_args, &s_rate_timer),
+                        TAG,
+                        "esp_timer_create fail.");
+    return esp_timer_start_periodic(s_rate_timer, ESP32_RIO_DIAG_RATE_PERIOD_MS * 1000ULL);
+}
+
+
+/*
+ Count one occurrence of a given event. Safe from any task
+*/
+void esp32_rio_diag_count(esp32_rio_diag_counter_t counter) {
+    atomic_fetch_add_explicit(&s_counters[counter], 1, memory_order_relaxed);
+}
+
+
+/*
+ Record a latency sample, in microseconds. Each latency must always be recorded from the same task
+*/
+void esp32_rio_diag_record_latency(esp32_rio_diag_latency_t latency, uint32_t latency_us) {
+    latency_histogram_t *histogram = &s_latencies[latency];
+    if (atomic_exchange_explicit(&histogram->reset_requested, false, memory_order_acquire)) {
+        histogram->count = 0;
+        histogram->min_us = UINT32_MAX;
+        histogram->max_us = 0;
+        histogram->sum_us = 0;
+        for (int i = 0; i < ESP32_RIO_DIAG_HISTOGRAM_BUCKETS; i++) {
+            histogram->buckets[i] = 0;
+        }
+    }
+    
+    int bucket = latency_us == 0 ? 0 : 32 - __builtin_clz(latency_us);
+    if (bucket >= ESP32_RIO_DIAG_HISTOGRAM_BUCKETS) {
+        bucket = ESP32_RIO_DIAG_HISTOGRAM_BUCKETS - 1;
+    }
+    histogram->buckets[bucket]++;
+    histogram->sum_us += latency_us;
+    if (latency_us < histogram->min_us) {
+        histogram->min_us = latency_us;
+    }
+    if (latency_us > histogram->max_us) {
+        histogram->max_us = latency_us;
+    }
+    histogram->count++;
+}
+
+
+/*
+ Retrieve all counters, rates and latency statistics
+*/
+void esp32_rio_diag_get_snapshot(esp32_rio_diag_snapshot_t *snapshot) {
+    memset(snapshot, 0, sizeof(*snapshot));
+    snapshot->uptime_s = (uint32_t)(esp_timer_get_time() / 1000000);
+    for (int i = 0; i < ESP32_RIO_DIAG_NUM_COUNTERS; i++) {
+        snapshot->counters[i] = atomic_load_explicit(&s_counters[i], memory_order_relaxed);
+    }
+    snapshot->request_rate = s_request_rate;
+    
+    for (int i = 0; i < ESP32_RIO_DIAG_NUM_LATENCIES; i++) {
+        const latency_histogram_t *histogram = &s_latencies[i];
+        esp32_rio_diag_latency_stats_t *stats = &snapshot->latencies[i];
+        if (atomic_load(&histogram->reset_requested)) {
+            continue; //Reported as empty until the writer clears it
+        }
+        stats->count = histogram->count;
+        if (stats->count == 0) {
+            continue;
+        }
+        stats->min_us = histogram->min_us;
+        stats->max_us = histogram->max_us;
+        stats->mean_us = (uint32_t)(histogram->sum_us / stats->count);
+        
+        // 99th percentile, resolved to the upper bound of its bucket
+        uint32_t threshold = stats->count - stats->count / 100;
+        uint32_t cumulative = 0;
+        bool p99_found = false;
+        for (int bucket = 0; bucket < ESP32_RIO_DIAG_HISTOGRAM_BUCKETS; bucket++) {
+            stats->buckets[bucket] = histogram->buckets[bucket];
+            cumulative += stats->buckets[bucket];
+            if (cumulative >= threshold && !p99_found) {
+                stats->p99_us = bucket == ESP32_RIO_DIAG_HISTOGRAM_BUCKETS - 1 ? stats->max_us : (1UL << bucket) - 1;
+                p99_found = true;
+            }
+        }
+        if (stats->p99_us > stats->max_us) {
+            stats->p99_us = stats->max_us;
+        }
+    }
+}
+
+
+/*
+ Restart all latency statistics
+*/
+void esp32_rio_diag_reset_latencies(void) {
+    for (int i = 0; i < ESP32_RIO_DIAG_NUM_LATENCIES; i++) {
+        atomic_store_explicit(&s_latencies[i].reset_requested, true, memory_order_release);
+    }
+}
+
+
+/*
+ Retrieve state, priority, core, stack high-water mark and CPU share of up to the given number of tasks.
+ Returns the number of tasks retrieved, 0 if FreeRTOS trace facility is disabled
+*/
+size_t esp32_rio_diag_get_task_stats(esp32_rio_diag_task_stats_t *stats, size_t max_tasks) {
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+    static const char state_letters[] = { 'X', 'R', 'B', 'S', 'D' }; //Indexed by eTaskState
+    UBaseType_t task_count = uxTaskGetNumberOfTasks();
+    TaskStatus_t *status = malloc(task_count * sizeof(TaskStatus_t));
+    if (status == NULL) {
+        return 0;
+    }
+    configRUN_TIME_COUNTER_TYPE total_run_time = 0;
+    task_count = uxTaskGetSystemState(status, task_count, &total_run_time);
+    
+    size_t count = task_count < max_tasks ? task_count : max_tasks;
+    for (size_t i = 0; i < count; i++) {
+        snprintf(stats[i].name, sizeof(stats[i].name), "%s", status[i].pcTaskName);
+        stats[i].state = status[i].eCurrentState <= eDeleted ? state_letters[status[i].eCurrentState] : '?';
+        stats[i].priority = (uint8_t)status[i].uxCurrentPriority;
+        BaseType_t core = xTaskGetCoreID(status[i].xHandle);
+        stats[i].core = core == tskNO_AFFINITY ? -1 : (int8_t)core;
+        stats[i].stack_free = status[i].usStackHighWaterMark;
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        stats[i].cpu_permille = total_run_time == 0 ? 0 : (uint32_t)((uint64_t)status[i].ulRunTimeCounter * 1000 / total_run_time);
+#else
+        stats[i].cpu_permille = 0;
+#endif
+    }
+    free(status);
+    return count;
+#else
+    return 0;
+#endif
+}
+
+
+static void rate_timer_callback(void *arg) {
+    uint32_t requests = atomic_load_explicit(&s_counters[ESP32_RIO_DIAG_MB_REQUESTS], memory_order_relaxed);
+    s_request_rate = (requests - s_last_request_count) * 1000 / ESP32_RIO_DIAG_RATE_PERIOD_MS;
+    s_last_request_count = requests;
+    
+    if (s_diag_update_callback) {
+        esp32_rio_diag_snapshot_t snapshot;
+        esp32_rio_diag_get_snapshot(&snapshot);
+        s_diag_update_callback(&snapshot);
+    }
+}
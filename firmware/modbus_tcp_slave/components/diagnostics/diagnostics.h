@@ -0,0 +1,78 @@
+/*
+@file diagnostics.h
+@brief Header for the diagnostics component.
+
+This file defines the public interface for recording performance counters and
+latency histograms on the hot paths of the firmware, and for reading them back.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define ESP32_RIO_DIAG_HISTOGRAM_BUCKETS 16 //Bucket 0: 0 us, bucket n: 2^(n-1) to 2^n - 1 us, last bucket open-ended
+#define ESP32_RIO_DIAG_RATE_PERIOD_MS 1000 //Rate computation and snapshot publishing period
+#define ESP32_RIO_DIAG_TASK_NAME_LENGTH 16 //Longer task names are truncated
+
+typedef enum {
+    ESP32_RIO_DIAG_MB_REQUESTS = 0, //Modbus register area accesses served
+    ESP32_RIO_DIAG_MB_COIL_WRITES, //Modbus writes to the coil image
+    ESP32_RIO_DIAG_OUTPUT_UPDATES, //Coil image applications to the outputs
+    ESP32_RIO_DIAG_OUTPUT_NOOPS, //Coil image applications changing no output
+    ESP32_RIO_DIAG_NUM_COUNTERS
+} esp32_rio_diag_counter_t;
+
+typedef enum {
+    ESP32_RIO_DIAG_COIL_TO_OUTPUT = 0, //Modbus coil write to outputs driven
+    ESP32_RIO_DIAG_DI_TO_REGISTER, //DI edge interrupt to discrete input register updated
+    ESP32_RIO_DIAG_NUM_LATENCIES
+} esp32_rio_diag_latency_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t mean_us;
+    uint32_t max_us;
+    uint32_t p99_us; //Upper bound of the bucket holding the 99th percentile
+    uint32_t buckets[ESP32_RIO_DIAG_HISTOGRAM_BUCKETS];
+} esp32_rio_diag_latency_stats_t;
+
+typedef struct {
+    uint32_t uptime_s;
+    uint32_t counters[ESP32_RIO_DIAG_NUM_COUNTERS];
+    uint32_t request_rate; //Modbus requests per second, over the last rate period
+    esp32_rio_diag_latency_stats_t latencies[ESP32_RIO_DIAG_NUM_LATENCIES];
+} esp32_rio_diag_snapshot_t;
+
+typedef struct {
+    char name[ESP32_RIO_DIAG_TASK_NAME_LENGTH];
+    char state; //'X' running, 'R' ready, 'B' blocked, 'S' suspended, 'D' deleted
+    uint8_t priority;
+    int8_t core; //-1 when not pinned to a core
+    uint32_t stack_free; //Stack high-water mark, in bytes
+    uint32_t cpu_permille; //Share of one core's time since boot (0 without run time statistics)
+} esp32_rio_diag_task_stats_t;
+
+typedef void (*diag_update_cb_t)(const esp32_rio_diag_snapshot_t *); //Receives a fresh snapshot every rate period
+typedef void (*diag_console_report_cb_t)(void); //Writes further lines of the diag command, from the console task
+typedef void (*diag_console_reset_cb_t)(void); //Restarts further statistics on diag reset, from the console task
+
+esp_err_t esp32_rio_diag_init(diag_update_cb_t);
+void esp32_rio_diag_count(esp32_rio_diag_counter_t);
+void esp32_rio_diag_record_latency(esp32_rio_diag_latency_t, uint32_t);
+void esp32_rio_diag_get_snapshot(esp32_rio_diag_snapshot_t *);
+void esp32_rio_diag_reset_latencies(void);
+size_t esp32_rio_diag_get_task_stats(esp32_rio_diag_task_stats_t *, size_t);
+esp_err_t esp32_rio_diag_console_register(diag_console_report_cb_t, diag_console_reset_cb_t);
+
+#endif //DIAGNOSTICS_H
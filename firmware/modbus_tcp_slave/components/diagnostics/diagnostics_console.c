@@ -0,0 +1,123 @@
+/*
+@file diagnostics_console.c
+@brief Console commands of the diagnostics component.
+
+This file implements the diag console command, which shows the performance counters
+and latencies recorded, along with those reported by the application, and the tasks
+console command, which lists tasks with their state, stack and CPU share.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "diagnostics.h"
+#include "usb_console.h"
+
+#define DIAG_CONSOLE_OUTPUT_LENGTH 160
+#define DIAG_CONSOLE_MAX_TASKS 32
+
+static void cmd_diag(int, char **);
+static void cmd_tasks(int, char **);
+
+static const char *s_latency_names[ESP32_RIO_DIAG_NUM_LATENCIES] = { "Coil write to outputs", "DI edge to register" }; //Indexed by esp32_rio_diag_latency_t
+
+static const esp32_rio_console_cmd_t s_diag_cmds[] = {
+    { "diag", "[reset]",
+      "Show performance counters and latencies, or restart latencies and high-water marks.", cmd_diag },
+    { "tasks", "",
+      "List tasks with their state, priority, core, free stack and CPU share.", cmd_tasks }
+};
+
+static esp32_rio_diag_task_stats_t s_task_stats[DIAG_CONSOLE_MAX_TASKS]; //Kept off the console task stack
+static diag_console_report_cb_t s_report_callback = NULL;
+static diag_console_reset_cb_t s_reset_callback = NULL;
+
+
+/*
+ Add the diag and tasks commands to the console. diag also shows what the report callback writes, and diag reset
+ also calls the reset callback, for the statistics of components diagnostics does not depend on. Must run before
+ the console starts
+*/
+esp_err_t esp32_rio_diag_console_register(diag_console_report_cb_t report_cb, diag_console_reset_cb_t reset_cb) {
+    s_report_callback = report_cb;
+    s_reset_callback = reset_cb;
+    for (size_t i = 0; i < sizeof(s_diag_cmds) / sizeof(s_diag_cmds[0]); i++) {
+        esp_err_t err = esp32_rio_console_register_command(&s_diag_cmds[i]);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+
+static void cmd_diag(int arg_count, char **args) {
+    char output_buf[DIAG_CONSOLE_OUTPUT_LENGTH];
+    if (arg_count == 0) {
+        esp32_rio_diag_snapshot_t snapshot;
+        esp32_rio_diag_get_snapshot(&snapshot);
+        snprintf(output_buf, sizeof(output_buf), "\n[diag] Uptime: %" PRIu32 " s\n", snapshot.uptime_s);
+        esp32_rio_console_write_str(output_buf);
+        snprintf(output_buf, sizeof(output_buf), "  Modbus requests: %" PRIu32 " (%" PRIu32 "/s), coil writes: %" PRIu32 ", output updates: %" PRIu32 "\n",
+                 snapshot.counters[ESP32_RIO_DIAG_MB_REQUESTS], snapshot.request_rate,
+                 snapshot.counters[ESP32_RIO_DIAG_MB_COIL_WRITES], snapshot.counters[ESP32_RIO_DIAG_OUTPUT_UPDATES]);
+        esp32_rio_console_write_str(output_buf);
+        snprintf(output_buf, sizeof(output_buf), "  Output updates changing no output: %" PRIu32 "\n",
+                 snapshot.counters[ESP32_RIO_DIAG_OUTPUT_NOOPS]);
+        esp32_rio_console_write_str(output_buf);
+        for (int i = 0; i < ESP32_RIO_DIAG_NUM_LATENCIES; i++) {
+            const esp32_rio_diag_latency_stats_t *stats = &snapshot.latencies[i];
+            snprintf(output_buf, sizeof(output_buf), "  %s: %" PRIu32 " samples, min %" PRIu32 " / mean %" PRIu32 " / p99 %" PRIu32 " / max %" PRIu32 " us\n",
+                     s_latency_names[i], stats->count, stats->min_us, stats->mean_us, stats->p99_us, stats->max_us);
+            esp32_rio_console_write_str(output_buf);
+        }
+        if (s_report_callback) {
+            s_report_callback();
+        }
+    } else if (arg_count == 1 && strcmp(args[0], "reset") == 0) {
+        esp32_rio_diag_reset_latencies();
+        if (s_reset_callback) {
+            s_reset_callback();
+        }
+        esp32_rio_console_write_str("\n[diag] Latencies and high-water marks restarted.\n");
+    } else {
+        esp32_rio_console_write_str("\n[diag] Error: Command takes either no argument or reset. See help.\n");
+    }
+}
+
+
+static void cmd_tasks(int arg_count, char **args) {
+    char output_buf[DIAG_CONSOLE_OUTPUT_LENGTH];
+    if (arg_count != 0) {
+        esp32_rio_console_write_str("\n[tasks] Error: Command does not take arguments.\n");
+        return;
+    }
+    size_t count = esp32_rio_diag_get_task_stats(s_task_stats, DIAG_CONSOLE_MAX_TASKS);
+    if (count == 0) {
+        esp32_rio_console_write_str("\n[tasks] Task statistics not available (CONFIG_ESP32_RIO_TASK_STATS).\n");
+        return;
+    }
+    snprintf(output_buf, sizeof(output_buf), "\n[tasks] %u tasks:\n  %-16s State Prio Core Free stack   CPU\n", (unsigned)count, "Name");
+    esp32_rio_console_write_str(output_buf);
+    for (size_t i = 0; i < count; i++) {
+        const esp32_rio_diag_task_stats_t *stats = &s_task_stats[i];
+        char core_str[4];
+        if (stats->core < 0) {
+            snprintf(core_str, sizeof(core_str), "-");
+        } else {
+            snprintf(core_str, sizeof(core_str), "%d", stats->core);
+        }
+        snprintf(output_buf, sizeof(output_buf), "  %-16s %-5c %4u %4s %10" PRIu32 " %3" PRIu32 ".%" PRIu32 "%%\n",
+                 stats->name, stats->state, stats->priority, core_str, stats->stack_free,
+                 stats->cpu_permille / 10, stats->cpu_permille % 10);
+        esp32_rio_console_write_str(output_buf);
+    }
+}
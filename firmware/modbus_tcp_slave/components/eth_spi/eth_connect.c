@@ -0,0 +1,338 @@
+/*
+@file eth_connect.c
+@brief Implementation for the SPI Ethernet connection component.
+
+This file handles the optional W5500 Ethernet controller on SPI, including
+driver and network interface setup, link and IP address event handling,
+and link state reporting. Built as stubs unless CONFIG_ESP32_RIO_ETH_ENABLED is set.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#include "sdkconfig.h"
+#include "esp_check.h"
+#include "esp_log.h"
+
+#include "eth_connect.h"
+
+#if CONFIG_ESP32_RIO_ETH_ENABLED
+
+#include "esp_event.h"
+#include "esp_eth.h"
+#include "esp_mac.h"
+#include "driver/spi_master.h"
+#include "driver/gpio.h"
+
+#include "remote_io.h"
+
+#define ESP32_RIO_ETH_SPI_HOST SPI2_HOST
+#define ESP32_RIO_ETH_SPI_QUEUE_SIZE 20
+#define ESP32_RIO_NETIF_DESC_ETH "esp32_rio_netif_eth"
+#define ETH_PIN_BIT(gpio) (((gpio) >= 0) ? (1ULL << (gpio)) : 0)
+#define ETH_PINS_MASK (ETH_PIN_BIT(CONFIG_ESP32_RIO_ETH_SPI_SCLK_GPIO) | ETH_PIN_BIT(CONFIG_ESP32_RIO_ETH_SPI_MOSI_GPIO) | \
+                       ETH_PIN_BIT(CONFIG_ESP32_RIO_ETH_SPI_MISO_GPIO) | ETH_PIN_BIT(CONFIG_ESP32_RIO_ETH_SPI_CS_GPIO) | \
+                       ETH_PIN_BIT(CONFIG_ESP32_RIO_ETH_INT_GPIO) | ETH_PIN_BIT(CONFIG_ESP32_RIO_ETH_RST_GPIO))
+
+static void esp32_rio_set_connected(bool);
+static void esp32_rio_handler_on_eth_event(void *, esp_event_base_t, int32_t, void *);
+static void esp32_rio_handler_on_eth_got_ip(void *, esp_event_base_t, int32_t, void *);
+static void esp32_rio_handler_on_eth_lost_ip(void *, esp_event_base_t, int32_t, void *);
+
+static const char *TAG = "ESP32_RIO_ETH";
+
+static esp_netif_t *s_esp32_rio_eth_netif = NULL;
+static esp_eth_handle_t s_eth_handle = NULL;
+static esp_eth_mac_t *s_eth_mac = NULL;
+static esp_eth_phy_t *s_eth_phy = NULL;
+static esp_eth_netif_glue_handle_t s_eth_glue = NULL;
+static bool s_spi_bus_initialized = false;
+static bool s_connected = false;
+static uint32_t s_link_losses = 0;
+static eth_link_cb_t s_link_lost_callback = NULL;
+static eth_link_cb_t s_link_restored_callback = NULL;
+
+
+/*
+ Initializes the W5500 controller and its network interface, and starts it. Any failure undoes what was set up,
+ for the board to carry on with WiFi only. Expects the GPIO ISR service to be installed already
+*/
+esp_err_t esp32_rio_eth_init(eth_link_cb_t link_lost_callback, eth_link_cb_t link_restored_callback) {
+    ESP_RETURN_ON_FALSE(CONFIG_ESP32_RIO_ETH_SPI_SCLK_GPIO >= 0 && CONFIG_ESP32_RIO_ETH_SPI_MOSI_GPIO >= 0 &&
+                        CONFIG_ESP32_RIO_ETH_SPI_MISO_GPIO >= 0 && CONFIG_ESP32_RIO_ETH_SPI_CS_GPIO >= 0 &&
+                        CONFIG_ESP32_RIO_ETH_INT_GPIO >= 0,
+                        ESP_ERR_INVALID_ARG,
+                        TAG,
+                        "Ethernet SPI pins not configured.");
+    ESP_RETURN_ON_FALSE((ETH_PINS_MASK & esp32_rio_get_board_gpio_mask()) == 0,
+                        ESP_ERR_INVALID_ARG,
+                        TAG,
+                        "Ethernet pins taken by the board pin map (GPIO mask 0x%llx).",
+                        (unsigned long long)(ETH_PINS_MASK & esp32_rio_get_board_gpio_mask()));
+    
+    esp_err_t ret = ESP_OK;
+    s_link_lost_callback = link_lost_callback;
+    s_link_restored_callback = link_restored_callback;
+    
+    spi_bus_config_t bus_config = {
+        .miso_io_num = CONFIG_ESP32_RIO_ETH_SPI_MISO_GPIO,
+        .mosi_io_num = CONFIG_ESP32_RIO_ETH_SPI_MOSI_GPIO,
+        .sclk_io_num = CONFIG_ESP32_RIO_ETH_SPI_SCLK_GPIO,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1
+    };
+    ESP_GOTO_ON_ERROR(spi_bus_initialize(ESP32_RIO_ETH_SPI_HOST, &bus_config, SPI_DMA_CH_AUTO),
+                      fail,
+                      TAG,
+                      "spi_bus_initialize fail.");
+    s_spi_bus_initialized = true;
+    
+    spi_device_interface_config_t device_config = {
+        .mode = 0,
+        .clock_speed_hz = CONFIG_ESP32_RIO_ETH_SPI_CLOCK_MHZ * 1000 * 1000,
+        .spics_io_num = CONFIG_ESP32_RIO_ETH_SPI_CS_GPIO,
+        .queue_size = ESP32_RIO_ETH_SPI_QUEUE_SIZE
+    };
+    eth_w5500_config_t w5500_config = ETH_W5500_DEFAULT_CONFIG(ESP32_RIO_ETH_SPI_HOST, &device_config);
+    w5500_config.int_gpio_num = CONFIG_ESP32_RIO_ETH_INT_GPIO;
+    eth_mac_config_t mac_config = ETH_MAC_DEFAULT_CONFIG();
+    eth_phy_config_t phy_config = ETH_PHY_DEFAULT_CONFIG();
+    phy_config.reset_gpio_num = CONFIG_ESP32_RIO_ETH_RST_GPIO;
+    
+    s_eth_mac = esp_eth_mac_new_w5500(&w5500_config, &mac_config);
+    s_eth_phy = esp_eth_phy_new_w5500(&phy_config);
+    ESP_GOTO_ON_FALSE(s_eth_mac != NULL && s_eth_phy != NULL, ESP_FAIL, fail, TAG, "W5500 driver creation fail.");
+    
+    esp_eth_config_t eth_config = ETH_DEFAULT_CONFIG(s_eth_mac, s_eth_phy);
+    ret = esp_eth_driver_install(&eth_config, &s_eth_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "esp_eth_driver_install fail: %s (W5500 not fitted?)", esp_err_to_name(ret));
+        s_eth_handle = NULL;
+        goto fail;
+    }
+    
+    // The W5500 has no factory address: use the one reserved for Ethernet in eFuse
+    uint8_t mac_addr[6];
+    ESP_GOTO_ON_ERROR(esp_read_mac(mac_addr, ESP_MAC_ETH), fail, TAG, "esp_read_mac fail.");
+    ESP_GOTO_ON_ERROR(esp_eth_ioctl(s_eth_handle, ETH_CMD_S_MAC_ADDR, mac_addr), fail, TAG, "ETH_CMD_S_MAC_ADDR fail.");
+    
+    esp_netif_inherent_config_t esp_netif_config = ESP_NETIF_INHERENT_DEFAULT_ETH();
+    esp_netif_config.if_desc = ESP32_RIO_NETIF_DESC_ETH;
+    esp_netif_config.route_prio = ESP32_RIO_ETH_ROUTE_PRIO;
+    esp_netif_config_t netif_config = {
+        .base = &esp_netif_config,
+        .stack = ESP_NETIF_NETSTACK_DEFAULT_ETH
+    };
+    s_esp32_rio_eth_netif = esp_netif_new(&netif_config);
+    s_eth_glue = (s_esp32_rio_eth_netif != NULL) ? esp_eth_new_netif_glue(s_eth_handle) : NULL;
+    ESP_GOTO_ON_FALSE(s_eth_glue != NULL, ESP_FAIL, fail, TAG, "Ethernet network interface creation fail.");
+    ESP_GOTO_ON_ERROR(esp_netif_attach(s_esp32_rio_eth_netif, s_eth_glue), fail, TAG, "esp_netif_attach fail.");
+    
+    ESP_GOTO_ON_ERROR(esp_event_handler_register(ETH_EVENT, ESP_EVENT_ANY_ID, &esp32_rio_handler_on_eth_event, NULL),
+                      fail, TAG, "ETH_EVENT handler registration fail.");
+    ESP_GOTO_ON_ERROR(esp_event_handler_register(IP_EVENT, IP_EVENT_ETH_GOT_IP, &esp32_rio_handler_on_eth_got_ip, NULL),
+                      fail, TAG, "IP_EVENT_ETH_GOT_IP handler registration fail.");
+    ESP_GOTO_ON_ERROR(esp_event_handler_register(IP_EVENT, IP_EVENT_ETH_LOST_IP, &esp32_rio_handler_on_eth_lost_ip, NULL),
+                      fail, TAG, "IP_EVENT_ETH_LOST_IP handler registration fail.");
+    
+    ESP_GOTO_ON_ERROR(esp_eth_start(s_eth_handle),
+                      fail,
+                      TAG,
+                      "esp_eth_start fail.");
+    
+    ESP_LOGI(TAG, "W5500 Ethernet started (" MACSTR ").", MAC2STR(mac_addr));
+    return ESP_OK;
+    
+fail:
+    esp32_rio_eth_deinit(); //Releases whatever was set up, handlers not registered are skipped
+    return ret;
+}
+
+
+/*
+ Stops Ethernet and releases its driver, network interface and SPI bus
+*/
+esp_err_t esp32_rio_eth_deinit(void) {
+    s_link_lost_callback = NULL;
+    s_link_restored_callback = NULL;
+    
+    if (s_eth_glue) {
+        esp_event_handler_unregister(ETH_EVENT, ESP_EVENT_ANY_ID, &esp32_rio_handler_on_eth_event);
+        esp_event_handler_unregister(IP_EVENT, IP_EVENT_ETH_GOT_IP, &esp32_rio_handler_on_eth_got_ip);
+        esp_event_handler_unregister(IP_EVENT, IP_EVENT_ETH_LOST_IP, &esp32_rio_handler_on_eth_lost_ip);
+        esp_eth_stop(s_eth_handle);
+        esp_eth_del_netif_glue(s_eth_glue);
+        s_eth_glue = NULL;
+    }
+    if (s_esp32_rio_eth_netif) {
+        esp_netif_destroy(s_esp32_rio_eth_netif);
+        s_esp32_rio_eth_netif = NULL;
+    }
+    if (s_eth_handle) {
+        ESP_RETURN_ON_ERROR(esp_eth_driver_uninstall(s_eth_handle),
+                            TAG,
+                            "esp_eth_driver_uninstall fail.");
+        s_eth_handle = NULL;
+    }
+    if (s_eth_mac) {
+        s_eth_mac->del(s_eth_mac);
+        s_eth_mac = NULL;
+    }
+    if (s_eth_phy) {
+        s_eth_phy->del(s_eth_phy);
+        s_eth_phy = NULL;
+    }
+    if (s_spi_bus_initialized) {
+        spi_bus_free(ESP32_RIO_ETH_SPI_HOST);
+        s_spi_bus_initialized = false;
+    }
+    s_connected = false;
+    
+    return ESP_OK;
+}
+
+
+/*
+ Reports whether the Ethernet controller is up
+*/
+bool esp32_rio_eth_available(void) {
+    return s_eth_glue != NULL;
+}
+
+
+/*
+ Reports whether the Ethernet interface holds an IP address
+*/
+bool esp32_rio_eth_connected(void) {
+    return s_connected;
+}
+
+
+/*
+ Returns a pointer to the Ethernet network interface (NULL if not available)
+*/
+esp_netif_t *esp32_rio_eth_get_netif(void) {
+    return s_esp32_rio_eth_netif;
+}
+
+
+/*
+ Retrieve the negotiated link speed (Mbps) and duplex mode
+*/
+esp_err_t esp32_rio_eth_get_link_info(uint32_t *speed_mbps, bool *full_duplex) {
+    eth_speed_t speed;
+    eth_duplex_t duplex;
+    
+    ESP_RETURN_ON_FALSE(s_eth_handle != NULL, ESP_ERR_INVALID_STATE, TAG, "Ethernet not available.");
+    ESP_RETURN_ON_ERROR(esp_eth_ioctl(s_eth_handle, ETH_CMD_G_SPEED, &speed),
+                        TAG,
+                        "ETH_CMD_G_SPEED fail.");
+    ESP_RETURN_ON_ERROR(esp_eth_ioctl(s_eth_handle, ETH_CMD_G_DUPLEX_MODE, &duplex),
+                        TAG,
+                        "ETH_CMD_G_DUPLEX_MODE fail.");
+    *speed_mbps = (speed == ETH_SPEED_100M) ? 100 : 10;
+    *full_duplex = (duplex == ETH_DUPLEX_FULL);
+    return ESP_OK;
+}
+
+
+/*
+ Retrieve number of link losses since boot
+*/
+uint32_t esp32_rio_eth_get_link_losses(void) {
+    return s_link_losses;
+}
+
+
+static void esp32_rio_set_connected(bool connected) {
+    if (connected == s_connected) {
+        return;
+    }
+    s_connected = connected;
+    if (connected) {
+        if (s_link_restored_callback) {
+            s_link_restored_callback();
+        }
+    } else {
+        s_link_losses++;
+        if (s_link_lost_callback) {
+            s_link_lost_callback();
+        }
+    }
+}
+
+
+static void esp32_rio_handler_on_eth_event(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
+    switch (event_id) {
+        case ETHERNET_EVENT_CONNECTED:
+            ESP_LOGI(TAG, "Ethernet link up.");
+            break;
+        case ETHERNET_EVENT_DISCONNECTED:
+            ESP_LOGW(TAG, "Ethernet link down.");
+            esp32_rio_set_connected(false);
+            break;
+        default:
+            break;
+    }
+}
+
+
+static void esp32_rio_handler_on_eth_got_ip(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
+    ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
+    ESP_LOGI(TAG, "Connected using %s:", esp_netif_get_desc(event->esp_netif));
+    ESP_LOGI(TAG, "- IP Address:\t" IPSTR, IP2STR(&event->ip_info.ip));
+    ESP_LOGI(TAG, "- Subnet Mask:\t" IPSTR, IP2STR(&event->ip_info.netmask));
+    ESP_LOGI(TAG, "- Gateway:\t" IPSTR, IP2STR(&event->ip_info.gw));
+    esp32_rio_set_connected(true);
+}
+
+
+static void esp32_rio_handler_on_eth_lost_ip(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
+    esp32_rio_set_connected(false);
+}
+
+#else //CONFIG_ESP32_RIO_ETH_ENABLED
+
+static const char *TAG = "ESP32_RIO_ETH";
+
+
+esp_err_t esp32_rio_eth_init(eth_link_cb_t link_lost_callback, eth_link_cb_t link_restored_callback) {
+    ESP_LOGD(TAG, "Ethernet support not enabled (CONFIG_ESP32_RIO_ETH_ENABLED).");
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+
+esp_err_t esp32_rio_eth_deinit(void) {
+    return ESP_OK;
+}
+
+
+bool esp32_rio_eth_available(void) {
+    return false;
+}
+
+
+bool esp32_rio_eth_connected(void) {
+    return false;
+}
+
+
+esp_netif_t *esp32_rio_eth_get_netif(void) {
+    return NULL;
+}
+
+
+esp_err_t esp32_rio_eth_get_link_info(uint32_t *speed_mbps, bool *full_duplex) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+
+uint32_t esp32_rio_eth_get_link_losses(void) {
+    return 0;
+}
+
+#endif //CONFIG_ESP32_RIO_ETH_ENABLED
@@ -0,0 +1,38 @@
+/*
+@file eth_connect.h
+@brief Header for the SPI Ethernet connection component.
+
+This file defines the public interface for bringing up an optional W5500
+Ethernet controller, reporting its link state and providing its network
+interface, which is preferred over WiFi whenever its link is up.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#ifndef ETH_CONNECT_H
+#define ETH_CONNECT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_netif.h"
+
+#define ESP32_RIO_ETH_ROUTE_PRIO 192 //Above the WiFi station (128), making Ethernet the default route when up
+
+typedef void (*eth_link_cb_t)(void);
+
+esp_err_t esp32_rio_eth_init(eth_link_cb_t, eth_link_cb_t);
+esp_err_t esp32_rio_eth_deinit(void);
+
+bool esp32_rio_eth_available(void);
+bool esp32_rio_eth_connected(void);
+esp_netif_t *esp32_rio_eth_get_netif(void);
+esp_err_t esp32_rio_eth_get_link_info(uint32_t *, bool *);
+uint32_t esp32_rio_eth_get_link_losses(void);
+
+#endif //ETH_CONNECT_H
@@ -0,0 +1,509 @@
+/*
+@file logic_engine.c
+@brief Implementation for the logic engine component.
+
+This file implements the scan task of the logic engine, paced by a hardware timer,
+which evaluates the loaded program once per scan period, along with the validation,
+loading and storage of programs.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#include <string.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "driver/gptimer.h"
+
+#include "logic_engine.h"
+#include "remote_io.h"
+#include "config_store.h"
+
+#define LOGIC_TASK_CORE CONFIG_ESP32_RIO_RT_CORE
+#define LOGIC_TASK_PRIORITY CONFIG_ESP32_RIO_LOGIC_TASK_PRIORITY
+#define LOGIC_TASK_STACK_SIZE CONFIG_ESP32_RIO_LOGIC_TASK_STACK_SIZE
+#define LOGIC_SCAN_US CONFIG_ESP32_RIO_LOGIC_SCAN_US
+#define LOGIC_TIMER_RESOLUTION_HZ 1000000 //Counts are microseconds
+
+_Static_assert(ESP32_RIO_LOGIC_MAX_BLOCKS == ESP32_RIO_CONFIG_LOGIC_MAX_BLOCKS,
+               "The stored logic program must hold every block");
+_Static_assert(ESP32_RIO_NUM_DI_CHANNELS <= 32 && ESP32_RIO_LOGIC_NUM_MARKERS <= 32,
+               "Every operand range holds 32 bits");
+
+typedef struct {
+    uint32_t count; //Scans counted by a timer block
+    bool output; //Output of a timer block
+    bool last_a; //Source A on the previous scan, for edges
+} logic_block_state_t;
+
+static void logic_task(void *);
+static bool logic_alarm_callback(gptimer_handle_t, const gptimer_alarm_event_data_t *, void *);
+static void logic_install(const esp32_rio_logic_block_t *, size_t);
+static void logic_scan(const esp32_rio_logic_inputs_t *);
+static bool logic_read(uint8_t, uint32_t, uint32_t);
+static void logic_write(uint8_t, bool);
+static bool logic_block_valid(const esp32_rio_logic_block_t *);
+static bool logic_operand_valid(uint8_t, bool);
+static esp_err_t logic_store(const esp32_rio_logic_block_t *, size_t);
+
+static const char *TAG = "ESP32_RIO_LOGIC";
+
+static const char *s_op_names[ESP32_RIO_LOGIC_NUM_OPS] = { //Indexed by esp32_rio_logic_op_t
+    "nop", "and", "or", "xor", "mov", "set", "reset", "ton", "tof", "tp", "rise"
+};
+
+/*
+ The program and its state belong to the scan task while it scans, and loads swap them in between scans under
+ the program mutex. Outputs driven by the program are published under a spinlock for the output task to merge
+ with the coils.
+*/
+static esp32_rio_logic_block_t s_blocks[ESP32_RIO_LOGIC_MAX_BLOCKS];
+static size_t s_block_count = 0;
+static uint32_t s_presets[ESP32_RIO_LOGIC_MAX_BLOCKS]; //Timer block times, in scans
+static logic_block_state_t s_block_states[ESP32_RIO_LOGIC_MAX_BLOCKS];
+static uint32_t s_outputs = 0; //Output levels given by the program (bit 16 * bank + n = DQbn)
+static uint32_t s_markers = 0;
+static uint32_t s_output_mask = 0; //Outputs written by the program
+static StaticSemaphore_t s_program_mutex_buffer;
+static SemaphoreHandle_t s_program_mutex = NULL;
+static StaticSemaphore_t s_load_mutex_buffer;
+static SemaphoreHandle_t s_load_mutex = NULL; //Loads from the console and from Modbus, one at a time
+
+static portMUX_TYPE s_publish_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_published_outputs = 0;
+static uint32_t s_published_mask = 0;
+static esp32_rio_logic_stats_t s_stats = { 0 };
+
+static TaskHandle_t s_logic_task_handle = NULL;
+static gptimer_handle_t s_scan_timer = NULL;
+static bool s_scanning = false; //Scan timer running, only while a program is loaded
+static logic_inputs_read_cb_t s_inputs_read_callback = NULL;
+static logic_outputs_change_cb_t s_outputs_change_callback = NULL;
+static logic_program_change_cb_t s_program_change_callback = NULL;
+
+
+/*
+ Start the scan task and its timer, running the stored program if any
+*/
+esp_err_t esp32_rio_logic_start(logic_inputs_read_cb_t inputs_read_callback, logic_outputs_change_cb_t outputs_change_callback,
+                                logic_program_change_cb_t program_change_callback) {
+    esp_err_t ret = ESP_OK;
+    
+    ESP_RETURN_ON_FALSE(s_logic_task_handle == NULL, ESP_ERR_INVALID_STATE, TAG, "Logic engine already started.");
+    
+    // Timer first, so a failure leaves no task behind. It stays disabled, raising no alarm, until a program is loaded
+    gptimer_config_t timer_config = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = LOGIC_TIMER_RESOLUTION_HZ
+    };
+    ESP_RETURN_ON_ERROR(gptimer_new_timer(&timer_config, &s_scan_timer),
+                        TAG,
+                        "gptimer_new_timer fail.");
+    gptimer_event_callbacks_t callbacks = {
+        .on_alarm = logic_alarm_callback
+    };
+    ESP_GOTO_ON_ERROR(gptimer_register_event_callbacks(s_scan_timer, &callbacks, NULL),
+                      fail,
+                      TAG,
+                      "gptimer_register_event_callbacks fail.");
+    gptimer_alarm_config_t alarm_config = {
+        .alarm_count = LOGIC_SCAN_US * (LOGIC_TIMER_RESOLUTION_HZ / 1000000),
+        .reload_count = 0,
+        .flags.auto_reload_on_alarm = true //One alarm per scan
+    };
+    ESP_GOTO_ON_ERROR(gptimer_set_alarm_action(s_scan_timer, &alarm_config),
+                      fail,
+                      TAG,
+                      "gptimer_set_alarm_action fail.");
+    
+    s_inputs_read_callback = inputs_read_callback;
+    s_outputs_change_callback = outputs_change_callback;
+    s_program_change_callback = program_change_callback;
+    s_program_mutex = xSemaphoreCreateMutexStatic(&s_program_mutex_buffer);
+    s_load_mutex = xSemaphoreCreateMutexStatic(&s_load_mutex_buffer);
+    if (xTaskCreatePinnedToCore(logic_task, "logic_task", LOGIC_TASK_STACK_SIZE, NULL,
+                                LOGIC_TASK_PRIORITY, &s_logic_task_handle, LOGIC_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create logic_task.");
+        s_logic_task_handle = NULL;
+        s_program_mutex = NULL; //Loads refused, as if never started
+        s_load_mutex = NULL;
+        ret = ESP_ERR_NO_MEM;
+        goto fail;
+    }
+    
+    // Stored program
+    esp32_rio_config_logic_t config = { 0 }; //No program by default
+    esp32_rio_logic_block_t blocks[ESP32_RIO_LOGIC_MAX_BLOCKS];
+    if (esp32_rio_config_read(ESP32_RIO_CONFIG_LOGIC, &config, sizeof(config)) != ESP_OK || config.block_count == 0) {
+        ESP_LOGI(TAG, "No logic program stored.");
+        return ESP_OK;
+    }
+    size_t block_count = config.block_count <= ESP32_RIO_LOGIC_MAX_BLOCKS ? config.block_count : 0;
+    for (size_t i = 0; i < block_count; i++) {
+        blocks[i] = (esp32_rio_logic_block_t){
+            .op = config.ops[i][0],
+            .destination = config.ops[i][1],
+            .source_a = config.sources[i][0],
+            .source_b = config.sources[i][1],
+            .time_ms = config.times_ms[i]
+        };
+        if (!logic_block_valid(&blocks[i])) {
+            block_count = 0;
+        }
+    }
+    if (block_count == 0) {
+        ESP_LOGW(TAG, "Ignoring invalid stored logic program.");
+        return ESP_OK;
+    }
+    logic_install(blocks, block_count);
+    ESP_LOGI(TAG, "Logic program of %u blocks running, %u us scan.", (unsigned int)block_count, (unsigned int)LOGIC_SCAN_US);
+    return ESP_OK;
+    
+fail:
+    gptimer_del_timer(s_scan_timer);
+    s_scan_timer = NULL;
+    return ret;
+}
+
+
+/*
+ Validate, run and store a program. An empty program stops the logic engine. On ESP_ERR_INVALID_ARG,
+ invalid_block (if given) tells the first invalid block, and the running program is left in place.
+ Loads run one at a time, each reported to the program change callback before the next one starts, so the
+ last load to arrive is both the program running and the one stored
+*/
+esp_err_t esp32_rio_logic_load(const esp32_rio_logic_block_t *blocks, size_t block_count, size_t *invalid_block) {
+    ESP_RETURN_ON_FALSE(s_load_mutex != NULL, ESP_ERR_INVALID_STATE, TAG, "Logic engine not started.");
+    esp_err_t err = ESP_OK;
+    size_t invalid = ESP32_RIO_LOGIC_MAX_BLOCKS;
+    
+    xSemaphoreTake(s_load_mutex, portMAX_DELAY);
+    if (block_count > ESP32_RIO_LOGIC_MAX_BLOCKS) {
+        err = ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; err == ESP_OK && i < block_count; i++) {
+        if (!logic_block_valid(&blocks[i])) {
+            invalid = i;
+            err = ESP_ERR_INVALID_ARG;
+        }
+    }
+    esp_err_t store_err = ESP_OK;
+    if (err == ESP_OK) {
+        logic_install(blocks, block_count);
+        ESP_LOGI(TAG, "Logic program of %u blocks loaded.", (unsigned int)block_count);
+        store_err = logic_store(blocks, block_count);
+    }
+    if (s_program_change_callback) {
+        s_program_change_callback(err, invalid);
+    }
+    xSemaphoreGive(s_load_mutex);
+    
+    if (err != ESP_OK && invalid_block) {
+        *invalid_block = invalid;
+    }
+    return err != ESP_OK ? err : store_err;
+}
+
+
+/*
+ Copy the running program, returning its number of blocks
+*/
+size_t esp32_rio_logic_get_program(esp32_rio_logic_block_t *blocks, size_t max_blocks) {
+    if (s_program_mutex == NULL) {
+        return 0;
+    }
+    xSemaphoreTake(s_program_mutex, portMAX_DELAY);
+    size_t block_count = s_block_count < max_blocks ? s_block_count : max_blocks;
+    memcpy(blocks, s_blocks, block_count * sizeof(blocks[0]));
+    xSemaphoreGive(s_program_mutex);
+    return block_count;
+}
+
+
+/*
+ Retrieve the outputs written by the program and their levels (bit 16 * bank + n = DQbn)
+*/
+void esp32_rio_logic_get_outputs(uint32_t *output_mask, uint32_t *output_levels) {
+    portENTER_CRITICAL(&s_publish_lock);
+    *output_mask = s_published_mask;
+    *output_levels = s_published_outputs;
+    portEXIT_CRITICAL(&s_publish_lock);
+}
+
+
+/*
+ Retrieve scan statistics
+*/
+void esp32_rio_logic_get_stats(esp32_rio_logic_stats_t *stats) {
+    portENTER_CRITICAL(&s_publish_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_publish_lock);
+}
+
+
+/*
+ Name of an operation, as shown by the console
+*/
+const char *esp32_rio_logic_op_name(esp32_rio_logic_op_t op) {
+    return op < ESP32_RIO_LOGIC_NUM_OPS ? s_op_names[op] : "?";
+}
+
+
+static void logic_task(void *arg) {
+    while (1) {
+        uint32_t alarms = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (alarms == 0) {
+            continue;
+        }
+        int64_t scan_start = esp_timer_get_time();
+        esp32_rio_logic_inputs_t inputs = { 0 };
+        if (s_inputs_read_callback) {
+            s_inputs_read_callback(&inputs);
+        }
+        
+        // Published under the program mutex too, so a load never sees them overwritten by the program it replaced
+        xSemaphoreTake(s_program_mutex, portMAX_DELAY);
+        logic_scan(&inputs);
+        uint32_t outputs = s_outputs & s_output_mask;
+        uint32_t scan_us = (uint32_t)(esp_timer_get_time() - scan_start);
+        portENTER_CRITICAL(&s_publish_lock);
+        bool changed = outputs != s_published_outputs || s_output_mask != s_published_mask;
+        s_published_outputs = outputs;
+        s_published_mask = s_output_mask;
+        s_stats.scans++;
+        s_stats.overruns += alarms - 1; //Alarms that found the previous scan still running
+        s_stats.last_scan_us = scan_us;
+        if (scan_us > s_stats.max_scan_us) {
+            s_stats.max_scan_us = scan_us;
+        }
+        portEXIT_CRITICAL(&s_publish_lock);
+        xSemaphoreGive(s_program_mutex);
+        
+        if (changed && s_outputs_change_callback) {
+            s_outputs_change_callback();
+        }
+    }
+}
+
+
+static bool IRAM_ATTR logic_alarm_callback(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_ctx) {
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    vTaskNotifyGiveFromISR(s_logic_task_handle, &higher_priority_task_woken);
+    return higher_priority_task_woken == pdTRUE;
+}
+
+
+/*
+ Swap in a validated program from a fresh state, starting or stopping the scan timer as needed
+*/
+static void logic_install(const esp32_rio_logic_block_t *blocks, size_t block_count) {
+    uint32_t output_mask = 0;
+    
+    xSemaphoreTake(s_program_mutex, portMAX_DELAY);
+    memcpy(s_blocks, blocks, block_count * sizeof(blocks[0]));
+    s_block_count = block_count;
+    for (size_t i = 0; i < block_count; i++) {
+        uint32_t preset = ((uint32_t)blocks[i].time_ms * 1000 + LOGIC_SCAN_US - 1) / LOGIC_SCAN_US;
+        s_presets[i] = (blocks[i].op == ESP32_RIO_LOGIC_OP_TP && preset == 0) ? 1 : preset; //A pulse lasts a scan at least
+        if (blocks[i].op != ESP32_RIO_LOGIC_OP_NOP && (blocks[i].destination >> 5) == (ESP32_RIO_LOGIC_BIT_DQ(0, 0) >> 5)) {
+            output_mask |= 1UL << (blocks[i].destination & 0x1F);
+        }
+    }
+    memset(s_block_states, 0, sizeof(s_block_states));
+    s_outputs = 0;
+    s_markers = 0;
+    s_output_mask = output_mask;
+    
+    // Outputs given up by the program go back to their coils at once
+    portENTER_CRITICAL(&s_publish_lock);
+    bool changed = s_published_mask != output_mask || s_published_outputs != 0;
+    s_published_mask = output_mask;
+    s_published_outputs = 0;
+    portEXIT_CRITICAL(&s_publish_lock);
+    xSemaphoreGive(s_program_mutex);
+    if (changed && s_outputs_change_callback) {
+        s_outputs_change_callback();
+    }
+    
+    // An enabled timer holds a power management lock, so it is only enabled while scanning
+    if (block_count > 0 && !s_scanning) {
+        s_scanning = gptimer_enable(s_scan_timer) == ESP_OK;
+        if (s_scanning && gptimer_start(s_scan_timer) != ESP_OK) {
+            gptimer_disable(s_scan_timer);
+            s_scanning = false;
+        }
+    } else if (block_count == 0 && s_scanning) {
+        gptimer_stop(s_scan_timer);
+        gptimer_disable(s_scan_timer);
+        s_scanning = false;
+    }
+}
+
+
+/*
+ Evaluate every block of the program once, in order. Called with the program mutex held
+*/
+static void logic_scan(const esp32_rio_logic_inputs_t *inputs) {
+    uint32_t coils = (uint32_t)inputs->coils[0] | ((uint32_t)inputs->coils[1] << 16);
+    
+    for (size_t i = 0; i < s_block_count; i++) {
+        const esp32_rio_logic_block_t *block = &s_blocks[i];
+        logic_block_state_t *state = &s_block_states[i];
+        bool a = logic_read(block->source_a, inputs->inputs, coils);
+        bool b = logic_read(block->source_b, inputs->inputs, coils);
+        bool q = logic_read(block->destination, inputs->inputs, coils);
+        switch (block->op) {
+            case ESP32_RIO_LOGIC_OP_AND:
+                q = a && b;
+                break;
+            case ESP32_RIO_LOGIC_OP_OR:
+                q = a || b;
+                break;
+            case ESP32_RIO_LOGIC_OP_XOR:
+                q = a != b;
+                break;
+            case ESP32_RIO_LOGIC_OP_MOV:
+                q = a;
+                break;
+            case ESP32_RIO_LOGIC_OP_SET:
+                q = a || (q && !b);
+                break;
+            case ESP32_RIO_LOGIC_OP_RESET:
+                q = !b && (a || q);
+                break;
+            case ESP32_RIO_LOGIC_OP_TON:
+                if (!a) {
+                    state->count = 0;
+                } else if (state->count < s_presets[i]) {
+                    state->count++; //The first scan seeing A on counts, so Q turns on at the preset-th scan
+                }
+                q = a && state->count >= s_presets[i];
+                break;
+            case ESP32_RIO_LOGIC_OP_TOF:
+                if (a) {
+                    state->output = true;
+                    state->count = 0;
+                } else {
+                    if (state->count < s_presets[i]) {
+                        state->count++; //The first scan seeing A off counts, so Q turns off at the preset-th scan
+                    }
+                    if (state->count >= s_presets[i]) {
+                        state->output = false;
+                    }
+                }
+                q = state->output;
+                break;
+            case ESP32_RIO_LOGIC_OP_TP:
+                if (a && !state->last_a && !state->output) {
+                    state->output = true;
+                    state->count = 0;
+                }
+                if (state->output) {
+                    if (state->count >= s_presets[i]) {
+                        state->output = false;
+                    } else {
+                        state->count++;
+                    }
+                }
+                q = state->output;
+                break;
+            case ESP32_RIO_LOGIC_OP_RISE:
+                q = a && !state->last_a;
+                break;
+            default:
+                continue; //No operation
+        }
+        state->last_a = a;
+        logic_write(block->destination, q);
+    }
+}
+
+
+static bool logic_read(uint8_t operand, uint32_t inputs, uint32_t coils) {
+    uint32_t word;
+    switch ((operand >> 5) & 3U) {
+        case 0:
+            word = inputs;
+            break;
+        case 1:
+            word = s_outputs;
+            break;
+        case 2:
+            word = s_markers;
+            break;
+        default:
+            word = coils;
+            break;
+    }
+    return (((word >> (operand & 0x1F)) & 1U) != 0) != ((operand & ESP32_RIO_LOGIC_BIT_INVERT) != 0);
+}
+
+
+static void logic_write(uint8_t operand, bool level) {
+    uint32_t *word = ((operand >> 5) & 3U) == 1 ? &s_outputs : &s_markers; //Only valid destinations get here
+    uint32_t bit = 1UL << (operand & 0x1F);
+    *word = level ? (*word | bit) : (*word & ~bit);
+}
+
+
+static bool logic_block_valid(const esp32_rio_logic_block_t *block) {
+    if (block->op >= ESP32_RIO_LOGIC_NUM_OPS) {
+        return false;
+    }
+    if (block->op == ESP32_RIO_LOGIC_OP_NOP) {
+        return true;
+    }
+    bool binary = block->op == ESP32_RIO_LOGIC_OP_AND || block->op == ESP32_RIO_LOGIC_OP_OR || block->op == ESP32_RIO_LOGIC_OP_XOR ||
+                  block->op == ESP32_RIO_LOGIC_OP_SET || block->op == ESP32_RIO_LOGIC_OP_RESET;
+    return logic_operand_valid(block->destination, true) && logic_operand_valid(block->source_a, false) &&
+           (!binary || logic_operand_valid(block->source_b, false));
+}
+
+
+static bool logic_operand_valid(uint8_t operand, bool destination) {
+    unsigned int address = operand & 0x1F;
+    if (destination && (operand & ESP32_RIO_LOGIC_BIT_INVERT)) {
+        return false;
+    }
+    switch ((operand >> 5) & 3U) {
+        case 0:
+            return !destination && address < ESP32_RIO_NUM_DI_CHANNELS;
+        case 1:
+            return address % 16 < ESP32_RIO_NUM_DQ_CHANNELS;
+        case 2:
+            return address < ESP32_RIO_LOGIC_NUM_MARKERS;
+        default:
+            return !destination && address % 16 < ESP32_RIO_NUM_DQ_CHANNELS;
+    }
+}
+
+
+static esp_err_t logic_store(const esp32_rio_logic_block_t *blocks, size_t block_count) {
+    esp32_rio_config_logic_t config = { 0 };
+    
+    config.block_count = (uint8_t)block_count;
+    for (size_t i = 0; i < block_count; i++) {
+        config.ops[i][0] = blocks[i].op;
+        config.ops[i][1] = blocks[i].destination;
+        config.sources[i][0] = blocks[i].source_a;
+        config.sources[i][1] = blocks[i].source_b;
+        config.times_ms[i] = blocks[i].time_ms;
+    }
+    esp_err_t err = esp32_rio_config_write(ESP32_RIO_CONFIG_LOGIC, &config, sizeof(config));
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error storing logic program: %s", esp_err_to_name(err));
+    }
+    return err;
+}
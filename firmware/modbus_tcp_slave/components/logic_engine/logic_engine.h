@@ -0,0 +1,84 @@
+/*
+@file logic_engine.h
+@brief Header for the logic engine component.
+
+This file defines the public interface for the on-device logic engine, which runs a
+table of boolean, latch and timer blocks on a fixed-period scan, driving outputs from
+inputs with no network round trip.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#ifndef LOGIC_ENGINE_H
+#define LOGIC_ENGINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define ESP32_RIO_LOGIC_MAX_BLOCKS 32
+#define ESP32_RIO_LOGIC_NUM_MARKERS 32
+
+/*
+ Bit operands. Inputs, outputs, markers and coils each take a range of 32 addresses, and source operands
+ read inverted with ESP32_RIO_LOGIC_BIT_INVERT set. Outputs read as the level the program last gave them
+*/
+#define ESP32_RIO_LOGIC_BIT_DI(input) (0x00 + (input))
+#define ESP32_RIO_LOGIC_BIT_DQ(bank, output) (0x20 + 16 * (bank) + (output))
+#define ESP32_RIO_LOGIC_BIT_MARKER(marker) (0x40 + (marker))
+#define ESP32_RIO_LOGIC_BIT_COIL(bank, output) (0x60 + 16 * (bank) + (output))
+#define ESP32_RIO_LOGIC_BIT_INVERT 0x80
+
+typedef enum {
+    ESP32_RIO_LOGIC_OP_NOP = 0, //Does nothing
+    ESP32_RIO_LOGIC_OP_AND, //Destination = A and B
+    ESP32_RIO_LOGIC_OP_OR, //Destination = A or B
+    ESP32_RIO_LOGIC_OP_XOR, //Destination = A xor B
+    ESP32_RIO_LOGIC_OP_MOV, //Destination = A
+    ESP32_RIO_LOGIC_OP_SET, //Set-dominant latch: set by A, reset by B
+    ESP32_RIO_LOGIC_OP_RESET, //Reset-dominant latch: set by A, reset by B
+    ESP32_RIO_LOGIC_OP_TON, //On once A has been on for the block time, off with A
+    ESP32_RIO_LOGIC_OP_TOF, //On with A, off once A has been off for the block time
+    ESP32_RIO_LOGIC_OP_TP, //On for the block time from a rising edge of A
+    ESP32_RIO_LOGIC_OP_RISE, //On for one scan on a rising edge of A
+    ESP32_RIO_LOGIC_NUM_OPS
+} esp32_rio_logic_op_t;
+
+typedef struct {
+    uint8_t op; //esp32_rio_logic_op_t
+    uint8_t destination; //Output or marker operand, not inverted
+    uint8_t source_a;
+    uint8_t source_b;
+    uint16_t time_ms; //Timer blocks only
+} esp32_rio_logic_block_t;
+
+typedef struct {
+    uint16_t inputs; //DI levels (bit n = DIn)
+    uint16_t coils[2]; //Coils of both banks (bit n = DQbn)
+} esp32_rio_logic_inputs_t;
+
+typedef struct {
+    uint32_t scans; //Since boot
+    uint32_t overruns; //Scans missed for a scan running late
+    uint32_t last_scan_us;
+    uint32_t max_scan_us;
+} esp32_rio_logic_stats_t;
+
+typedef void (*logic_inputs_read_cb_t)(esp32_rio_logic_inputs_t *); //Fills in the inputs of a scan
+typedef void (*logic_outputs_change_cb_t)(void); //Outputs driven by the program changed, from the scan task
+typedef void (*logic_program_change_cb_t)(esp_err_t, size_t); //A load was checked (ESP_OK, or ESP_ERR_INVALID_ARG and the first invalid block), from the loading task
+
+esp_err_t esp32_rio_logic_start(logic_inputs_read_cb_t, logic_outputs_change_cb_t, logic_program_change_cb_t);
+esp_err_t esp32_rio_logic_load(const esp32_rio_logic_block_t *, size_t, size_t *);
+size_t esp32_rio_logic_get_program(esp32_rio_logic_block_t *, size_t);
+void esp32_rio_logic_get_outputs(uint32_t *, uint32_t *);
+void esp32_rio_logic_get_stats(esp32_rio_logic_stats_t *);
+const char *esp32_rio_logic_op_name(esp32_rio_logic_op_t);
+esp_err_t esp32_rio_logic_console_register(void);
+
+#endif //LOGIC_ENGINE_H
@@ -0,0 +1,158 @@
+/*
+@file logic_engine_console.c
+@brief Console command of the logic engine component.
+
+This file implements the logic console command, which lists the program running with
+the scan statistics, and loads a program given in hexadecimal or stops it.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include "sdkconfig.h"
+
+#include "logic_engine.h"
+#include "usb_console.h"
+
+#define LOGIC_CONSOLE_OUTPUT_LENGTH 160
+#define LOGIC_BLOCK_DIGITS 12 //Hexadecimal digits of a block, as its three holding registers
+
+static void cmd_logic(int, char **);
+static void logic_load_args(int, char **);
+static const char *logic_operand_name(uint8_t, char *, size_t);
+
+static const esp32_rio_console_cmd_t s_logic_cmd = {
+    "logic", "[load BLOCKS [BLOCKS [BLOCKS]]|stop]",
+    "Show logic engine scan statistics and the program running, or load and store a program (hex) or stop it.", cmd_logic
+};
+
+
+/*
+ Add the logic command to the console. Must run before the console starts
+*/
+esp_err_t esp32_rio_logic_console_register(void) {
+    return esp32_rio_console_register_command(&s_logic_cmd);
+}
+
+
+static void cmd_logic(int arg_count, char **args) {
+    char output_buf[LOGIC_CONSOLE_OUTPUT_LENGTH];
+    if (arg_count == 1 && strcmp(args[0], "stop") == 0) {
+        logic_load_args(0, NULL); //An empty program stops the logic engine
+        return;
+    } else if (arg_count >= 2 && strcmp(args[0], "load") == 0) {
+        logic_load_args(arg_count - 1, &args[1]);
+        return;
+    } else if (arg_count != 0) {
+        esp32_rio_console_write_str("\n[logic] Error: Command takes no argument, load BLOCKS or stop. See help.\n");
+        return;
+    }
+    esp32_rio_logic_block_t blocks[ESP32_RIO_LOGIC_MAX_BLOCKS];
+    esp32_rio_logic_stats_t stats;
+    size_t block_count = esp32_rio_logic_get_program(blocks, ESP32_RIO_LOGIC_MAX_BLOCKS);
+    esp32_rio_logic_get_stats(&stats);
+    snprintf(output_buf, sizeof(output_buf), "\n[logic] Program: %u blocks, scan period: %d us\n",
+             (unsigned int)block_count, CONFIG_ESP32_RIO_LOGIC_SCAN_US);
+    esp32_rio_console_write_str(output_buf);
+    snprintf(output_buf, sizeof(output_buf), "  Scans: %" PRIu32 ", overruns: %" PRIu32 ", scan time: %" PRIu32 " us (max %" PRIu32 " us)\n",
+             stats.scans, stats.overruns, stats.last_scan_us, stats.max_scan_us);
+    esp32_rio_console_write_str(output_buf);
+    for (size_t i = 0; i < block_count; i++) {
+        char destination[8], source_a[8], source_b[8];
+        snprintf(output_buf, sizeof(output_buf), "  %2u: %-5s %-5s %-5s %-5s %u ms\n", (unsigned int)i,
+                 esp32_rio_logic_op_name(blocks[i].op),
+                 logic_operand_name(blocks[i].destination, destination, sizeof(destination)),
+                 logic_operand_name(blocks[i].source_a, source_a, sizeof(source_a)),
+                 logic_operand_name(blocks[i].source_b, source_b, sizeof(source_b)),
+                 blocks[i].time_ms);
+        esp32_rio_console_write_str(output_buf);
+    }
+}
+
+
+/*
+ Load and store the logic program given in hexadecimal arguments, or stop the logic engine if there are none
+*/
+static void logic_load_args(int arg_count, char **args) {
+    char output_buf[LOGIC_CONSOLE_OUTPUT_LENGTH];
+    esp32_rio_logic_block_t blocks[ESP32_RIO_LOGIC_MAX_BLOCKS];
+    
+    // Blocks laid out as their three holding registers: op, destination, source A, source B, then the block time
+    size_t block_count = 0;
+    for (int i = 0; i < arg_count; i++) {
+        size_t length = strlen(args[i]);
+        bool valid = length > 0 && length % LOGIC_BLOCK_DIGITS == 0 && block_count + length / LOGIC_BLOCK_DIGITS <= ESP32_RIO_LOGIC_MAX_BLOCKS;
+        for (size_t j = 0; valid && j < length; j++) {
+            valid = isxdigit((int)args[i][j]);
+        }
+        if (!valid) {
+            snprintf(output_buf, sizeof(output_buf), "\n[logic] Error: Blocks must be %d hexadecimal digits each, up to %d blocks.\n",
+                     LOGIC_BLOCK_DIGITS, ESP32_RIO_LOGIC_MAX_BLOCKS);
+            esp32_rio_console_write_str(output_buf);
+            return;
+        }
+        for (size_t j = 0; j < length; j += LOGIC_BLOCK_DIGITS, block_count++) {
+            char field[5] = { 0 };
+            uint8_t bytes[4];
+            for (int k = 0; k < 4; k++) {
+                memcpy(field, &args[i][j + 2 * k], 2);
+                bytes[k] = (uint8_t)strtoul(field, NULL, 16);
+            }
+            memcpy(field, &args[i][j + 8], 4);
+            blocks[block_count] = (esp32_rio_logic_block_t){
+                .op = bytes[0],
+                .destination = bytes[1],
+                .source_a = bytes[2],
+                .source_b = bytes[3],
+                .time_ms = (uint16_t)strtoul(field, NULL, 16)
+            };
+        }
+    }
+    size_t invalid_block = 0;
+    esp_err_t err = esp32_rio_logic_load(blocks, block_count, &invalid_block);
+    if (err == ESP_ERR_INVALID_ARG) {
+        snprintf(output_buf, sizeof(output_buf), "\n[logic] Error: Invalid block %u, running program left in place.\n",
+                 (unsigned int)invalid_block);
+    } else if (err == ESP_ERR_INVALID_STATE) {
+        snprintf(output_buf, sizeof(output_buf), "\n[logic] Error: Logic engine not running.\n");
+    } else if (err != ESP_OK) {
+        snprintf(output_buf, sizeof(output_buf), "\n[logic] Error: Program loaded but could not be stored.\n");
+    } else {
+        snprintf(output_buf, sizeof(output_buf), "\n[logic] Program of %u blocks loaded and saved.\n", (unsigned int)block_count);
+    }
+    esp32_rio_console_write_str(output_buf);
+}
+
+
+/*
+ Render a logic operand as DIn, DQbn, Mn or Cbn (coil), prefixed with ! when inverted
+*/
+static const char *logic_operand_name(uint8_t operand, char *name, size_t size) {
+    const char *invert = (operand & ESP32_RIO_LOGIC_BIT_INVERT) ? "!" : "";
+    unsigned int address = operand & 0x1F;
+    switch ((operand >> 5) & 3U) {
+        case 0:
+            snprintf(name, size, "%sDI%u", invert, address);
+            break;
+        case 1:
+            snprintf(name, size, "%sDQ%u%u", invert, address / 16, address % 16);
+            break;
+        case 2:
+            snprintf(name, size, "%sM%u", invert, address);
+            break;
+        default:
+            snprintf(name, size, "%sC%u%u", invert, address / 16, address % 16);
+            break;
+    }
+    return name;
+}
@@ -0,0 +1,723 @@
+/*
+@file mb_frontend.c
+@brief Implementation for the Modbus TCP front-end component.
+
+This file implements a task owning the public Modbus TCP port. It accepts up to a
+configurable number of masters, assembles their requests and forwards them one at a
+time, over a loopback connection, to the Modbus stack, picking the next one to serve
+according to the configured scheduling policy. Responses are relayed back to the
+requesting master, and every connection keeps its own request accounting.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#include <string.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_netif.h"
+#include "lwip/sockets.h"
+
+#include "mb_frontend.h"
+#include "config_store.h"
+#include "power_mgmt.h"
+
+#define MB_FRONTEND_TASK_CORE CONFIG_ESP32_RIO_RT_CORE //Same core as the Modbus slave task, off the WiFi stack
+#define MB_FRONTEND_TASK_PRIORITY CONFIG_ESP32_RIO_MB_TASK_PRIORITY
+#define MB_FRONTEND_TASK_STACK_SIZE CONFIG_ESP32_RIO_MB_TASK_STACK_SIZE
+
+#define MB_TCP_MBAP_LENGTH 7 //Transaction ID, protocol ID, length, unit ID
+#define MB_TCP_MAX_PDU_LENGTH 253
+#define MB_TCP_MAX_ADU_LENGTH (MB_TCP_MBAP_LENGTH + MB_TCP_MAX_PDU_LENGTH)
+#define MB_TCP_LISTEN_BACKLOG 2
+#define MB_TCP_KEEPALIVE_IDLE_S 10 //Drop masters gone without closing their connection
+#define MB_TCP_KEEPALIVE_INTERVAL_S 5
+#define MB_TCP_KEEPALIVE_COUNT 3
+
+#define MB_FRONTEND_POLL_MS 100 //Upper bound on waits, for stack timeouts and reconnection
+#define MB_FRONTEND_STACK_TIMEOUT_MS 500 //Time allowed to the stack for each response
+#define MB_FRONTEND_SEND_TIMEOUT_MS 500 //Time allowed to the stack to take each request
+#define MB_FRONTEND_STOP_TIMEOUT_MS (MB_FRONTEND_POLL_MS + MB_FRONTEND_SEND_TIMEOUT_MS + 1000) //Longest time a loop may take
+
+static void frontend_task(void *);
+static void accept_connection(int64_t);
+static void close_connection(int);
+static void receive_request(int, int64_t);
+static bool answer_unit_request(int);
+static int schedule_next(void);
+static void forward_request(int, int64_t);
+static void receive_response(int64_t);
+static void abandon_active_request(void);
+static bool backend_connect(void);
+static void backend_close(void);
+static size_t frame_missing_bytes(const uint8_t *, size_t, bool *);
+static bool send_all(int, const uint8_t *, size_t);
+static bool send_response(int, const uint8_t *, size_t);
+static bool is_primary(uint32_t);
+static void mb_config_fill(esp32_rio_config_mb_t *);
+
+static const char *TAG = "ESP32_RIO_MB_FE";
+
+/*
+ A connection holds at most one request at a time: once a complete request is received, its socket is no longer
+ read until the response has been relayed, so further requests wait in the TCP buffers of that master alone and
+ cannot delay other connections. The scheduler then only needs to pick among complete requests.
+*/
+typedef struct {
+    int socket; //-1 when the slot is free
+    uint8_t frame[MB_TCP_MAX_ADU_LENGTH];
+    size_t frame_length; //Bytes of the current request received so far
+    bool pending; //Complete request waiting for its turn or being served
+    int64_t received_us; //When the pending request was completed
+    int64_t last_activity_us;
+    int64_t connected_us;
+    esp32_rio_mb_conn_stats_t stats;
+} mb_connection_t;
+
+static mb_connection_t s_connections[ESP32_RIO_MB_MAX_CONNECTIONS];
+static portMUX_TYPE s_connections_lock = portMUX_INITIALIZER_UNLOCKED; //Guards connection statistics read by other tasks
+static uint32_t s_accepted_count = 0;
+static uint32_t s_rejected_count = 0;
+static uint32_t s_evicted_count = 0;
+
+static int s_listen_socket = -1;
+static TaskHandle_t s_task_handle = NULL;
+static volatile TaskHandle_t s_stop_waiter = NULL; //Task waiting for frontend_task to stop, which is asked to by setting it
+static uint16_t s_backend_port = 0;
+static int s_backend_socket = -1;
+static int s_active_connection = -1; //Connection whose request is being served by the stack, -1 if none
+static bool s_power_held = false; //Modbus power path held for the request being served
+static int64_t s_forwarded_us = 0;
+static uint8_t s_response[MB_TCP_MAX_ADU_LENGTH];
+static size_t s_response_length = 0;
+static int s_last_served = 0; //Round-robin position
+static uint8_t s_local_unit = 0;
+static mb_unit_request_cb_t s_unit_request_callback = NULL; //Answers requests for units other than the local one
+static uint8_t s_unit_response[MB_TCP_MAX_ADU_LENGTH];
+
+static volatile unsigned int s_max_connections = ESP32_RIO_MB_DEFAULT_CONNECTIONS;
+static volatile esp32_rio_mb_sched_policy_t s_sched_policy = ESP32_RIO_MB_SCHED_ROUND_ROBIN;
+static volatile uint32_t s_primary_ip = 0; //Network byte order, 0 if none
+
+
+/*
+ Start accepting Modbus TCP connections on a port, serving them through the stack listening on a loopback port
+*/
+esp_err_t esp32_rio_mb_frontend_start(uint16_t port, uint16_t backend_port) {
+    if (esp32_rio_mb_nv_params_load() != ESP_OK) {
+        ESP_LOGI(TAG, "Using default Modbus connection settings.");
+    }
+    for (int i = 0; i < ESP32_RIO_MB_MAX_CONNECTIONS; i++) {
+        s_connections[i].socket = -1;
+    }
+    s_backend_port = backend_port;
+    
+    s_listen_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    ESP_RETURN_ON_FALSE(s_listen_socket >= 0, ESP_FAIL, TAG, "Failed to create listening socket: errno %d", errno);
+    int reuse = 1;
+    setsockopt(s_listen_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in listen_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY)
+    };
+    if (bind(s_listen_socket, (struct sockaddr *)&listen_addr, sizeof(listen_addr)) != 0 ||
+        listen(s_listen_socket, MB_TCP_LISTEN_BACKLOG) != 0) {
+        ESP_LOGE(TAG, "Failed to listen on port %u: errno %d", port, errno);
+        close(s_listen_socket);
+        s_listen_socket = -1;
+        return ESP_FAIL;
+    }
+    
+    if (xTaskCreatePinnedToCore(frontend_task, "mb_frontend_task", MB_FRONTEND_TASK_STACK_SIZE, NULL,
+                                MB_FRONTEND_TASK_PRIORITY, &s_task_handle, MB_FRONTEND_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create mb_frontend_task.");
+        close(s_listen_socket);
+        s_listen_socket = -1;
+        s_task_handle = NULL;
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Accepting up to %u Modbus TCP connections on port %u.", s_max_connections, port);
+    return ESP_OK;
+}
+
+
+/*
+ Stop the front-end task, closing every connection, the stack connection and the listening socket
+*/
+esp_err_t esp32_rio_mb_frontend_stop(void) {
+    if (s_task_handle == NULL) {
+        return ESP_OK;
+    }
+    s_stop_waiter = xTaskGetCurrentTaskHandle(); //Seen within a poll period, select never waits longer
+    ESP_RETURN_ON_FALSE(ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MB_FRONTEND_STOP_TIMEOUT_MS)) != 0, ESP_ERR_TIMEOUT, TAG, "mb_frontend_task did not stop.");
+    s_task_handle = NULL;
+    s_stop_waiter = NULL;
+    
+    for (int i = 0; i < ESP32_RIO_MB_MAX_CONNECTIONS; i++) {
+        if (s_connections[i].socket >= 0) {
+            close_connection(i);
+        }
+    }
+    s_active_connection = -1;
+    backend_close();
+    close(s_listen_socket);
+    s_listen_socket = -1;
+    if (s_power_held) {
+        esp32_rio_power_release(ESP32_RIO_POWER_PATH_MODBUS);
+        s_power_held = false;
+    }
+    ESP_LOGI(TAG, "Modbus TCP front-end stopped.");
+    return ESP_OK;
+}
+
+
+/*
+ Have requests for any unit other than the local one offered to a handler first, before the stack. Must be called
+ before the front-end starts
+*/
+void esp32_rio_mb_set_unit_handler(uint8_t local_unit, mb_unit_request_cb_t unit_request_cb) {
+    s_local_unit = local_unit;
+    s_unit_request_callback = unit_request_cb;
+}
+
+
+/*
+ Set the maximum number of concurrent connections. Connections beyond a lowered maximum are kept until closed
+*/
+esp_err_t esp32_rio_set_mb_max_connections(unsigned int max_connections) {
+    if (max_connections < 1 || max_connections > ESP32_RIO_MB_MAX_CONNECTIONS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_max_connections = max_connections;
+    return ESP_OK;
+}
+
+
+unsigned int esp32_rio_get_mb_max_connections(void) {
+    return s_max_connections;
+}
+
+
+/*
+ Set the request scheduling policy. The priority policy requires the IPv4 address (network byte order) of the primary master
+*/
+esp_err_t esp32_rio_set_mb_sched_policy(esp32_rio_mb_sched_policy_t policy, uint32_t primary_ip) {
+    if (policy == ESP32_RIO_MB_SCHED_ROUND_ROBIN) {
+        s_primary_ip = 0;
+    } else if (policy == ESP32_RIO_MB_SCHED_PRIORITY && primary_ip != 0) {
+        s_primary_ip = primary_ip;
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_sched_policy = policy;
+    return ESP_OK;
+}
+
+
+esp32_rio_mb_sched_policy_t esp32_rio_get_mb_sched_policy(uint32_t *primary_ip) {
+    if (primary_ip) {
+        *primary_ip = s_primary_ip;
+    }
+    return s_sched_policy;
+}
+
+
+/*
+ Retrieve the statistics of up to a given number of open connections, returning how many were retrieved
+*/
+size_t esp32_rio_get_mb_connections(esp32_rio_mb_conn_stats_t *stats, size_t max_count) {
+    size_t count = 0;
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&s_connections_lock);
+    for (int i = 0; i < ESP32_RIO_MB_MAX_CONNECTIONS && count < max_count; i++) {
+        if (s_connections[i].socket >= 0) {
+            stats[count] = s_connections[i].stats;
+            stats[count].primary = is_primary(stats[count].peer_ip);
+            stats[count].connected_s = (uint32_t)((now_us - s_connections[i].connected_us) / 1000000);
+            count++;
+        }
+    }
+    portEXIT_CRITICAL(&s_connections_lock);
+    return count;
+}
+
+
+/*
+ Retrieve the number of connections accepted, rejected for lack of a free slot and closed to make room for the primary master
+*/
+void esp32_rio_get_mb_connection_totals(uint32_t *accepted, uint32_t *rejected, uint32_t *evicted) {
+    *accepted = s_accepted_count;
+    *rejected = s_rejected_count;
+    *evicted = s_evicted_count;
+}
+
+
+/*
+ Retrieve stored Modbus connection settings. Settings never stored keep their defaults
+*/
+esp_err_t esp32_rio_mb_nv_params_load(void) {
+    esp32_rio_config_mb_t config;
+    
+    mb_config_fill(&config); //Defaults, for any setting left out of the store
+    esp_err_t err = esp32_rio_config_read(ESP32_RIO_CONFIG_MB, &config, sizeof(config));
+    if (err != ESP_OK) {
+        ESP_LOGI(TAG, "No stored Modbus connection settings: %s", esp_err_to_name(err));
+        return err;
+    }
+    
+    if (esp32_rio_set_mb_max_connections(config.max_connections) != ESP_OK) {
+        ESP_LOGW(TAG, "Ignoring invalid stored maximum number of connections.");
+    }
+    if (esp32_rio_set_mb_sched_policy((esp32_rio_mb_sched_policy_t)config.sched_policy, config.primary_ip) != ESP_OK) {
+        ESP_LOGW(TAG, "Ignoring invalid stored scheduling policy.");
+    }
+    
+    ESP_LOGI(TAG, "Modbus connection settings loaded.");
+    return ESP_OK;
+}
+
+
+/*
+ Store current Modbus connection settings
+*/
+esp_err_t esp32_rio_mb_nv_params_save(void) {
+    esp32_rio_config_mb_t config;
+    
+    mb_config_fill(&config);
+    esp_err_t err = esp32_rio_config_write(ESP32_RIO_CONFIG_MB, &config, sizeof(config));
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error storing Modbus connection settings: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+
+/*
+ Current Modbus connection settings, as stored. Zeroed first, padding included, as the store compares settings
+ byte for byte to skip unchanged writes
+*/
+static void mb_config_fill(esp32_rio_config_mb_t *config) {
+    memset(config, 0, sizeof(*config));
+    config->max_connections = (uint8_t)s_max_connections;
+    config->sched_policy = (uint8_t)s_sched_policy;
+    config->primary_ip = s_primary_ip;
+}
+
+
+static void frontend_task(void *arg) {
+    bool backend_warned = false;
+    
+    while (s_stop_waiter == NULL) {
+        if (s_backend_socket < 0) {
+            if (backend_connect()) {
+                backend_warned = false;
+            } else if (!backend_warned) {
+                ESP_LOGW(TAG, "Modbus stack not reachable on loopback port %u, retrying.", s_backend_port);
+                backend_warned = true;
+            }
+        }
+        
+        // Wait for new connections, requests from idle connections or the response being served
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(s_listen_socket, &read_fds);
+        int max_fd = s_listen_socket;
+        for (int i = 0; i < ESP32_RIO_MB_MAX_CONNECTIONS; i++) {
+            if (s_connections[i].socket >= 0 && !s_connections[i].pending) {
+                FD_SET(s_connections[i].socket, &read_fds);
+                max_fd = s_connections[i].socket > max_fd ? s_connections[i].socket : max_fd;
+            }
+        }
+        if (s_active_connection >= 0) {
+            FD_SET(s_backend_socket, &read_fds);
+            max_fd = s_backend_socket > max_fd ? s_backend_socket : max_fd;
+        }
+        struct timeval timeout = { .tv_sec = 0, .tv_usec = MB_FRONTEND_POLL_MS * 1000 };
+        if (select(max_fd + 1, &read_fds, NULL, NULL, &timeout) < 0) {
+            ESP_LOGE(TAG, "select failed: errno %d", errno);
+            vTaskDelay(pdMS_TO_TICKS(MB_FRONTEND_POLL_MS));
+            continue;
+        }
+        int64_t now_us = esp_timer_get_time();
+        
+        if (FD_ISSET(s_listen_socket, &read_fds)) {
+            accept_connection(now_us);
+        }
+        for (int i = 0; i < ESP32_RIO_MB_MAX_CONNECTIONS; i++) {
+            if (s_connections[i].socket >= 0 && !s_connections[i].pending && FD_ISSET(s_connections[i].socket, &read_fds)) {
+                receive_request(i, now_us);
+            }
+        }
+        if (s_active_connection >= 0) {
+            if (FD_ISSET(s_backend_socket, &read_fds)) {
+                receive_response(now_us);
+            } else if (now_us - s_forwarded_us > MB_FRONTEND_STACK_TIMEOUT_MS * 1000LL) {
+                ESP_LOGW(TAG, "Modbus stack response timeout.");
+                s_connections[s_active_connection].stats.timeouts++;
+                abandon_active_request();
+            }
+        }
+        
+        // Hand the stack its next request as soon as it is free
+        if (s_active_connection < 0 && s_backend_socket >= 0) {
+            int next = schedule_next();
+            if (next >= 0) {
+                forward_request(next, now_us);
+            }
+        }
+        
+        // Full CPU speed from forwarding a request until its response is relayed
+        bool serving = (s_active_connection >= 0);
+        if (serving != s_power_held) {
+            if (serving) {
+                esp32_rio_power_acquire(ESP32_RIO_POWER_PATH_MODBUS);
+            } else {
+                esp32_rio_power_release(ESP32_RIO_POWER_PATH_MODBUS);
+            }
+            s_power_held = serving;
+        }
+    }
+    xTaskNotifyGive(s_stop_waiter);
+    vTaskDelete(NULL);
+}
+
+
+static void accept_connection(int64_t now_us) {
+    struct sockaddr_in peer_addr;
+    socklen_t addr_length = sizeof(peer_addr);
+    int client_socket = accept(s_listen_socket, (struct sockaddr *)&peer_addr, &addr_length);
+    if (client_socket < 0) {
+        ESP_LOGW(TAG, "accept failed: errno %d", errno);
+        return;
+    }
+    
+    int free_slot = -1;
+    unsigned int open_count = 0;
+    for (int i = 0; i < ESP32_RIO_MB_MAX_CONNECTIONS; i++) {
+        if (s_connections[i].socket >= 0) {
+            open_count++;
+        } else if (free_slot < 0) {
+            free_slot = i;
+        }
+    }
+    if (open_count >= s_max_connections) {
+        free_slot = -1;
+        if (is_primary(peer_addr.sin_addr.s_addr)) {
+            // Make room for the primary master by closing the secondary connection idle for longest
+            for (int i = 0; i < ESP32_RIO_MB_MAX_CONNECTIONS; i++) {
+                if (s_connections[i].socket >= 0 && i != s_active_connection && !is_primary(s_connections[i].stats.peer_ip) &&
+                    (free_slot < 0 || s_connections[i].last_activity_us < s_connections[free_slot].last_activity_us)) {
+                    free_slot = i;
+                }
+            }
+            if (free_slot >= 0) {
+                ESP_LOGW(TAG, "Closing connection from " IPSTR " to make room for the primary master.",
+                         IP2STR((esp_ip4_addr_t *)&s_connections[free_slot].stats.peer_ip));
+                close_connection(free_slot);
+                s_evicted_count++;
+            }
+        }
+        if (free_slot < 0) {
+            ESP_LOGW(TAG, "Rejecting connection from " IPSTR ": %u connections already open.",
+                     IP2STR((esp_ip4_addr_t *)&peer_addr.sin_addr.s_addr), open_count);
+            close(client_socket);
+            s_rejected_count++;
+            return;
+        }
+    }
+    
+    // Requests are single small segments, send them without delay; probe idle masters to detect vanished ones
+    int enable = 1;
+    int keepalive_idle = MB_TCP_KEEPALIVE_IDLE_S;
+    int keepalive_interval = MB_TCP_KEEPALIVE_INTERVAL_S;
+    int keepalive_count = MB_TCP_KEEPALIVE_COUNT;
+    setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    setsockopt(client_socket, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(enable));
+    setsockopt(client_socket, IPPROTO_TCP, TCP_KEEPIDLE, &keepalive_idle, sizeof(keepalive_idle));
+    setsockopt(client_socket, IPPROTO_TCP, TCP_KEEPINTVL, &keepalive_interval, sizeof(keepalive_interval));
+    setsockopt(client_socket, IPPROTO_TCP, TCP_KEEPCNT, &keepalive_count, sizeof(keepalive_count));
+    
+    mb_connection_t *connection = &s_connections[free_slot];
+    portENTER_CRITICAL(&s_connections_lock);
+    memset(&connection->stats, 0, sizeof(connection->stats));
+    connection->stats.peer_ip = peer_addr.sin_addr.s_addr;
+    connection->stats.peer_port = ntohs(peer_addr.sin_port);
+    connection->frame_length = 0;
+    connection->pending = false;
+    connection->connected_us = now_us;
+    connection->last_activity_us = now_us;
+    connection->socket = client_socket;
+    portEXIT_CRITICAL(&s_connections_lock);
+    s_accepted_count++;
+    ESP_LOGI(TAG, "Connection from " IPSTR ":%u accepted%s.", IP2STR((esp_ip4_addr_t *)&connection->stats.peer_ip),
+             connection->stats.peer_port, is_primary(connection->stats.peer_ip) ? " (primary master)" : "");
+}
+
+
+static void close_connection(int index) {
+    mb_connection_t *connection = &s_connections[index];
+    int client_socket = connection->socket;
+    portENTER_CRITICAL(&s_connections_lock);
+    connection->socket = -1;
+    connection->pending = false;
+    portEXIT_CRITICAL(&s_connections_lock);
+    close(client_socket);
+    ESP_LOGI(TAG, "Connection from " IPSTR ":%u closed after %" PRIu32 " requests.",
+             IP2STR((esp_ip4_addr_t *)&connection->stats.peer_ip), connection->stats.peer_port, connection->stats.requests);
+}
+
+
+/*
+ Read what is available of a connection's current request, marking it pending once complete
+*/
+static void receive_request(int index, int64_t now_us) {
+    mb_connection_t *connection = &s_connections[index];
+    bool valid;
+    size_t missing = frame_missing_bytes(connection->frame, connection->frame_length, &valid);
+    int received = recv(connection->socket, connection->frame + connection->frame_length, missing, 0);
+    if (received <= 0) {
+        close_connection(index); //Closed by the master (or reset)
+        return;
+    }
+    connection->frame_length += received;
+    connection->last_activity_us = now_us;
+    
+    missing = frame_missing_bytes(connection->frame, connection->frame_length, &valid);
+    if (!valid) {
+        ESP_LOGW(TAG, "Malformed request from " IPSTR ", closing connection.", IP2STR((esp_ip4_addr_t *)&connection->stats.peer_ip));
+        close_connection(index);
+    } else if (missing == 0) {
+        connection->received_us = now_us;
+        connection->stats.requests++;
+        if (!answer_unit_request(index)) {
+            connection->pending = true;
+        }
+    }
+}
+
+
+/*
+ Answer a complete request for another unit through the unit handler at once, without going through the stack.
+ Returns false for requests left to the stack
+*/
+static bool answer_unit_request(int index) {
+    mb_connection_t *connection = &s_connections[index];
+    uint8_t unit = connection->frame[MB_TCP_MBAP_LENGTH - 1];
+    if (s_unit_request_callback == NULL || unit == s_local_unit) {
+        return false;
+    }
+    size_t pdu_length = s_unit_request_callback(unit, connection->frame + MB_TCP_MBAP_LENGTH,
+                                                connection->frame_length - MB_TCP_MBAP_LENGTH,
+                                                s_unit_response + MB_TCP_MBAP_LENGTH);
+    if (pdu_length == 0 || pdu_length > MB_TCP_MAX_PDU_LENGTH) {
+        return false;
+    }
+    
+    memcpy(s_unit_response, connection->frame, 4); //Transaction and protocol IDs
+    s_unit_response[4] = (uint8_t)((pdu_length + 1) >> 8);
+    s_unit_response[5] = (uint8_t)(pdu_length + 1);
+    s_unit_response[6] = unit;
+    connection->frame_length = 0;
+    if (s_unit_response[MB_TCP_MBAP_LENGTH] & 0x80) {
+        connection->stats.exceptions++;
+    }
+    if (!send_response(index, s_unit_response, MB_TCP_MBAP_LENGTH + pdu_length)) {
+        close_connection(index);
+        return true;
+    }
+    uint32_t response_us = (uint32_t)(esp_timer_get_time() - connection->received_us);
+    connection->stats.last_response_us = response_us;
+    if (response_us > connection->stats.max_response_us) {
+        connection->stats.max_response_us = response_us;
+    }
+    return true;
+}
+
+
+/*
+ Pick the connection whose request the stack shall serve next, -1 if none is pending
+*/
+static int schedule_next(void) {
+    if (s_sched_policy == ESP32_RIO_MB_SCHED_PRIORITY) {
+        for (int i = 0; i < ESP32_RIO_MB_MAX_CONNECTIONS; i++) {
+            if (s_connections[i].socket >= 0 && s_connections[i].pending && is_primary(s_connections[i].stats.peer_ip)) {
+                return i;
+            }
+        }
+    }
+    for (int step = 1; step <= ESP32_RIO_MB_MAX_CONNECTIONS; step++) {
+        int i = (s_last_served + step) % ESP32_RIO_MB_MAX_CONNECTIONS;
+        if (s_connections[i].socket >= 0 && s_connections[i].pending) {
+            s_last_served = i;
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+static void forward_request(int index, int64_t now_us) {
+    mb_connection_t *connection = &s_connections[index];
+    if (!send_all(s_backend_socket, connection->frame, connection->frame_length)) {
+        ESP_LOGW(TAG, "Failed to forward request to the Modbus stack: errno %d", errno);
+        backend_close(); //Request stays pending until the stack is reachable again
+        return;
+    }
+    uint32_t wait_us = (uint32_t)(now_us - connection->received_us);
+    if (wait_us > connection->stats.max_wait_us) {
+        connection->stats.max_wait_us = wait_us;
+    }
+    s_active_connection = index;
+    s_forwarded_us = now_us;
+    s_response_length = 0;
+}
+
+
+/*
+ Read what is available of the stack's response, relaying it to the requesting master once complete
+*/
+static void receive_response(int64_t now_us) {
+    bool valid;
+    size_t missing = frame_missing_bytes(s_response, s_response_length, &valid);
+    int received = recv(s_backend_socket, s_response + s_response_length, missing, 0);
+    if (received <= 0) {
+        ESP_LOGW(TAG, "Connection to the Modbus stack lost.");
+        abandon_active_request();
+        return;
+    }
+    s_response_length += received;
+    missing = frame_missing_bytes(s_response, s_response_length, &valid);
+    if (!valid) {
+        ESP_LOGW(TAG, "Malformed response from the Modbus stack.");
+        abandon_active_request();
+        return;
+    }
+    if (missing > 0) {
+        return;
+    }
+    
+    int index = s_active_connection;
+    mb_connection_t *connection = &s_connections[index];
+    s_active_connection = -1;
+    connection->pending = false;
+    connection->frame_length = 0;
+    connection->last_activity_us = now_us;
+    if (s_response[MB_TCP_MBAP_LENGTH] & 0x80) {
+        connection->stats.exceptions++;
+    }
+    if (!send_response(index, s_response, s_response_length)) {
+        close_connection(index);
+        return;
+    }
+    uint32_t response_us = (uint32_t)(esp_timer_get_time() - connection->received_us);
+    connection->stats.last_response_us = response_us;
+    if (response_us > connection->stats.max_response_us) {
+        connection->stats.max_response_us = response_us;
+    }
+}
+
+
+/*
+ Leave the request being served unanswered, as the stack itself would on error. A late response would be
+ taken for the next request's, so the stack connection is started over
+*/
+static void abandon_active_request(void) {
+    s_connections[s_active_connection].pending = false;
+    s_connections[s_active_connection].frame_length = 0;
+    s_active_connection = -1;
+    backend_close();
+}
+
+
+static bool backend_connect(void) {
+    int backend_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (backend_socket < 0) {
+        return false;
+    }
+    struct sockaddr_in backend_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(s_backend_port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+    };
+    if (connect(backend_socket, (struct sockaddr *)&backend_addr, sizeof(backend_addr)) != 0) {
+        close(backend_socket);
+        return false;
+    }
+    // A stack no longer taking requests fails the send within the timeout, and is connected to again
+    int no_delay = 1;
+    struct timeval send_timeout = { .tv_sec = 0, .tv_usec = MB_FRONTEND_SEND_TIMEOUT_MS * 1000 };
+    setsockopt(backend_socket, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+    setsockopt(backend_socket, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+    s_backend_socket = backend_socket;
+    s_response_length = 0;
+    return true;
+}
+
+
+static void backend_close(void) {
+    if (s_backend_socket >= 0) {
+        close(s_backend_socket);
+        s_backend_socket = -1;
+    }
+}
+
+
+/*
+ Number of bytes still missing from a partially received Modbus TCP frame, flagging frames with invalid headers
+*/
+static size_t frame_missing_bytes(const uint8_t *frame, size_t length, bool *valid) {
+    *valid = true;
+    if (length < MB_TCP_MBAP_LENGTH) {
+        return MB_TCP_MBAP_LENGTH - length;
+    }
+    uint16_t protocol_id = ((uint16_t)frame[2] << 8) | frame[3];
+    size_t frame_length = 6 + (((size_t)frame[4] << 8) | frame[5]); //Length field counts unit ID and PDU
+    if (protocol_id != 0 || frame_length <= MB_TCP_MBAP_LENGTH || frame_length > MB_TCP_MAX_ADU_LENGTH) {
+        *valid = false;
+        return 0;
+    }
+    return frame_length - length;
+}
+
+
+static bool send_all(int target_socket, const uint8_t *data, size_t length) {
+    while (length > 0) {
+        int sent = send(target_socket, data, length, 0);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+
+/*
+ Send a response to a master without waiting. A response is far smaller than the send buffer of a connection, so
+ one that does not fit at once belongs to a master no longer reading its responses, and the caller drops it
+ rather than stall every other connection on it
+*/
+static bool send_response(int index, const uint8_t *data, size_t length) {
+    int sent = send(s_connections[index].socket, data, length, MSG_DONTWAIT);
+    if (sent != (int)length) {
+        ESP_LOGW(TAG, "Master " IPSTR " not taking its response, closing connection.",
+                 IP2STR((esp_ip4_addr_t *)&s_connections[index].stats.peer_ip));
+        return false;
+    }
+    return true;
+}
+
+
+static bool is_primary(uint32_t peer_ip) {
+    return s_sched_policy == ESP32_RIO_MB_SCHED_PRIORITY && peer_ip == s_primary_ip;
+}
@@ -0,0 +1,61 @@
+/*
+@file mb_frontend.h
+@brief Header for the Modbus TCP front-end component.
+
+This file defines the public interface for the front-end accepting Modbus TCP
+connections on behalf of the Modbus stack, which limits the number of concurrent
+masters, schedules their requests and keeps per-connection accounting.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#ifndef MB_FRONTEND_H
+#define MB_FRONTEND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define ESP32_RIO_MB_MAX_CONNECTIONS 5 //Connection slots (each master takes one lwIP socket, see CONFIG_LWIP_MAX_SOCKETS)
+#define ESP32_RIO_MB_DEFAULT_CONNECTIONS 3
+
+typedef enum {
+    ESP32_RIO_MB_SCHED_ROUND_ROBIN = 0, //Connections with pending requests served in turn
+    ESP32_RIO_MB_SCHED_PRIORITY = 1 //Primary master served first, others in turn
+} esp32_rio_mb_sched_policy_t;
+
+typedef struct {
+    uint32_t peer_ip; //IPv4 address, network byte order
+    uint16_t peer_port;
+    bool primary; //Peer is the primary master of the priority policy
+    uint32_t connected_s; //Time since connection
+    uint32_t requests;
+    uint32_t exceptions; //Exception responses
+    uint32_t timeouts; //Requests left unanswered by the stack
+    uint32_t max_wait_us; //Longest time a request was held behind other connections
+    uint32_t last_response_us; //Request received to response sent, wait included
+    uint32_t max_response_us;
+} esp32_rio_mb_conn_stats_t;
+
+typedef size_t (*mb_unit_request_cb_t)(uint8_t, const uint8_t *, size_t, uint8_t *); //Answers a request PDU for another unit, returning the response PDU length, or 0 to leave it to the stack
+
+esp_err_t esp32_rio_mb_frontend_start(uint16_t, uint16_t);
+esp_err_t esp32_rio_mb_frontend_stop(void);
+void esp32_rio_mb_set_unit_handler(uint8_t, mb_unit_request_cb_t);
+
+esp_err_t esp32_rio_set_mb_max_connections(unsigned int);
+unsigned int esp32_rio_get_mb_max_connections(void);
+esp_err_t esp32_rio_set_mb_sched_policy(esp32_rio_mb_sched_policy_t, uint32_t);
+esp32_rio_mb_sched_policy_t esp32_rio_get_mb_sched_policy(uint32_t *);
+size_t esp32_rio_get_mb_connections(esp32_rio_mb_conn_stats_t *, size_t);
+void esp32_rio_get_mb_connection_totals(uint32_t *, uint32_t *, uint32_t *);
+esp_err_t esp32_rio_mb_nv_params_load(void);
+esp_err_t esp32_rio_mb_nv_params_save(void);
+
+#endif //MB_FRONTEND_H
@@ -0,0 +1,501 @@
+/*
+@file mb_gateway.c
+@brief Implementation for the Modbus gateway component.
+
+This file implements a task answering I/O image requests of the gateways set to be
+answered over UDP, and, on a board acting as a gateway, polling the boards it serves
+unit IDs for and caching the images they report, for Modbus reads to be answered from.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+
+#include "mb_gateway.h"
+#include "config_store.h"
+
+_Static_assert(ESP32_RIO_GATEWAY_MAX_PEERS == ESP32_RIO_CONFIG_GATEWAY_MAX_PEERS, "Stored peers must match the peer table");
+_Static_assert(ESP32_RIO_GATEWAY_MAX_SERVED == ESP32_RIO_CONFIG_GATEWAY_MAX_SERVED, "Stored gateways must match the gateways answered");
+
+#define GATEWAY_TASK_CORE CONFIG_ESP32_RIO_AUX_CORE
+#define GATEWAY_TASK_PRIORITY CONFIG_ESP32_RIO_GATEWAY_TASK_PRIORITY
+#define GATEWAY_TASK_STACK_SIZE CONFIG_ESP32_RIO_GATEWAY_TASK_STACK_SIZE
+#define GATEWAY_PORT CONFIG_ESP32_RIO_GATEWAY_PORT
+#define GATEWAY_MESSAGE_SIZE (sizeof(esp32_rio_gateway_header_t) + sizeof(esp32_rio_gateway_image_t))
+#define GATEWAY_STOP_TIMEOUT_MS (ESP32_RIO_GATEWAY_POLL_MAX_MS + 1000) //Longest select wait, should the wake-up datagram be lost
+
+static void gateway_task(void *);
+static void receive_message(void);
+static void poll_peers(void);
+static int find_peer(uint8_t);
+static bool gateway_served(uint32_t);
+static void gateway_config_fill(esp32_rio_config_gateway_t *);
+
+static const char *TAG = "ESP32_RIO_GW";
+
+/*
+ Peers are polled all at once every poll period, and the image of each peer is replaced by every reply more
+ recent than the one it holds. The table is guarded by a spinlock, held only to copy entries in or out.
+ Image requests are answered only from the gateways set, kept under the same lock: none by default, so a
+ board does not hand out its I/O image, or reflect requests many times their size, to any sender.
+*/
+typedef struct {
+    uint8_t unit;
+    uint32_t peer_ip; //Network byte order
+    bool valid; //An image has been received
+    uint32_t sequence; //Of the poll the image answers
+    int64_t received_us;
+    esp32_rio_gateway_image_t image;
+    uint32_t polls;
+    uint32_t replies;
+    uint32_t requests;
+} gateway_peer_t;
+
+static portMUX_TYPE s_peers_lock = portMUX_INITIALIZER_UNLOCKED;
+static gateway_peer_t s_peers[ESP32_RIO_GATEWAY_MAX_PEERS];
+static size_t s_peer_count = 0;
+static volatile uint32_t s_poll_ms = ESP32_RIO_GATEWAY_POLL_DEFAULT_MS;
+static uint32_t s_gateway_ips[ESP32_RIO_GATEWAY_MAX_SERVED]; //Network byte order, 0 for none
+
+static uint8_t s_local_unit = 0;
+static gateway_image_read_cb_t s_image_read_callback = NULL;
+static int s_socket = -1;
+static TaskHandle_t s_task_handle = NULL;
+static volatile TaskHandle_t s_stop_waiter = NULL; //Task waiting for gateway_task to stop, which is asked to by setting it
+static uint32_t s_sequence = 0;
+static uint32_t s_served_count = 0; //Images sent to gateways
+static uint32_t s_refused_count = 0; //Image requests from senders not set as gateways
+static uint32_t s_error_count = 0; //Failed sends
+static uint8_t s_message[GATEWAY_MESSAGE_SIZE + 1]; //One spare byte, so longer datagrams are seen as such instead of cut short
+
+
+/*
+ Start answering image requests of the stored gateways on the inter-board port, and polling the stored peers.
+ The local unit is served by the Modbus stack and cannot be taken by a peer
+*/
+esp_err_t esp32_rio_gateway_start(uint8_t local_unit, gateway_image_read_cb_t image_read_cb) {
+    s_local_unit = local_unit;
+    s_image_read_callback = image_read_cb;
+    if (esp32_rio_gateway_nv_params_load() != ESP_OK) {
+        ESP_LOGI(TAG, "Using default gateway settings.");
+    }
+    
+    s_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    ESP_RETURN_ON_FALSE(s_socket >= 0, ESP_FAIL, TAG, "Failed to create UDP socket: errno %d", errno);
+    struct sockaddr_in bind_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(GATEWAY_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY)
+    };
+    if (bind(s_socket, (struct sockaddr *)&bind_addr, sizeof(bind_addr)) != 0) {
+        ESP_LOGE(TAG, "Failed to bind UDP port %d: errno %d", GATEWAY_PORT, errno);
+        close(s_socket);
+        s_socket = -1;
+        return ESP_FAIL;
+    }
+    
+    if (xTaskCreatePinnedToCore(gateway_task, "gateway_task", GATEWAY_TASK_STACK_SIZE, NULL,
+                                GATEWAY_TASK_PRIORITY, &s_task_handle, GATEWAY_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create gateway_task.");
+        close(s_socket);
+        s_socket = -1;
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Answering image requests on UDP port %d, serving %u peer units.", GATEWAY_PORT, (unsigned int)s_peer_count);
+    return ESP_OK;
+}
+
+
+/*
+ Stop answering and polling, once gateway_task is done with the socket. Nothing to do if not started
+*/
+esp_err_t esp32_rio_gateway_stop(void) {
+    if (s_task_handle == NULL) {
+        return ESP_OK;
+    }
+    s_stop_waiter = xTaskGetCurrentTaskHandle();
+    // Wake the task from select with a datagram to itself, dropped as not for us
+    struct sockaddr_in self_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(GATEWAY_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+    };
+    uint8_t wake = 0;
+    sendto(s_socket, &wake, sizeof(wake), 0, (struct sockaddr *)&self_addr, sizeof(self_addr));
+    ESP_RETURN_ON_FALSE(ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(GATEWAY_STOP_TIMEOUT_MS)) != 0, ESP_ERR_TIMEOUT, TAG, "gateway_task did not stop.");
+    s_task_handle = NULL;
+    s_stop_waiter = NULL;
+    close(s_socket);
+    s_socket = -1;
+    ESP_LOGI(TAG, "Gateway stopped.");
+    return ESP_OK;
+}
+
+
+/*
+ Retrieve the latest image of the peer served as a unit. Fails with ESP_ERR_NOT_FOUND for a unit not served,
+ and with ESP_ERR_TIMEOUT while the peer has not answered the latest polls
+*/
+esp_err_t esp32_rio_gateway_get_image(uint8_t unit, esp32_rio_gateway_image_t *image) {
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    int64_t stale_us = (int64_t)s_poll_ms * 1000 * ESP32_RIO_GATEWAY_STALE_POLLS;
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&s_peers_lock);
+    int index = find_peer(unit);
+    if (index >= 0) {
+        gateway_peer_t *peer = &s_peers[index];
+        if (peer->valid && now_us - peer->received_us <= stale_us) {
+            *image = peer->image;
+            peer->requests++;
+            err = ESP_OK;
+        } else {
+            err = ESP_ERR_TIMEOUT;
+        }
+    }
+    portEXIT_CRITICAL(&s_peers_lock);
+    return err;
+}
+
+
+/*
+ Serve a unit ID for the board at an IPv4 address (network byte order), replacing the address of a unit already
+ served. Address 0 stops serving the unit
+*/
+esp_err_t esp32_rio_set_gateway_peer(uint8_t unit, uint32_t peer_ip) {
+    if (unit == 0 || unit > 247 || unit == s_local_unit) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_OK;
+    portENTER_CRITICAL(&s_peers_lock);
+    int index = find_peer(unit);
+    if (peer_ip == 0) {
+        if (index < 0) {
+            err = ESP_ERR_NOT_FOUND;
+        } else {
+            s_peers[index] = s_peers[--s_peer_count];
+        }
+    } else {
+        if (index < 0 && s_peer_count < ESP32_RIO_GATEWAY_MAX_PEERS) {
+            index = (int)s_peer_count++;
+        }
+        if (index < 0) {
+            err = ESP_ERR_NO_MEM;
+        } else {
+            memset(&s_peers[index], 0, sizeof(s_peers[index]));
+            s_peers[index].unit = unit;
+            s_peers[index].peer_ip = peer_ip;
+        }
+    }
+    portEXIT_CRITICAL(&s_peers_lock);
+    return err;
+}
+
+
+/*
+ Set the period peers are polled at, in milliseconds
+*/
+esp_err_t esp32_rio_set_gateway_poll(uint32_t poll_ms) {
+    if (poll_ms < ESP32_RIO_GATEWAY_POLL_MIN_MS || poll_ms > ESP32_RIO_GATEWAY_POLL_MAX_MS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_poll_ms = poll_ms;
+    return ESP_OK;
+}
+
+
+uint32_t esp32_rio_get_gateway_poll(void) {
+    return s_poll_ms;
+}
+
+
+/*
+ Set the gateways image requests are answered from, as IPv4 addresses (network byte order), replacing those
+ set. No address stops answering
+*/
+esp_err_t esp32_rio_set_gateways_served(const uint32_t *gateway_ips, size_t count) {
+    if (count > ESP32_RIO_GATEWAY_MAX_SERVED) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (gateway_ips[i] == 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    portENTER_CRITICAL(&s_peers_lock);
+    for (size_t i = 0; i < ESP32_RIO_GATEWAY_MAX_SERVED; i++) {
+        s_gateway_ips[i] = (i < count) ? gateway_ips[i] : 0;
+    }
+    portEXIT_CRITICAL(&s_peers_lock);
+    return ESP_OK;
+}
+
+
+/*
+ Retrieve up to a given number of the gateways answered, returning how many were retrieved
+*/
+size_t esp32_rio_get_gateways_served(uint32_t *gateway_ips, size_t max_count) {
+    size_t count = 0;
+    portENTER_CRITICAL(&s_peers_lock);
+    for (size_t i = 0; i < ESP32_RIO_GATEWAY_MAX_SERVED && count < max_count; i++) {
+        if (s_gateway_ips[i] != 0) {
+            gateway_ips[count++] = s_gateway_ips[i];
+        }
+    }
+    portEXIT_CRITICAL(&s_peers_lock);
+    return count;
+}
+
+
+/*
+ Retrieve the statistics of up to a given number of peers, returning how many were retrieved
+*/
+size_t esp32_rio_get_gateway_peers(esp32_rio_gateway_peer_stats_t *stats, size_t max_count) {
+    size_t count = 0;
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&s_peers_lock);
+    for (; count < s_peer_count && count < max_count; count++) {
+        const gateway_peer_t *peer = &s_peers[count];
+        stats[count].unit = peer->unit;
+        stats[count].peer_ip = peer->peer_ip;
+        stats[count].polls = peer->polls;
+        stats[count].replies = peer->replies;
+        stats[count].requests = peer->requests;
+        stats[count].age_ms = peer->valid ? (uint32_t)((now_us - peer->received_us) / 1000) : UINT32_MAX;
+    }
+    portEXIT_CRITICAL(&s_peers_lock);
+    return count;
+}
+
+
+/*
+ Retrieve the number of images sent to gateways, of requests refused from other senders and of failed sends
+*/
+void esp32_rio_get_gateway_stats(uint32_t *served, uint32_t *refused, uint32_t *errors) {
+    *served = s_served_count;
+    *refused = s_refused_count;
+    *errors = s_error_count;
+}
+
+
+/*
+ Retrieve stored gateway settings. Settings never stored keep their defaults
+*/
+esp_err_t esp32_rio_gateway_nv_params_load(void) {
+    esp32_rio_config_gateway_t config;
+    
+    gateway_config_fill(&config); //Defaults, for any setting left out of the store
+    esp_err_t err = esp32_rio_config_read(ESP32_RIO_CONFIG_GATEWAY, &config, sizeof(config));
+    if (err != ESP_OK) {
+        ESP_LOGI(TAG, "No stored gateway settings: %s", esp_err_to_name(err));
+        return err;
+    }
+    
+    for (int i = 0; i < config.peer_count && i < ESP32_RIO_GATEWAY_MAX_PEERS; i++) {
+        if (config.peer_ips[i] == 0 || esp32_rio_set_gateway_peer(config.units[i], config.peer_ips[i]) != ESP_OK) {
+            ESP_LOGW(TAG, "Ignoring invalid stored peer %u.", config.units[i]);
+        }
+    }
+    if (esp32_rio_set_gateway_poll(config.poll_ms) != ESP_OK) {
+        ESP_LOGW(TAG, "Ignoring invalid stored poll period.");
+    }
+    size_t gateway_count = 0;
+    for (int i = 0; i < ESP32_RIO_GATEWAY_MAX_SERVED; i++) {
+        if (config.gateway_ips[i] != 0) {
+            config.gateway_ips[gateway_count++] = config.gateway_ips[i];
+        }
+    }
+    esp32_rio_set_gateways_served(config.gateway_ips, gateway_count);
+    
+    ESP_LOGI(TAG, "Gateway settings loaded.");
+    return ESP_OK;
+}
+
+
+/*
+ Store current gateway settings
+*/
+esp_err_t esp32_rio_gateway_nv_params_save(void) {
+    esp32_rio_config_gateway_t config;
+    
+    gateway_config_fill(&config);
+    esp_err_t err = esp32_rio_config_write(ESP32_RIO_CONFIG_GATEWAY, &config, sizeof(config));
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error storing gateway settings: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+
+static void gateway_task(void *arg) {
+    int64_t next_poll_us = esp_timer_get_time();
+    
+    while (s_stop_waiter == NULL) {
+        // Wait for a message, or for the next poll
+        int64_t wait_us = next_poll_us - esp_timer_get_time();
+        wait_us = wait_us > 0 ? wait_us : 0;
+        struct timeval timeout = { .tv_sec = wait_us / 1000000, .tv_usec = wait_us % 1000000 };
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(s_socket, &read_fds);
+        int ready = select(s_socket + 1, &read_fds, NULL, NULL, &timeout);
+        if (ready < 0) {
+            ESP_LOGE(TAG, "select failed: errno %d", errno);
+            vTaskDelay(pdMS_TO_TICKS(ESP32_RIO_GATEWAY_POLL_MIN_MS));
+        } else if (ready > 0) {
+            receive_message();
+        }
+        
+        int64_t now_us = esp_timer_get_time();
+        if (now_us >= next_poll_us) {
+            poll_peers();
+            next_poll_us += s_poll_ms * 1000LL;
+            if (next_poll_us <= now_us) {
+                next_poll_us = now_us + s_poll_ms * 1000LL; //Fell behind, skip the polls missed
+            }
+        }
+    }
+    xTaskNotifyGive(s_stop_waiter);
+    vTaskDelete(NULL);
+}
+
+
+/*
+ Answer an image request of a gateway set, or take in the image of a peer
+*/
+static void receive_message(void) {
+    struct sockaddr_in source_addr;
+    socklen_t addr_length = sizeof(source_addr);
+    int received = recvfrom(s_socket, s_message, sizeof(s_message), 0, (struct sockaddr *)&source_addr, &addr_length);
+    esp32_rio_gateway_header_t *header = (esp32_rio_gateway_header_t *)s_message;
+    if (received < (int)sizeof(*header) || header->magic[0] != ESP32_RIO_GATEWAY_MAGIC_0 ||
+        header->magic[1] != ESP32_RIO_GATEWAY_MAGIC_1 || header->version != ESP32_RIO_GATEWAY_VERSION) {
+        return; //Not for us
+    }
+    
+    if (header->type == ESP32_RIO_GATEWAY_MSG_IMAGE_REQUEST && received == (int)sizeof(*header)) {
+        if (!gateway_served(source_addr.sin_addr.s_addr)) {
+            s_refused_count++;
+            return;
+        }
+        esp32_rio_gateway_image_t *image = (esp32_rio_gateway_image_t *)(s_message + sizeof(*header));
+        memset(image, 0, sizeof(*image));
+        if (s_image_read_callback) {
+            s_image_read_callback(image);
+        }
+        header->type = ESP32_RIO_GATEWAY_MSG_IMAGE; //Sequence number echoed
+        if (sendto(s_socket, s_message, GATEWAY_MESSAGE_SIZE, MSG_DONTWAIT, (struct sockaddr *)&source_addr, addr_length) == (int)GATEWAY_MESSAGE_SIZE) {
+            s_served_count++;
+        } else {
+            s_error_count++;
+        }
+    } else if (header->type == ESP32_RIO_GATEWAY_MSG_IMAGE && received == (int)GATEWAY_MESSAGE_SIZE) {
+        int64_t now_us = esp_timer_get_time();
+        portENTER_CRITICAL(&s_peers_lock);
+        for (size_t i = 0; i < s_peer_count; i++) {
+            gateway_peer_t *peer = &s_peers[i];
+            // Replies overtaken by a later one are dropped
+            if (peer->peer_ip == source_addr.sin_addr.s_addr && (!peer->valid || (int32_t)(header->sequence - peer->sequence) > 0)) {
+                memcpy(&peer->image, s_message + sizeof(*header), sizeof(peer->image));
+                peer->valid = true;
+                peer->sequence = header->sequence;
+                peer->received_us = now_us;
+                peer->replies++;
+            }
+        }
+        portEXIT_CRITICAL(&s_peers_lock);
+    }
+}
+
+
+/*
+ Send an image request to every peer
+*/
+static void poll_peers(void) {
+    uint32_t peer_ips[ESP32_RIO_GATEWAY_MAX_PEERS];
+    size_t peer_count;
+    portENTER_CRITICAL(&s_peers_lock);
+    peer_count = s_peer_count;
+    for (size_t i = 0; i < peer_count; i++) {
+        peer_ips[i] = s_peers[i].peer_ip;
+        s_peers[i].polls++;
+    }
+    portEXIT_CRITICAL(&s_peers_lock);
+    if (peer_count == 0) {
+        return;
+    }
+    
+    esp32_rio_gateway_header_t request = {
+        .magic = { ESP32_RIO_GATEWAY_MAGIC_0, ESP32_RIO_GATEWAY_MAGIC_1 },
+        .version = ESP32_RIO_GATEWAY_VERSION,
+        .type = ESP32_RIO_GATEWAY_MSG_IMAGE_REQUEST,
+        .sequence = ++s_sequence
+    };
+    struct sockaddr_in peer_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(GATEWAY_PORT)
+    };
+    for (size_t i = 0; i < peer_count; i++) {
+        peer_addr.sin_addr.s_addr = peer_ips[i];
+        if (sendto(s_socket, &request, sizeof(request), 0, (struct sockaddr *)&peer_addr, sizeof(peer_addr)) != (int)sizeof(request)) {
+            s_error_count++;
+        }
+    }
+}
+
+
+/*
+ Index of the peer served as a unit, -1 if none. Called with the peer table lock held
+*/
+static int find_peer(uint8_t unit) {
+    for (size_t i = 0; i < s_peer_count; i++) {
+        if (s_peers[i].unit == unit) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+
+/*
+ Current gateway settings, as stored
+*/
+static void gateway_config_fill(esp32_rio_config_gateway_t *config) {
+    memset(config, 0, sizeof(*config));
+    portENTER_CRITICAL(&s_peers_lock);
+    config->peer_count = (uint8_t)s_peer_count;
+    for (size_t i = 0; i < s_peer_count; i++) {
+        config->units[i] = s_peers[i].unit;
+        config->peer_ips[i] = s_peers[i].peer_ip;
+    }
+    memcpy(config->gateway_ips, s_gateway_ips, sizeof(config->gateway_ips));
+    portEXIT_CRITICAL(&s_peers_lock);
+    config->poll_ms = s_poll_ms;
+}
+
+
+/*
+ Whether image requests from an IPv4 address (network byte order) are answered
+*/
+static bool gateway_served(uint32_t source_ip) {
+    bool served = false;
+    portENTER_CRITICAL(&s_peers_lock);
+    for (size_t i = 0; i < ESP32_RIO_GATEWAY_MAX_SERVED; i++) {
+        served = served || (source_ip != 0 && s_gateway_ips[i] == source_ip);
+    }
+    portEXIT_CRITICAL(&s_peers_lock);
+    return served;
+}
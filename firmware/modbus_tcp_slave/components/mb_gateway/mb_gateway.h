@@ -0,0 +1,87 @@
+/*
+@file mb_gateway.h
+@brief Header for the Modbus gateway component.
+
+This file defines the public interface for serving further Modbus unit IDs on behalf
+of other boards, from I/O images they report over UDP, along with the inter-board
+message format and the gateway settings.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#ifndef MB_GATEWAY_H
+#define MB_GATEWAY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define ESP32_RIO_GATEWAY_MAX_PEERS 20 //Stored peer addresses fit a single console setting
+#define ESP32_RIO_GATEWAY_MAX_SERVED 2 //Gateways this board answers image requests from
+#define ESP32_RIO_GATEWAY_MAX_DI 16 //Largest board supported, see remote_io.h
+#define ESP32_RIO_GATEWAY_POLL_MIN_MS 10
+#define ESP32_RIO_GATEWAY_POLL_MAX_MS 10000
+#define ESP32_RIO_GATEWAY_POLL_DEFAULT_MS 100
+#define ESP32_RIO_GATEWAY_STALE_POLLS 3 //Polls left unanswered before an image is no longer served
+
+#define ESP32_RIO_GATEWAY_MAGIC_0 'R'
+#define ESP32_RIO_GATEWAY_MAGIC_1 'G'
+#define ESP32_RIO_GATEWAY_VERSION 1
+
+typedef enum {
+    ESP32_RIO_GATEWAY_MSG_IMAGE_REQUEST = 0, //Header only, from a gateway
+    ESP32_RIO_GATEWAY_MSG_IMAGE = 1 //Header followed by the I/O image, echoing the request sequence number
+} esp32_rio_gateway_msg_type_t;
+
+/*
+ Message layout, little-endian
+*/
+typedef struct __attribute__((packed)) {
+    uint8_t magic[2];
+    uint8_t version;
+    uint8_t type; //esp32_rio_gateway_msg_type_t
+    uint32_t sequence; //Counts the polls of a gateway
+} esp32_rio_gateway_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t coils[3]; //Coil image from coil 0, bit n of word w holding coil 16w + n
+    uint16_t discrete_inputs; //Bit n = DIn
+    uint16_t io_image[4]; //Packed I/O image: coils bank 0, coils bank 1, discrete inputs, status word
+    uint8_t coil_count; //Coil addresses of the board, Output Enable included
+    uint8_t di_count;
+    uint32_t counts[ESP32_RIO_GATEWAY_MAX_DI];
+    uint32_t rates_mhz[ESP32_RIO_GATEWAY_MAX_DI];
+} esp32_rio_gateway_image_t;
+
+typedef struct {
+    uint8_t unit; //Modbus unit ID served for the peer
+    uint32_t peer_ip; //IPv4 address, network byte order
+    uint32_t polls;
+    uint32_t replies;
+    uint32_t requests; //Modbus requests answered from its image
+    uint32_t age_ms; //Since its last image, UINT32_MAX if none yet
+} esp32_rio_gateway_peer_stats_t;
+
+typedef void (*gateway_image_read_cb_t)(esp32_rio_gateway_image_t *); //Fills in the I/O image of this board
+
+esp_err_t esp32_rio_gateway_start(uint8_t, gateway_image_read_cb_t);
+esp_err_t esp32_rio_gateway_stop(void);
+esp_err_t esp32_rio_gateway_get_image(uint8_t, esp32_rio_gateway_image_t *);
+
+esp_err_t esp32_rio_set_gateway_peer(uint8_t, uint32_t);
+esp_err_t esp32_rio_set_gateway_poll(uint32_t);
+uint32_t esp32_rio_get_gateway_poll(void);
+esp_err_t esp32_rio_set_gateways_served(const uint32_t *, size_t);
+size_t esp32_rio_get_gateways_served(uint32_t *, size_t);
+size_t esp32_rio_get_gateway_peers(esp32_rio_gateway_peer_stats_t *, size_t);
+void esp32_rio_get_gateway_stats(uint32_t *, uint32_t *, uint32_t *);
+esp_err_t esp32_rio_gateway_nv_params_load(void);
+esp_err_t esp32_rio_gateway_nv_params_save(void);
+esp_err_t esp32_rio_gateway_console_register(void);
+
+#endif //MB_GATEWAY_H
@@ -0,0 +1,127 @@
+/*
+@file mb_gateway_console.c
+@brief Console command of the Modbus gateway component.
+
+This file implements the gateway console command, which lists the boards served
+through this one and sets the units served for them, their poll period and the
+gateways this board answers.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "esp_netif.h"
+
+#include "mb_gateway.h"
+#include "usb_console.h"
+
+#define GATEWAY_CONSOLE_OUTPUT_LENGTH 160
+
+static void cmd_gateway(int, char **);
+
+static const esp32_rio_console_cmd_t s_gateway_cmd = {
+    "gateway", "[add UNIT IP|remove UNIT|poll MILLISECONDS|serve IP [IP]|serve off]",
+    "Show the boards served through this one, or set and store the unit served for a board, their poll period or the gateways this board answers.", cmd_gateway
+};
+
+
+/*
+ Add the gateway command to the console. Must run before the console starts
+*/
+esp_err_t esp32_rio_gateway_console_register(void) {
+    return esp32_rio_console_register_command(&s_gateway_cmd);
+}
+
+
+static void cmd_gateway(int arg_count, char **args) {
+    char output_buf[GATEWAY_CONSOLE_OUTPUT_LENGTH];
+    uint32_t value;
+    esp_err_t err;
+    if (arg_count == 0) {
+        esp32_rio_gateway_peer_stats_t peers[ESP32_RIO_GATEWAY_MAX_PEERS];
+        uint32_t gateway_ips[ESP32_RIO_GATEWAY_MAX_SERVED];
+        uint32_t served, refused, errors;
+        size_t count = esp32_rio_get_gateway_peers(peers, ESP32_RIO_GATEWAY_MAX_PEERS);
+        size_t gateway_count = esp32_rio_get_gateways_served(gateway_ips, ESP32_RIO_GATEWAY_MAX_SERVED);
+        esp32_rio_get_gateway_stats(&served, &refused, &errors);
+        snprintf(output_buf, sizeof(output_buf), "\n[gateway] %u peer units, polled every %" PRIu32 " ms\n",
+                 (unsigned int)count, esp32_rio_get_gateway_poll());
+        esp32_rio_console_write_str(output_buf);
+        if (gateway_count == 0) {
+            esp32_rio_console_write_str("  Answering no gateway\n");
+        } else {
+            esp32_rio_console_write_str("  Answering gateways:");
+            for (size_t i = 0; i < gateway_count; i++) {
+                snprintf(output_buf, sizeof(output_buf), " " IPSTR, IP2STR((esp_ip4_addr_t *)&gateway_ips[i]));
+                esp32_rio_console_write_str(output_buf);
+            }
+            esp32_rio_console_write_str("\n");
+        }
+        snprintf(output_buf, sizeof(output_buf), "  Images sent to gateways: %" PRIu32 ", requests refused: %" PRIu32 ", failed sends: %" PRIu32 "\n",
+                 served, refused, errors);
+        esp32_rio_console_write_str(output_buf);
+        for (size_t i = 0; i < count; i++) {
+            const esp32_rio_gateway_peer_stats_t *peer = &peers[i];
+            char age[16];
+            if (peer->age_ms == UINT32_MAX) {
+                snprintf(age, sizeof(age), "none");
+            } else {
+                snprintf(age, sizeof(age), "%" PRIu32 " ms", peer->age_ms);
+            }
+            snprintf(output_buf, sizeof(output_buf), "  Unit %3u " IPSTR ": last image %s, %" PRIu32 " of %" PRIu32 " polls answered, %" PRIu32 " requests\n",
+                     peer->unit, IP2STR((esp_ip4_addr_t *)&peer->peer_ip), age, peer->replies, peer->polls, peer->requests);
+            esp32_rio_console_write_str(output_buf);
+        }
+        return;
+    }
+    
+    if (arg_count == 3 && strcmp(args[0], "add") == 0) {
+        esp_ip4_addr_t peer_ip;
+        if (!esp32_rio_console_parse_uint(args[1], UINT8_MAX, &value) || esp_netif_str_to_ip4(args[2], &peer_ip) != ESP_OK || peer_ip.addr == 0) {
+            err = ESP_ERR_INVALID_ARG;
+        } else {
+            err = esp32_rio_set_gateway_peer((uint8_t)value, peer_ip.addr);
+        }
+    } else if (arg_count == 2 && strcmp(args[0], "remove") == 0) {
+        err = esp32_rio_console_parse_uint(args[1], UINT8_MAX, &value) ? esp32_rio_set_gateway_peer((uint8_t)value, 0) : ESP_ERR_INVALID_ARG;
+    } else if (arg_count == 2 && strcmp(args[0], "poll") == 0) {
+        err = esp32_rio_console_parse_uint(args[1], UINT32_MAX, &value) ? esp32_rio_set_gateway_poll(value) : ESP_ERR_INVALID_ARG;
+    } else if (arg_count == 2 && strcmp(args[0], "serve") == 0 && strcmp(args[1], "off") == 0) {
+        err = esp32_rio_set_gateways_served(NULL, 0);
+    } else if (arg_count >= 2 && arg_count <= 1 + ESP32_RIO_GATEWAY_MAX_SERVED && strcmp(args[0], "serve") == 0) {
+        uint32_t gateway_ips[ESP32_RIO_GATEWAY_MAX_SERVED];
+        err = ESP_OK;
+        for (int i = 1; i < arg_count && err == ESP_OK; i++) {
+            esp_ip4_addr_t gateway_ip;
+            err = (esp_netif_str_to_ip4(args[i], &gateway_ip) == ESP_OK && gateway_ip.addr != 0) ? ESP_OK : ESP_ERR_INVALID_ARG;
+            gateway_ips[i - 1] = gateway_ip.addr;
+        }
+        if (err == ESP_OK) {
+            err = esp32_rio_set_gateways_served(gateway_ips, (size_t)(arg_count - 1));
+        }
+    } else {
+        esp32_rio_console_write_str("\n[gateway] Error: Command takes no argument, add UNIT IP, remove UNIT, poll MILLISECONDS, serve IP [IP] or serve off. See help.\n");
+        return;
+    }
+    
+    if (err == ESP_ERR_NO_MEM) {
+        snprintf(output_buf, sizeof(output_buf), "\n[gateway] Error: All %d peer units taken.\n", ESP32_RIO_GATEWAY_MAX_PEERS);
+    } else if (err == ESP_ERR_NOT_FOUND) {
+        snprintf(output_buf, sizeof(output_buf), "\n[gateway] Error: Unit not served.\n");
+    } else if (err != ESP_OK) {
+        snprintf(output_buf, sizeof(output_buf), "\n[gateway] Error: Invalid unit (1-247, not this board's), address or poll period (%d-%d ms).\n",
+                 ESP32_RIO_GATEWAY_POLL_MIN_MS, ESP32_RIO_GATEWAY_POLL_MAX_MS);
+    } else if (esp32_rio_gateway_nv_params_save() == ESP_OK) {
+        snprintf(output_buf, sizeof(output_buf), "\n[gateway] Gateway settings applied and saved.\n");
+    } else {
+        snprintf(output_buf, sizeof(output_buf), "\n[gateway] Error: Settings applied but could not be stored.\n");
+    }
+    esp32_rio_console_write_str(output_buf);
+}
@@ -0,0 +1,144 @@
+/*
+@file power_mgmt.c
+@brief Implementation for the power management component.
+
+This file configures ESP-IDF power management for the power profile selected in
+menuconfig, and wraps the power management locks of the active paths so that they
+cost nothing under the performance profile.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_pm.h"
+
+#include "power_mgmt.h"
+
+#if CONFIG_ESP32_RIO_POWER_PROFILE_PERFORMANCE
+#define POWER_PROFILE_NAME "performance"
+#define POWER_LOCKS_USED 0 //Nothing ever scales down
+#elif CONFIG_ESP32_RIO_POWER_PROFILE_BALANCED
+#define POWER_PROFILE_NAME "balanced"
+#define POWER_LOCKS_USED 1
+#else
+#define POWER_PROFILE_NAME "low power"
+#define POWER_LOCKS_USED 1
+#endif
+
+#if CONFIG_ESP32_RIO_POWER_LIGHT_SLEEP
+#define POWER_LIGHT_SLEEP true
+#else
+#define POWER_LIGHT_SLEEP false
+#endif
+
+static const char *TAG = "ESP32_RIO_POWER";
+
+static const struct {
+    const char *name;
+    esp_pm_lock_type_t lock_type;
+} s_paths[ESP32_RIO_POWER_NUM_PATHS] = { //Indexed by esp32_rio_power_path_t
+    { "modbus", ESP_PM_CPU_FREQ_MAX },
+    { "io", ESP_PM_CPU_FREQ_MAX },
+    { "console", ESP_PM_CPU_FREQ_MAX },
+    { "counters", ESP_PM_NO_LIGHT_SLEEP },
+    { "pwm", ESP_PM_APB_FREQ_MAX } //LEDC timers run from the APB clock
+};
+
+static atomic_uint s_acquisitions[ESP32_RIO_POWER_NUM_PATHS];
+static atomic_uint s_holders[ESP32_RIO_POWER_NUM_PATHS];
+
+#if POWER_LOCKS_USED
+static esp_pm_lock_handle_t s_locks[ESP32_RIO_POWER_NUM_PATHS];
+#endif
+
+
+/*
+ Apply the power profile and create the locks of the active paths. Must run before any path acquires its lock
+*/
+esp_err_t esp32_rio_power_init(void) {
+#if POWER_LOCKS_USED
+    for (int i = 0; i < ESP32_RIO_POWER_NUM_PATHS; i++) {
+        ESP_RETURN_ON_ERROR(esp_pm_lock_create(s_paths[i].lock_type, 0, s_paths[i].name, &s_locks[i]),
+                            TAG,
+                            "esp_pm_lock_create fail.");
+    }
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_ESP32_RIO_POWER_MIN_CPU_MHZ,
+        .light_sleep_enable = POWER_LIGHT_SLEEP
+    };
+    ESP_RETURN_ON_ERROR(esp_pm_configure(&pm_config),
+                        TAG,
+                        "esp_pm_configure fail.");
+    ESP_LOGI(TAG, "Power profile %s: CPU %d-%d MHz, light sleep %s.", POWER_PROFILE_NAME,
+             pm_config.min_freq_mhz, pm_config.max_freq_mhz, pm_config.light_sleep_enable ? "on" : "off");
+#else
+    ESP_LOGI(TAG, "Power profile %s.", POWER_PROFILE_NAME);
+#endif
+    return ESP_OK;
+}
+
+
+/*
+ Take the lock of a path before it starts working. Paths may be acquired again before being released, as
+ many times as they are released
+*/
+void esp32_rio_power_acquire(esp32_rio_power_path_t path) {
+    atomic_fetch_add(&s_acquisitions[path], 1);
+    atomic_fetch_add(&s_holders[path], 1);
+#if POWER_LOCKS_USED
+    if (s_locks[path] != NULL) {
+        esp_pm_lock_acquire(s_locks[path]);
+    }
+#endif
+}
+
+
+/*
+ Give back the lock of a path once it is done working
+*/
+void esp32_rio_power_release(esp32_rio_power_path_t path) {
+#if POWER_LOCKS_USED
+    if (s_locks[path] != NULL) {
+        esp_pm_lock_release(s_locks[path]);
+    }
+#endif
+    atomic_fetch_sub(&s_holders[path], 1);
+}
+
+
+/*
+ Name of the power profile built in
+*/
+const char *esp32_rio_power_profile_name(void) {
+    return POWER_PROFILE_NAME;
+}
+
+
+/*
+ Name of a path, as shown by the console
+*/
+const char *esp32_rio_power_path_name(esp32_rio_power_path_t path) {
+    return path < ESP32_RIO_POWER_NUM_PATHS ? s_paths[path].name : "?";
+}
+
+
+/*
+ Retrieve, for every path, lock acquisitions since boot and holders at present (arrays of
+ ESP32_RIO_POWER_NUM_PATHS entries)
+*/
+void esp32_rio_power_get_stats(uint32_t *acquisitions, uint32_t *holders) {
+    for (int i = 0; i < ESP32_RIO_POWER_NUM_PATHS; i++) {
+        acquisitions[i] = atomic_load(&s_acquisitions[i]);
+        holders[i] = atomic_load(&s_holders[i]);
+    }
+}
@@ -0,0 +1,41 @@
+/*
+@file power_mgmt.h
+@brief Header for the power management component.
+
+This file defines the public interface for the power profile of the firmware: the
+ESP-IDF power management configuration it selects, and the locks the active paths
+hold to run at full CPU speed, or to keep the chip out of light sleep.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#ifndef POWER_MGMT_H
+#define POWER_MGMT_H
+
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+typedef enum {
+    ESP32_RIO_POWER_PATH_MODBUS = 0, //Modbus requests being served, full CPU speed
+    ESP32_RIO_POWER_PATH_IO, //I/O events being processed, full CPU speed
+    ESP32_RIO_POWER_PATH_CONSOLE, //Console commands being run, full CPU speed
+    ESP32_RIO_POWER_PATH_COUNTERS, //Inputs in counter mode, no light sleep
+    ESP32_RIO_POWER_PATH_PWM, //PWM outputs running, APB clock kept steady and no light sleep
+    ESP32_RIO_POWER_NUM_PATHS
+} esp32_rio_power_path_t;
+
+esp_err_t esp32_rio_power_init(void);
+void esp32_rio_power_acquire(esp32_rio_power_path_t);
+void esp32_rio_power_release(esp32_rio_power_path_t);
+const char *esp32_rio_power_profile_name(void);
+const char *esp32_rio_power_path_name(esp32_rio_power_path_t);
+void esp32_rio_power_get_stats(uint32_t *, uint32_t *);
+esp_err_t esp32_rio_power_console_register(void);
+
+#endif //POWER_MGMT_H
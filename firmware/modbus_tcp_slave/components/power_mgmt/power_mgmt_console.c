@@ -0,0 +1,75 @@
+/*
+@file power_mgmt_console.c
+@brief Console command of the power management component.
+
+This file implements the power console command, which shows the power profile, the
+WiFi power save mode and the power management locks taken by each path.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "sdkconfig.h"
+#include "esp_wifi.h"
+
+#include "power_mgmt.h"
+#include "usb_console.h"
+
+#define POWER_CONSOLE_OUTPUT_LENGTH 160
+
+static void cmd_power(int, char **);
+
+static const char *s_wifi_ps_names[] = { "off", "minimum modem (every DTIM)", "maximum modem (every listen interval)" }; //Indexed by wifi_ps_type_t
+
+static const esp32_rio_console_cmd_t s_power_cmd = {
+    "power", "",
+    "Show the power profile and the power management locks taken by each active path.", cmd_power
+};
+
+
+/*
+ Add the power command to the console. Must run before the console starts
+*/
+esp_err_t esp32_rio_power_console_register(void) {
+    return esp32_rio_console_register_command(&s_power_cmd);
+}
+
+
+static void cmd_power(int arg_count, char **args) {
+    char output_buf[POWER_CONSOLE_OUTPUT_LENGTH];
+    if (arg_count != 0) {
+        esp32_rio_console_write_str("\n[power] Error: Command takes no arguments. See help.\n");
+        return;
+    }
+    wifi_ps_type_t ps_type = WIFI_PS_NONE;
+    esp_wifi_get_ps(&ps_type);
+#if CONFIG_ESP32_RIO_POWER_PROFILE_PERFORMANCE
+    int min_cpu_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+#else
+    int min_cpu_mhz = CONFIG_ESP32_RIO_POWER_MIN_CPU_MHZ;
+#endif
+#if CONFIG_ESP32_RIO_POWER_LIGHT_SLEEP
+    const char *light_sleep = "on";
+#else
+    const char *light_sleep = "off";
+#endif
+    snprintf(output_buf, sizeof(output_buf), "\n[power] Profile: %s, CPU %d-%d MHz, light sleep %s\n",
+             esp32_rio_power_profile_name(), min_cpu_mhz, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ, light_sleep);
+    esp32_rio_console_write_str(output_buf);
+    snprintf(output_buf, sizeof(output_buf), "  WiFi power save: %s\n",
+             (ps_type <= WIFI_PS_MAX_MODEM) ? s_wifi_ps_names[ps_type] : "?");
+    esp32_rio_console_write_str(output_buf);
+    uint32_t acquisitions[ESP32_RIO_POWER_NUM_PATHS], holders[ESP32_RIO_POWER_NUM_PATHS];
+    esp32_rio_power_get_stats(acquisitions, holders);
+    for (int i = 0; i < ESP32_RIO_POWER_NUM_PATHS; i++) {
+        snprintf(output_buf, sizeof(output_buf), "  %-8s acquisitions: %" PRIu32 ", held: %s\n",
+                 esp32_rio_power_path_name(i), acquisitions[i], holders[i] ? "yes" : "no");
+        esp32_rio_console_write_str(output_buf);
+    }
+}
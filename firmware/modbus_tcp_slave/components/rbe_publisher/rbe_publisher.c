@@ -0,0 +1,413 @@
+/*
+@file rbe_publisher.c
+@brief Implementation for the report-by-exception publisher component.
+
+This file implements a task pushing digital input changes to a configured UDP
+endpoint or MQTT topic. Changes are timestamped as they are reported, queued, and
+coalesced into a single message over a short interval. A heartbeat carrying the
+current input levels is sent periodically, so a subscriber can verify its image.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+#include "mqtt_client.h"
+
+#include "rbe_publisher.h"
+#include "config_store.h"
+
+_Static_assert(ESP32_RIO_RBE_TARGET_MAX_LENGTH == ESP32_RIO_CONFIG_RBE_TARGET_MAX_LENGTH, "Stored target must fit any valid target");
+
+#define RBE_TASK_CORE CONFIG_ESP32_RIO_AUX_CORE
+#define RBE_TASK_PRIORITY CONFIG_ESP32_RIO_RBE_TASK_PRIORITY
+#define RBE_TASK_STACK_SIZE CONFIG_ESP32_RIO_RBE_TASK_STACK_SIZE
+#define RBE_QUEUE_LENGTH 64 //Changes buffered while a message is being sent
+#define RBE_POLL_MS 1000 //Upper bound on waits, for settings changes to take effect
+#define RBE_MQTT_DEFAULT_PORT 1883
+
+static void rbe_task(void *);
+static bool parse_target(const char *, bool *, char *, uint16_t *, char *);
+static void transport_open(void);
+static void transport_close(void);
+static void send_message(esp32_rio_rbe_msg_type_t, int64_t, const esp32_rio_rbe_record_t *, uint16_t, uint16_t);
+static void rbe_config_fill(esp32_rio_config_rbe_t *);
+
+static const char *TAG = "ESP32_RIO_RBE";
+
+typedef struct {
+    int64_t timestamp_us;
+    uint16_t levels;
+} rbe_change_t;
+
+static QueueHandle_t s_change_queue = NULL;
+static volatile bool s_publishing = false; //Transport open, changes are queued
+static volatile uint16_t s_levels = 0; //Latest levels reported
+static atomic_uint s_dropped_count = 0;
+static uint32_t s_sequence = 0;
+static uint32_t s_message_count = 0;
+static uint32_t s_record_count = 0;
+static uint32_t s_error_count = 0;
+
+static portMUX_TYPE s_target_lock = portMUX_INITIALIZER_UNLOCKED;
+static char s_target[ESP32_RIO_RBE_TARGET_MAX_LENGTH + 1] = ""; //Empty when disabled
+static volatile bool s_target_changed = true;
+static volatile uint32_t s_coalesce_ms = ESP32_RIO_RBE_COALESCE_DEFAULT_MS;
+static volatile uint32_t s_heartbeat_s = ESP32_RIO_RBE_HEARTBEAT_DEFAULT_S;
+
+static int s_udp_socket = -1;
+static struct sockaddr_in s_udp_addr;
+static esp_mqtt_client_handle_t s_mqtt_client = NULL;
+static char s_mqtt_topic[ESP32_RIO_RBE_TARGET_MAX_LENGTH + 1];
+
+static uint8_t s_message[sizeof(esp32_rio_rbe_header_t) + ESP32_RIO_RBE_MAX_RECORDS * sizeof(esp32_rio_rbe_record_t)];
+
+
+/*
+ Start the publisher task, with the stored settings. Nothing is sent until a target is configured
+*/
+esp_err_t esp32_rio_rbe_start(void) {
+    if (esp32_rio_rbe_nv_params_load() != ESP_OK) {
+        ESP_LOGI(TAG, "Using default publisher settings.");
+    }
+    s_change_queue = xQueueCreate(RBE_QUEUE_LENGTH, sizeof(rbe_change_t));
+    if (s_change_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to create change queue.");
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreatePinnedToCore(rbe_task, "rbe_task", RBE_TASK_STACK_SIZE, NULL, RBE_TASK_PRIORITY, NULL, RBE_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create rbe_task.");
+        vQueueDelete(s_change_queue);
+        s_change_queue = NULL;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+
+/*
+ Report the levels of all digital inputs (bit n = DIn) after a change. Never blocks
+*/
+void esp32_rio_rbe_publish_levels(uint16_t levels) {
+    s_levels = levels;
+    if (!s_publishing) {
+        return;
+    }
+    rbe_change_t change = { .timestamp_us = esp_timer_get_time(), .levels = levels };
+    if (xQueueSend(s_change_queue, &change, 0) != pdTRUE) {
+        atomic_fetch_add_explicit(&s_dropped_count, 1, memory_order_relaxed);
+    }
+}
+
+
+/*
+ Set the subscriber (udp://HOST:PORT or mqtt://HOST[:PORT]/TOPIC), or disable publishing with an empty target
+*/
+esp_err_t esp32_rio_set_rbe_target(const char *target) {
+    bool mqtt;
+    char host[ESP32_RIO_RBE_TARGET_MAX_LENGTH + 1];
+    char topic[ESP32_RIO_RBE_TARGET_MAX_LENGTH + 1];
+    uint16_t port;
+    if (target[0] != '\0' && !parse_target(target, &mqtt, host, &port, topic)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&s_target_lock);
+    strcpy(s_target, target);
+    s_target_changed = true;
+    portEXIT_CRITICAL(&s_target_lock);
+    return ESP_OK;
+}
+
+
+void esp32_rio_get_rbe_target(char *target, size_t size) {
+    portENTER_CRITICAL(&s_target_lock);
+    snprintf(target, size, "%s", s_target);
+    portEXIT_CRITICAL(&s_target_lock);
+}
+
+
+/*
+ Set the change coalescing interval (ms, 0 sends every change at once) and the heartbeat period (s)
+*/
+esp_err_t esp32_rio_set_rbe_timing(uint32_t coalesce_ms, uint32_t heartbeat_s) {
+    if (coalesce_ms > ESP32_RIO_RBE_COALESCE_MAX_MS ||
+        heartbeat_s < ESP32_RIO_RBE_HEARTBEAT_MIN_S || heartbeat_s > ESP32_RIO_RBE_HEARTBEAT_MAX_S) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_coalesce_ms = coalesce_ms;
+    s_heartbeat_s = heartbeat_s;
+    return ESP_OK;
+}
+
+
+void esp32_rio_get_rbe_timing(uint32_t *coalesce_ms, uint32_t *heartbeat_s) {
+    *coalesce_ms = s_coalesce_ms;
+    *heartbeat_s = s_heartbeat_s;
+}
+
+
+/*
+ Retrieve the number of messages sent, change records sent, change records dropped and failed sends
+*/
+void esp32_rio_get_rbe_stats(uint32_t *messages, uint32_t *records, uint32_t *dropped, uint32_t *errors) {
+    *messages = s_message_count;
+    *records = s_record_count;
+    *dropped = atomic_load_explicit(&s_dropped_count, memory_order_relaxed);
+    *errors = s_error_count;
+}
+
+
+/*
+ Retrieve stored publisher settings. Settings never stored keep their defaults
+*/
+esp_err_t esp32_rio_rbe_nv_params_load(void) {
+    esp32_rio_config_rbe_t config;
+    
+    rbe_config_fill(&config); //Defaults, for any setting left out of the store
+    esp_err_t err = esp32_rio_config_read(ESP32_RIO_CONFIG_RBE, &config, sizeof(config));
+    if (err != ESP_OK) {
+        ESP_LOGI(TAG, "No stored publisher settings: %s", esp_err_to_name(err));
+        return err;
+    }
+    
+    config.target[sizeof(config.target) - 1] = '\0';
+    if (esp32_rio_set_rbe_target(config.target) != ESP_OK) {
+        ESP_LOGW(TAG, "Ignoring invalid stored target.");
+    }
+    if (esp32_rio_set_rbe_timing(config.coalesce_ms, config.heartbeat_s) != ESP_OK) {
+        ESP_LOGW(TAG, "Ignoring invalid stored timing.");
+    }
+    
+    ESP_LOGI(TAG, "Publisher settings loaded.");
+    return ESP_OK;
+}
+
+
+/*
+ Store current publisher settings
+*/
+esp_err_t esp32_rio_rbe_nv_params_save(void) {
+    esp32_rio_config_rbe_t config;
+    
+    rbe_config_fill(&config);
+    esp_err_t err = esp32_rio_config_write(ESP32_RIO_CONFIG_RBE, &config, sizeof(config));
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error storing publisher settings: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+
+/*
+ Current publisher settings, as stored
+*/
+static void rbe_config_fill(esp32_rio_config_rbe_t *config) {
+    memset(config, 0, sizeof(*config));
+    esp32_rio_get_rbe_target(config->target, sizeof(config->target));
+    config->coalesce_ms = s_coalesce_ms;
+    config->heartbeat_s = s_heartbeat_s;
+}
+
+
+static void rbe_task(void *arg) {
+    esp32_rio_rbe_record_t records[ESP32_RIO_RBE_MAX_RECORDS];
+    rbe_change_t change;
+    int64_t next_heartbeat_us = 0;
+    
+    while (1) {
+        if (s_target_changed) {
+            s_target_changed = false;
+            transport_close();
+            transport_open();
+            next_heartbeat_us = esp_timer_get_time(); //Announce the current levels right away
+        }
+        
+        // Wait for the first change of a message, or for the next heartbeat
+        int64_t wait_us = next_heartbeat_us - esp_timer_get_time();
+        TickType_t wait_ticks = 0;
+        if (wait_us > 0) {
+            wait_ticks = pdMS_TO_TICKS(wait_us < RBE_POLL_MS * 1000LL ? (wait_us + 999) / 1000 : RBE_POLL_MS);
+            wait_ticks = wait_ticks > 0 ? wait_ticks : 1;
+        }
+        if (xQueueReceive(s_change_queue, &change, wait_ticks) == pdTRUE) {
+            // Gather further changes until the coalescing interval from the first one is over
+            int64_t base_us = change.timestamp_us;
+            int64_t deadline_us = base_us + s_coalesce_ms * 1000LL;
+            uint16_t count = 0;
+            do {
+                records[count].offset_us = (uint32_t)(change.timestamp_us - base_us);
+                records[count].levels = change.levels;
+                count++;
+                int64_t remaining_us = deadline_us - esp_timer_get_time();
+                wait_ticks = remaining_us <= 0 ? 0 : pdMS_TO_TICKS((remaining_us + 999) / 1000) + 1; //Rounded up to whole ticks
+            } while (count < ESP32_RIO_RBE_MAX_RECORDS && xQueueReceive(s_change_queue, &change, wait_ticks) == pdTRUE);
+            send_message(ESP32_RIO_RBE_MSG_CHANGES, base_us, records, count, records[count - 1].levels);
+        }
+        
+        int64_t now_us = esp_timer_get_time();
+        if (now_us >= next_heartbeat_us) {
+            if (!s_publishing && s_target[0] != '\0') {
+                transport_open(); //Retry a target that could not be opened
+            }
+            send_message(ESP32_RIO_RBE_MSG_HEARTBEAT, now_us, NULL, 0, s_levels);
+            next_heartbeat_us = now_us + s_heartbeat_s * 1000000LL;
+        }
+    }
+}
+
+
+/*
+ Split a target into transport, host, port and (MQTT only) topic, rejecting malformed targets
+*/
+static bool parse_target(const char *target, bool *mqtt, char *host, uint16_t *port, char *topic) {
+    const char *rest;
+    if (strncmp(target, "udp://", 6) == 0) {
+        *mqtt = false;
+        rest = target + 6;
+    } else if (strncmp(target, "mqtt://", 7) == 0) {
+        *mqtt = true;
+        rest = target + 7;
+    } else {
+        return false;
+    }
+    
+    size_t host_length = strcspn(rest, ":/");
+    if (host_length == 0 || strlen(target) > ESP32_RIO_RBE_TARGET_MAX_LENGTH) {
+        return false;
+    }
+    memcpy(host, rest, host_length);
+    host[host_length] = '\0';
+    rest += host_length;
+    
+    *port = *mqtt ? RBE_MQTT_DEFAULT_PORT : 0;
+    if (*rest == ':') {
+        char *end;
+        unsigned long parsed = strtoul(rest + 1, &end, 10);
+        if (end == rest + 1 || parsed == 0 || parsed > UINT16_MAX) {
+            return false;
+        }
+        *port = (uint16_t)parsed;
+        rest = end;
+    }
+    
+    topic[0] = '\0';
+    if (*mqtt) {
+        if (*rest != '/' || rest[1] == '\0') {
+            return false; //Topic is mandatory
+        }
+        strcpy(topic, rest + 1);
+        return true;
+    }
+    return *port != 0 && *rest == '\0';
+}
+
+
+static void transport_open(void) {
+    char target[ESP32_RIO_RBE_TARGET_MAX_LENGTH + 1];
+    char host[ESP32_RIO_RBE_TARGET_MAX_LENGTH + 1];
+    uint16_t port;
+    bool mqtt;
+    
+    esp32_rio_get_rbe_target(target, sizeof(target));
+    if (target[0] == '\0' || !parse_target(target, &mqtt, host, &port, s_mqtt_topic)) {
+        return; //Disabled
+    }
+    
+    if (mqtt) {
+        // The client connects (and reconnects) in the background. Messages sent while disconnected are lost
+        const esp_mqtt_client_config_t mqtt_config = {
+            .broker.address.hostname = host,
+            .broker.address.port = port,
+            .broker.address.transport = MQTT_TRANSPORT_OVER_TCP
+        };
+        s_mqtt_client = esp_mqtt_client_init(&mqtt_config);
+        if (s_mqtt_client == NULL || esp_mqtt_client_start(s_mqtt_client) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to start MQTT client for %s.", target);
+            transport_close();
+            return;
+        }
+    } else {
+        const struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_DGRAM };
+        struct addrinfo *address = NULL;
+        if (getaddrinfo(host, NULL, &hints, &address) != 0 || address == NULL) {
+            ESP_LOGW(TAG, "Failed to resolve %s.", host);
+            return;
+        }
+        memcpy(&s_udp_addr, address->ai_addr, sizeof(s_udp_addr));
+        s_udp_addr.sin_port = htons(port);
+        freeaddrinfo(address);
+        
+        s_udp_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (s_udp_socket < 0) {
+            ESP_LOGE(TAG, "Failed to create UDP socket: errno %d", errno);
+            return;
+        }
+        int broadcast = 1;
+        setsockopt(s_udp_socket, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast)); //Subscriber may be a broadcast address
+    }
+    s_publishing = true;
+    ESP_LOGI(TAG, "Publishing DI changes to %s.", target);
+}
+
+
+static void transport_close(void) {
+    s_publishing = false;
+    if (s_udp_socket >= 0) {
+        close(s_udp_socket);
+        s_udp_socket = -1;
+    }
+    if (s_mqtt_client != NULL) {
+        esp_mqtt_client_destroy(s_mqtt_client);
+        s_mqtt_client = NULL;
+    }
+}
+
+
+static void send_message(esp32_rio_rbe_msg_type_t type, int64_t timestamp_us, const esp32_rio_rbe_record_t *records,
+                         uint16_t record_count, uint16_t levels) {
+    if (!s_publishing) {
+        return;
+    }
+    esp32_rio_rbe_header_t *header = (esp32_rio_rbe_header_t *)s_message;
+    header->magic[0] = ESP32_RIO_RBE_MAGIC_0;
+    header->magic[1] = ESP32_RIO_RBE_MAGIC_1;
+    header->version = ESP32_RIO_RBE_VERSION;
+    header->type = (uint8_t)type;
+    header->sequence = s_sequence++;
+    header->timestamp_us = (uint64_t)timestamp_us;
+    header->levels = levels;
+    header->record_count = record_count;
+    header->dropped = atomic_load_explicit(&s_dropped_count, memory_order_relaxed);
+    size_t length = sizeof(*header) + record_count * sizeof(esp32_rio_rbe_record_t);
+    if (record_count > 0) {
+        memcpy(s_message + sizeof(*header), records, record_count * sizeof(esp32_rio_rbe_record_t));
+    }
+    
+    bool sent;
+    if (s_mqtt_client != NULL) {
+        sent = esp_mqtt_client_publish(s_mqtt_client, s_mqtt_topic, (const char *)s_message, length, 0, 0) >= 0;
+    } else {
+        sent = sendto(s_udp_socket, s_message, length, 0, (struct sockaddr *)&s_udp_addr, sizeof(s_udp_addr)) == (int)length;
+    }
+    if (sent) {
+        s_message_count++;
+        s_record_count += record_count;
+    } else {
+        s_error_count++;
+    }
+}
@@ -0,0 +1,73 @@
+/*
+@file rbe_publisher.h
+@brief Header for the report-by-exception publisher component.
+
+This file defines the public interface for pushing digital input changes to a
+subscriber as compact binary records, over UDP or MQTT, along with the record
+format and the publisher settings.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#ifndef RBE_PUBLISHER_H
+#define RBE_PUBLISHER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define ESP32_RIO_RBE_TARGET_MAX_LENGTH 64 //udp://HOST:PORT or mqtt://HOST[:PORT]/TOPIC
+#define ESP32_RIO_RBE_MAX_RECORDS 32 //Change records per message
+#define ESP32_RIO_RBE_COALESCE_MAX_MS 1000
+#define ESP32_RIO_RBE_COALESCE_DEFAULT_MS 10
+#define ESP32_RIO_RBE_HEARTBEAT_MIN_S 1
+#define ESP32_RIO_RBE_HEARTBEAT_MAX_S 3600
+#define ESP32_RIO_RBE_HEARTBEAT_DEFAULT_S 10
+
+#define ESP32_RIO_RBE_MAGIC_0 'R'
+#define ESP32_RIO_RBE_MAGIC_1 'B'
+#define ESP32_RIO_RBE_VERSION 1
+
+typedef enum {
+    ESP32_RIO_RBE_MSG_CHANGES = 0, //Header followed by change records
+    ESP32_RIO_RBE_MSG_HEARTBEAT = 1 //Header only, carrying the current input levels
+} esp32_rio_rbe_msg_type_t;
+
+/*
+ Message layout, little-endian. Sequence numbers count every message sent (changes and heartbeats alike), so
+ a subscriber detects lost messages from gaps and lost records (publisher queue overruns) from the dropped count.
+*/
+typedef struct __attribute__((packed)) {
+    uint8_t magic[2];
+    uint8_t version;
+    uint8_t type; //esp32_rio_rbe_msg_type_t
+    uint32_t sequence;
+    uint64_t timestamp_us; //Time since boot of the first record, or of the heartbeat
+    uint16_t levels; //Levels of all digital inputs after the last record (bit n = DIn)
+    uint16_t record_count;
+    uint32_t dropped; //Change records lost since boot
+} esp32_rio_rbe_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t offset_us; //Time of the change after the header timestamp
+    uint16_t levels; //Levels of all digital inputs after the change
+} esp32_rio_rbe_record_t;
+
+esp_err_t esp32_rio_rbe_start(void);
+void esp32_rio_rbe_publish_levels(uint16_t);
+
+esp_err_t esp32_rio_set_rbe_target(const char *);
+void esp32_rio_get_rbe_target(char *, size_t);
+esp_err_t esp32_rio_set_rbe_timing(uint32_t, uint32_t);
+void esp32_rio_get_rbe_timing(uint32_t *, uint32_t *);
+void esp32_rio_get_rbe_stats(uint32_t *, uint32_t *, uint32_t *, uint32_t *);
+esp_err_t esp32_rio_rbe_nv_params_load(void);
+esp_err_t esp32_rio_rbe_nv_params_save(void);
+
+#endif //RBE_PUBLISHER_H
@@ -0,0 +1,38 @@
+/*
+@file esp32_rio.h
+@brief Pin map of the ESP32 RIO board.
+
+This file lists the GPIO of every I/O channel of the board, 10 digital inputs and
+two banks of 10 digital outputs, along with its status LED and Output Enable button.
+Board variants supply a header of the same form, selected in menuconfig.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#ifndef ESP32_RIO_BOARD_H
+#define ESP32_RIO_BOARD_H
+
+#define ESP32_RIO_BOARD_NAME "ESP32 RIO"
+
+/*
+ Channel tables, in channel order: X(channel, GPIO) for every channel.
+ Up to 16 digital inputs, all below GPIO32. Up to 16 outputs per bank, the same number in both banks
+*/
+#define ESP32_RIO_BOARD_DI(X) \
+    X(0, 4) X(1, 5) X(2, 6) X(3, 7) X(4, 15) X(5, 16) X(6, 17) X(7, 9) X(8, 8) X(9, 18)
+
+#define ESP32_RIO_BOARD_DQ0(X) \
+    X(0, 10) X(1, 12) X(2, 14) X(3, 47) X(4, 39) X(5, 40) X(6, 41) X(7, 42) X(8, 2) X(9, 1)
+
+#define ESP32_RIO_BOARD_DQ1(X) \
+    X(0, 46) X(1, 11) X(2, 13) X(3, 21) X(4, 48) X(5, 45) X(6, 35) X(7, 36) X(8, 37) X(9, 38)
+
+#define ESP32_RIO_BOARD_STATUS_LED    43  //IO43 (TXD0)
+#define ESP32_RIO_BOARD_OE_TOGGLE_BTN 3   //IO3
+
+#endif //ESP32_RIO_BOARD_H
@@ -14,18 +14,43 @@ It is subject to the terms of the MIT License, which can be found in the LICENSE
 SPDX-License-Identifier: MIT
 */
 
+#include <limits.h>
+#include <stdatomic.h>
+#include "sdkconfig.h"
 #include "esp_log.h"
 #include "esp_check.h"
 #include "driver/gpio.h"
+#include "soc/gpio_reg.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/queue.h"
 #include "freertos/timers.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "driver/pulse_cnt.h"
+#include "driver/gptimer.h"
+#include "driver/ledc.h"
+#include "soc/soc_caps.h"
+#if CONFIG_ESP32_RIO_POWER_LIGHT_SLEEP
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#endif
 
 #include "remote_io.h"
+#include "config_store.h"
+#include "diagnostics.h"
+#include "trace_log.h"
+#include "power_mgmt.h"
+
+#define STATUS_LED      ESP32_RIO_BOARD_STATUS_LED
+#define OE_TOGGLE_BTN   ESP32_RIO_BOARD_OE_TOGGLE_BTN
+
+#define IO_TASK_CORE CONFIG_ESP32_RIO_RT_CORE
+#define IO_TASK_PRIORITY CONFIG_ESP32_RIO_IO_TASK_PRIORITY
+#define IO_TASK_STACK_SIZE CONFIG_ESP32_RIO_IO_TASK_STACK_SIZE
+#define MORSE_BLINKER_TASK_CORE CONFIG_ESP32_RIO_AUX_CORE
+#define MORSE_BLINKER_TASK_PRIORITY CONFIG_ESP32_RIO_STATUS_TASK_PRIORITY
+#define MORSE_BLINKER_TASK_STACK_SIZE 2048
 
-#define STATUS_LED      43  //IO43 (TXD0)
-#define OE_TOGGLE_BTN   3   //IO3
 
 // Morse code timings (in milliseconds)
 #define MORSE_DOT_DURATION_MS       250
@@ -35,15 +60,72 @@ SPDX-License-Identifier: MIT
 #define MORSE_WORD_PAUSE_MS         (7 * MORSE_DOT_DURATION_MS)
 
 static void io_task(void *);
-static void io_isr_handler(void *);
+static void oe_button_isr_handler(void *);
+static void di_isr_handler(void *);
+static void di_edge_signal(uint32_t, uint32_t, BaseType_t *);
+static bool di_edge_record(uint32_t, uint32_t);
+static void di_update(uint32_t);
 static void debounce_timer_callback(TimerHandle_t);
+static void di_filter_arm(void);
+static void di_filter_timer_callback(void *);
+static esp_err_t di_counters_init(void);
+static void di_counters_deinit(void);
+static uint32_t di_counter_read(unsigned int);
+static void counter_timer_callback(void *);
+static size_t di_events_merge(esp32_rio_di_event_t *, size_t, bool);
+static esp_err_t output_watchdog_init(void);
+static void output_watchdog_deinit(void);
+static bool output_watchdog_alarm_callback(gptimer_handle_t, const gptimer_alarm_event_data_t *, void *);
+static void output_watchdog_run(bool);
+#if CONFIG_ESP32_RIO_POWER_LIGHT_SLEEP
+static esp_err_t di_sleep_enter_callback(int64_t, void *);
+static esp_err_t di_sleep_exit_callback(int64_t, void *);
+#endif
+static void dq_modes_update_masks(void);
+static uint64_t dq_pattern_pins(uint16_t, uint16_t);
+static void dq_shadow_invalidate(void);
+static void dq_modes_apply(uint32_t);
+static void dq_modes_stop(bool);
+static void dq_modes_deinit(void);
+static void dq_timer_start(unsigned int, unsigned int, bool, uint32_t);
+static void dq_timer_callback(void *);
+static esp_err_t dq_pwm_claim(unsigned int, unsigned int, uint16_t);
+static void dq_pwm_release(unsigned int, unsigned int);
+static void dq_pwm_set_duty(unsigned int, unsigned int, uint16_t);
 static void morse_blinker_task(void *);
+static void io_config_fill(esp32_rio_config_io_t *, esp32_rio_config_dq_t *);
 
 static const char *TAG = "ESP32_RIO_IO";
 
-static const gpio_num_t DI[ESP32_RIO_NUM_IO_CHANNELS]   = {4, 5, 6, 7, 15, 16, 17, 9, 8, 18};
-static const gpio_num_t DQ0[ESP32_RIO_NUM_IO_CHANNELS]  = {10, 12, 14, 47, 39, 40, 41, 42, 2, 1};
-static const gpio_num_t DQ1[ESP32_RIO_NUM_IO_CHANNELS]  = {46, 11, 13, 21, 48, 45, 35, 36, 37, 38};
+/*
+ Lookup tables and GPIO register masks generated from the board pin map (mask bits 0-31: GPIO0-31, bits 32-63: GPIO32-63).
+ Input sampling and output updates expand into straight-line mask operations over the same tables
+*/
+#define PIN_TABLE_ENTRY(channel, gpio) [channel] = (gpio),
+#define PIN_MASK_BIT(channel, gpio) | (1ULL << (gpio))
+#define DI_LEVEL_BIT(channel, gpio) | (((gpio_levels >> (gpio)) & 1U) << (channel))
+#define DQ0_SET_BIT(channel, gpio) | ((uint64_t)((bank0_pattern >> (channel)) & 1U) << (gpio))
+#define DQ1_SET_BIT(channel, gpio) | ((uint64_t)((bank1_pattern >> (channel)) & 1U) << (gpio))
+
+#define DI_PINS_MASK  (0 ESP32_RIO_BOARD_DI(PIN_MASK_BIT))
+#define DQ0_PINS_MASK (0 ESP32_RIO_BOARD_DQ0(PIN_MASK_BIT))
+#define DQ1_PINS_MASK (0 ESP32_RIO_BOARD_DQ1(PIN_MASK_BIT))
+#define DQ_PINS_MASK  (DQ0_PINS_MASK | DQ1_PINS_MASK)
+#define BOARD_PINS_MASK ((1ULL << STATUS_LED) | (1ULL << OE_TOGGLE_BTN))
+
+static const gpio_num_t DI[ESP32_RIO_NUM_DI_CHANNELS] = { ESP32_RIO_BOARD_DI(PIN_TABLE_ENTRY) };
+static const gpio_num_t DQ[2][ESP32_RIO_NUM_DQ_CHANNELS] = {
+    { ESP32_RIO_BOARD_DQ0(PIN_TABLE_ENTRY) },
+    { ESP32_RIO_BOARD_DQ1(PIN_TABLE_ENTRY) }
+};
+
+// DI levels are sampled from GPIO_IN_REG, which holds GPIO0-31
+_Static_assert((DI_PINS_MASK >> 32) == 0, "Every DI pin must be below GPIO32 (GPIO_IN_REG range)");
+_Static_assert(__builtin_popcountll(DI_PINS_MASK | DQ_PINS_MASK | BOARD_PINS_MASK) ==
+               ESP32_RIO_NUM_DI_CHANNELS + 2 * ESP32_RIO_NUM_DQ_CHANNELS + 2,
+               "The board pin map assigns a GPIO twice");
+_Static_assert(ESP32_RIO_NUM_DI_CHANNELS <= ESP32_RIO_CONFIG_MAX_DI && ESP32_RIO_NUM_DQ_CHANNELS <= ESP32_RIO_CONFIG_MAX_DQ,
+               "The stored I/O settings do not cover every channel of the board");
 
 #define DEBOUNCE_TIME_MS 250
 static TimerHandle_t s_debounce_timer = NULL;
@@ -52,14 +134,179 @@ static bool s_button_pressed = false;
 static oe_button_toggle_cb_t s_oe_button_toggle_callback = NULL;
 static di_level_change_cb_t s_di_level_change_callback = NULL;
 
-static QueueHandle_t s_io_event_queue = NULL;
+/*
+ DI edges are coalesced through io_task's notification value: the ISR ORs in the bit of the interrupting channel
+ (bit n = DIn, the same layout as the input levels) and io_task samples all inputs once per wake-up, however many
+ edges arrived in the meantime. Each DI handler gets its channel number and GPIO in its argument, so the ISR and
+ the event records need no pin lookups.
+*/
+#define DI_ISR_ARG(channel) ((void *)(uintptr_t)((channel) | ((uint32_t)DI[channel] << 8))) //Channel in bits 0-7, GPIO in bits 8-15
 static TaskHandle_t s_io_task_handle = NULL;
+static TaskHandle_t s_morse_blinker_task_handle = NULL;
+static volatile uint32_t s_di_edge_count = 0; //DI edges seen by the ISR
+static volatile uint32_t s_di_update_count = 0; //Input samples published by io_task
+static atomic_uint s_di_edge_pending_since = 0; //Timestamp (us, bit 0 set) of the oldest unfiltered edge not yet published, 0 if none
+static volatile uint32_t s_di_last_edge_us[ESP32_RIO_NUM_DI_CHANNELS] = { 0 }; //Timestamps (us) of the last unfiltered edge of each input
+static volatile uint32_t s_di_last_update_us = 0; //Timestamp (us) of the last wake-up of io_task for input changes
+#if CONFIG_ESP32_RIO_POWER_LIGHT_SLEEP
+static uint32_t s_sleep_gpio_levels = 0; //GPIO0-31 levels on entering light sleep
+static atomic_uint s_di_sleep_edges = 0; //Bit n = edge of DIn recorded on leaving light sleep, its interrupt left pending to flag it
+static bool s_sleep_button_level = true;
+static esp_pm_sleep_cbs_register_config_t s_sleep_callbacks = {
+    .enter_cb = di_sleep_enter_callback,
+    .exit_cb = di_sleep_exit_callback
+};
+#endif
+
+/*
+ DI filter. Filtered channels are sampled every ESP32_RIO_DI_FILTER_TICK_US by a single one-shot esp_timer
+ that re-arms itself only while some channel is still settling, so it costs nothing while inputs are quiet.
+ Each filtered channel keeps an up/down integrator: it counts up on samples differing from the stable level,
+ down on agreeing ones, and the stable level flips once the count reaches the channel's filter time.
+ While the sampler is armed, the ISR does not wake io_task for edges on filtered channels.
+*/
+#define DI_FILTER_NOTIFY_BIT (1UL << 31) //io_task notification for filtered level changes (past every DI channel bit)
+static esp_timer_handle_t s_di_filter_timer = NULL;
+static portMUX_TYPE s_di_filter_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_di_filter_us[ESP32_RIO_NUM_DI_CHANNELS] = { 0 }; //Configured filter times (0 = unfiltered)
+static uint16_t s_di_filter_ticks[ESP32_RIO_NUM_DI_CHANNELS] = { 0 }; //Integrator thresholds
+static uint16_t s_di_filter_counts[ESP32_RIO_NUM_DI_CHANNELS] = { 0 }; //Integrator states
+static uint16_t s_di_filtered_channels = 0; //Bit n = DIn is filtered
+static uint16_t s_di_stable_levels = 0; //Debounced levels of filtered channels
+static atomic_bool s_di_filter_armed = false;
+
+/*
+ DI pulse counters. Counter mode channels are counted on rising edges by the PCNT units first (in hardware, with
+ the driver extending the 16-bit count on overflow), and by the GPIO ISR for channels beyond the available units.
+ Totals are published every ESP32_RIO_COUNTER_PUBLISH_MS and rates recomputed at the end of each window.
+*/
+#define PCNT_HIGH_LIMIT 32767
+static uint8_t s_di_modes[ESP32_RIO_NUM_DI_CHANNELS] = { 0 }; //Stored modes, applied on I/O service start
+static uint16_t s_di_counter_channels = 0; //Bit n = DIn is counting
+static uint16_t s_di_isr_counter_channels = 0; //Bit n = DIn is counted by the ISR
+static volatile uint32_t s_isr_pulse_counts[ESP32_RIO_NUM_DI_CHANNELS] = { 0 };
+static pcnt_unit_handle_t s_pcnt_units[ESP32_RIO_NUM_DI_CHANNELS] = { NULL };
+static pcnt_channel_handle_t s_pcnt_channels[ESP32_RIO_NUM_DI_CHANNELS] = { NULL };
+static esp_timer_handle_t s_counter_timer = NULL;
+static uint32_t s_counter_window_ms = ESP32_RIO_COUNTER_WINDOW_DEFAULT_MS;
+static uint32_t s_counter_window_elapsed_ms = 0;
+static uint32_t s_counter_base_counts[ESP32_RIO_NUM_DI_CHANNELS] = { 0 }; //Reset offsets of ISR counters
+static uint32_t s_counter_window_counts[ESP32_RIO_NUM_DI_CHANNELS] = { 0 }; //Totals at window start
+static uint32_t s_counter_rates[ESP32_RIO_NUM_DI_CHANNELS] = { 0 }; //In mHz
+static atomic_uint s_counter_reset_requests = 0; //Bit n = reset DIn counter on next publish
+static counter_update_cb_t s_counter_update_callback = NULL;
+static bool s_counters_power_held = false; //Light sleep held off while inputs count
+
+/*
+ Output watchdog. A GPTimer counts microseconds since the last feed and its alarm interrupt drives the outputs
+ straight to their safe states, so the reaction time does not depend on task scheduling. Once expired,
+ esp32_rio_apply_outputs is ignored until the watchdog is armed again. Latency is measured from the alarm
+ deadline to the outputs being written, in timer counts. The timer only runs while armed, since an enabled
+ GPTimer holds the APB clock and keeps the chip out of light sleep.
+*/
+#define OUTPUT_WATCHDOG_NOTIFY_BIT (1UL << 30) //io_task notification for watchdog expiry (past every DI channel bit)
+#define OUTPUT_WATCHDOG_RESOLUTION_HZ 1000000 //Counts are microseconds
+static gptimer_handle_t s_watchdog_timer = NULL;
+static uint32_t s_watchdog_timeout_ms = 0; //0 = disabled
+static atomic_bool s_watchdog_armed = false;
+static StaticSemaphore_t s_watchdog_run_mutex_buffer;
+static SemaphoreHandle_t s_watchdog_run_mutex = NULL;
+static bool s_watchdog_running = false; //Timer enabled and started
+static volatile bool s_watchdog_expired = false;
+static volatile uint32_t s_watchdog_expiry_count = 0;
+static volatile uint32_t s_watchdog_last_latency_us = 0;
+static volatile uint32_t s_watchdog_max_latency_us = 0;
+static portMUX_TYPE s_dq_safe_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t s_dq_safe_states[2][ESP32_RIO_NUM_DQ_CHANNELS] = { 0 }; //Stored safe states per output bank
+static uint64_t s_dq_safe_set_mask = 0; //GPIO masks derived from the safe states
+static uint64_t s_dq_safe_clear_mask = 0;
+static output_watchdog_expiry_cb_t s_output_watchdog_expiry_callback = NULL;
+
+/*
+ Shadow of the output patterns last applied, both banks in one word (bit 16 + n: output n of bank 1). A write
+ of the same patterns is counted and skipped with a single compare, and a write changing some outputs only
+ touches their pins. Anything else driving the outputs (disabling them, the watchdog or a mode change)
+ invalidates the shadow, so the next write drives every output again
+*/
+#define DQ_SHADOW_MASK (((1UL << ESP32_RIO_NUM_DQ_CHANNELS) - 1) * 0x10001UL)
+static portMUX_TYPE s_dq_shadow_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_dq_shadow_patterns = 0;
+static bool s_dq_shadow_valid = false;
+static bool s_dq_outputs_disabled = false; //Set with the outputs cleared, until the next write. Under the shadow lock
+
+/*
+ Output modes. Outputs in normal mode are written through the GPIO set/clear registers as always, and while every
+ output is in normal mode nothing else happens. Timed outputs (pulse, on-delay, off-delay) act on their coil edges,
+ with the edge that follows scheduled on a one-shot esp_timer of microsecond resolution. PWM outputs are routed to
+ an LEDC channel, with one LEDC timer per frequency in use, and run at zero duty while their coil is off.
+ Channel k of the masks is output k % 16 of bank k / 16. Mode changes and coil edges are serialized by a mutex;
+ the timer callbacks only read the level their timer was started for.
+*/
+#define DQ_CHANNEL(bank, output) ((bank) * 16 + (output))
+#define DQ_TIMER_ARG(bank, output) ((void *)(uintptr_t)(DQ_CHANNEL(bank, output) | ((uint32_t)DQ[bank][output] << 8))) //Channel in bits 0-7, GPIO in bits 8-15
+#define DQ_PWM_SRC_CLK_HZ 80000000 //APB clock, driving the LEDC timers
+#if CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+#define DQ_TIMER_DISPATCH ESP_TIMER_ISR
+#else
+#define DQ_TIMER_DISPATCH ESP_TIMER_TASK
+#endif
+static StaticSemaphore_t s_dq_mode_mutex_buffer;
+static SemaphoreHandle_t s_dq_mode_mutex = NULL;
+static esp32_rio_dq_mode_config_t s_dq_modes[2][ESP32_RIO_NUM_DQ_CHANNELS] = { 0 };
+static atomic_uint s_dq_moded_channels = 0; //Channels in any mode but normal
+static uint64_t s_dq_normal_pins_mask = DQ_PINS_MASK; //GPIO mask of the outputs in normal mode
+static uint32_t s_dq_coils = 0; //Coil levels last applied to the moded channels
+static atomic_uint s_dq_timer_levels = 0; //Level each channel is driven to when its timer expires
+static esp_timer_handle_t s_dq_timers[2][ESP32_RIO_NUM_DQ_CHANNELS] = { NULL };
+static uint8_t s_dq_ledc_channels[2][ESP32_RIO_NUM_DQ_CHANNELS] = { 0 }; //LEDC channel plus one, 0 = none
+static uint8_t s_dq_ledc_timers[2][ESP32_RIO_NUM_DQ_CHANNELS] = { 0 };
+static uint32_t s_ledc_channels_used = 0;
+static uint16_t s_ledc_timer_frequencies[SOC_LEDC_TIMER_NUM] = { 0 };
+static uint8_t s_ledc_timer_bits[SOC_LEDC_TIMER_NUM] = { 0 }; //Duty resolution
+static uint8_t s_ledc_timer_users[SOC_LEDC_TIMER_NUM] = { 0 }; //0 = free
+
+/*
+ DI event (sequence of events) rings. Each ring is lock-free with a single producer and a single consumer:
+ the ISR records edges of unfiltered inputs, the filter sampler records accepted transitions of filtered ones.
+ Records hold the GPIO number until consumed. The consumer merges both rings in timestamp order, which is
+ well defined because either producer only ever appends records newer than everything already queued.
+*/
+#define DI_EVENT_RING_SIZE 128 //Power of two
+typedef struct {
+    esp32_rio_di_event_t records[DI_EVENT_RING_SIZE];
+    atomic_uint head; //Advanced by the producer
+    atomic_uint tail; //Advanced by the consumer
+    volatile uint32_t overruns;
+    volatile uint32_t high_water; //Most records ever queued at once
+} di_event_ring_t;
+static di_event_ring_t s_di_isr_events = { 0 };
+static di_event_ring_t s_di_filter_events = { 0 };
+
+static inline bool di_event_ring_push(di_event_ring_t *ring, int64_t timestamp_us, uint8_t channel, uint8_t level) {
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= DI_EVENT_RING_SIZE) {
+        ring->overruns++;
+        return false;
+    }
+    esp32_rio_di_event_t *record = &ring->records[head & (DI_EVENT_RING_SIZE - 1)];
+    record->timestamp_us = timestamp_us;
+    record->channel = channel;
+    record->level = level;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    uint32_t queued = head + 1 - atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (queued > ring->high_water) {
+        ring->high_water = queued;
+    }
+    return true;
+}
 
 
 /*
  Configure GPIO for esp32_rio board
 */
 void esp32_rio_configure_gpio(void) {
+    ESP_LOGI(TAG, "%s board: %d DI, 2 x %d DQ.", ESP32_RIO_BOARD_NAME, ESP32_RIO_NUM_DI_CHANNELS, ESP32_RIO_NUM_DQ_CHANNELS);
+    
     // Configure input for outputs enable/disable button
     gpio_config_t di_cfg = {
         .pin_bit_mask = 1ULL << OE_TOGGLE_BTN,
@@ -71,10 +318,8 @@ void esp32_rio_configure_gpio(void) {
     gpio_config(&di_cfg);
     // Configure DI pins as input
     di_cfg.intr_type = GPIO_INTR_ANYEDGE; //Interrupt on change
-    for (int i = 0; i < ESP32_RIO_NUM_IO_CHANNELS; ++i) {
-        di_cfg.pin_bit_mask = 1ULL << DI[i];
-        gpio_config(&di_cfg);
-    }
+    di_cfg.pin_bit_mask = DI_PINS_MASK;
+    gpio_config(&di_cfg);
 
     // Configure status led
     gpio_config_t out_cfg = {
@@ -86,14 +331,13 @@ void esp32_rio_configure_gpio(void) {
     };
     gpio_config(&out_cfg);
     gpio_set_level(STATUS_LED, 0); //LED off, outputs disabled by default
-    // Configure DQ0x, DQ1x pins as outputs
-    for (int i = 0; i < ESP32_RIO_NUM_IO_CHANNELS; ++i) {
-        out_cfg.pin_bit_mask = (1ULL << DQ0[i]) | (1ULL << DQ1[i]);
-        gpio_config(&out_cfg);
-
-        gpio_set_level(DQ0[i], 0);
-        gpio_set_level(DQ1[i], 0);
-    }
+    // Configure DQ0x, DQ1x pins as outputs, all off
+    out_cfg.pin_bit_mask = DQ_PINS_MASK;
+    gpio_config(&out_cfg);
+    REG_WRITE(GPIO_OUT_W1TC_REG, (uint32_t)DQ_PINS_MASK);
+    REG_WRITE(GPIO_OUT1_W1TC_REG, (uint32_t)(DQ_PINS_MASK >> 32));
+    
+    s_dq_mode_mutex = xSemaphoreCreateMutexStatic(&s_dq_mode_mutex_buffer);
 }
 
 
@@ -101,48 +345,112 @@ void esp32_rio_configure_gpio(void) {
  Initialize I/O services
 */
 esp_err_t esp32_rio_io_services_init(oe_button_toggle_cb_t oe_button_toggle_callback,
-                                     di_level_change_cb_t di_level_change_callback) {
-    // GPIO event queue
-    s_io_event_queue = xQueueCreate(10, sizeof(uint32_t)); //Hold up to 10 GPIO numbers
-    if (s_io_event_queue == NULL) {
-        ESP_LOGE(TAG, "Failed to create GPIO event queue.");
+                                     di_level_change_cb_t di_level_change_callback,
+                                     counter_update_cb_t counter_update_callback,
+                                     output_watchdog_expiry_cb_t output_watchdog_expiry_callback) {
+    // Register callbacks
+    s_oe_button_toggle_callback = oe_button_toggle_callback;
+    s_di_level_change_callback = di_level_change_callback;
+    s_counter_update_callback = counter_update_callback;
+    s_output_watchdog_expiry_callback = output_watchdog_expiry_callback;
+    
+    // Button debounce timer
+    s_debounce_timer = xTimerCreate("DebounceTimer", pdMS_TO_TICKS(DEBOUNCE_TIME_MS), pdFALSE, (void *)0, debounce_timer_callback);
+    if (s_debounce_timer == NULL) {
+        ESP_LOGE(TAG, "Failed to create debounce timer.");
+        return ESP_FAIL;
+    }
+    
+    // DI filter sampler and stored filter settings
+    const esp_timer_create_args_t di_filter_timer_args = {
+        .callback = di_filter_timer_callback,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "di_filter"
+    };
+    if (esp_timer_create(&di_filter_timer_args, &s_di_filter_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create DI filter timer.");
+        xTimerDelete(s_debounce_timer, 0);
+        return ESP_FAIL;
+    }
+    if (esp32_rio_io_nv_params_load() != ESP_OK) {
+        ESP_LOGW(TAG, "Using default I/O settings.");
+    }
+    
+    // Pulse counters for DI channels in counter mode
+    if (di_counters_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set up DI pulse counters.");
+        di_counters_deinit();
+        xTimerDelete(s_debounce_timer, 0);
+        esp_timer_delete(s_di_filter_timer);
+        s_di_filter_timer = NULL;
         return ESP_FAIL;
     }
 
+    // Output watchdog timer (stays idle until armed)
+    if (output_watchdog_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set up output watchdog.");
+        output_watchdog_deinit();
+        di_counters_deinit();
+        xTimerDelete(s_debounce_timer, 0);
+        esp_timer_delete(s_di_filter_timer);
+        s_di_filter_timer = NULL;
+        return ESP_FAIL;
+    }
+    
+    // GPIO task (must exist before any DI or watchdog interrupt can notify it)
+    BaseType_t ret_task_create = xTaskCreatePinnedToCore(io_task, "io_task", IO_TASK_STACK_SIZE, NULL, IO_TASK_PRIORITY, &s_io_task_handle, IO_TASK_CORE);
+    if (ret_task_create != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create io_task: %d", ret_task_create);
+        output_watchdog_deinit();
+        di_counters_deinit();
+        xTimerDelete(s_debounce_timer, 0);
+        esp_timer_delete(s_di_filter_timer);
+        s_di_filter_timer = NULL;
+        return ESP_FAIL;
+    }
+    
     // Install the GPIO ISR service
     ESP_RETURN_ON_ERROR(gpio_install_isr_service(0),
                         TAG,
                         "gpio_install_isr_service fail.");
     
     // Hook the GPIO interrupt handlers
-    ESP_RETURN_ON_ERROR(gpio_isr_handler_add(OE_TOGGLE_BTN, io_isr_handler, (void*)OE_TOGGLE_BTN),
+    ESP_RETURN_ON_ERROR(gpio_isr_handler_add(OE_TOGGLE_BTN, oe_button_isr_handler, NULL),
                         TAG,
                         "gpio_isr_handler_add fail.");
-    for (int i = 0; i < ESP32_RIO_NUM_IO_CHANNELS; ++i) {
-        ESP_RETURN_ON_ERROR(gpio_isr_handler_add(DI[i], io_isr_handler, (void*)DI[i]),
+    for (int i = 0; i < ESP32_RIO_NUM_DI_CHANNELS; ++i) {
+        if (s_pcnt_units[i] != NULL) {
+            // Counted in hardware, edges must not reach the CPU
+            ESP_RETURN_ON_ERROR(gpio_set_intr_type(DI[i], GPIO_INTR_DISABLE),
+                                TAG,
+                                "gpio_set_intr_type fail.");
+            continue;
+        }
+        if (s_di_isr_counter_channels & (1U << i)) {
+            ESP_RETURN_ON_ERROR(gpio_set_intr_type(DI[i], GPIO_INTR_POSEDGE),
+                                TAG,
+                                "gpio_set_intr_type fail.");
+        }
+        ESP_RETURN_ON_ERROR(gpio_isr_handler_add(DI[i], di_isr_handler, DI_ISR_ARG(i)),
                             TAG,
                             "gpio_isr_handler_add fail.");
     }
     
-    // Button debounce timer
-    s_debounce_timer = xTimerCreate("DebounceTimer", pdMS_TO_TICKS(DEBOUNCE_TIME_MS), pdFALSE, (void *)0, debounce_timer_callback);
-    if (s_debounce_timer == NULL) {
-        ESP_LOGE(TAG, "Failed to create debounce timer.");
-        vQueueDelete(s_io_event_queue);
-        return ESP_FAIL;
-    }
+#if CONFIG_ESP32_RIO_POWER_LIGHT_SLEEP
+    // Wake from light sleep on DI edges and button presses
+    ESP_RETURN_ON_ERROR(esp_sleep_enable_gpio_wakeup(),
+                        TAG,
+                        "esp_sleep_enable_gpio_wakeup fail.");
+    ESP_RETURN_ON_ERROR(esp_pm_light_sleep_register_cbs(&s_sleep_callbacks),
+                        TAG,
+                        "esp_pm_light_sleep_register_cbs fail.");
+#endif
     
-    // Register callbacks
-    s_oe_button_toggle_callback = oe_button_toggle_callback;
-    s_di_level_change_callback = di_level_change_callback;
-
-    // GPIO task
-    BaseType_t ret_task_create = xTaskCreate(io_task, "io_task", 4096, NULL, 10, &s_io_task_handle);
-    if (ret_task_create != pdPASS) {
-        ESP_LOGE(TAG, "Failed to create io_task: %d", ret_task_create);
-        vQueueDelete(s_io_event_queue);
-        xTimerDelete(s_debounce_timer, 0);
-        return ESP_FAIL;
+    // Start publishing counters
+    if (s_counter_timer != NULL) {
+        ESP_RETURN_ON_ERROR(esp_timer_start_periodic(s_counter_timer, ESP32_RIO_COUNTER_PUBLISH_MS * 1000ULL),
+                            TAG,
+                            "esp_timer_start_periodic fail.");
     }
     
     return ESP_OK;
@@ -155,16 +463,21 @@ esp_err_t esp32_rio_io_services_init(oe_button_toggle_cb_t oe_button_toggle_call
 esp_err_t esp32_rio_io_services_deinit(void){
     s_oe_button_toggle_callback = NULL;
     s_di_level_change_callback = NULL;
+    s_counter_update_callback = NULL;
+    s_output_watchdog_expiry_callback = NULL;
     
     ESP_RETURN_ON_ERROR(gpio_isr_handler_remove(OE_TOGGLE_BTN),
                         TAG,
                         "gpio_isr_handler_remove fail.");
-    for (int i = 0; i < ESP32_RIO_NUM_IO_CHANNELS; ++i) {
+    for (int i = 0; i < ESP32_RIO_NUM_DI_CHANNELS; ++i) {
         ESP_RETURN_ON_ERROR(gpio_isr_handler_remove(DI[i]),
                             TAG,
                             "gpio_isr_handler_remove fail.");
     }
     
+#if CONFIG_ESP32_RIO_POWER_LIGHT_SLEEP
+    esp_pm_light_sleep_unregister_cbs(&s_sleep_callbacks);
+#endif
     gpio_uninstall_isr_service();
     
     if (s_debounce_timer != NULL) {
@@ -175,16 +488,22 @@ esp_err_t esp32_rio_io_services_deinit(void){
         s_debounce_timer = NULL;
     }
     
+    if (s_di_filter_timer != NULL) {
+        esp_timer_stop(s_di_filter_timer); //Fails harmlessly if not armed
+        esp_timer_delete(s_di_filter_timer);
+        s_di_filter_timer = NULL;
+        atomic_store(&s_di_filter_armed, false);
+    }
+    
+    di_counters_deinit();
+    output_watchdog_deinit();
+    dq_modes_deinit();
+    
     if (s_io_task_handle != NULL) {
         vTaskDelete(s_io_task_handle);
         s_io_task_handle = NULL;
     }
     
-    if (s_io_event_queue != NULL) {
-        vQueueDelete(s_io_event_queue);
-        s_io_event_queue = NULL;
-    }
-    
     return ESP_OK;
 }
 
@@ -198,115 +517,1408 @@ bool esp32_rio_is_input_on(unsigned int input_number) {
 
 
 /*
- Disable all digital outputs
+ GPIOs taken by the board pin map: I/O channels, status LED and OE button (bit n = GPIOn)
 */
-void esp32_rio_disable_outputs(void) {
-    for (int i = 0; i < ESP32_RIO_NUM_IO_CHANNELS; i++) {
-        gpio_set_level(DQ0[i], 0);
-        gpio_set_level(DQ1[i], 0);
+uint64_t esp32_rio_get_board_gpio_mask(void) {
+    return DI_PINS_MASK | DQ_PINS_MASK | BOARD_PINS_MASK;
+}
+
+
+/*
+ Sample all digital inputs with a single GPIO input register read.
+ Bit n of the result is the level of DIn
+*/
+uint16_t esp32_rio_read_inputs(void) {
+    uint32_t gpio_levels = REG_READ(GPIO_IN_REG);
+    return (uint16_t)(0 ESP32_RIO_BOARD_DI(DI_LEVEL_BIT));
+}
+
+
+/*
+ Retrieve DI event counters: total edges interrupted and edges coalesced into an earlier input update
+*/
+void esp32_rio_get_di_event_stats(uint32_t *edge_count, uint32_t *coalesced_count) {
+    uint32_t updates = s_di_update_count;
+    uint32_t edges = s_di_edge_count;
+    if (edge_count) {
+        *edge_count = edges;
+    }
+    if (coalesced_count) {
+        *coalesced_count = edges - updates;
     }
 }
 
 
 /*
- Turn status LED on/off
+ Retrieve the timestamps (esp_timer, low 32 bits in us) of the last edge interrupted on an unfiltered input
+ (number in range) and of the last wake-up of io_task to publish input changes, for latency measurements
 */
+void esp32_rio_get_di_edge_times(unsigned int input_number, uint32_t *edge_us, uint32_t *update_us) {
+    *edge_us = s_di_last_edge_us[input_number];
+    *update_us = s_di_last_update_us;
+}
 
-void esp32_rio_turn_status_led_on(void) {
-    gpio_set_level(STATUS_LED, 1);
+
+/*
+ Retrieve DI event ring high-water marks (most records queued at once) of unfiltered and filtered inputs
+*/
+void esp32_rio_get_di_queue_stats(uint32_t *isr_high_water, uint32_t *filter_high_water) {
+    if (isr_high_water) {
+        *isr_high_water = s_di_isr_events.high_water;
+    }
+    if (filter_high_water) {
+        *filter_high_water = s_di_filter_events.high_water;
+    }
 }
 
 
-void esp32_rio_turn_status_led_off(void) {
-    gpio_set_level(STATUS_LED, 0);
+/*
+ Restart DI event ring high-water marks from the records currently queued
+*/
+void esp32_rio_reset_di_queue_stats(void) {
+    s_di_isr_events.high_water = atomic_load(&s_di_isr_events.head) - atomic_load(&s_di_isr_events.tail);
+    s_di_filter_events.high_water = atomic_load(&s_di_filter_events.head) - atomic_load(&s_di_filter_events.tail);
 }
 
 
 /*
- Turn on/off a given digital output of a given output bank
+ Copy up to max_events of the oldest recorded DI events, without consuming them.
+ Returns the number of events copied
 */
+size_t esp32_rio_peek_di_events(esp32_rio_di_event_t *events, size_t max_events) {
+    return di_events_merge(events, max_events, false);
+}
 
 
-void esp32_rio_turn_output_on(unsigned int bank_number, unsigned int output_number) {
-    if (bank_number == 0) {
-        gpio_set_level(DQ0[output_number], 1U);
-    } else if (bank_number == 1U) {
-        gpio_set_level(DQ1[output_number], 1U);
+/*
+ Discard the given number of oldest recorded DI events (normally those just peeked).
+ Must be called from the same task that peeks events
+*/
+void esp32_rio_consume_di_events(size_t count) {
+    di_events_merge(NULL, count, true);
+}
+
+
+/*
+ Query the number of recorded DI events not consumed yet and, optionally, of those lost to full rings
+*/
+size_t esp32_rio_get_di_event_count(uint32_t *overrun_count) {
+    if (overrun_count) {
+        *overrun_count = s_di_isr_events.overruns + s_di_filter_events.overruns;
     }
+    return (atomic_load(&s_di_isr_events.head) - atomic_load(&s_di_isr_events.tail)) +
+           (atomic_load(&s_di_filter_events.head) - atomic_load(&s_di_filter_events.tail));
 }
 
 
-void esp32_rio_turn_output_off(unsigned int bank_number, unsigned int output_number) {
-    if (bank_number == 0) {
-        gpio_set_level(DQ0[output_number], 0);
-    } else if (bank_number == 1U) {
-        gpio_set_level(DQ1[output_number], 0);
+/*
+ Set the filter time of a given digital input, in microseconds (0 disables filtering).
+ Takes effect immediately. The time is rounded up to a multiple of ESP32_RIO_DI_FILTER_TICK_US
+*/
+esp_err_t esp32_rio_set_di_filter(unsigned int input_number, uint32_t filter_us) {
+    if (input_number >= ESP32_RIO_NUM_DI_CHANNELS || filter_us > ESP32_RIO_DI_FILTER_MAX_US) {
+        return ESP_ERR_INVALID_ARG;
     }
+    uint16_t ticks = (filter_us + ESP32_RIO_DI_FILTER_TICK_US - 1) / ESP32_RIO_DI_FILTER_TICK_US;
+    uint16_t channel_bit = 1U << input_number;
+    
+    portENTER_CRITICAL(&s_di_filter_lock);
+    s_di_filter_us[input_number] = filter_us;
+    s_di_filter_ticks[input_number] = ticks;
+    s_di_filter_counts[input_number] = 0;
+    if (ticks > 0) {
+        if (!(s_di_filtered_channels & channel_bit)) {
+            // Start from the current level
+            s_di_stable_levels = (s_di_stable_levels & ~channel_bit) | (esp32_rio_read_inputs() & channel_bit);
+        }
+        s_di_filtered_channels |= channel_bit;
+    } else {
+        s_di_filtered_channels &= ~channel_bit;
+    }
+    portEXIT_CRITICAL(&s_di_filter_lock);
+    
+    // Republish input levels
+    if (s_io_task_handle != NULL) {
+        xTaskNotify(s_io_task_handle, DI_FILTER_NOTIFY_BIT, eSetBits);
+    }
+    return ESP_OK;
 }
 
 
 /*
- Start Morse blinking for "W".
- The task is meant to run indefinitely
+ Query the filter time of a given digital input, in microseconds
 */
-void esp32_rio_start_morse_blinker(void) {
-    BaseType_t ret_task_create = xTaskCreate(morse_blinker_task, "morse_blinker", 2048, NULL, 5, NULL);
-    if (ret_task_create != pdPASS) {
-        ESP_LOGE(TAG, "Failed to create morse_blinker_task: %d", ret_task_create);
+uint32_t esp32_rio_get_di_filter(unsigned int input_number) {
+    return input_number < ESP32_RIO_NUM_DI_CHANNELS ? s_di_filter_us[input_number] : 0;
+}
+
+
+/*
+ Set the mode of a given digital input. Stored modes take effect when I/O services start
+*/
+esp_err_t esp32_rio_set_di_mode(unsigned int input_number, esp32_rio_di_mode_t mode) {
+    if (input_number >= ESP32_RIO_NUM_DI_CHANNELS || (mode != ESP32_RIO_DI_MODE_NORMAL && mode != ESP32_RIO_DI_MODE_COUNTER)) {
+        return ESP_ERR_INVALID_ARG;
     }
+    s_di_modes[input_number] = (uint8_t)mode;
+    return ESP_OK;
 }
 
 
-static void IRAM_ATTR io_isr_handler(void *arg) {
-    uint32_t gpio_num = (uint32_t)arg; //Get the GPIO number from the argument
-    if (gpio_num == OE_TOGGLE_BTN) {
-        s_button_pressed = true;
-        xTimerStartFromISR(s_debounce_timer, NULL);
-    } else {
-        xQueueSendFromISR(s_io_event_queue, &gpio_num, NULL); //Send input pin number to the queue
+/*
+ Query the stored mode of a given digital input
+*/
+esp32_rio_di_mode_t esp32_rio_get_di_mode(unsigned int input_number) {
+    return input_number < ESP32_RIO_NUM_DI_CHANNELS ? (esp32_rio_di_mode_t)s_di_modes[input_number] : ESP32_RIO_DI_MODE_NORMAL;
+}
+
+
+/*
+ Set the counter rate computation window, in milliseconds (multiple of ESP32_RIO_COUNTER_PUBLISH_MS).
+ Takes effect from the next window
+*/
+esp_err_t esp32_rio_set_counter_window(uint32_t window_ms) {
+    if (window_ms < ESP32_RIO_COUNTER_WINDOW_MIN_MS || window_ms > ESP32_RIO_COUNTER_WINDOW_MAX_MS ||
+        window_ms % ESP32_RIO_COUNTER_PUBLISH_MS != 0) {
+        return ESP_ERR_INVALID_ARG;
     }
+    s_counter_window_ms = window_ms;
+    return ESP_OK;
 }
 
 
-static void io_task(void *pvArg) {
-    uint32_t io_num;
-    while (1) {
-        if (xQueueReceive(s_io_event_queue, &io_num, portMAX_DELAY)) {
-            // A digital input pin (DIx) changed state
-            ESP_LOGI(TAG, "GPIO %d was interrupted.", (int)io_num);
-            
-            for (int i = 0; i < ESP32_RIO_NUM_IO_CHANNELS; i++) {
-                if (io_num == DI[i]) {
-                    int level = gpio_get_level(DI[i]);
-                    ESP_LOGI(TAG, "DI%d changed to %s.", i, level ? "HIGH" : "LOW");
-                    
-                    // Notify main task
-                    if (s_di_level_change_callback) {
-                        s_di_level_change_callback(i);
-                    }
-                    
-                    break; //No need to check other pins
+/*
+ Query the counter rate computation window, in milliseconds
+*/
+uint32_t esp32_rio_get_counter_window(void) {
+    return s_counter_window_ms;
+}
+
+
+/*
+ Request the pulse counter of a given digital input to restart from zero (on the next publishing period)
+*/
+esp_err_t esp32_rio_reset_counter(unsigned int input_number) {
+    if (input_number >= ESP32_RIO_NUM_DI_CHANNELS || !(s_di_counter_channels & (1U << input_number))) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    atomic_fetch_or(&s_counter_reset_requests, 1U << input_number);
+    return ESP_OK;
+}
+
+
+/*
+ Retrieve stored I/O settings. Settings never stored keep their defaults
+*/
+esp_err_t esp32_rio_io_nv_params_load(void) {
+    esp32_rio_config_io_t config;
+    esp32_rio_config_dq_t dq_config;
+    
+    io_config_fill(&config, &dq_config); //Defaults, for any setting left out of the store
+    if (esp32_rio_config_read(ESP32_RIO_CONFIG_DQ, &dq_config, sizeof(dq_config)) == ESP_OK) {
+        for (int bank = 0; bank < 2; bank++) {
+            for (int i = 0; i < ESP32_RIO_NUM_DQ_CHANNELS; i++) {
+                esp32_rio_dq_mode_config_t mode = {
+                    .mode = dq_config.modes[bank][i],
+                    .time_ms = dq_config.times_ms[bank][i],
+                    .frequency_hz = dq_config.frequencies_hz[bank][i],
+                    .duty_permille = dq_config.duties_permille[bank][i]
+                };
+                if (esp32_rio_set_dq_mode(bank, i, &mode) != ESP_OK) {
+                    ESP_LOGW(TAG, "Ignoring invalid stored mode for DQ%d%d.", bank, i);
                 }
             }
         }
     }
+    
+    esp_err_t err = esp32_rio_config_read(ESP32_RIO_CONFIG_IO, &config, sizeof(config));
+    if (err != ESP_OK) {
+        ESP_LOGI(TAG, "No stored I/O settings: %s", esp_err_to_name(err));
+        return err;
+    }
+    
+    for (int i = 0; i < ESP32_RIO_NUM_DI_CHANNELS; i++) {
+        if (esp32_rio_set_di_filter(i, config.di_filter_us[i]) != ESP_OK) {
+            ESP_LOGW(TAG, "Ignoring invalid stored filter time for DI%d.", i);
+        }
+        if (esp32_rio_set_di_mode(i, (esp32_rio_di_mode_t)config.di_modes[i]) != ESP_OK) {
+            ESP_LOGW(TAG, "Ignoring invalid stored mode for DI%d.", i);
+        }
+    }
+    if (esp32_rio_set_counter_window(config.counter_window_ms) != ESP_OK) {
+        ESP_LOGW(TAG, "Ignoring invalid stored counter window.");
+    }
+    if (esp32_rio_set_output_watchdog(config.watchdog_ms) != ESP_OK) {
+        ESP_LOGW(TAG, "Ignoring invalid stored output watchdog timeout.");
+    }
+    for (int bank = 0; bank < 2; bank++) {
+        for (int i = 0; i < ESP32_RIO_NUM_DQ_CHANNELS; i++) {
+            if (esp32_rio_set_dq_safe_state(bank, i, (esp32_rio_dq_safe_state_t)config.dq_safe_states[bank][i]) != ESP_OK) {
+                ESP_LOGW(TAG, "Ignoring invalid stored safe state for DQ%d%d.", bank, i);
+            }
+        }
+    }
+    
+    ESP_LOGI(TAG, "I/O settings loaded.");
+    return ESP_OK;
 }
 
 
-static void debounce_timer_callback(TimerHandle_t xTimer) {
-    if (s_button_pressed) {
-        // OE toggle button pressed
-        s_button_pressed = false;
-        ESP_LOGI(TAG, "OE Button (IO%d) pressed (debounced).", OE_TOGGLE_BTN);
-        
-        // Notify main task
-        if (s_oe_button_toggle_callback) {
-            s_oe_button_toggle_callback();
+/*
+ Store current I/O settings
+*/
+esp_err_t esp32_rio_io_nv_params_save(void) {
+    esp32_rio_config_io_t config;
+    esp32_rio_config_dq_t dq_config;
+    
+    io_config_fill(&config, &dq_config);
+    esp32_rio_config_hold(); //Both sections in one write
+    esp_err_t err = esp32_rio_config_write(ESP32_RIO_CONFIG_IO, &config, sizeof(config));
+    if (err == ESP_OK) {
+        err = esp32_rio_config_write(ESP32_RIO_CONFIG_DQ, &dq_config, sizeof(dq_config));
+    }
+    esp_err_t release_err = esp32_rio_config_release();
+    if (err == ESP_OK) {
+        err = release_err;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error storing I/O settings: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+
+/*
+ Current I/O settings, as stored
+*/
+static void io_config_fill(esp32_rio_config_io_t *config, esp32_rio_config_dq_t *dq_config) {
+    memset(config, 0, sizeof(*config));
+    memset(dq_config, 0, sizeof(*dq_config));
+    for (int i = 0; i < ESP32_RIO_NUM_DI_CHANNELS; i++) {
+        config->di_filter_us[i] = s_di_filter_us[i];
+        config->di_modes[i] = (uint8_t)s_di_modes[i];
+    }
+    config->counter_window_ms = s_counter_window_ms;
+    config->watchdog_ms = s_watchdog_timeout_ms;
+    for (int bank = 0; bank < 2; bank++) {
+        for (int i = 0; i < ESP32_RIO_NUM_DQ_CHANNELS; i++) {
+            config->dq_safe_states[bank][i] = (uint8_t)s_dq_safe_states[bank][i];
+            esp32_rio_dq_mode_config_t mode;
+            esp32_rio_get_dq_mode(bank, i, &mode);
+            dq_config->modes[bank][i] = (uint8_t)mode.mode;
+            dq_config->times_ms[bank][i] = mode.time_ms;
+            dq_config->frequencies_hz[bank][i] = mode.frequency_hz;
+            dq_config->duties_permille[bank][i] = mode.duty_permille;
         }
     }
 }
 
 
+/*
+ Disable all digital outputs
+*/
+void esp32_rio_disable_outputs(void) {
+    if (atomic_load(&s_dq_moded_channels) != 0) {
+        dq_modes_stop(false); //First, so that no timer turns an output on again
+    }
+    portENTER_CRITICAL(&s_dq_shadow_lock);
+    s_dq_outputs_disabled = true; //Timer callbacks already running on the other core leave the outputs alone
+    REG_WRITE(GPIO_OUT_W1TC_REG, (uint32_t)DQ_PINS_MASK);
+    REG_WRITE(GPIO_OUT1_W1TC_REG, (uint32_t)(DQ_PINS_MASK >> 32));
+    s_dq_shadow_valid = false;
+    portEXIT_CRITICAL(&s_dq_shadow_lock);
+}
+
+
+/*
+ Apply output patterns to both output banks at once.
+ Bit n of each pattern drives output n of the corresponding bank; bits beyond the channel count are ignored.
+ Outputs in normal mode whose pattern bit changed since the last write are written through the GPIO set/clear
+ registers with no more than two stores per register bank, so all of them switch together. Outputs in other
+ modes then act on their coil edges. Ignored after an output watchdog expiry, until it is armed again.
+*/
+void esp32_rio_apply_outputs(uint16_t bank0_pattern, uint16_t bank1_pattern) {
+    if (s_watchdog_expired) {
+        return; //Outputs held in their safe states
+    }
+    uint32_t patterns = ((uint32_t)bank0_pattern | ((uint32_t)bank1_pattern << 16)) & DQ_SHADOW_MASK;
+    bool moded = atomic_load(&s_dq_moded_channels) != 0;
+    uint64_t normal_pins_mask = DQ_PINS_MASK;
+    if (moded) {
+        xSemaphoreTake(s_dq_mode_mutex, portMAX_DELAY);
+        normal_pins_mask = s_dq_normal_pins_mask;
+    }
+    
+    portENTER_CRITICAL(&s_dq_shadow_lock);
+    s_dq_outputs_disabled = false;
+    uint32_t changed = s_dq_shadow_valid ? (patterns ^ s_dq_shadow_patterns) : DQ_SHADOW_MASK;
+    if (changed != 0) {
+        uint64_t changed_mask = dq_pattern_pins((uint16_t)changed, (uint16_t)(changed >> 16)) & normal_pins_mask;
+        uint64_t set_mask = dq_pattern_pins(bank0_pattern, bank1_pattern) & changed_mask;
+        uint64_t clear_mask = changed_mask & ~set_mask;
+        REG_WRITE(GPIO_OUT_W1TS_REG, (uint32_t)set_mask);
+        REG_WRITE(GPIO_OUT_W1TC_REG, (uint32_t)clear_mask);
+        REG_WRITE(GPIO_OUT1_W1TS_REG, (uint32_t)(set_mask >> 32));
+        REG_WRITE(GPIO_OUT1_W1TC_REG, (uint32_t)(clear_mask >> 32));
+        s_dq_shadow_patterns = patterns;
+        s_dq_shadow_valid = true;
+    }
+    portEXIT_CRITICAL(&s_dq_shadow_lock);
+    if (changed == 0) {
+        esp32_rio_diag_count(ESP32_RIO_DIAG_OUTPUT_NOOPS);
+    }
+    if (moded) {
+        dq_modes_apply((uint32_t)bank0_pattern | ((uint32_t)bank1_pattern << 16));
+        xSemaphoreGive(s_dq_mode_mutex);
+    }
+}
+
+
+/*
+ GPIO mask of the outputs whose bit is set in the patterns (bit n of each pattern: output n of that bank)
+*/
+static uint64_t dq_pattern_pins(uint16_t bank0_pattern, uint16_t bank1_pattern) {
+    return 0 ESP32_RIO_BOARD_DQ0(DQ0_SET_BIT) ESP32_RIO_BOARD_DQ1(DQ1_SET_BIT);
+}
+
+
+/*
+ Have the next esp32_rio_apply_outputs drive every output in normal mode, after outputs were driven otherwise
+*/
+static void dq_shadow_invalidate(void) {
+    portENTER_CRITICAL(&s_dq_shadow_lock);
+    s_dq_shadow_valid = false;
+    portEXIT_CRITICAL(&s_dq_shadow_lock);
+}
+
+
+/*
+ Set the output watchdog timeout, in milliseconds (0 disables the watchdog). Takes effect immediately,
+ restarting the timeout
+*/
+esp_err_t esp32_rio_set_output_watchdog(uint32_t timeout_ms) {
+    if (timeout_ms > ESP32_RIO_OUTPUT_WATCHDOG_MAX_MS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_watchdog_timeout_ms = timeout_ms;
+    if (s_watchdog_timer == NULL) {
+        return ESP_OK; //Applied when I/O services start
+    }
+    ESP_RETURN_ON_ERROR(gptimer_set_raw_count(s_watchdog_timer, 0),
+                        TAG,
+                        "gptimer_set_raw_count fail.");
+    gptimer_alarm_config_t alarm_config = {
+        .alarm_count = (uint64_t)timeout_ms * (OUTPUT_WATCHDOG_RESOLUTION_HZ / 1000),
+        .flags.auto_reload_on_alarm = false //Fires once per feed
+    };
+    esp_err_t err = gptimer_set_alarm_action(s_watchdog_timer, (timeout_ms != 0) ? &alarm_config : NULL);
+    output_watchdog_run(timeout_ms != 0 && atomic_load(&s_watchdog_armed)); //A disabled watchdog holds no timer, nor its power management lock
+    return err;
+}
+
+
+/*
+ Query the output watchdog timeout, in milliseconds
+*/
+uint32_t esp32_rio_get_output_watchdog(void) {
+    return s_watchdog_timeout_ms;
+}
+
+
+/*
+ Set the state a given output of a given output bank is driven to on output watchdog expiry
+*/
+esp_err_t esp32_rio_set_dq_safe_state(unsigned int bank_number, unsigned int output_number, esp32_rio_dq_safe_state_t state) {
+    if (bank_number > 1 || output_number >= ESP32_RIO_NUM_DQ_CHANNELS ||
+        (state != ESP32_RIO_DQ_SAFE_OFF && state != ESP32_RIO_DQ_SAFE_ON && state != ESP32_RIO_DQ_SAFE_HOLD)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint64_t set_mask = 0;
+    uint64_t clear_mask = 0;
+    
+    s_dq_safe_states[bank_number][output_number] = (uint8_t)state;
+    for (int bank = 0; bank < 2; bank++) {
+        for (int i = 0; i < ESP32_RIO_NUM_DQ_CHANNELS; i++) {
+            if (s_dq_safe_states[bank][i] == ESP32_RIO_DQ_SAFE_ON) {
+                set_mask |= 1ULL << DQ[bank][i];
+            } else if (s_dq_safe_states[bank][i] == ESP32_RIO_DQ_SAFE_OFF) {
+                clear_mask |= 1ULL << DQ[bank][i];
+            }
+        }
+    }
+    portENTER_CRITICAL(&s_dq_safe_lock);
+    s_dq_safe_set_mask = set_mask;
+    s_dq_safe_clear_mask = clear_mask;
+    portEXIT_CRITICAL(&s_dq_safe_lock);
+    return ESP_OK;
+}
+
+
+/*
+ Query the safe state of a given output of a given output bank
+*/
+esp32_rio_dq_safe_state_t esp32_rio_get_dq_safe_state(unsigned int bank_number, unsigned int output_number) {
+    if (bank_number > 1 || output_number >= ESP32_RIO_NUM_DQ_CHANNELS) {
+        return ESP32_RIO_DQ_SAFE_OFF;
+    }
+    return (esp32_rio_dq_safe_state_t)s_dq_safe_states[bank_number][output_number];
+}
+
+
+/*
+ Start watching for output activity, normally when outputs get enabled. Lifts the hold on outputs of an earlier expiry
+*/
+void esp32_rio_arm_output_watchdog(void) {
+    // The alarm disables itself when it fires, so set it up again from a fresh count
+    esp32_rio_set_output_watchdog(s_watchdog_timeout_ms);
+    dq_shadow_invalidate(); //Outputs may still be in their safe states
+    s_watchdog_expired = false;
+    atomic_store(&s_watchdog_armed, true);
+    output_watchdog_run(s_watchdog_timeout_ms != 0);
+}
+
+
+/*
+ Stop watching for output activity, normally when outputs get disabled
+*/
+void esp32_rio_disarm_output_watchdog(void) {
+    atomic_store(&s_watchdog_armed, false);
+    output_watchdog_run(false);
+}
+
+
+/*
+ Restart the output watchdog timeout, on every output write by the master
+*/
+void esp32_rio_feed_output_watchdog(void) {
+    if (s_watchdog_timer != NULL && atomic_load(&s_watchdog_armed)) {
+        gptimer_set_raw_count(s_watchdog_timer, 0);
+    }
+}
+
+
+/*
+ Retrieve output watchdog statistics: expiries since boot, last and worst reaction latency (microseconds)
+*/
+void esp32_rio_get_output_watchdog_stats(uint32_t *expiry_count, uint32_t *last_latency_us, uint32_t *max_latency_us) {
+    if (expiry_count) {
+        *expiry_count = s_watchdog_expiry_count;
+    }
+    if (last_latency_us) {
+        *last_latency_us = s_watchdog_last_latency_us;
+    }
+    if (max_latency_us) {
+        *max_latency_us = s_watchdog_max_latency_us;
+    }
+}
+
+
+/*
+ Set the mode of a given output of a given output bank. A change of mode or PWM frequency turns the output off
+ until the next output update. Other parameter changes take effect on the next coil edge, or at once for the
+ duty cycle of a running PWM output. Should the mode not be set up, the output is left in normal mode
+*/
+esp_err_t esp32_rio_set_dq_mode(unsigned int bank_number, unsigned int output_number, const esp32_rio_dq_mode_config_t *config) {
+    if (bank_number > 1 || output_number >= ESP32_RIO_NUM_DQ_CHANNELS || config->mode > ESP32_RIO_DQ_MODE_PWM) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (config->mode != ESP32_RIO_DQ_MODE_NORMAL && config->mode != ESP32_RIO_DQ_MODE_PWM && config->time_ms == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (config->mode == ESP32_RIO_DQ_MODE_PWM &&
+        (config->frequency_hz < ESP32_RIO_DQ_PWM_MIN_HZ || config->frequency_hz > ESP32_RIO_DQ_PWM_MAX_HZ ||
+         config->duty_permille > ESP32_RIO_DQ_PWM_DUTY_MAX)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    unsigned int channel = DQ_CHANNEL(bank_number, output_number);
+    esp32_rio_dq_mode_config_t *current = &s_dq_modes[bank_number][output_number];
+    esp_err_t err = ESP_OK;
+    
+    xSemaphoreTake(s_dq_mode_mutex, portMAX_DELAY);
+    if (config->mode == current->mode && (config->mode != ESP32_RIO_DQ_MODE_PWM || config->frequency_hz == current->frequency_hz)) {
+        // Same waveform, only its parameters change
+        *current = *config;
+        if (config->mode == ESP32_RIO_DQ_MODE_PWM && (s_dq_coils & (1UL << channel))) {
+            dq_pwm_set_duty(bank_number, output_number, config->duty_permille);
+        }
+        xSemaphoreGive(s_dq_mode_mutex);
+        return ESP_OK;
+    }
+    
+    // Quiesce the output in its current mode
+    if (s_dq_timers[bank_number][output_number] != NULL) {
+        esp_timer_stop(s_dq_timers[bank_number][output_number]); //Fails harmlessly if not running
+    }
+    if (current->mode == ESP32_RIO_DQ_MODE_PWM) {
+        dq_pwm_release(bank_number, output_number);
+    }
+    gpio_set_level(DQ[bank_number][output_number], 0);
+    s_dq_coils &= ~(1UL << channel); //The next update counts as an edge
+    
+    // Set up the new one
+    if (config->mode == ESP32_RIO_DQ_MODE_PWM) {
+        err = dq_pwm_claim(bank_number, output_number, config->frequency_hz);
+    } else if (config->mode != ESP32_RIO_DQ_MODE_NORMAL && s_dq_timers[bank_number][output_number] == NULL) {
+        const esp_timer_create_args_t dq_timer_args = {
+            .callback = dq_timer_callback,
+            .arg = DQ_TIMER_ARG(bank_number, output_number),
+            .dispatch_method = DQ_TIMER_DISPATCH,
+            .name = "dq_mode"
+        };
+        err = esp_timer_create(&dq_timer_args, &s_dq_timers[bank_number][output_number]);
+    }
+    if (err == ESP_OK) {
+        *current = *config;
+    } else {
+        ESP_LOGE(TAG, "Failed to set up mode %u of DQ%u%u: %s", (unsigned int)config->mode, bank_number, output_number,
+                 esp_err_to_name(err));
+        *current = (esp32_rio_dq_mode_config_t){ 0 };
+    }
+    dq_modes_update_masks();
+    xSemaphoreGive(s_dq_mode_mutex);
+    return err;
+}
+
+
+/*
+ Query the mode of a given output of a given output bank
+*/
+void esp32_rio_get_dq_mode(unsigned int bank_number, unsigned int output_number, esp32_rio_dq_mode_config_t *config) {
+    if (bank_number > 1 || output_number >= ESP32_RIO_NUM_DQ_CHANNELS) {
+        *config = (esp32_rio_dq_mode_config_t){ 0 };
+        return;
+    }
+    xSemaphoreTake(s_dq_mode_mutex, portMAX_DELAY);
+    *config = s_dq_modes[bank_number][output_number];
+    xSemaphoreGive(s_dq_mode_mutex);
+}
+
+
+/*
+ Turn status LED on/off
+*/
+
+void esp32_rio_turn_status_led_on(void) {
+    gpio_set_level(STATUS_LED, 1);
+}
+
+
+void esp32_rio_turn_status_led_off(void) {
+    gpio_set_level(STATUS_LED, 0);
+}
+
+
+/*
+ Turn on/off a given digital output of a given output bank (both numbers must be in range)
+*/
+
+
+void esp32_rio_turn_output_on(unsigned int bank_number, unsigned int output_number) {
+    gpio_set_level(DQ[bank_number][output_number], 1U);
+    dq_shadow_invalidate();
+}
+
+
+void esp32_rio_turn_output_off(unsigned int bank_number, unsigned int output_number) {
+    gpio_set_level(DQ[bank_number][output_number], 0);
+    dq_shadow_invalidate();
+}
+
+
+/*
+ Start Morse blinking for "W", unless already blinking.
+ The task runs until stopped
+*/
+void esp32_rio_start_morse_blinker(void) {
+    if (s_morse_blinker_task_handle != NULL) {
+        return;
+    }
+    BaseType_t ret_task_create = xTaskCreatePinnedToCore(morse_blinker_task, "morse_blinker", MORSE_BLINKER_TASK_STACK_SIZE, NULL,
+                                                         MORSE_BLINKER_TASK_PRIORITY, &s_morse_blinker_task_handle, MORSE_BLINKER_TASK_CORE);
+    if (ret_task_create != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create morse_blinker_task: %d", ret_task_create);
+        s_morse_blinker_task_handle = NULL;
+    }
+}
+
+
+/*
+ Stop Morse blinking, leaving the status LED off
+*/
+void esp32_rio_stop_morse_blinker(void) {
+    if (s_morse_blinker_task_handle == NULL) {
+        return;
+    }
+    vTaskDelete(s_morse_blinker_task_handle);
+    s_morse_blinker_task_handle = NULL;
+    gpio_set_level(STATUS_LED, 0);
+}
+
+
+static void IRAM_ATTR oe_button_isr_handler(void *arg) {
+    s_button_pressed = true;
+    xTimerStartFromISR(s_debounce_timer, NULL);
+}
+
+
+static void IRAM_ATTR di_isr_handler(void *arg) {
+    uint32_t channel = (uintptr_t)arg & 0xFFU; //See DI_ISR_ARG
+    uint32_t gpio_num = (uintptr_t)arg >> 8;
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    if (s_di_isr_counter_channels & (1UL << channel)) {
+        s_isr_pulse_counts[channel]++; //Counter mode input without a PCNT unit
+        return;
+    }
+#if CONFIG_ESP32_RIO_POWER_LIGHT_SLEEP
+    if (atomic_fetch_and(&s_di_sleep_edges, ~(1UL << channel)) & (1UL << channel)) {
+        // Edge already recorded while leaving light sleep, only io_task is left to flag
+        xTaskNotifyFromISR(s_io_task_handle, 1UL << channel, eSetBits, &higher_priority_task_woken);
+        portYIELD_FROM_ISR(higher_priority_task_woken);
+        return;
+    }
+#endif
+    di_edge_signal(channel, gpio_num, &higher_priority_task_woken);
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+
+/*
+ Record an edge of a DI channel and flag it to io_task, from interrupt context
+*/
+static void IRAM_ATTR di_edge_signal(uint32_t channel, uint32_t gpio_num, BaseType_t *higher_priority_task_woken) {
+    if (di_edge_record(channel, gpio_num)) {
+        xTaskNotifyFromISR(s_io_task_handle, 1UL << channel, eSetBits, higher_priority_task_woken); //Flag input channel as pending
+    }
+}
+
+
+/*
+ Count and timestamp an edge of a DI channel, with no FreeRTOS call. Returns whether io_task must be flagged
+*/
+static bool IRAM_ATTR di_edge_record(uint32_t channel, uint32_t gpio_num) {
+    uint32_t channel_bit = 1UL << channel;
+    s_di_edge_count++;
+    if (s_di_filtered_channels & channel_bit) {
+        if (atomic_load(&s_di_filter_armed)) {
+            return false; //Bouncing filtered input, already being sampled
+        }
+    } else {
+        int64_t now = esp_timer_get_time();
+        s_di_last_edge_us[channel] = (uint32_t)now;
+        di_event_ring_push(&s_di_isr_events, now, channel, (REG_READ(GPIO_IN_REG) >> gpio_num) & 1U);
+        unsigned int none = 0;
+        atomic_compare_exchange_strong(&s_di_edge_pending_since, &none, (uint32_t)now | 1U); //Latency measured from the oldest edge
+    }
+    return true;
+}
+
+
+#if CONFIG_ESP32_RIO_POWER_LIGHT_SLEEP
+
+/*
+ Light sleep wake-up on DI edges and OE button presses. GPIO wake-up only works on levels, so on entering light
+ sleep every pin taking edge interrupts wakes on the level opposite to its current one instead; on leaving it,
+ edge interrupts are restored and the edges of inputs found changed are recorded. Counter inputs keep the chip out of
+ light sleep and are left alone. Both run in the idle task with interrupts disabled, where no FreeRTOS call may be
+ made: the interrupts raised by the wake-up levels of changed pins are left pending instead, so that their handlers
+ run once interrupts are back on, flag io_task and take the OE button press
+*/
+static esp_err_t di_sleep_enter_callback(int64_t sleep_time_us, void *arg) {
+    uint32_t gpio_levels = REG_READ(GPIO_IN_REG);
+    s_sleep_gpio_levels = gpio_levels;
+    for (int i = 0; i < ESP32_RIO_NUM_DI_CHANNELS; i++) {
+        if (!(s_di_counter_channels & (1U << i))) {
+            gpio_wakeup_enable(DI[i], ((gpio_levels >> DI[i]) & 1U) ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+        }
+    }
+    s_sleep_button_level = gpio_get_level(OE_TOGGLE_BTN);
+    gpio_wakeup_enable(OE_TOGGLE_BTN, s_sleep_button_level ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+    return ESP_OK;
+}
+
+
+static esp_err_t di_sleep_exit_callback(int64_t sleep_time_us, void *arg) {
+    uint32_t changed_levels = REG_READ(GPIO_IN_REG) ^ s_sleep_gpio_levels;
+    uint32_t wake_pins = 0;
+    for (int i = 0; i < ESP32_RIO_NUM_DI_CHANNELS; i++) {
+        if (!(s_di_counter_channels & (1U << i))) {
+            gpio_wakeup_disable(DI[i]);
+            gpio_set_intr_type(DI[i], GPIO_INTR_ANYEDGE);
+            wake_pins |= 1UL << DI[i];
+        }
+    }
+    bool button_level = gpio_get_level(OE_TOGGLE_BTN);
+    gpio_wakeup_disable(OE_TOGGLE_BTN);
+    gpio_set_intr_type(OE_TOGGLE_BTN, GPIO_INTR_NEGEDGE);
+    for (int i = 0; i < ESP32_RIO_NUM_DI_CHANNELS; i++) {
+        if ((wake_pins & changed_levels) & (1UL << DI[i])) {
+            di_edge_record(i, DI[i]);
+            atomic_fetch_or(&s_di_sleep_edges, 1UL << i);
+        }
+    }
+    bool button_pressed = s_sleep_button_level && !button_level; //Pressed while asleep
+    
+    // Drop the interrupts raised by the wake-up levels of unchanged pins only
+    REG_WRITE(GPIO_STATUS_W1TC_REG, wake_pins & ~changed_levels);
+#if OE_TOGGLE_BTN < 32
+    if (!button_pressed) {
+        REG_WRITE(GPIO_STATUS_W1TC_REG, 1UL << OE_TOGGLE_BTN);
+    }
+#else
+    if (!button_pressed) {
+        REG_WRITE(GPIO_STATUS1_W1TC_REG, 1UL << (OE_TOGGLE_BTN - 32));
+    }
+#endif
+    return ESP_OK;
+}
+
+#endif //CONFIG_ESP32_RIO_POWER_LIGHT_SLEEP
+
+
+static void io_task(void *pvArg) {
+    uint32_t pending_channels;
+    while (1) {
+        if (xTaskNotifyWait(0, ULONG_MAX, &pending_channels, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        esp32_rio_power_acquire(ESP32_RIO_POWER_PATH_IO); //Full speed until the work is handed over
+        if (pending_channels & OUTPUT_WATCHDOG_NOTIFY_BIT) {
+            // Outputs already in their safe states, but for the PWM ones and pending output timers
+            if (atomic_load(&s_dq_moded_channels) != 0) {
+                dq_modes_stop(true);
+            }
+            output_watchdog_run(false); //Armed again along with the outputs
+            // Notify main task
+            if (s_output_watchdog_expiry_callback) {
+                s_output_watchdog_expiry_callback();
+            }
+            pending_channels &= ~OUTPUT_WATCHDOG_NOTIFY_BIT;
+        }
+        if (pending_channels != 0) {
+            di_update(pending_channels);
+        }
+        esp32_rio_power_release(ESP32_RIO_POWER_PATH_IO);
+    }
+}
+            
+            
+/*
+ Sample and publish the inputs once one or more digital inputs (DIx) changed state, on io_task. Edges arrived since
+ the last wake-up are folded into this sample
+*/
+static void di_update(uint32_t pending_channels) {
+    s_di_last_update_us = (uint32_t)esp_timer_get_time();
+    uint32_t edge_since = atomic_exchange(&s_di_edge_pending_since, 0);
+    uint16_t inputs = esp32_rio_read_inputs();
+    s_di_update_count++;
+    
+    // Filtered channels report their debounced level, sampling starts on their first edge
+    portENTER_CRITICAL(&s_di_filter_lock);
+    uint16_t filtered_channels = s_di_filtered_channels;
+    inputs = (inputs & ~filtered_channels) | (s_di_stable_levels & filtered_channels);
+    portEXIT_CRITICAL(&s_di_filter_lock);
+    if (pending_channels & filtered_channels) {
+        di_filter_arm();
+    }
+    ESP32_RIO_TRACE(ESP32_RIO_TRACE_DI_UPDATE, pending_channels, inputs, 0, 0);
+    
+    // Notify main task
+    if (s_di_level_change_callback) {
+        s_di_level_change_callback(inputs);
+    }
+    if (edge_since != 0) {
+        esp32_rio_diag_record_latency(ESP32_RIO_DIAG_DI_TO_REGISTER, ((uint32_t)esp_timer_get_time() | 1U) - edge_since);
+    }
+}
+
+
+static void debounce_timer_callback(TimerHandle_t xTimer) {
+    if (s_button_pressed) {
+        // OE toggle button pressed
+        s_button_pressed = false;
+        ESP_LOGI(TAG, "OE Button (IO%d) pressed (debounced).", OE_TOGGLE_BTN);
+        
+        // Notify main task
+        if (s_oe_button_toggle_callback) {
+            s_oe_button_toggle_callback();
+        }
+    }
+}
+
+
+static void di_filter_arm(void) {
+    bool expected = false;
+    if (atomic_compare_exchange_strong(&s_di_filter_armed, &expected, true)) {
+        esp_timer_start_once(s_di_filter_timer, ESP32_RIO_DI_FILTER_TICK_US);
+    }
+}
+
+
+static void di_filter_timer_callback(void *arg) {
+    uint16_t levels = esp32_rio_read_inputs();
+    bool settling = false;
+    uint16_t flipped = 0;
+    
+    portENTER_CRITICAL(&s_di_filter_lock);
+    for (int i = 0; i < ESP32_RIO_NUM_DI_CHANNELS; i++) {
+        uint16_t channel_bit = 1U << i;
+        if (!(s_di_filtered_channels & channel_bit)) {
+            continue;
+        }
+        if ((levels ^ s_di_stable_levels) & channel_bit) {
+            if (++s_di_filter_counts[i] >= s_di_filter_ticks[i]) {
+                s_di_stable_levels ^= channel_bit; //Level held long enough
+                s_di_filter_counts[i] = 0;
+                flipped |= channel_bit;
+            } else {
+                settling = true;
+            }
+        } else if (s_di_filter_counts[i] > 0) {
+            s_di_filter_counts[i]--;
+            settling = s_di_filter_counts[i] > 0 || settling;
+        }
+    }
+    portEXIT_CRITICAL(&s_di_filter_lock);
+    
+    if (flipped) {
+        int64_t now = esp_timer_get_time();
+        for (int i = 0; i < ESP32_RIO_NUM_DI_CHANNELS; i++) {
+            if (flipped & (1U << i)) {
+                di_event_ring_push(&s_di_filter_events, now, i, (s_di_stable_levels >> i) & 1U);
+            }
+        }
+        xTaskNotify(s_io_task_handle, DI_FILTER_NOTIFY_BIT, eSetBits);
+    }
+    if (!settling) {
+        // Disarm, then look again for an edge the ISR skipped while the sampler was still armed
+        atomic_store(&s_di_filter_armed, false);
+        if (((esp32_rio_read_inputs() ^ s_di_stable_levels) & s_di_filtered_channels) == 0) {
+            return;
+        }
+        bool expected = false;
+        if (!atomic_compare_exchange_strong(&s_di_filter_armed, &expected, true)) {
+            return; //Re-armed by io_task meanwhile
+        }
+    }
+    esp_timer_start_once(s_di_filter_timer, ESP32_RIO_DI_FILTER_TICK_US);
+}
+
+
+static size_t di_events_merge(esp32_rio_di_event_t *events, size_t max_events, bool consume) {
+    unsigned int isr_tail = atomic_load_explicit(&s_di_isr_events.tail, memory_order_relaxed);
+    unsigned int isr_head = atomic_load_explicit(&s_di_isr_events.head, memory_order_acquire);
+    unsigned int filter_tail = atomic_load_explicit(&s_di_filter_events.tail, memory_order_relaxed);
+    unsigned int filter_head = atomic_load_explicit(&s_di_filter_events.head, memory_order_acquire);
+    size_t n = 0;
+    
+    while (n < max_events && (isr_tail != isr_head || filter_tail != filter_head)) {
+        const esp32_rio_di_event_t *record;
+        const esp32_rio_di_event_t *isr_record = &s_di_isr_events.records[isr_tail & (DI_EVENT_RING_SIZE - 1)];
+        const esp32_rio_di_event_t *filter_record = &s_di_filter_events.records[filter_tail & (DI_EVENT_RING_SIZE - 1)];
+        if (filter_tail == filter_head || (isr_tail != isr_head && isr_record->timestamp_us <= filter_record->timestamp_us)) {
+            record = isr_record;
+            isr_tail++;
+        } else {
+            record = filter_record;
+            filter_tail++;
+        }
+        if (events != NULL) {
+            events[n] = *record;
+        }
+        n++;
+    }
+    if (consume) {
+        atomic_store_explicit(&s_di_isr_events.tail, isr_tail, memory_order_release);
+        atomic_store_explicit(&s_di_filter_events.tail, filter_tail, memory_order_release);
+    }
+    return n;
+}
+
+
+static esp_err_t di_counters_init(void) {
+    int pcnt_units_used = 0;
+    
+    s_di_counter_channels = 0;
+    s_di_isr_counter_channels = 0;
+    for (int i = 0; i < ESP32_RIO_NUM_DI_CHANNELS; i++) {
+        if (s_di_modes[i] != ESP32_RIO_DI_MODE_COUNTER) {
+            continue;
+        }
+        s_di_counter_channels |= 1U << i;
+        s_counter_base_counts[i] = 0;
+        s_counter_window_counts[i] = 0;
+        s_counter_rates[i] = 0;
+        if (pcnt_units_used == SOC_PCNT_UNITS_PER_GROUP) {
+            // Out of PCNT units, fall back to counting in the ISR
+            s_isr_pulse_counts[i] = 0;
+            s_di_isr_counter_channels |= 1U << i;
+            ESP_LOGI(TAG, "DI%d counting pulses by interrupt.", i);
+            continue;
+        }
+        
+        pcnt_unit_config_t unit_config = {
+            .low_limit = -1,
+            .high_limit = PCNT_HIGH_LIMIT,
+            .flags.accum_count = 1 //Keep counting across hardware overflows
+        };
+        ESP_RETURN_ON_ERROR(pcnt_new_unit(&unit_config, &s_pcnt_units[i]),
+                            TAG,
+                            "pcnt_new_unit fail.");
+        pcnt_chan_config_t chan_config = {
+            .edge_gpio_num = DI[i],
+            .level_gpio_num = -1
+        };
+        ESP_RETURN_ON_ERROR(pcnt_new_channel(s_pcnt_units[i], &chan_config, &s_pcnt_channels[i]),
+                            TAG,
+                            "pcnt_new_channel fail.");
+        ESP_RETURN_ON_ERROR(pcnt_channel_set_edge_action(s_pcnt_channels[i], PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_HOLD),
+                            TAG,
+                            "pcnt_channel_set_edge_action fail.");
+        ESP_RETURN_ON_ERROR(pcnt_unit_add_watch_point(s_pcnt_units[i], PCNT_HIGH_LIMIT),
+                            TAG,
+                            "pcnt_unit_add_watch_point fail.");
+        ESP_RETURN_ON_ERROR(pcnt_unit_enable(s_pcnt_units[i]),
+                            TAG,
+                            "pcnt_unit_enable fail.");
+        ESP_RETURN_ON_ERROR(pcnt_unit_clear_count(s_pcnt_units[i]),
+                            TAG,
+                            "pcnt_unit_clear_count fail.");
+        ESP_RETURN_ON_ERROR(pcnt_unit_start(s_pcnt_units[i]),
+                            TAG,
+                            "pcnt_unit_start fail.");
+        pcnt_units_used++;
+        ESP_LOGI(TAG, "DI%d counting pulses by PCNT.", i);
+    }
+    
+    if (s_di_counter_channels == 0) {
+        return ESP_OK;
+    }
+    esp32_rio_power_acquire(ESP32_RIO_POWER_PATH_COUNTERS); //Pulses would go uncounted in light sleep
+    s_counters_power_held = true;
+    const esp_timer_create_args_t counter_timer_args = {
+        .callback = counter_timer_callback,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "di_counters"
+    };
+    s_counter_window_elapsed_ms = 0;
+    return esp_timer_create(&counter_timer_args, &s_counter_timer);
+}
+
+
+static void di_counters_deinit(void) {
+    if (s_counter_timer != NULL) {
+        esp_timer_stop(s_counter_timer); //Fails harmlessly if not started
+        esp_timer_delete(s_counter_timer);
+        s_counter_timer = NULL;
+    }
+    for (int i = 0; i < ESP32_RIO_NUM_DI_CHANNELS; i++) {
+        if (s_pcnt_units[i] == NULL) {
+            continue;
+        }
+        // Unwind whatever stage the unit reached
+        pcnt_unit_stop(s_pcnt_units[i]);
+        pcnt_unit_disable(s_pcnt_units[i]);
+        if (s_pcnt_channels[i] != NULL) {
+            pcnt_del_channel(s_pcnt_channels[i]);
+            s_pcnt_channels[i] = NULL;
+        }
+        pcnt_unit_remove_watch_point(s_pcnt_units[i], PCNT_HIGH_LIMIT);
+        pcnt_del_unit(s_pcnt_units[i]);
+        s_pcnt_units[i] = NULL;
+    }
+    s_di_counter_channels = 0;
+    s_di_isr_counter_channels = 0;
+    if (s_counters_power_held) {
+        esp32_rio_power_release(ESP32_RIO_POWER_PATH_COUNTERS);
+        s_counters_power_held = false;
+    }
+}
+
+
+static uint32_t di_counter_read(unsigned int input_number) {
+    if (s_pcnt_units[input_number] != NULL) {
+        int count = 0;
+        pcnt_unit_get_count(s_pcnt_units[input_number], &count);
+        return (uint32_t)count;
+    }
+    return s_isr_pulse_counts[input_number] - s_counter_base_counts[input_number];
+}
+
+
+static void counter_timer_callback(void *arg) {
+    uint32_t counts[ESP32_RIO_NUM_DI_CHANNELS] = { 0 };
+    uint32_t reset_requests = atomic_exchange(&s_counter_reset_requests, 0);
+    
+    s_counter_window_elapsed_ms += ESP32_RIO_COUNTER_PUBLISH_MS;
+    bool window_end = s_counter_window_elapsed_ms >= s_counter_window_ms;
+    for (int i = 0; i < ESP32_RIO_NUM_DI_CHANNELS; i++) {
+        if (!(s_di_counter_channels & (1U << i))) {
+            continue;
+        }
+        if (reset_requests & (1U << i)) {
+            if (s_pcnt_units[i] != NULL) {
+                pcnt_unit_clear_count(s_pcnt_units[i]);
+            } else {
+                s_counter_base_counts[i] = s_isr_pulse_counts[i];
+            }
+            s_counter_window_counts[i] = 0;
+        }
+        counts[i] = di_counter_read(i);
+        if (window_end) {
+            uint64_t rate = (uint64_t)(counts[i] - s_counter_window_counts[i]) * 1000000ULL / s_counter_window_elapsed_ms;
+            s_counter_rates[i] = rate > UINT32_MAX ? UINT32_MAX : (uint32_t)rate;
+            s_counter_window_counts[i] = counts[i];
+        }
+    }
+    if (window_end) {
+        s_counter_window_elapsed_ms = 0;
+    }
+    
+    // Notify main task
+    if (s_counter_update_callback) {
+        s_counter_update_callback(counts, s_counter_rates);
+    }
+}
+
+
+static esp_err_t output_watchdog_init(void) {
+    gptimer_config_t timer_config = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = OUTPUT_WATCHDOG_RESOLUTION_HZ
+    };
+    ESP_RETURN_ON_ERROR(gptimer_new_timer(&timer_config, &s_watchdog_timer),
+                        TAG,
+                        "gptimer_new_timer fail.");
+    gptimer_event_callbacks_t callbacks = {
+        .on_alarm = output_watchdog_alarm_callback
+    };
+    ESP_RETURN_ON_ERROR(gptimer_register_event_callbacks(s_watchdog_timer, &callbacks, NULL),
+                        TAG,
+                        "gptimer_register_event_callbacks fail.");
+    ESP_RETURN_ON_ERROR(esp32_rio_set_output_watchdog(s_watchdog_timeout_ms),
+                        TAG,
+                        "Output watchdog alarm setup fail.");
+    s_watchdog_run_mutex = xSemaphoreCreateMutexStatic(&s_watchdog_run_mutex_buffer);
+    return ESP_OK; //Timer started once armed
+}
+
+
+static void output_watchdog_deinit(void) {
+    atomic_store(&s_watchdog_armed, false);
+    if (s_watchdog_timer == NULL) {
+        return;
+    }
+    // Unwind whatever stage the timer reached
+    gptimer_stop(s_watchdog_timer);
+    gptimer_disable(s_watchdog_timer);
+    gptimer_del_timer(s_watchdog_timer);
+    s_watchdog_timer = NULL;
+    s_watchdog_running = false;
+}
+
+
+/*
+ Start or stop the watchdog timer, from task context only. Arming and disarming come from different tasks
+*/
+static void output_watchdog_run(bool run) {
+    if (s_watchdog_timer == NULL || s_watchdog_run_mutex == NULL) {
+        return;
+    }
+    xSemaphoreTake(s_watchdog_run_mutex, portMAX_DELAY);
+    if (run && !s_watchdog_running) {
+        s_watchdog_running = gptimer_enable(s_watchdog_timer) == ESP_OK;
+        if (s_watchdog_running && gptimer_start(s_watchdog_timer) != ESP_OK) {
+            gptimer_disable(s_watchdog_timer);
+            s_watchdog_running = false;
+        }
+        if (!s_watchdog_running) {
+            ESP_LOGE(TAG, "Output watchdog timer start fail.");
+        }
+    } else if (!run && s_watchdog_running) {
+        gptimer_stop(s_watchdog_timer);
+        gptimer_disable(s_watchdog_timer);
+        s_watchdog_running = false;
+    }
+    xSemaphoreGive(s_watchdog_run_mutex);
+}
+
+
+static bool IRAM_ATTR output_watchdog_alarm_callback(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_ctx) {
+    bool expected = true;
+    if (!atomic_compare_exchange_strong(&s_watchdog_armed, &expected, false)) {
+        return false; //Outputs not enabled, nothing to protect
+    }
+    s_watchdog_expired = true; //Hold off task-level output updates
+    
+    // Hold outputs keep their level: they are in neither mask
+    portENTER_CRITICAL_ISR(&s_dq_safe_lock);
+    REG_WRITE(GPIO_OUT_W1TS_REG, (uint32_t)s_dq_safe_set_mask);
+    REG_WRITE(GPIO_OUT_W1TC_REG, (uint32_t)s_dq_safe_clear_mask);
+    REG_WRITE(GPIO_OUT1_W1TS_REG, (uint32_t)(s_dq_safe_set_mask >> 32));
+    REG_WRITE(GPIO_OUT1_W1TC_REG, (uint32_t)(s_dq_safe_clear_mask >> 32));
+    portEXIT_CRITICAL_ISR(&s_dq_safe_lock);
+    
+    uint64_t count = edata->alarm_value;
+    gptimer_get_raw_count(timer, &count);
+    uint32_t latency_us = (uint32_t)(count - edata->alarm_value); //One count per microsecond
+    s_watchdog_last_latency_us = latency_us;
+    if (latency_us > s_watchdog_max_latency_us) {
+        s_watchdog_max_latency_us = latency_us;
+    }
+    s_watchdog_expiry_count++;
+    
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    xTaskNotifyFromISR(s_io_task_handle, OUTPUT_WATCHDOG_NOTIFY_BIT, eSetBits, &higher_priority_task_woken);
+    return higher_priority_task_woken == pdTRUE;
+}
+
+
+/*
+ Recompute the channel masks from the output modes. Called with the mode mutex held
+*/
+static void dq_modes_update_masks(void) {
+    uint32_t moded_channels = 0;
+    uint64_t normal_pins_mask = 0;
+    
+    for (int bank = 0; bank < 2; bank++) {
+        for (int i = 0; i < ESP32_RIO_NUM_DQ_CHANNELS; i++) {
+            if (s_dq_modes[bank][i].mode == ESP32_RIO_DQ_MODE_NORMAL) {
+                normal_pins_mask |= 1ULL << DQ[bank][i];
+            } else {
+                moded_channels |= 1UL << DQ_CHANNEL(bank, i);
+            }
+        }
+    }
+    s_dq_normal_pins_mask = normal_pins_mask;
+    s_dq_coils &= moded_channels;
+    dq_shadow_invalidate(); //Outputs back in normal mode follow their coils from the next write
+    atomic_store(&s_dq_moded_channels, moded_channels);
+}
+
+
+/*
+ Act on the coil edges of the outputs not in normal mode. Called with the mode mutex held
+*/
+static void dq_modes_apply(uint32_t coils) {
+    uint32_t moded_channels = atomic_load(&s_dq_moded_channels);
+    uint32_t changed = (coils ^ s_dq_coils) & moded_channels;
+    s_dq_coils = coils & moded_channels;
+    
+    while (changed != 0) {
+        unsigned int channel = __builtin_ctz(changed);
+        changed &= changed - 1;
+        unsigned int bank = channel / 16;
+        unsigned int output = channel % 16;
+        bool coil_on = (coils >> channel) & 1U;
+        const esp32_rio_dq_mode_config_t *config = &s_dq_modes[bank][output];
+        switch (config->mode) {
+            case ESP32_RIO_DQ_MODE_PULSE:
+                if (coil_on) {
+                    gpio_set_level(DQ[bank][output], 1);
+                    dq_timer_start(bank, output, false, config->time_ms); //A new edge restarts a running pulse
+                }
+                break;
+            case ESP32_RIO_DQ_MODE_ON_DELAY:
+                if (coil_on) {
+                    dq_timer_start(bank, output, true, config->time_ms);
+                } else {
+                    esp_timer_stop(s_dq_timers[bank][output]);
+                    gpio_set_level(DQ[bank][output], 0);
+                }
+                break;
+            case ESP32_RIO_DQ_MODE_OFF_DELAY:
+                if (coil_on) {
+                    esp_timer_stop(s_dq_timers[bank][output]);
+                    gpio_set_level(DQ[bank][output], 1);
+                } else {
+                    dq_timer_start(bank, output, false, config->time_ms);
+                }
+                break;
+            case ESP32_RIO_DQ_MODE_PWM:
+                dq_pwm_set_duty(bank, output, coil_on ? config->duty_permille : 0);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+
+/*
+ Stop the waveforms and pending timers of the outputs not in normal mode, when outputs get disabled or on
+ output watchdog expiry. PWM outputs then turn off, or take up their safe states on expiry
+*/
+static void dq_modes_stop(bool safe_states) {
+    xSemaphoreTake(s_dq_mode_mutex, portMAX_DELAY);
+    uint32_t moded_channels = atomic_load(&s_dq_moded_channels);
+    while (moded_channels != 0) {
+        unsigned int channel = __builtin_ctz(moded_channels);
+        moded_channels &= moded_channels - 1;
+        unsigned int bank = channel / 16;
+        unsigned int output = channel % 16;
+        if (s_dq_modes[bank][output].mode != ESP32_RIO_DQ_MODE_PWM) {
+            esp_timer_stop(s_dq_timers[bank][output]); //Timed outputs keep the level they have
+        } else if (!safe_states || s_dq_safe_states[bank][output] == ESP32_RIO_DQ_SAFE_OFF) {
+            dq_pwm_set_duty(bank, output, 0);
+        } else if (s_dq_safe_states[bank][output] == ESP32_RIO_DQ_SAFE_ON) {
+            dq_pwm_set_duty(bank, output, ESP32_RIO_DQ_PWM_DUTY_MAX);
+        } //Hold keeps the waveform running
+    }
+    s_dq_coils = 0; //Coils that are on count as rising edges on the next output update
+    xSemaphoreGive(s_dq_mode_mutex);
+}
+
+
+/*
+ Return every output to normal mode, releasing its timer and LEDC channel. Modes are set up again from the
+ stored settings when I/O services start
+*/
+static void dq_modes_deinit(void) {
+    xSemaphoreTake(s_dq_mode_mutex, portMAX_DELAY);
+    for (int bank = 0; bank < 2; bank++) {
+        for (int i = 0; i < ESP32_RIO_NUM_DQ_CHANNELS; i++) {
+            if (s_dq_timers[bank][i] != NULL) {
+                esp_timer_stop(s_dq_timers[bank][i]);
+                esp_timer_delete(s_dq_timers[bank][i]);
+                s_dq_timers[bank][i] = NULL;
+            }
+            if (s_dq_modes[bank][i].mode == ESP32_RIO_DQ_MODE_PWM) {
+                dq_pwm_release(bank, i);
+            }
+            s_dq_modes[bank][i] = (esp32_rio_dq_mode_config_t){ 0 };
+        }
+    }
+    dq_modes_update_masks();
+    xSemaphoreGive(s_dq_mode_mutex);
+}
+
+
+/*
+ (Re)start the timer of a timed output, driving it to the given level on expiry
+*/
+static void dq_timer_start(unsigned int bank_number, unsigned int output_number, bool level, uint32_t time_ms) {
+    uint32_t channel_bit = 1UL << DQ_CHANNEL(bank_number, output_number);
+    esp_timer_stop(s_dq_timers[bank_number][output_number]); //Fails harmlessly if not running
+    if (level) {
+        atomic_fetch_or(&s_dq_timer_levels, channel_bit);
+    } else {
+        atomic_fetch_and(&s_dq_timer_levels, ~channel_bit);
+    }
+    esp_timer_start_once(s_dq_timers[bank_number][output_number], (uint64_t)time_ms * 1000);
+}
+
+
+static void IRAM_ATTR dq_timer_callback(void *arg) {
+    uint32_t channel = (uintptr_t)arg & 0xFFU; //See DQ_TIMER_ARG
+    uint32_t gpio_num = (uintptr_t)arg >> 8;
+    bool level = (atomic_load(&s_dq_timer_levels) >> channel) & 1U;
+    portENTER_CRITICAL_ISR(&s_dq_shadow_lock); //Either fully before outputs get disabled, or seeing them disabled
+    if (!s_watchdog_expired && !s_dq_outputs_disabled) { //Otherwise outputs held in their safe states, or off
+        if (gpio_num < 32) {
+            REG_WRITE(level ? GPIO_OUT_W1TS_REG : GPIO_OUT_W1TC_REG, 1UL << gpio_num);
+        } else {
+            REG_WRITE(level ? GPIO_OUT1_W1TS_REG : GPIO_OUT1_W1TC_REG, 1UL << (gpio_num - 32));
+        }
+    }
+    portEXIT_CRITICAL_ISR(&s_dq_shadow_lock);
+}
+
+
+/*
+ Route an output to a free LEDC channel, on the LEDC timer running at the given frequency or on a free one.
+ The output starts at zero duty. Called with the mode mutex held
+*/
+static esp_err_t dq_pwm_claim(unsigned int bank_number, unsigned int output_number, uint16_t frequency_hz) {
+    int ledc_channel = 0;
+    while (ledc_channel < SOC_LEDC_CHANNEL_NUM && (s_ledc_channels_used & (1UL << ledc_channel))) {
+        ledc_channel++;
+    }
+    ESP_RETURN_ON_FALSE(ledc_channel < SOC_LEDC_CHANNEL_NUM, ESP_ERR_NO_MEM, TAG, "No LEDC channel left.");
+    
+    int ledc_timer = 0;
+    while (ledc_timer < SOC_LEDC_TIMER_NUM &&
+           (s_ledc_timer_users[ledc_timer] == 0 || s_ledc_timer_frequencies[ledc_timer] != frequency_hz)) {
+        ledc_timer++;
+    }
+    if (ledc_timer == SOC_LEDC_TIMER_NUM) {
+        // No timer at this frequency yet
+        ledc_timer = 0;
+        while (ledc_timer < SOC_LEDC_TIMER_NUM && s_ledc_timer_users[ledc_timer] != 0) {
+            ledc_timer++;
+        }
+        ESP_RETURN_ON_FALSE(ledc_timer < SOC_LEDC_TIMER_NUM, ESP_ERR_NO_MEM, TAG, "No LEDC timer left for %u Hz.", frequency_hz);
+        uint32_t duty_bits = ledc_find_suitable_duty_resolution(DQ_PWM_SRC_CLK_HZ, frequency_hz);
+        if (duty_bits > SOC_LEDC_TIMER_BIT_WIDTH) {
+            duty_bits = SOC_LEDC_TIMER_BIT_WIDTH;
+        }
+        ledc_timer_config_t timer_config = {
+            .speed_mode = LEDC_LOW_SPEED_MODE,
+            .duty_resolution = (ledc_timer_bit_t)duty_bits,
+            .timer_num = (ledc_timer_t)ledc_timer,
+            .freq_hz = frequency_hz,
+            .clk_cfg = LEDC_USE_APB_CLK
+        };
+        ESP_RETURN_ON_ERROR(ledc_timer_config(&timer_config),
+                            TAG,
+                            "ledc_timer_config fail.");
+        s_ledc_timer_frequencies[ledc_timer] = frequency_hz;
+        s_ledc_timer_bits[ledc_timer] = (uint8_t)duty_bits;
+    }
+    
+    ledc_channel_config_t channel_config = {
+        .gpio_num = DQ[bank_number][output_number],
+        .speed_mode = LEDC_LOW_SPEED_MODE,
+        .channel = (ledc_channel_t)ledc_channel,
+        .timer_sel = (ledc_timer_t)ledc_timer,
+        .duty = 0,
+        .hpoint = 0
+    };
+    ESP_RETURN_ON_ERROR(ledc_channel_config(&channel_config),
+                        TAG,
+                        "ledc_channel_config fail.");
+    if (s_ledc_channels_used == 0) {
+        esp32_rio_power_acquire(ESP32_RIO_POWER_PATH_PWM); //Frequency scaling would change the LEDC clock
+    }
+    s_ledc_channels_used |= 1UL << ledc_channel;
+    s_ledc_timer_users[ledc_timer]++;
+    s_dq_ledc_channels[bank_number][output_number] = (uint8_t)(ledc_channel + 1);
+    s_dq_ledc_timers[bank_number][output_number] = (uint8_t)ledc_timer;
+    return ESP_OK;
+}
+
+
+/*
+ Hand an output back to its GPIO output register, off, freeing its LEDC channel. Called with the mode mutex held
+*/
+static void dq_pwm_release(unsigned int bank_number, unsigned int output_number) {
+    int ledc_channel = (int)s_dq_ledc_channels[bank_number][output_number] - 1;
+    if (ledc_channel < 0) {
+        return;
+    }
+    ledc_stop(LEDC_LOW_SPEED_MODE, (ledc_channel_t)ledc_channel, 0);
+    gpio_set_level(DQ[bank_number][output_number], 0);
+    gpio_set_direction(DQ[bank_number][output_number], GPIO_MODE_OUTPUT); //Reconnects the pin to the GPIO output register
+    s_ledc_channels_used &= ~(1UL << ledc_channel);
+    s_ledc_timer_users[s_dq_ledc_timers[bank_number][output_number]]--;
+    s_dq_ledc_channels[bank_number][output_number] = 0;
+    if (s_ledc_channels_used == 0) {
+        esp32_rio_power_release(ESP32_RIO_POWER_PATH_PWM);
+    }
+}
+
+
+static void dq_pwm_set_duty(unsigned int bank_number, unsigned int output_number, uint16_t duty_permille) {
+    int ledc_channel = (int)s_dq_ledc_channels[bank_number][output_number] - 1;
+    if (ledc_channel < 0) {
+        return;
+    }
+    uint32_t duty = ((uint32_t)duty_permille << s_ledc_timer_bits[s_dq_ledc_timers[bank_number][output_number]]) / ESP32_RIO_DQ_PWM_DUTY_MAX;
+    ledc_set_duty(LEDC_LOW_SPEED_MODE, (ledc_channel_t)ledc_channel, duty);
+    ledc_update_duty(LEDC_LOW_SPEED_MODE, (ledc_channel_t)ledc_channel);
+}
+
+
 static void morse_blinker_task(void *pvParameters) {
     // The status LED must be configured already
     gpio_set_level(STATUS_LED, 0); //Ensure it is off
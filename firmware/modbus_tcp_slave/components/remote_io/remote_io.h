@@ -17,21 +17,117 @@ SPDX-License-Identifier: MIT
 #ifndef REMOTE_IO_H
 #define REMOTE_IO_H
 
+#include <stddef.h>
+#include "sdkconfig.h"
 #include "esp_err.h"
+#include CONFIG_ESP32_RIO_BOARD_HEADER
 
-#define ESP32_RIO_NUM_IO_CHANNELS 10
+// Channel counts, from the board pin map
+#define ESP32_RIO_BOARD_COUNT_PIN(channel, gpio) + 1
+#define ESP32_RIO_NUM_DI_CHANNELS (0 ESP32_RIO_BOARD_DI(ESP32_RIO_BOARD_COUNT_PIN))
+#define ESP32_RIO_NUM_DQ_CHANNELS (0 ESP32_RIO_BOARD_DQ0(ESP32_RIO_BOARD_COUNT_PIN)) //Per output bank
+
+#if ESP32_RIO_NUM_DI_CHANNELS < 1 || ESP32_RIO_NUM_DI_CHANNELS > 16
+#error "The board pin map must define 1 to 16 digital inputs"
+#endif
+#if ESP32_RIO_NUM_DQ_CHANNELS < 1 || ESP32_RIO_NUM_DQ_CHANNELS > 16
+#error "The board pin map must define 1 to 16 digital outputs per bank"
+#endif
+#if (0 ESP32_RIO_BOARD_DQ1(ESP32_RIO_BOARD_COUNT_PIN)) != ESP32_RIO_NUM_DQ_CHANNELS
+#error "Both output banks of the board pin map must have the same number of outputs"
+#endif
+
+#define ESP32_RIO_DI_FILTER_TICK_US 100 //DI filter sampling period (filter time granularity)
+#define ESP32_RIO_DI_FILTER_MAX_US  100000
+
+#define ESP32_RIO_COUNTER_PUBLISH_MS        100 //Counter publishing period (rate window granularity)
+#define ESP32_RIO_COUNTER_WINDOW_MIN_MS     100
+#define ESP32_RIO_COUNTER_WINDOW_MAX_MS     60000
+#define ESP32_RIO_COUNTER_WINDOW_DEFAULT_MS 1000
+
+#define ESP32_RIO_OUTPUT_WATCHDOG_MAX_MS 60000
+
+#define ESP32_RIO_DQ_PWM_MIN_HZ 10
+#define ESP32_RIO_DQ_PWM_MAX_HZ 40000
+#define ESP32_RIO_DQ_PWM_DUTY_MAX 1000 //Per mille
+
+typedef struct {
+    int64_t timestamp_us; //esp_timer time of the transition
+    uint8_t channel; //DI channel number
+    uint8_t level; //New level
+} esp32_rio_di_event_t;
+
+typedef enum {
+    ESP32_RIO_DI_MODE_NORMAL = 0, //Level reported as discrete input
+    ESP32_RIO_DI_MODE_COUNTER = 1 //Rising edges counted
+} esp32_rio_di_mode_t;
+
+typedef enum {
+    ESP32_RIO_DQ_SAFE_OFF = 0, //Output turned off on watchdog expiry
+    ESP32_RIO_DQ_SAFE_ON = 1, //Output turned on on watchdog expiry
+    ESP32_RIO_DQ_SAFE_HOLD = 2 //Output kept at its last level on watchdog expiry
+} esp32_rio_dq_safe_state_t;
+
+typedef enum {
+    ESP32_RIO_DQ_MODE_NORMAL = 0, //Output follows its coil
+    ESP32_RIO_DQ_MODE_PULSE = 1, //Rising coil edge turns the output on for the configured time
+    ESP32_RIO_DQ_MODE_ON_DELAY = 2, //Output turns on once its coil has been on for the configured time, off with it
+    ESP32_RIO_DQ_MODE_OFF_DELAY = 3, //Output turns on with its coil, off once the coil has been off for the configured time
+    ESP32_RIO_DQ_MODE_PWM = 4 //Output carries a PWM waveform while its coil is on
+} esp32_rio_dq_mode_t;
+
+typedef struct {
+    uint16_t mode; //esp32_rio_dq_mode_t
+    uint16_t time_ms; //Pulse or delay time (1-65535 ms)
+    uint16_t frequency_hz; //PWM frequency
+    uint16_t duty_permille; //PWM duty cycle (0-1000)
+} esp32_rio_dq_mode_config_t;
 
 typedef void (*oe_button_toggle_cb_t)(void);
-typedef void (*di_level_change_cb_t)(unsigned int);
+typedef void (*di_level_change_cb_t)(uint16_t); //Receives the levels of all digital inputs (bit n = DIn)
+typedef void (*counter_update_cb_t)(const uint32_t *, const uint32_t *); //Receives pulse totals and rates (mHz) of all digital inputs
+typedef void (*output_watchdog_expiry_cb_t)(void); //Outputs were driven to their safe states
 
 void esp32_rio_configure_gpio(void);
-esp_err_t esp32_rio_io_services_init(oe_button_toggle_cb_t, di_level_change_cb_t);
+esp_err_t esp32_rio_io_services_init(oe_button_toggle_cb_t, di_level_change_cb_t, counter_update_cb_t, output_watchdog_expiry_cb_t);
 esp_err_t esp32_rio_io_services_deinit(void);
+uint64_t esp32_rio_get_board_gpio_mask(void);
 
 bool esp32_rio_is_input_on(unsigned int);
+uint16_t esp32_rio_read_inputs(void);
+void esp32_rio_get_di_event_stats(uint32_t *, uint32_t *);
+void esp32_rio_get_di_edge_times(unsigned int, uint32_t *, uint32_t *);
+void esp32_rio_get_di_queue_stats(uint32_t *, uint32_t *);
+void esp32_rio_reset_di_queue_stats(void);
+size_t esp32_rio_peek_di_events(esp32_rio_di_event_t *, size_t);
+void esp32_rio_consume_di_events(size_t);
+size_t esp32_rio_get_di_event_count(uint32_t *);
+
+esp_err_t esp32_rio_set_di_filter(unsigned int, uint32_t);
+uint32_t esp32_rio_get_di_filter(unsigned int);
+esp_err_t esp32_rio_set_di_mode(unsigned int, esp32_rio_di_mode_t);
+esp32_rio_di_mode_t esp32_rio_get_di_mode(unsigned int);
+esp_err_t esp32_rio_set_counter_window(uint32_t);
+uint32_t esp32_rio_get_counter_window(void);
+esp_err_t esp32_rio_reset_counter(unsigned int);
+esp_err_t esp32_rio_io_nv_params_load(void);
+esp_err_t esp32_rio_io_nv_params_save(void);
 
 void esp32_rio_turn_output_on(unsigned int, unsigned int);
 void esp32_rio_turn_output_off(unsigned int, unsigned int);
+void esp32_rio_apply_outputs(uint16_t, uint16_t);
+
+esp_err_t esp32_rio_set_output_watchdog(uint32_t);
+uint32_t esp32_rio_get_output_watchdog(void);
+esp_err_t esp32_rio_set_dq_safe_state(unsigned int, unsigned int, esp32_rio_dq_safe_state_t);
+esp32_rio_dq_safe_state_t esp32_rio_get_dq_safe_state(unsigned int, unsigned int);
+void esp32_rio_arm_output_watchdog(void);
+void esp32_rio_disarm_output_watchdog(void);
+void esp32_rio_feed_output_watchdog(void);
+void esp32_rio_get_output_watchdog_stats(uint32_t *, uint32_t *, uint32_t *);
+
+esp_err_t esp32_rio_set_dq_mode(unsigned int, unsigned int, const esp32_rio_dq_mode_config_t *);
+void esp32_rio_get_dq_mode(unsigned int, unsigned int, esp32_rio_dq_mode_config_t *);
 
 void esp32_rio_disable_outputs(void);
 
@@ -39,5 +135,6 @@ void esp32_rio_turn_status_led_on(void);
 void esp32_rio_turn_status_led_off(void);
 
 void esp32_rio_start_morse_blinker(void);
+void esp32_rio_stop_morse_blinker(void);
 
 #endif //REMOTE_IO_H
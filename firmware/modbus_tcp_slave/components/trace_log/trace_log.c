@@ -0,0 +1,175 @@
+/*
+@file trace_log.c
+@brief Implementation for the trace log component.
+
+This file implements a fixed-size buffer of binary trace records, written by the
+hot paths without any formatting or allocation, and the low-priority task
+draining it to the log.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#include <stddef.h>
+#include <inttypes.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+
+#include "trace_log.h"
+
+#if CONFIG_ESP32_RIO_TRACE_ENABLED
+
+#define TRACE_TASK_CORE CONFIG_ESP32_RIO_AUX_CORE
+#define TRACE_TASK_PRIORITY CONFIG_ESP32_RIO_TRACE_TASK_PRIORITY
+#define TRACE_TASK_STACK_SIZE 3072
+#define TRACE_DRAIN_PERIOD_MS 50
+#define TRACE_DRAIN_BATCH 16 //Records copied out of the buffer at a time
+#define TRACE_RECORDS CONFIG_ESP32_RIO_TRACE_RECORDS
+
+_Static_assert((TRACE_RECORDS & (TRACE_RECORDS - 1)) == 0, "The trace buffer size must be a power of two");
+
+static void trace_task(void *);
+static void trace_render(const esp32_rio_trace_record_t *);
+
+static const char *TAG = "ESP32_RIO_TRACE";
+
+/*
+ Trace points may run on either core and from ISRs, so records are claimed under a spinlock held only for the
+ copy of one record. The drain task is the only reader and renders its copies outside the lock.
+*/
+static esp32_rio_trace_record_t s_records[TRACE_RECORDS];
+static unsigned int s_head = 0; //Records written
+static unsigned int s_tail = 0; //Records drained
+static uint32_t s_dropped = 0; //Records lost to a full buffer
+static portMUX_TYPE s_trace_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t s_trace_task_handle = NULL;
+
+
+/*
+ Start draining trace records to the log
+*/
+esp_err_t esp32_rio_trace_start(void) {
+    if (s_trace_task_handle != NULL) {
+        return ESP_OK;
+    }
+    if (xTaskCreatePinnedToCore(trace_task, "trace_task", TRACE_TASK_STACK_SIZE, NULL,
+                                TRACE_TASK_PRIORITY, &s_trace_task_handle, TRACE_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create trace_task.");
+        s_trace_task_handle = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+
+/*
+ Store a trace record with the given format and raw arguments. Safe from any task or ISR
+*/
+void IRAM_ATTR esp32_rio_trace_write(esp32_rio_trace_format_t format, uint32_t arg0, uint32_t arg1, uint32_t arg2, uint32_t arg3) {
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    
+    portENTER_CRITICAL_SAFE(&s_trace_lock);
+    if (s_head - s_tail >= TRACE_RECORDS) {
+        s_dropped++;
+    } else {
+        esp32_rio_trace_record_t *record = &s_records[s_head & (TRACE_RECORDS - 1)];
+        record->timestamp_us = now;
+        record->format = (uint32_t)format;
+        record->args[0] = arg0;
+        record->args[1] = arg1;
+        record->args[2] = arg2;
+        record->args[3] = arg3;
+        s_head++;
+    }
+    portEXIT_CRITICAL_SAFE(&s_trace_lock);
+}
+
+
+/*
+ Retrieve trace statistics: records written and records dropped since boot
+*/
+void esp32_rio_trace_get_stats(uint32_t *written, uint32_t *dropped) {
+    portENTER_CRITICAL(&s_trace_lock);
+    if (written) {
+        *written = s_head;
+    }
+    if (dropped) {
+        *dropped = s_dropped;
+    }
+    portEXIT_CRITICAL(&s_trace_lock);
+}
+
+
+static void trace_task(void *arg) {
+    esp32_rio_trace_record_t batch[TRACE_DRAIN_BATCH];
+    uint32_t reported_dropped = 0;
+    
+    while (1) {
+        size_t n = 0;
+        portENTER_CRITICAL(&s_trace_lock);
+        while (n < TRACE_DRAIN_BATCH && s_tail != s_head) {
+            batch[n++] = s_records[s_tail++ & (TRACE_RECORDS - 1)];
+        }
+        uint32_t dropped = s_dropped;
+        portEXIT_CRITICAL(&s_trace_lock);
+        
+        for (size_t i = 0; i < n; i++) {
+            trace_render(&batch[i]);
+        }
+        if (dropped != reported_dropped) {
+            ESP_LOGW(TAG, "%" PRIu32 " trace records dropped.", dropped - reported_dropped);
+            reported_dropped = dropped;
+        }
+        if (n < TRACE_DRAIN_BATCH) {
+            vTaskDelay(pdMS_TO_TICKS(TRACE_DRAIN_PERIOD_MS)); //Buffer drained, let records pile up again
+        }
+    }
+}
+
+
+static void trace_render(const esp32_rio_trace_record_t *record) {
+    const uint32_t *args = record->args;
+    switch (record->format) {
+        case ESP32_RIO_TRACE_DI_UPDATE:
+            ESP_LOGI(TAG, "[%" PRIu32 " us] Channel mask 0x%08" PRIx32 " was interrupted, DI levels 0x%03" PRIx32 ".",
+                     record->timestamp_us, args[0], args[1]);
+            break;
+        case ESP32_RIO_TRACE_MB_WRITE:
+            ESP_LOGI(TAG, "[%" PRIu32 " us] %s WRITE (%" PRIu32 " us), ADDR:%" PRIu32 ", SIZE:%" PRIu32,
+                     record->timestamp_us, args[0] ? "COILS" : "HOLDING", args[1], args[2], args[3]);
+            break;
+        default:
+            ESP_LOGW(TAG, "[%" PRIu32 " us] Unknown trace record format %" PRIu32 ".", record->timestamp_us, record->format);
+            break;
+    }
+}
+
+#else //CONFIG_ESP32_RIO_TRACE_ENABLED
+
+esp_err_t esp32_rio_trace_start(void) {
+    return ESP_OK; //Trace points compiled out, nothing to drain
+}
+
+
+void esp32_rio_trace_write(esp32_rio_trace_format_t format, uint32_t arg0, uint32_t arg1, uint32_t arg2, uint32_t arg3) {
+}
+
+
+void esp32_rio_trace_get_stats(uint32_t *written, uint32_t *dropped) {
+    if (written) {
+        *written = 0;
+    }
+    if (dropped) {
+        *dropped = 0;
+    }
+}
+
+#endif //CONFIG_ESP32_RIO_TRACE_ENABLED
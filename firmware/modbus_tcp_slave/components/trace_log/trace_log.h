@@ -0,0 +1,53 @@
+/*
+@file trace_log.h
+@brief Header for the trace log component.
+
+This file defines the public interface for deferred logging on the hot paths of
+the firmware: trace points store a format ID and raw arguments in a fixed record
+buffer, and a low-priority task renders them to the log.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#ifndef TRACE_LOG_H
+#define TRACE_LOG_H
+
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+#define ESP32_RIO_TRACE_MAX_ARGS 4
+
+typedef enum {
+    ESP32_RIO_TRACE_DI_UPDATE = 0, //Interrupted channel mask, DI levels
+    ESP32_RIO_TRACE_MB_WRITE, //Coils (1) or holding registers (0), stack timestamp (us), address, size
+    ESP32_RIO_TRACE_NUM_FORMATS
+} esp32_rio_trace_format_t;
+
+typedef struct {
+    uint32_t timestamp_us; //Time since boot, low 32 bits
+    uint32_t format; //esp32_rio_trace_format_t
+    uint32_t args[ESP32_RIO_TRACE_MAX_ARGS];
+} esp32_rio_trace_record_t;
+
+/*
+ Trace points. Nothing is formatted on the calling task, and without CONFIG_ESP32_RIO_TRACE_ENABLED they
+ compile to nothing
+*/
+#if CONFIG_ESP32_RIO_TRACE_ENABLED
+#define ESP32_RIO_TRACE(format, arg0, arg1, arg2, arg3) \
+    esp32_rio_trace_write((format), (uint32_t)(arg0), (uint32_t)(arg1), (uint32_t)(arg2), (uint32_t)(arg3))
+#else
+#define ESP32_RIO_TRACE(format, arg0, arg1, arg2, arg3) ((void)0)
+#endif
+
+esp_err_t esp32_rio_trace_start(void);
+void esp32_rio_trace_write(esp32_rio_trace_format_t, uint32_t, uint32_t, uint32_t, uint32_t);
+void esp32_rio_trace_get_stats(uint32_t *, uint32_t *);
+
+#endif //TRACE_LOG_H
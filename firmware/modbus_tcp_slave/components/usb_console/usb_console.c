@@ -17,27 +17,138 @@ SPDX-License-Identifier: MIT
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdlib.h>
 #include <fcntl.h>
+#include <inttypes.h>
+#include "sdkconfig.h"
 #include "esp_log.h"
 #include "esp_check.h"
 #include "driver/usb_serial_jtag.h"
 #include "esp_system.h"
 #include "esp_wifi.h"
+#include "esp_mac.h"
 
 #include "usb_console.h"
+#include "config_store.h"
 #include "wifi_connect.h"
+#include "eth_connect.h"
+#include "remote_io.h"
+#include "mb_frontend.h"
+#include "rbe_publisher.h"
+#include "power_mgmt.h"
 
 #define USB_SERIAL_JTAG_BUF_SIZE 1096
+#define CONSOLE_TX_BUFFER_SIZE 512 //Output batched into whole lines before reaching the driver
+#define CONSOLE_TX_TIMEOUT_MS 100 //Longest wait for a host draining output, once attached
+
+#define CONSOLE_TASK_CORE CONFIG_ESP32_RIO_AUX_CORE
+#define CONSOLE_TASK_PRIORITY CONFIG_ESP32_RIO_CONSOLE_TASK_PRIORITY //Below every I/O and Modbus task
+#define CONSOLE_TASK_STACK_SIZE CONFIG_ESP32_RIO_CONSOLE_TASK_STACK_SIZE
 
 #define MAX_COMMAND_LENGTH 32
-#define MAX_ARG_COUNT 2
-#define MAX_ARG_LENGTH 64
+#define MAX_ARG_COUNT 4
+#define MAX_ARG_LENGTH 160 //Fits a hexadecimal blob of CONFIG_STAGE_MAX_VALUE_SIZE bytes
 #define MAX_CMD_OUTPUT_LENGTH (MAX_COMMAND_LENGTH + 3 + 128) //Takes into account the header with command name
+#define MAX_COMMANDS 48 //Built-in commands plus those registered by other components
+#define CONFIG_STAGE_MAX_ENTRIES 32 //Settings staged by one import
+#define CONFIG_STAGE_MAX_VALUE_SIZE (MAX_ARG_LENGTH / 2)
+
+static const char *s_log_level_names[] = { "none", "error", "warn", "info", "debug", "verbose" }; //Indexed by esp_log_level_t
+static const char *s_dq_safe_state_names[] = { "off", "on", "hold" }; //Indexed by esp32_rio_dq_safe_state_t
+static const char *s_mb_sched_policy_names[] = { "round-robin", "priority" }; //Indexed by esp32_rio_mb_sched_policy_t
 
 static void console_task(void *);
+static void parse_char(uint8_t);
 static void reset_console_state(void);
 static void evaluate_command(void);
+static int compare_command_name(const void *, const void *);
+static void cmd_help(int, char **);
+static void cmd_wifi_status(int, char **);
+static void cmd_eth_status(int, char **);
+static void cmd_wifi_config(int, char **);
+static void cmd_wifi_ip(int, char **);
+static void cmd_di_filter(int, char **);
+static void cmd_di_mode(int, char **);
+static void cmd_counter_window(int, char **);
+static void cmd_counter_reset(int, char **);
+static void cmd_watchdog(int, char **);
+static void cmd_dq_safe(int, char **);
+static void cmd_mb_clients(int, char **);
+static void cmd_mb_max_conn(int, char **);
+static void cmd_mb_sched(int, char **);
+static void cmd_rbe(int, char **);
+static void cmd_rbe_timing(int, char **);
+static void cmd_log_level(int, char **);
+static void cmd_config(int, char **);
+static void cmd_config_set(int, char **);
 static void usb_console_write_str(const char *);
+static void usb_console_flush(void);
+static bool parse_uint_arg(const char *, uint32_t, uint32_t *);
+static bool parse_log_level_arg(const char *, esp_log_level_t *);
+
+typedef struct {
+    const char *name;
+    esp32_rio_config_field_type_t type;
+    uint32_t max_value; //Numeric types only
+} config_value_type_t;
+
+typedef struct {
+    const esp32_rio_config_field_t *field;
+    uint8_t value[CONFIG_STAGE_MAX_VALUE_SIZE];
+} config_stage_entry_t;
+
+static void console_reboot(void);
+static void config_export(void);
+static const char *config_parse_entry(const char *, const char *, const char *, const char *, config_stage_entry_t *);
+static const config_value_type_t *config_type_by_name(const char *);
+
+static const config_value_type_t s_config_value_types[] = { //Indexed by esp32_rio_config_field_type_t
+    { "u8", ESP32_RIO_CONFIG_FIELD_U8, UINT8_MAX },
+    { "u32", ESP32_RIO_CONFIG_FIELD_U32, UINT32_MAX },
+    { "str", ESP32_RIO_CONFIG_FIELD_STR, 0 },
+    { "blob", ESP32_RIO_CONFIG_FIELD_BLOB, 0 }
+};
+
+static const esp32_rio_console_cmd_t s_builtin_commands[] = {
+    { "help", "",
+      "List and describe all available commands.", cmd_help },
+    { "wifi-status", "",
+      "Show WiFi connection information.", cmd_wifi_status },
+    { "eth-status", "",
+      "Show Ethernet link information and the active link.", cmd_eth_status },
+    { "wifi-config", "SSID PASSWORD",
+      "Configure stored WiFi connection information (SSID & mandatory password), rebooting afterwards.", cmd_wifi_config },
+    { "wifi-ip", "[dhcp|IP/PREFIX GATEWAY]",
+      "Show or set and store DHCP or static addressing (gateway as DNS), rebooting afterwards.", cmd_wifi_ip },
+    { "di-filter", "[CHANNEL MICROSECONDS]",
+      "Show DI filter times or set and store the filter time of one DI channel (0 disables filtering).", cmd_di_filter },
+    { "di-mode", "[CHANNEL normal|counter]",
+      "Show DI modes or set and store the mode of one DI channel, rebooting afterwards.", cmd_di_mode },
+    { "counter-window", "[MILLISECONDS]",
+      "Show or set and store the pulse rate computation window.", cmd_counter_window },
+    { "counter-reset", "CHANNEL",
+      "Restart the pulse count of a DI channel in counter mode from zero.", cmd_counter_reset },
+    { "watchdog", "[MILLISECONDS]",
+      "Show output watchdog status or set and store its timeout (0 disables it).", cmd_watchdog },
+    { "dq-safe", "[OUTPUT off|on|hold]",
+      "Show output safe states or set and store the safe state of one output (bank 0 first, then bank 1).", cmd_dq_safe },
+    { "mb-clients", "",
+      "List open Modbus TCP connections and their request statistics.", cmd_mb_clients },
+    { "mb-max-conn", "[COUNT]",
+      "Show or set and store the maximum number of concurrent Modbus TCP connections.", cmd_mb_max_conn },
+    { "mb-sched", "[round-robin|priority IP]",
+      "Show or set and store the Modbus request scheduling policy (IP: primary master).", cmd_mb_sched },
+    { "rbe", "[off|udp://HOST:PORT|mqtt://HOST[:PORT]/TOPIC]",
+      "Show DI change publisher status or set and store its subscriber (off disables it).", cmd_rbe },
+    { "rbe-timing", "[COALESCE_MS HEARTBEAT_S]",
+      "Show or set and store the DI change coalescing interval and heartbeat period.", cmd_rbe_timing },
+    { "log-level", "[none|error|warn|info|debug|verbose [TAG]]",
+      "Show or set the log verbosity, for all tags or a single one (not stored).", cmd_log_level },
+    { "config", "export|import|commit|abort",
+      "Export stored settings as paste-able commands, or stage settings and store them all at once, rebooting afterwards.", cmd_config },
+    { "config-set", "GROUP KEY u8|u32|str|blob VALUE",
+      "Stage one setting of an import (blob in hexadecimal), as written by config export.", cmd_config_set },
+};
 
 typedef enum {
     STATE_IDLE,
@@ -46,6 +157,7 @@ typedef enum {
     STATE_READING_ARG,
     STATE_READING_QUOTED_ARG,
     STATE_CLOSED_QUOTED_ARG,
+    STATE_COMMENT,
     STATE_ERROR
 } console_cmd_parse_state_t;
 
@@ -60,6 +172,32 @@ static char *s_current_arg_buf = NULL; //Pointer to the active argument buffer
 static bool s_escape_next_char = false;
 static console_cmd_parse_state_t s_current_state = STATE_IDLE;
 
+/*
+ Input is read in chunks as large as the driver buffer, blocking while there is none. Output lines are gathered
+ in s_tx_buffer and handed to the driver once per input chunk, or sooner when full. With no host reading, a
+ write times out once and further output is dropped without waiting, until the host drains output again.
+*/
+static uint8_t s_rx_buffer[USB_SERIAL_JTAG_BUF_SIZE];
+static char s_tx_buffer[CONSOLE_TX_BUFFER_SIZE];
+static size_t s_tx_length = 0;
+static bool s_tx_stalled = false; //Last write timed out, host not reading
+
+/*
+ Commands are kept sorted by name and looked up by binary search. The table only changes before the console
+ task starts, so lookups need no locking.
+*/
+static const esp32_rio_console_cmd_t *s_commands[MAX_COMMANDS];
+static size_t s_command_count = 0;
+static bool s_console_started = false;
+
+/*
+ Settings staged by config import and config-set, stored together by config commit
+*/
+static config_stage_entry_t s_config_stage[CONFIG_STAGE_MAX_ENTRIES];
+static size_t s_config_stage_count = 0;
+static size_t s_config_stage_errors = 0; //Settings rejected since the import started
+static bool s_config_staging = false;
+
 
 /*
  Initialize and start USB serial console task
@@ -73,7 +211,13 @@ esp_err_t esp32_rio_start_usb_console(void) {
                         TAG,
                         "usb_serial_jtag_driver_install fail.");
     
-    BaseType_t ret_task_create = xTaskCreate(console_task, "console_task", 4096, NULL, 10, NULL);
+    for (size_t i = 0; i < sizeof(s_builtin_commands) / sizeof(s_builtin_commands[0]); i++) {
+        ESP_RETURN_ON_ERROR(esp32_rio_console_register_command(&s_builtin_commands[i]), TAG, "Failed to register built-in commands.");
+    }
+    s_console_started = true; //Command table frozen from here on
+    
+    BaseType_t ret_task_create = xTaskCreatePinnedToCore(console_task, "console_task", CONSOLE_TASK_STACK_SIZE, NULL,
+                                                         CONSOLE_TASK_PRIORITY, NULL, CONSOLE_TASK_CORE);
     if (ret_task_create != pdPASS) {
         ESP_LOGE(TAG, "Failed to create console_task: %d", ret_task_create);
         return ESP_FAIL;
@@ -82,155 +226,214 @@ esp_err_t esp32_rio_start_usb_console(void) {
 }
 
 
-static void console_task(void *pvArg) {
-    uint8_t rx_char;
+/*
+ Register a console command. Commands can only be registered before the console is started, which keeps the
+ sorted table immutable while the console task looks commands up
+*/
+esp_err_t esp32_rio_console_register_command(const esp32_rio_console_cmd_t *cmd) {
+    ESP_RETURN_ON_FALSE(cmd && cmd->name && cmd->handler && strlen(cmd->name) > 0 && strlen(cmd->name) <= MAX_COMMAND_LENGTH,
+                        ESP_ERR_INVALID_ARG, TAG, "Invalid console command.");
+    ESP_RETURN_ON_FALSE(!s_console_started, ESP_ERR_INVALID_STATE, TAG, "Console already started, %s not registered.", cmd->name);
+    ESP_RETURN_ON_FALSE(s_command_count < MAX_COMMANDS, ESP_ERR_NO_MEM, TAG, "Command table full, %s not registered.", cmd->name);
     
+    // Keep the table sorted by name for lookup by binary search
+    size_t position = 0;
+    while (position < s_command_count && strcmp(s_commands[position]->name, cmd->name) < 0) {
+        position++;
+    }
+    ESP_RETURN_ON_FALSE(position == s_command_count || strcmp(s_commands[position]->name, cmd->name) != 0,
+                        ESP_ERR_INVALID_STATE, TAG, "Command %s already registered.", cmd->name);
+    memmove(&s_commands[position + 1], &s_commands[position], (s_command_count - position) * sizeof(s_commands[0]));
+    s_commands[position] = cmd;
+    s_command_count++;
+    return ESP_OK;
+}
+
+
+/*
+ Write a string to the console. Meant for command handlers, which run in the console task
+*/
+void esp32_rio_console_write_str(const char *str) {
+    usb_console_write_str(str);
+}
+
+
+/*
+ Parse a decimal argument of at most max_value, as built-in commands do. Meant for command handlers
+*/
+bool esp32_rio_console_parse_uint(const char *arg, uint32_t max_value, uint32_t *value) {
+    return parse_uint_arg(arg, max_value, value);
+}
+
+
+static void console_task(void *pvArg) {
     reset_console_state(); //Initialize state
     while (1) {
-        int bytes_read = usb_serial_jtag_read_bytes(&rx_char, 1, 20 / portTICK_PERIOD_MS);
+        // Block until input arrives, then take all of it at once
+        int bytes_read = usb_serial_jtag_read_bytes(s_rx_buffer, sizeof(s_rx_buffer), portMAX_DELAY);
+        esp32_rio_config_hold(); //Settings changed by the whole chunk get stored together
+        for (int i = 0; i < bytes_read; i++) {
+            parse_char(s_rx_buffer[i]);
+        }
+        if (esp32_rio_config_release() != ESP_OK) {
+            usb_console_write_str("\nError: Settings could not be stored.\n");
+        }
+        usb_console_flush(); //Responses to the whole chunk leave together
+    }
+}
         
-        if (bytes_read > 0) {
-            switch (s_current_state) {
-                case STATE_IDLE:
-                    if (isalpha((int)rx_char)) {
-                        // Start parsing of a new command
-                        s_cmd_buffer[s_cmd_char_idx++] = rx_char;
-                        s_current_state = STATE_READING_COMMAND_NAME;
-                    } else if (rx_char != '\r' && rx_char != '\n') {
-                        // Non-empty invalid command name
-                        usb_console_write_str("\nError: Invalid character to start command.\n");
-                        s_current_state = STATE_ERROR;
-                    }
-                    break;
-
-                case STATE_READING_COMMAND_NAME:
-                    if (rx_char == '\r' || rx_char == '\n') {
-                        s_cmd_buffer[s_cmd_char_idx] = '\0'; //Null-terminate command name
-                        evaluate_command();
-                        reset_console_state();
-                    } else if (isblank((int)rx_char)) {
-                        s_cmd_buffer[s_cmd_char_idx] = '\0'; //Null-terminate command name
-                        s_current_state = STATE_EXPECTING_ARG;
-                    } else if (isalnum((int)rx_char) || rx_char == '-' || rx_char == '_') {
-                        if (s_cmd_char_idx < MAX_COMMAND_LENGTH) {
-                            s_cmd_buffer[s_cmd_char_idx++] = rx_char;
-                        } else {
-                            usb_console_write_str("\nError: Command name too long.\n");
-                            s_current_state = STATE_ERROR;
-                        }
+
+/*
+ Run the command parser over one input character, evaluating the command once its line is complete
+*/
+static void parse_char(uint8_t rx_char) {
+    switch (s_current_state) {
+        case STATE_IDLE:
+            if (isalpha((int)rx_char)) {
+                // Start parsing of a new command
+                s_cmd_buffer[s_cmd_char_idx++] = rx_char;
+                s_current_state = STATE_READING_COMMAND_NAME;
+            } else if (rx_char == '#') {
+                s_current_state = STATE_COMMENT; //Lets exported settings carry remarks
+            } else if (rx_char != '\r' && rx_char != '\n') {
+                // Non-empty invalid command name
+                usb_console_write_str("\nError: Invalid character to start command.\n");
+                s_current_state = STATE_ERROR;
+            }
+            break;
+        
+        case STATE_READING_COMMAND_NAME:
+            if (rx_char == '\r' || rx_char == '\n') {
+                s_cmd_buffer[s_cmd_char_idx] = '\0'; //Null-terminate command name
+                evaluate_command();
+                reset_console_state();
+            } else if (isblank((int)rx_char)) {
+                s_cmd_buffer[s_cmd_char_idx] = '\0'; //Null-terminate command name
+                s_current_state = STATE_EXPECTING_ARG;
+            } else if (isalnum((int)rx_char) || rx_char == '-' || rx_char == '_') {
+                if (s_cmd_char_idx < MAX_COMMAND_LENGTH) {
+                    s_cmd_buffer[s_cmd_char_idx++] = rx_char;
+                } else {
+                    usb_console_write_str("\nError: Command name too long.\n");
+                    s_current_state = STATE_ERROR;
+                }
+            } else {
+                usb_console_write_str("\nError: Invalid character in command name.\n");
+                s_current_state = STATE_ERROR;
+            }
+            break;
+            
+        case STATE_EXPECTING_ARG:
+            s_arg_char_idx = 0; //Reset index for new argument
+            if (rx_char == '\r' || rx_char == '\n') {
+                // Expected argument is missing
+                usb_console_write_str("\nError: Malformed command.\n");
+                reset_console_state();
+            } else if (isblank((int)rx_char)) {
+                usb_console_write_str("\nError: Too much spacing before command argument.\n");
+                s_current_state = STATE_ERROR;
+            } else if (rx_char == '"') {
+                if (s_arg_count < MAX_ARG_COUNT) {
+                    s_current_arg_buf = s_arg_buffer[s_arg_count]; //Point to the current argument buffer
+                    s_arg_count++; //Increment argument count AFTER assignment
+                    s_current_state = STATE_READING_QUOTED_ARG;
+                } else {
+                    usb_console_write_str("\nError: Too many arguments for a command.\n");
+                    s_current_state = STATE_ERROR;
+                }
+            } else {
+                if (s_arg_count < MAX_ARG_COUNT) {
+                    s_current_arg_buf = s_arg_buffer[s_arg_count]; //Point to the current argument buffer
+                    s_arg_count++; //Increment argument count AFTER assignment
+                    s_current_arg_buf[s_arg_char_idx++] = rx_char; //Store first character of new argument
+                    s_current_state = STATE_READING_ARG;
+                } else {
+                    usb_console_write_str("\nError: Too many arguments for a command.\n");
+                    s_current_state = STATE_ERROR;
+                }
+            }
+            break;
+            
+        case STATE_READING_ARG:
+            if (rx_char == '\r' || rx_char == '\n') {
+                s_current_arg_buf[s_arg_char_idx++] = '\0'; //Null-terminate argument
+                evaluate_command();
+                reset_console_state();
+            } else if (isblank((int)rx_char)) {
+                s_current_arg_buf[s_arg_char_idx++] = '\0'; //Null-terminate argument
+                s_current_state = STATE_EXPECTING_ARG;
+            } else {
+                if (s_arg_char_idx < MAX_ARG_LENGTH) {
+                    s_current_arg_buf[s_arg_char_idx++] = rx_char;
+                } else {
+                    usb_console_write_str("\nError: Command argument is too long.\n");
+                    s_current_state = STATE_ERROR;
+                }
+            }
+            break;
+            
+        case STATE_READING_QUOTED_ARG:
+            if (rx_char == '"') {
+                if (s_escape_next_char) {
+                    s_escape_next_char = false;
+                    if (s_arg_char_idx < MAX_ARG_LENGTH) {
+                        s_current_arg_buf[s_arg_char_idx++] = rx_char;
                     } else {
-                        usb_console_write_str("\nError: Invalid character in command name.\n");
+                        usb_console_write_str("\nError: Command argument is too long.\n");
                         s_current_state = STATE_ERROR;
                     }
-                    break;
-                    
-                case STATE_EXPECTING_ARG:
-                    s_arg_char_idx = 0; //Reset index for new argument
-                    if (rx_char == '\r' || rx_char == '\n') {
-                        // Expected argument is missing
-                        usb_console_write_str("\nError: Malformed command.\n");
-                        reset_console_state();
-                    } else if (isblank((int)rx_char)) {
-                        usb_console_write_str("\nError: Too much spacing before command argument.\n");
-                        s_current_state = STATE_ERROR;
-                    } else if (rx_char == '"') {
-                        if (s_arg_count < MAX_ARG_COUNT) {
-                            s_current_arg_buf = s_arg_buffer[s_arg_count]; //Point to the current argument buffer
-                            s_arg_count++; //Increment argument count AFTER assignment
-                            s_current_state = STATE_READING_QUOTED_ARG;
-                        } else {
-                            usb_console_write_str("\nError: Too many arguments for a command.\n");
-                            s_current_state = STATE_ERROR;
-                        }
-                    } else {
-                        if (s_arg_count < MAX_ARG_COUNT) {
-                            s_current_arg_buf = s_arg_buffer[s_arg_count]; //Point to the current argument buffer
-                            s_arg_count++; //Increment argument count AFTER assignment
-                            s_current_arg_buf[s_arg_char_idx++] = rx_char; //Store first character of new argument
-                            s_current_state = STATE_READING_ARG;
-                        } else {
-                            usb_console_write_str("\nError: Too many arguments for a command.\n");
-                            s_current_state = STATE_ERROR;
-                        }
-                    }
-                    break;
-                    
-                case STATE_READING_ARG:
-                    if (rx_char == '\r' || rx_char == '\n') {
-                        s_current_arg_buf[s_arg_char_idx++] = '\0'; //Null-terminate argument
-                        evaluate_command();
-                        reset_console_state();
-                    } else if (isblank((int)rx_char)) {
-                        s_current_arg_buf[s_arg_char_idx++] = '\0'; //Null-terminate argument
-                        s_current_state = STATE_EXPECTING_ARG;
-                    } else {
-                        if (s_arg_char_idx < MAX_ARG_LENGTH) {
-                            s_current_arg_buf[s_arg_char_idx++] = rx_char;
-                        } else {
-                            usb_console_write_str("\nError: Command argument is too long.\n");
-                            s_current_state = STATE_ERROR;
-                        }
-                    }
-                    break;
-                    
-                case STATE_READING_QUOTED_ARG:
-                    if (rx_char == '"') {
-                        if (s_escape_next_char) {
-                            s_escape_next_char = false;
-                            if (s_arg_char_idx < MAX_ARG_LENGTH) {
-                                s_current_arg_buf[s_arg_char_idx++] = rx_char;
-                            } else {
-                                usb_console_write_str("\nError: Command argument is too long.\n");
-                                s_current_state = STATE_ERROR;
-                            }
-                        } else {
-                            s_current_state = STATE_CLOSED_QUOTED_ARG;
-                        }
-                    } else if (rx_char == '\\') {
-                        if (s_escape_next_char) {
-                            s_escape_next_char = false;
-                            if (s_arg_char_idx < MAX_ARG_LENGTH) {
-                                s_current_arg_buf[s_arg_char_idx++] = rx_char;
-                            } else {
-                                usb_console_write_str("\nError: Command argument is too long.\n");
-                                s_current_state = STATE_ERROR;
-                            }
-                        } else {
-                            s_escape_next_char = true;
-                        }
-                    } else {
-                        if (s_arg_char_idx < MAX_ARG_LENGTH) {
-                            s_current_arg_buf[s_arg_char_idx++] = rx_char;
-                        } else {
-                            usb_console_write_str("\nError: Command argument is too long.\n");
-                            s_current_state = STATE_ERROR;
-                        }
-                        s_escape_next_char = false; //Neutralize invalid escape sequences
-                    }
-                    break;
-                
-                case STATE_CLOSED_QUOTED_ARG:
-                    if (rx_char == '\r' || rx_char == '\n') {
-                        s_current_arg_buf[s_arg_char_idx++] = '\0'; //Null-terminate argument
-                        evaluate_command();
-                        reset_console_state();
-                    } else if (isblank((int)rx_char)) {
-                        s_current_arg_buf[s_arg_char_idx++] = '\0'; //Null-terminate argument
-                        s_current_state = STATE_EXPECTING_ARG;
+                } else {
+                    s_current_state = STATE_CLOSED_QUOTED_ARG;
+                }
+            } else if (rx_char == '\\') {
+                if (s_escape_next_char) {
+                    s_escape_next_char = false;
+                    if (s_arg_char_idx < MAX_ARG_LENGTH) {
+                        s_current_arg_buf[s_arg_char_idx++] = rx_char;
                     } else {
-                        usb_console_write_str("\nError: Malformed argument in command.\n");
+                        usb_console_write_str("\nError: Command argument is too long.\n");
                         s_current_state = STATE_ERROR;
                     }
-                    break;
+                } else {
+                    s_escape_next_char = true;
+                }
+            } else {
+                if (s_arg_char_idx < MAX_ARG_LENGTH) {
+                    s_current_arg_buf[s_arg_char_idx++] = rx_char;
+                } else {
+                    usb_console_write_str("\nError: Command argument is too long.\n");
+                    s_current_state = STATE_ERROR;
+                }
+                s_escape_next_char = false; //Neutralize invalid escape sequences
+            }
+            break;
                     
-                case STATE_ERROR:
-                    // Consume characters until newline to clear the bad input
-                    if (rx_char == '\r' || rx_char == '\n') {
-                        ESP_LOGD(TAG, "Input cleared.");
-                        reset_console_state();
-                    }
+        case STATE_CLOSED_QUOTED_ARG:
+            if (rx_char == '\r' || rx_char == '\n') {
+                s_current_arg_buf[s_arg_char_idx++] = '\0'; //Null-terminate argument
+                evaluate_command();
+                reset_console_state();
+            } else if (isblank((int)rx_char)) {
+                s_current_arg_buf[s_arg_char_idx++] = '\0'; //Null-terminate argument
+                s_current_state = STATE_EXPECTING_ARG;
+            } else {
+                usb_console_write_str("\nError: Malformed argument in command.\n");
+                s_current_state = STATE_ERROR;
+            }
+            break;
+                    
+        case STATE_COMMENT:
+            if (rx_char == '\r' || rx_char == '\n') {
+                reset_console_state();
+            }
+            break;
+            
+        case STATE_ERROR:
+            // Consume characters until newline to clear the bad input
+            if (rx_char == '\r' || rx_char == '\n') {
+                ESP_LOGD(TAG, "Input cleared.");
+                reset_console_state();
             }
-        }
     }
 }
 
@@ -250,90 +453,884 @@ static void reset_console_state(void) {
 
 
 static void evaluate_command(void) {
+    char *args[MAX_ARG_COUNT];
+    const esp32_rio_console_cmd_t *const *cmd = bsearch(s_cmd_buffer, s_commands, s_command_count, sizeof(s_commands[0]),
+                                                        compare_command_name);
+    if (cmd == NULL) {
+        char cmd_output_buf[MAX_CMD_OUTPUT_LENGTH];
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\nUnrecognized command: %s\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+        return;
+    }
+    for (int i = 0; i < MAX_ARG_COUNT; i++) {
+        args[i] = s_arg_buffer[i]; //Unused arguments are left empty
+    }
+    esp32_rio_power_acquire(ESP32_RIO_POWER_PATH_CONSOLE);
+    (*cmd)->handler(s_arg_count, args);
+    esp32_rio_power_release(ESP32_RIO_POWER_PATH_CONSOLE);
+}
+
+
+static int compare_command_name(const void *name, const void *entry) {
+    return strcmp((const char *)name, (*(const esp32_rio_console_cmd_t *const *)entry)->name);
+}
+
+
+static void cmd_help(int arg_count, char **args) {
+    char cmd_output_buf[MAX_CMD_OUTPUT_LENGTH];
+    if (arg_count == 0) {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Recognized commands:\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+        
+        for (size_t i = 0; i < s_command_count; i++) {
+            usb_console_write_str("  ");
+            usb_console_write_str(s_commands[i]->name);
+            if (s_commands[i]->usage && s_commands[i]->usage[0] != '\0') {
+                usb_console_write_str(" ");
+                usb_console_write_str(s_commands[i]->usage);
+            }
+            usb_console_write_str("\n    ");
+            usb_console_write_str(s_commands[i]->help ? s_commands[i]->help : "");
+            usb_console_write_str("\n");
+        }
+    } else {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Command does not take arguments.\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+    }
+}
+
+
+static void cmd_wifi_status(int arg_count, char **args) {
     char cmd_output_buf[MAX_CMD_OUTPUT_LENGTH];
-    if (strcmp(s_cmd_buffer, "help") == 0) {
-        if (s_arg_count == 0) {
-            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Recognized commands:\n", s_cmd_buffer);
+    if (arg_count == 0) {
+        wifi_ap_record_t ap_info;
+        esp_netif_ip_info_t ip_info;
+        char ip_str[16];
+        
+        if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Connected to \"%s\":\n", s_cmd_buffer, ap_info.ssid);
             usb_console_write_str(cmd_output_buf);
             
-            usb_console_write_str("  help\n");
-            usb_console_write_str("    List and describe all available commands.\n");
-            usb_console_write_str("  wifi-status\n");
-            usb_console_write_str("    Show WiFi connection information.\n");
-            usb_console_write_str("  wifi-config SSID PASSWORD\n");
-            usb_console_write_str("    Configure stored WiFi connection information (SSID & mandatory password),\n");
-            usb_console_write_str("    rebooting afterwards.\n");
+            esp_netif_t *netif = esp32_rio_get_netif();
+            if (netif && esp_netif_get_ip_info(netif, &ip_info) == ESP_OK) {
+                sprintf(ip_str, IPSTR, IP2STR(&ip_info.ip));
+                snprintf(cmd_output_buf, sizeof(cmd_output_buf), "  IP Address: %s\n", ip_str);
+                usb_console_write_str(cmd_output_buf);
+                
+                sprintf(ip_str, IPSTR, IP2STR(&ip_info.netmask));
+                snprintf(cmd_output_buf, sizeof(cmd_output_buf), "  Subnet Mask: %s\n", ip_str);
+                usb_console_write_str(cmd_output_buf);
+                
+                sprintf(ip_str, IPSTR, IP2STR(&ip_info.gw));
+                snprintf(cmd_output_buf, sizeof(cmd_output_buf), "  Gateway: %s\n", ip_str);
+                usb_console_write_str(cmd_output_buf);
+                
+                esp_netif_dhcp_status_t dhcp_status = ESP_NETIF_DHCP_INIT;
+                esp_netif_dhcpc_get_status(netif, &dhcp_status);
+                snprintf(cmd_output_buf, sizeof(cmd_output_buf), "  Addressing: %s\n", dhcp_status == ESP_NETIF_DHCP_STOPPED ? "static" : "DHCP");
+                usb_console_write_str(cmd_output_buf);
+            } else {
+                usb_console_write_str("  IP Information: Not available.\n");
+            }
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "  AP: " MACSTR " on channel %u (%s)\n", MAC2STR(ap_info.bssid), ap_info.primary,
+                     esp32_rio_wifi_fast_connected() ? "cached, no scan" : "found by scan");
+            usb_console_write_str(cmd_output_buf);
         } else {
-            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Command does not take arguments.\n", s_cmd_buffer);
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Disconnected.\n", s_cmd_buffer);
             usb_console_write_str(cmd_output_buf);
         }
-    } else if (strcmp(s_cmd_buffer, "wifi-status") == 0) {
-        if (s_arg_count == 0) {
-            wifi_ap_record_t ap_info;
-            esp_netif_ip_info_t ip_info;
-            char ip_str[16];
+        uint32_t losses, attempts;
+        esp32_rio_wifi_get_link_stats(&losses, &attempts);
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "  Link losses: %" PRIu32 ", failed reconnection attempts: %" PRIu32 "\n", losses, attempts);
+        usb_console_write_str(cmd_output_buf);
+    } else {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Command does not take arguments.\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+    }
+}
 
-            if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK) {
-                snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Connected to \"%s\":\n", s_cmd_buffer, ap_info.ssid);
-                usb_console_write_str(cmd_output_buf);
 
-                esp_netif_t *netif = esp32_rio_get_netif();
-                if (netif && esp_netif_get_ip_info(netif, &ip_info) == ESP_OK) {
-                    sprintf(ip_str, IPSTR, IP2STR(&ip_info.ip));
-                    snprintf(cmd_output_buf, sizeof(cmd_output_buf), "  IP Address: %s\n", ip_str);
-                    usb_console_write_str(cmd_output_buf);
+static void cmd_eth_status(int arg_count, char **args) {
+    char cmd_output_buf[MAX_CMD_OUTPUT_LENGTH];
+    if (arg_count == 0) {
+        uint32_t speed_mbps;
+        bool full_duplex;
+        esp_netif_ip_info_t ip_info;
+        char ip_str[16];
+        
+        if (!esp32_rio_eth_available()) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Ethernet not available.\n", s_cmd_buffer);
+            usb_console_write_str(cmd_output_buf);
+        } else if (esp32_rio_eth_connected() && esp32_rio_eth_get_link_info(&speed_mbps, &full_duplex) == ESP_OK &&
+                   esp_netif_get_ip_info(esp32_rio_eth_get_netif(), &ip_info) == ESP_OK) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Link up, %" PRIu32 " Mbps %s duplex:\n", s_cmd_buffer, speed_mbps, full_duplex ? "full" : "half");
+            usb_console_write_str(cmd_output_buf);
+            sprintf(ip_str, IPSTR, IP2STR(&ip_info.ip));
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "  IP Address: %s\n", ip_str);
+            usb_console_write_str(cmd_output_buf);
+            sprintf(ip_str, IPSTR, IP2STR(&ip_info.netmask));
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "  Subnet Mask: %s\n", ip_str);
+            usb_console_write_str(cmd_output_buf);
+            sprintf(ip_str, IPSTR, IP2STR(&ip_info.gw));
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "  Gateway: %s\n", ip_str);
+            usb_console_write_str(cmd_output_buf);
+        } else {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Link down.\n", s_cmd_buffer);
+            usb_console_write_str(cmd_output_buf);
+        }
+        if (esp32_rio_eth_available()) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "  Link losses: %" PRIu32 "\n", esp32_rio_eth_get_link_losses());
+            usb_console_write_str(cmd_output_buf);
+        }
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "  Active link: %s\n",
+                 esp32_rio_eth_connected() ? "Ethernet" : (esp32_rio_wifi_connected() ? "WiFi" : "none"));
+        usb_console_write_str(cmd_output_buf);
+    } else {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Command does not take arguments.\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+    }
+}
 
-                    sprintf(ip_str, IPSTR, IP2STR(&ip_info.netmask));
-                    snprintf(cmd_output_buf, sizeof(cmd_output_buf), "  Subnet Mask: %s\n", ip_str);
-                    usb_console_write_str(cmd_output_buf);
 
-                    sprintf(ip_str, IPSTR, IP2STR(&ip_info.gw));
-                    snprintf(cmd_output_buf, sizeof(cmd_output_buf), "  Gateway: %s\n", ip_str);
-                    usb_console_write_str(cmd_output_buf);
-                } else {
-                    usb_console_write_str("  IP Information: Not available.\n");
-                }
-            } else {
-                snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Disconnected.\n", s_cmd_buffer);
+static void cmd_wifi_config(int arg_count, char **args) {
+    char cmd_output_buf[MAX_CMD_OUTPUT_LENGTH];
+    size_t ssid_length = strlen(args[0]);
+    size_t password_length = strlen(args[1]);
+    if (arg_count == 2 && ssid_length > 0 && password_length > 0) {
+        if (ssid_length > ESP32_RIO_SSID_MAX_LENGTH - 1) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: SSID length is too long.\n", s_cmd_buffer);
+            usb_console_write_str(cmd_output_buf);
+            return;
+        }
+        if (password_length > ESP32_RIO_PASSWORD_MAX_LENGTH - 1) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Password length is too long.\n", s_cmd_buffer);
+            usb_console_write_str(cmd_output_buf);
+            return;
+        }
+        ESP_ERROR_CHECK(esp32_rio_wifi_nv_params_save((const unsigned char *)args[0],
+                                                      (const unsigned char *)args[1]));
+        
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Configuration successful. Rebooting...\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+        console_reboot();
+    } else {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Command requires two (non-empty) arguments. See help.\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+    }
+}
+
+
+static void cmd_wifi_ip(int arg_count, char **args) {
+    char cmd_output_buf[MAX_CMD_OUTPUT_LENGTH];
+    esp_netif_ip_info_t ip_info = { 0 };
+    if (arg_count == 0) {
+        if (esp32_rio_wifi_nv_static_ip_load(&ip_info) == ESP_OK) {
+            char ip_str[16];
+            sprintf(ip_str, IPSTR, IP2STR(&ip_info.ip));
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Static IP %s,", s_cmd_buffer, ip_str);
+            usb_console_write_str(cmd_output_buf);
+            sprintf(ip_str, IPSTR, IP2STR(&ip_info.netmask));
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), " subnet mask %s,", ip_str);
+            usb_console_write_str(cmd_output_buf);
+            sprintf(ip_str, IPSTR, IP2STR(&ip_info.gw));
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), " gateway %s\n", ip_str);
+        } else {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] DHCP\n", s_cmd_buffer);
+        }
+        usb_console_write_str(cmd_output_buf);
+    } else if ((arg_count == 1 && strcmp(args[0], "dhcp") == 0) || arg_count == 2) {
+        if (arg_count == 2) {
+            char *prefix_str = strchr(args[0], '/');
+            uint32_t prefix;
+            if (prefix_str) {
+                *prefix_str++ = '\0';
+            }
+            if (!prefix_str || !parse_uint_arg(prefix_str, 30, &prefix) || prefix == 0 ||
+                esp_netif_str_to_ip4(args[0], &ip_info.ip) != ESP_OK ||
+                esp_netif_str_to_ip4(args[1], &ip_info.gw) != ESP_OK || ip_info.ip.addr == 0) {
+                snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Invalid address, prefix length (1-30) or gateway.\n", s_cmd_buffer);
                 usb_console_write_str(cmd_output_buf);
+                return;
             }
+            ip_info.netmask.addr = esp_netif_htonl(0xFFFFFFFFu << (32 - prefix));
+        }
+        if (esp32_rio_wifi_nv_static_ip_save(arg_count == 2 ? &ip_info : NULL) != ESP_OK) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Addressing could not be stored.\n", s_cmd_buffer);
+            usb_console_write_str(cmd_output_buf);
+            return;
+        }
+            
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Configuration successful. Rebooting...\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+        console_reboot();
+    } else {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Command takes no argument, dhcp or IP/PREFIX GATEWAY. See help.\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+    }
+}
+
+
+static void cmd_di_filter(int arg_count, char **args) {
+    char cmd_output_buf[MAX_CMD_OUTPUT_LENGTH];
+    if (arg_count == 0) {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] DI filter times:\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+        for (int i = 0; i < ESP32_RIO_NUM_DI_CHANNELS; i++) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "  DI%d: %" PRIu32 " us\n", i, esp32_rio_get_di_filter(i));
+            usb_console_write_str(cmd_output_buf);
+        }
+    } else if (arg_count == 2) {
+        uint32_t channel, filter_us;
+        if (!parse_uint_arg(args[0], ESP32_RIO_NUM_DI_CHANNELS - 1, &channel) ||
+            !parse_uint_arg(args[1], ESP32_RIO_DI_FILTER_MAX_US, &filter_us)) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Invalid channel or filter time (0-%d us).\n", s_cmd_buffer, ESP32_RIO_DI_FILTER_MAX_US);
+            usb_console_write_str(cmd_output_buf);
+            return;
+        }
+        ESP_ERROR_CHECK(esp32_rio_set_di_filter(channel, filter_us));
+        if (esp32_rio_io_nv_params_save() == ESP_OK) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] DI%" PRIu32 " filter time set to %" PRIu32 " us.\n", s_cmd_buffer, channel, filter_us);
         } else {
-            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Command does not take arguments.\n", s_cmd_buffer);
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Filter time applied but could not be stored.\n", s_cmd_buffer);
+        }
+        usb_console_write_str(cmd_output_buf);
+    } else {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Command takes either no or two arguments. See help.\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+    }
+}
+
+
+static void cmd_di_mode(int arg_count, char **args) {
+    char cmd_output_buf[MAX_CMD_OUTPUT_LENGTH];
+    if (arg_count == 0) {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] DI modes:\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+        for (int i = 0; i < ESP32_RIO_NUM_DI_CHANNELS; i++) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "  DI%d: %s\n", i,
+                     esp32_rio_get_di_mode(i) == ESP32_RIO_DI_MODE_COUNTER ? "counter" : "normal");
             usb_console_write_str(cmd_output_buf);
         }
-    } else if (strcmp(s_cmd_buffer, "wifi-config") == 0) {
-        size_t ssid_length = strlen(s_arg_buffer[0]);
-        size_t password_length = strlen(s_arg_buffer[1]);
-        if (s_arg_count == 2 && ssid_length > 0 && password_length > 0) {
-            if (ssid_length > ESP32_RIO_SSID_MAX_LENGTH - 1) {
-                snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: SSID length is too long.\n", s_cmd_buffer);
+    } else if (arg_count == 2) {
+        uint32_t channel;
+        esp32_rio_di_mode_t mode;
+        if (strcmp(args[1], "normal") == 0) {
+            mode = ESP32_RIO_DI_MODE_NORMAL;
+        } else if (strcmp(args[1], "counter") == 0) {
+            mode = ESP32_RIO_DI_MODE_COUNTER;
+        } else {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Mode must be either normal or counter.\n", s_cmd_buffer);
+            usb_console_write_str(cmd_output_buf);
+            return;
+        }
+        if (!parse_uint_arg(args[0], ESP32_RIO_NUM_DI_CHANNELS - 1, &channel)) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Invalid channel.\n", s_cmd_buffer);
+            usb_console_write_str(cmd_output_buf);
+            return;
+        }
+        ESP_ERROR_CHECK(esp32_rio_set_di_mode(channel, mode));
+        ESP_ERROR_CHECK(esp32_rio_io_nv_params_save());
+        
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Configuration successful. Rebooting...\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+        console_reboot();
+    } else {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Command takes either no or two arguments. See help.\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+    }
+}
+
+
+static void cmd_counter_window(int arg_count, char **args) {
+    char cmd_output_buf[MAX_CMD_OUTPUT_LENGTH];
+    if (arg_count == 0) {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Pulse rate window: %" PRIu32 " ms\n", s_cmd_buffer, esp32_rio_get_counter_window());
+        usb_console_write_str(cmd_output_buf);
+    } else if (arg_count == 1) {
+        uint32_t window_ms;
+        if (!parse_uint_arg(args[0], ESP32_RIO_COUNTER_WINDOW_MAX_MS, &window_ms) ||
+            esp32_rio_set_counter_window(window_ms) != ESP_OK) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Window must be a multiple of %d ms from %d to %d ms.\n", s_cmd_buffer,
+                     ESP32_RIO_COUNTER_PUBLISH_MS, ESP32_RIO_COUNTER_WINDOW_MIN_MS, ESP32_RIO_COUNTER_WINDOW_MAX_MS);
+            usb_console_write_str(cmd_output_buf);
+            return;
+        }
+        if (esp32_rio_io_nv_params_save() == ESP_OK) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Pulse rate window set to %" PRIu32 " ms.\n", s_cmd_buffer, window_ms);
+        } else {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Window applied but could not be stored.\n", s_cmd_buffer);
+        }
+        usb_console_write_str(cmd_output_buf);
+    } else {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Command takes at most one argument. See help.\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+    }
+}
+
+
+static void cmd_counter_reset(int arg_count, char **args) {
+    char cmd_output_buf[MAX_CMD_OUTPUT_LENGTH];
+    uint32_t channel;
+    if (arg_count == 1 && parse_uint_arg(args[0], ESP32_RIO_NUM_DI_CHANNELS - 1, &channel)) {
+        if (esp32_rio_reset_counter(channel) == ESP_OK) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] DI%" PRIu32 " pulse count reset.\n", s_cmd_buffer, channel);
+        } else {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: DI%" PRIu32 " is not counting.\n", s_cmd_buffer, channel);
+        }
+    } else {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Command requires a valid channel. See help.\n", s_cmd_buffer);
+    }
+    usb_console_write_str(cmd_output_buf);
+}
+
+
+static void cmd_watchdog(int arg_count, char **args) {
+    char cmd_output_buf[MAX_CMD_OUTPUT_LENGTH];
+    if (arg_count == 0) {
+        uint32_t expiry_count, last_latency_us, max_latency_us;
+        esp32_rio_get_output_watchdog_stats(&expiry_count, &last_latency_us, &max_latency_us);
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Timeout: %" PRIu32 " ms%s\n", s_cmd_buffer,
+                 esp32_rio_get_output_watchdog(), esp32_rio_get_output_watchdog() == 0 ? " (disabled)" : "");
+        usb_console_write_str(cmd_output_buf);
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "  Expiries: %" PRIu32 ", last latency: %" PRIu32 " us, max latency: %" PRIu32 " us\n",
+                 expiry_count, last_latency_us, max_latency_us);
+        usb_console_write_str(cmd_output_buf);
+    } else if (arg_count == 1) {
+        uint32_t timeout_ms;
+        if (!parse_uint_arg(args[0], ESP32_RIO_OUTPUT_WATCHDOG_MAX_MS, &timeout_ms)) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Timeout must be from 0 to %d ms.\n", s_cmd_buffer, ESP32_RIO_OUTPUT_WATCHDOG_MAX_MS);
+            usb_console_write_str(cmd_output_buf);
+            return;
+        }
+        ESP_ERROR_CHECK(esp32_rio_set_output_watchdog(timeout_ms));
+        if (esp32_rio_io_nv_params_save() == ESP_OK) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Output watchdog timeout set to %" PRIu32 " ms.\n", s_cmd_buffer, timeout_ms);
+        } else {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Timeout applied but could not be stored.\n", s_cmd_buffer);
+        }
+        usb_console_write_str(cmd_output_buf);
+    } else {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Command takes at most one argument. See help.\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+    }
+}
+
+
+static void cmd_dq_safe(int arg_count, char **args) {
+    char cmd_output_buf[MAX_CMD_OUTPUT_LENGTH];
+    if (arg_count == 0) {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Output safe states:\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+        for (int bank = 0; bank < 2; bank++) {
+            for (int i = 0; i < ESP32_RIO_NUM_DQ_CHANNELS; i++) {
+                snprintf(cmd_output_buf, sizeof(cmd_output_buf), "  DQ%d%d: %s\n", bank, i,
+                         s_dq_safe_state_names[esp32_rio_get_dq_safe_state(bank, i)]);
                 usb_console_write_str(cmd_output_buf);
-                return;
             }
-            if (password_length > ESP32_RIO_PASSWORD_MAX_LENGTH - 1) {
-                snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Password length is too long.\n", s_cmd_buffer);
-                usb_console_write_str(cmd_output_buf);
-                return;
+        }
+    } else if (arg_count == 2) {
+        uint32_t output;
+        int state = -1;
+        for (size_t i = 0; i < sizeof(s_dq_safe_state_names) / sizeof(s_dq_safe_state_names[0]); i++) {
+            if (strcmp(args[1], s_dq_safe_state_names[i]) == 0) {
+                state = (int)i;
             }
-            ESP_ERROR_CHECK(esp32_rio_wifi_nv_params_save((const unsigned char *)s_arg_buffer[0],
-                                                          (const unsigned char *)s_arg_buffer[1]));
-            
-            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Configuration successful. Rebooting...\n", s_cmd_buffer);
+        }
+        if (state < 0) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: State must be off, on or hold.\n", s_cmd_buffer);
             usb_console_write_str(cmd_output_buf);
-            
-            vTaskDelay(pdMS_TO_TICKS(1000)); //Give some time for messages to flush
-            esp_restart();
+            return;
+        }
+        if (!parse_uint_arg(args[0], 2 * ESP32_RIO_NUM_DQ_CHANNELS - 1, &output)) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Invalid output.\n", s_cmd_buffer);
+            usb_console_write_str(cmd_output_buf);
+            return;
+        }
+        ESP_ERROR_CHECK(esp32_rio_set_dq_safe_state(output / ESP32_RIO_NUM_DQ_CHANNELS, output % ESP32_RIO_NUM_DQ_CHANNELS,
+                                                    (esp32_rio_dq_safe_state_t)state));
+        if (esp32_rio_io_nv_params_save() == ESP_OK) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] DQ%" PRIu32 "%" PRIu32 " safe state set to %s.\n", s_cmd_buffer,
+                     output / ESP32_RIO_NUM_DQ_CHANNELS, output % ESP32_RIO_NUM_DQ_CHANNELS,
+                     s_dq_safe_state_names[state]);
         } else {
-            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Command requires two (non-empty) arguments. See help.\n", s_cmd_buffer);
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Safe state applied but could not be stored.\n", s_cmd_buffer);
+        }
+        usb_console_write_str(cmd_output_buf);
+    } else {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Command takes either no or two arguments. See help.\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+    }
+}
+
+
+static void cmd_mb_clients(int arg_count, char **args) {
+    char cmd_output_buf[MAX_CMD_OUTPUT_LENGTH];
+    if (arg_count == 0) {
+        esp32_rio_mb_conn_stats_t connections[ESP32_RIO_MB_MAX_CONNECTIONS];
+        uint32_t accepted, rejected, evicted;
+        size_t count = esp32_rio_get_mb_connections(connections, ESP32_RIO_MB_MAX_CONNECTIONS);
+        esp32_rio_get_mb_connection_totals(&accepted, &rejected, &evicted);
+        
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] %u of %u connections open (%s scheduling)\n", s_cmd_buffer,
+                 (unsigned)count, esp32_rio_get_mb_max_connections(), s_mb_sched_policy_names[esp32_rio_get_mb_sched_policy(NULL)]);
+        usb_console_write_str(cmd_output_buf);
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "  Accepted: %" PRIu32 ", rejected: %" PRIu32 ", closed for primary master: %" PRIu32 "\n",
+                 accepted, rejected, evicted);
+        usb_console_write_str(cmd_output_buf);
+        for (size_t i = 0; i < count; i++) {
+            const esp32_rio_mb_conn_stats_t *stats = &connections[i];
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "  " IPSTR ":%u%s, connected %" PRIu32 " s: %" PRIu32 " requests, %" PRIu32 " exceptions, %" PRIu32 " timeouts\n",
+                     IP2STR((esp_ip4_addr_t *)&stats->peer_ip), stats->peer_port, stats->primary ? " (primary)" : "",
+                     stats->connected_s, stats->requests, stats->exceptions, stats->timeouts);
+            usb_console_write_str(cmd_output_buf);
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "    Max wait: %" PRIu32 " us, response last %" PRIu32 " / max %" PRIu32 " us\n",
+                     stats->max_wait_us, stats->last_response_us, stats->max_response_us);
             usb_console_write_str(cmd_output_buf);
         }
     } else {
-        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\nUnrecognized command: %s\n", s_cmd_buffer);
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Command does not take arguments.\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+    }
+}
+
+
+static void cmd_mb_max_conn(int arg_count, char **args) {
+    char cmd_output_buf[MAX_CMD_OUTPUT_LENGTH];
+    if (arg_count == 0) {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Maximum connections: %u\n", s_cmd_buffer, esp32_rio_get_mb_max_connections());
+        usb_console_write_str(cmd_output_buf);
+    } else if (arg_count == 1) {
+        uint32_t max_connections;
+        if (!parse_uint_arg(args[0], ESP32_RIO_MB_MAX_CONNECTIONS, &max_connections) ||
+            esp32_rio_set_mb_max_connections(max_connections) != ESP_OK) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Count must be from 1 to %d.\n", s_cmd_buffer, ESP32_RIO_MB_MAX_CONNECTIONS);
+            usb_console_write_str(cmd_output_buf);
+            return;
+        }
+        if (esp32_rio_mb_nv_params_save() == ESP_OK) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Maximum connections set to %" PRIu32 ".\n", s_cmd_buffer, max_connections);
+        } else {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Maximum applied but could not be stored.\n", s_cmd_buffer);
+        }
+        usb_console_write_str(cmd_output_buf);
+    } else {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Command takes at most one argument. See help.\n", s_cmd_buffer);
         usb_console_write_str(cmd_output_buf);
     }
 }
 
 
+static void cmd_mb_sched(int arg_count, char **args) {
+    char cmd_output_buf[MAX_CMD_OUTPUT_LENGTH];
+    esp_ip4_addr_t primary_ip = { 0 };
+    if (arg_count == 0) {
+        esp32_rio_mb_sched_policy_t policy = esp32_rio_get_mb_sched_policy(&primary_ip.addr);
+        if (policy == ESP32_RIO_MB_SCHED_PRIORITY) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Scheduling policy: %s, primary master " IPSTR "\n", s_cmd_buffer,
+                     s_mb_sched_policy_names[policy], IP2STR(&primary_ip));
+        } else {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Scheduling policy: %s\n", s_cmd_buffer, s_mb_sched_policy_names[policy]);
+        }
+        usb_console_write_str(cmd_output_buf);
+    } else if ((arg_count == 1 && strcmp(args[0], "round-robin") == 0) ||
+               (arg_count == 2 && strcmp(args[0], "priority") == 0)) {
+        esp32_rio_mb_sched_policy_t policy = (arg_count == 2) ? ESP32_RIO_MB_SCHED_PRIORITY : ESP32_RIO_MB_SCHED_ROUND_ROBIN;
+        if (arg_count == 2 && esp_netif_str_to_ip4(args[1], &primary_ip) != ESP_OK) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Invalid IPv4 address.\n", s_cmd_buffer);
+            usb_console_write_str(cmd_output_buf);
+            return;
+        }
+        if (esp32_rio_set_mb_sched_policy(policy, primary_ip.addr) != ESP_OK) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Invalid primary master address.\n", s_cmd_buffer);
+            usb_console_write_str(cmd_output_buf);
+            return;
+        }
+        if (esp32_rio_mb_nv_params_save() == ESP_OK) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Scheduling policy set to %s.\n", s_cmd_buffer, s_mb_sched_policy_names[policy]);
+        } else {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Policy applied but could not be stored.\n", s_cmd_buffer);
+        }
+        usb_console_write_str(cmd_output_buf);
+    } else {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Command takes no argument, round-robin or priority IP. See help.\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+    }
+}
+
+
+static void cmd_rbe(int arg_count, char **args) {
+    char cmd_output_buf[MAX_CMD_OUTPUT_LENGTH];
+    char target[ESP32_RIO_RBE_TARGET_MAX_LENGTH + 1];
+    if (arg_count == 0) {
+        uint32_t messages, records, dropped, errors;
+        esp32_rio_get_rbe_target(target, sizeof(target));
+        esp32_rio_get_rbe_stats(&messages, &records, &dropped, &errors);
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Subscriber: %s\n", s_cmd_buffer, target[0] != '\0' ? target : "none (disabled)");
+        usb_console_write_str(cmd_output_buf);
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "  Messages sent: %" PRIu32 ", change records sent: %" PRIu32 ", dropped: %" PRIu32 ", send errors: %" PRIu32 "\n",
+                 messages, records, dropped, errors);
+        usb_console_write_str(cmd_output_buf);
+    } else if (arg_count == 1) {
+        const char *new_target = (strcmp(args[0], "off") == 0) ? "" : args[0];
+        if (esp32_rio_set_rbe_target(new_target) != ESP_OK) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Invalid subscriber. See help.\n", s_cmd_buffer);
+            usb_console_write_str(cmd_output_buf);
+            return;
+        }
+        if (esp32_rio_rbe_nv_params_save() == ESP_OK) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] DI change publishing %s.\n", s_cmd_buffer, new_target[0] != '\0' ? "enabled" : "disabled");
+        } else {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Subscriber applied but could not be stored.\n", s_cmd_buffer);
+        }
+        usb_console_write_str(cmd_output_buf);
+    } else {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Command takes at most one argument. See help.\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+    }
+}
+
+
+static void cmd_rbe_timing(int arg_count, char **args) {
+    char cmd_output_buf[MAX_CMD_OUTPUT_LENGTH];
+    uint32_t coalesce_ms, heartbeat_s;
+    if (arg_count == 0) {
+        esp32_rio_get_rbe_timing(&coalesce_ms, &heartbeat_s);
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Coalescing interval: %" PRIu32 " ms, heartbeat period: %" PRIu32 " s\n", s_cmd_buffer,
+                 coalesce_ms, heartbeat_s);
+        usb_console_write_str(cmd_output_buf);
+    } else if (arg_count == 2) {
+        if (!parse_uint_arg(args[0], ESP32_RIO_RBE_COALESCE_MAX_MS, &coalesce_ms) ||
+            !parse_uint_arg(args[1], ESP32_RIO_RBE_HEARTBEAT_MAX_S, &heartbeat_s) ||
+            esp32_rio_set_rbe_timing(coalesce_ms, heartbeat_s) != ESP_OK) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Interval must be from 0 to %d ms and period from %d to %d s.\n", s_cmd_buffer,
+                     ESP32_RIO_RBE_COALESCE_MAX_MS, ESP32_RIO_RBE_HEARTBEAT_MIN_S, ESP32_RIO_RBE_HEARTBEAT_MAX_S);
+            usb_console_write_str(cmd_output_buf);
+            return;
+        }
+        if (esp32_rio_rbe_nv_params_save() == ESP_OK) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Coalescing interval set to %" PRIu32 " ms, heartbeat period to %" PRIu32 " s.\n", s_cmd_buffer,
+                     coalesce_ms, heartbeat_s);
+        } else {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Timing applied but could not be stored.\n", s_cmd_buffer);
+        }
+        usb_console_write_str(cmd_output_buf);
+    } else {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Command takes either no or two arguments. See help.\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+    }
+}
+
+
+static void cmd_log_level(int arg_count, char **args) {
+    char cmd_output_buf[MAX_CMD_OUTPUT_LENGTH];
+    esp_log_level_t level;
+    if (arg_count == 0) {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Default log level: %s\n", s_cmd_buffer,
+                 s_log_level_names[esp_log_level_get("*")]);
+    } else if (arg_count <= 2 && parse_log_level_arg(args[0], &level)) {
+        const char *tag = (arg_count == 2) ? args[1] : "*";
+        esp_log_level_set(tag, level);
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Log level of %s set to %s.\n", s_cmd_buffer,
+                 (arg_count == 2) ? tag : "all tags", s_log_level_names[level]);
+    } else {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Unknown log level. See help.\n", s_cmd_buffer);
+    }
+    usb_console_write_str(cmd_output_buf);
+}
+
+
+static void cmd_config(int arg_count, char **args) {
+    char cmd_output_buf[MAX_CMD_OUTPUT_LENGTH];
+    if (arg_count == 1 && strcmp(args[0], "export") == 0) {
+        config_export();
+    } else if (arg_count == 1 && strcmp(args[0], "import") == 0) {
+        s_config_stage_count = 0;
+        s_config_stage_errors = 0;
+        s_config_staging = true;
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Import started, stage settings with config-set and end with config commit.\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+    } else if (arg_count == 1 && strcmp(args[0], "abort") == 0) {
+        s_config_staging = false;
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Import aborted, %u staged settings discarded.\n", s_cmd_buffer,
+                 (unsigned int)s_config_stage_count);
+        usb_console_write_str(cmd_output_buf);
+    } else if (arg_count == 1 && strcmp(args[0], "commit") == 0) {
+        if (!s_config_staging) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: No import in progress. See help.\n", s_cmd_buffer);
+            usb_console_write_str(cmd_output_buf);
+            return;
+        }
+        s_config_staging = false;
+        if (s_config_stage_errors > 0) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: %u settings rejected, nothing stored.\n", s_cmd_buffer,
+                     (unsigned int)s_config_stage_errors);
+            usb_console_write_str(cmd_output_buf);
+            return;
+        }
+        if (s_config_stage_count == 0) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Nothing to store.\n", s_cmd_buffer);
+            usb_console_write_str(cmd_output_buf);
+            return;
+        }
+        
+        // All staged settings go into a single write of the settings blob
+        esp32_rio_config_hold();
+        esp_err_t err = ESP_OK;
+        for (size_t i = 0; i < s_config_stage_count && err == ESP_OK; i++) {
+            err = esp32_rio_config_set_field(s_config_stage[i].field, s_config_stage[i].value);
+        }
+        esp_err_t flush_err = esp32_rio_config_flush();
+        esp32_rio_config_release();
+        if (err == ESP_OK) {
+            err = flush_err;
+        }
+        if (err != ESP_OK) {
+            snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Settings could not be stored: %s\n", s_cmd_buffer, esp_err_to_name(err));
+            usb_console_write_str(cmd_output_buf);
+            return;
+        }
+        
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] %u settings stored. Rebooting...\n", s_cmd_buffer,
+                 (unsigned int)s_config_stage_count);
+        usb_console_write_str(cmd_output_buf);
+        console_reboot();
+    } else {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Command takes export, import, commit or abort. See help.\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+    }
+}
+
+
+static void cmd_config_set(int arg_count, char **args) {
+    char cmd_output_buf[MAX_CMD_OUTPUT_LENGTH];
+    if (!s_config_staging) {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: No import in progress, start one with config import.\n", s_cmd_buffer);
+        usb_console_write_str(cmd_output_buf);
+        return;
+    }
+    if (arg_count != 4) {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: Command takes four arguments. See help.\n", s_cmd_buffer);
+        s_config_stage_errors++;
+        usb_console_write_str(cmd_output_buf);
+        return;
+    }
+    
+    config_stage_entry_t entry = { 0 };
+    const char *error = config_parse_entry(args[0], args[1], args[2], args[3], &entry);
+    if (error == NULL) {
+        // A setting staged twice keeps its last value
+        size_t i = 0;
+        while (i < s_config_stage_count && s_config_stage[i].field != entry.field) {
+            i++;
+        }
+        if (i < CONFIG_STAGE_MAX_ENTRIES) {
+            s_config_stage[i] = entry;
+            if (i == s_config_stage_count) {
+                s_config_stage_count++;
+            }
+        } else {
+            error = "Too many settings in one import";
+        }
+    }
+    if (error != NULL) {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] Error: %s, %s/%s rejected.\n", s_cmd_buffer, error, args[0], args[1]);
+        s_config_stage_errors++;
+    } else {
+        snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n[%s] %s/%s staged.\n", s_cmd_buffer, entry.field->group, entry.field->key);
+    }
+    usb_console_write_str(cmd_output_buf);
+}
+
+
+/*
+ Validate one exported setting and convert it into a staged entry. Returns NULL on success or the reason of failure
+*/
+static const char *config_parse_entry(const char *group, const char *key, const char *type_name, const char *value,
+                                      config_stage_entry_t *entry) {
+    size_t field_count;
+    const esp32_rio_config_field_t *fields = esp32_rio_config_get_fields(&field_count);
+    const config_value_type_t *type = config_type_by_name(type_name);
+    
+    entry->field = NULL;
+    for (size_t i = 0; i < field_count; i++) {
+        if (strcmp(group, fields[i].group) == 0 && strcmp(key, fields[i].key) == 0) {
+            entry->field = &fields[i];
+        }
+    }
+    if (entry->field == NULL || entry->field->size > sizeof(entry->value)) {
+        return "Unknown setting";
+    }
+    if (type == NULL || type->type != entry->field->type) {
+        return "Wrong type";
+    }
+    
+    if (type->type == ESP32_RIO_CONFIG_FIELD_STR) {
+        size_t length = strlen(value);
+        if (length >= entry->field->size) {
+            return "String too long";
+        }
+        memcpy(entry->value, value, length + 1);
+    } else if (type->type == ESP32_RIO_CONFIG_FIELD_BLOB) {
+        if (strlen(value) != 2 * entry->field->size) {
+            return "Wrong blob length";
+        }
+        for (size_t i = 0; i < entry->field->size; i++) {
+            char byte_str[3] = { value[2 * i], value[2 * i + 1], '\0' };
+            char *end;
+            entry->value[i] = (uint8_t)strtoul(byte_str, &end, 16);
+            if (!isxdigit((int)byte_str[0]) || *end != '\0') {
+                return "Invalid hexadecimal digit";
+            }
+        }
+    } else {
+        uint32_t number;
+        if (!parse_uint_arg(value, type->max_value, &number)) {
+            return "Number out of range";
+        }
+        if (type->type == ESP32_RIO_CONFIG_FIELD_U8) {
+            entry->value[0] = (uint8_t)number;
+        } else {
+            memcpy(entry->value, &number, sizeof(number));
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ Dump the stored settings as console commands, which restore them on another unit when pasted into its console
+*/
+static void config_export(void) {
+    char cmd_output_buf[MAX_CMD_OUTPUT_LENGTH];
+    char value_str[2 * CONFIG_STAGE_MAX_VALUE_SIZE + 3]; //Room for a hexadecimal blob or a quoted string
+    uint8_t value[CONFIG_STAGE_MAX_VALUE_SIZE];
+    unsigned int exported = 0;
+    size_t field_count;
+    const esp32_rio_config_field_t *fields = esp32_rio_config_get_fields(&field_count);
+    
+    snprintf(cmd_output_buf, sizeof(cmd_output_buf), "\n# [%s] Stored settings, paste into a console to import:\n", s_cmd_buffer);
+    usb_console_write_str(cmd_output_buf);
+    usb_console_write_str("config import\n");
+    for (size_t n = 0; n < field_count; n++) {
+        const esp32_rio_config_field_t *field = &fields[n];
+        if (field->size > sizeof(value) || esp32_rio_config_get_field(field, value) != ESP_OK) {
+            continue; //Never stored
+        }
+        if (field->type == ESP32_RIO_CONFIG_FIELD_U8) {
+            snprintf(value_str, sizeof(value_str), "%u", (unsigned int)value[0]);
+        } else if (field->type == ESP32_RIO_CONFIG_FIELD_U32) {
+            uint32_t number;
+            memcpy(&number, value, sizeof(number));
+            snprintf(value_str, sizeof(value_str), "%" PRIu32, number);
+        } else if (field->type == ESP32_RIO_CONFIG_FIELD_STR) {
+            // Quote the string, escaping quotes and backslashes the way the parser expects them
+            size_t out = 0;
+            value[field->size - 1] = '\0';
+            value_str[out++] = '"';
+            for (size_t i = 0; value[i] != '\0'; i++) {
+                if (value[i] == '"' || value[i] == '\\') {
+                    value_str[out++] = '\\';
+                }
+                value_str[out++] = (char)value[i];
+            }
+            value_str[out++] = '"';
+            value_str[out] = '\0';
+        } else {
+            for (size_t i = 0; i < field->size; i++) {
+                sprintf(&value_str[2 * i], "%02x", value[i]);
+            }
+        }
+        usb_console_write_str("config-set ");
+        usb_console_write_str(field->group);
+        usb_console_write_str(" ");
+        usb_console_write_str(field->key);
+        usb_console_write_str(" ");
+        usb_console_write_str(s_config_value_types[field->type].name);
+        usb_console_write_str(" ");
+        usb_console_write_str(value_str);
+        usb_console_write_str("\n");
+        exported++;
+    }
+    usb_console_write_str("config commit\n");
+    snprintf(cmd_output_buf, sizeof(cmd_output_buf), "# [%s] %u settings exported.\n", s_cmd_buffer, exported);
+    usb_console_write_str(cmd_output_buf);
+}
+
+
+static const config_value_type_t *config_type_by_name(const char *name) {
+    for (size_t i = 0; i < sizeof(s_config_value_types) / sizeof(s_config_value_types[0]); i++) {
+        if (strcmp(name, s_config_value_types[i].name) == 0) {
+            return &s_config_value_types[i];
+        }
+    }
+    return NULL;
+}
+
+
 static void usb_console_write_str(const char *str) {
-    usb_serial_jtag_write_bytes(str, strlen(str), portMAX_DELAY);
+    size_t length = strlen(str);
+    while (length > 0) {
+        if (s_tx_length == sizeof(s_tx_buffer)) {
+            usb_console_flush();
+        }
+        size_t chunk = sizeof(s_tx_buffer) - s_tx_length;
+        if (chunk > length) {
+            chunk = length;
+        }
+        memcpy(&s_tx_buffer[s_tx_length], str, chunk);
+        s_tx_length += chunk;
+        str += chunk;
+        length -= chunk;
+    }
+}
+
+
+/*
+ Hand buffered output to the driver in a single write
+*/
+static void usb_console_flush(void) {
+    if (s_tx_length == 0) {
+        return;
+    }
+    int written = usb_serial_jtag_write_bytes(s_tx_buffer, s_tx_length, s_tx_stalled ? 0 : pdMS_TO_TICKS(CONSOLE_TX_TIMEOUT_MS));
+    s_tx_stalled = written < (int)s_tx_length; //Output not taken is dropped
+    s_tx_length = 0;
+}
+
+
+/*
+ Store settings still held by the current input, let pending output reach the host and restart
+*/
+static void console_reboot(void) {
+    if (esp32_rio_config_flush() != ESP_OK) {
+        usb_console_write_str("\nError: Settings could not be stored.\n");
+    }
+    usb_console_flush();
+    vTaskDelay(pdMS_TO_TICKS(1000)); //Give some time for messages to flush
+    esp_restart();
+}
+
+
+static bool parse_uint_arg(const char *arg, uint32_t max_value, uint32_t *value) {
+    char *end;
+    if (!isdigit((int)arg[0])) {
+        return false;
+    }
+    unsigned long parsed = strtoul(arg, &end, 10);
+    if (*end != '\0' || parsed > max_value) {
+        return false;
+    }
+    *value = (uint32_t)parsed;
+    return true;
+}
+
+
+static bool parse_log_level_arg(const char *arg, esp_log_level_t *level) {
+    for (size_t i = 0; i < sizeof(s_log_level_names) / sizeof(s_log_level_names[0]); i++) {
+        if (strcmp(arg, s_log_level_names[i]) == 0) {
+            *level = (esp_log_level_t)i;
+            return true;
+        }
+    }
+    return false;
 }
@@ -4,7 +4,8 @@
 
 This file defines the public interface for starting and managing the
 USB Serial/JTAG console, which provides a command-line interface for
-user interaction, such as WiFi configuration and status checks.
+user interaction, such as WiFi configuration and status checks, and for
+extending it with further commands.
 
 @copyright 2025 Douglas Almeida
 
@@ -17,8 +18,26 @@ SPDX-License-Identifier: MIT
 #ifndef USB_CONSOLE_H
 #define USB_CONSOLE_H
 
+#include <stdint.h>
+#include <stdbool.h>
 #include "esp_err.h"
 
+/*
+ Command handlers run in the console task and receive the parsed arguments. The argument array always holds the
+ maximum number of arguments, those beyond the argument count being empty strings.
+*/
+typedef void (*esp32_rio_console_cmd_handler_t)(int, char **);
+
+typedef struct {
+    const char *name;
+    const char *usage; //Arguments shown by help, empty for none
+    const char *help; //One line description shown by help
+    esp32_rio_console_cmd_handler_t handler;
+} esp32_rio_console_cmd_t;
+
 esp_err_t esp32_rio_start_usb_console(void);
+esp_err_t esp32_rio_console_register_command(const esp32_rio_console_cmd_t *);
+void esp32_rio_console_write_str(const char *);
+bool esp32_rio_console_parse_uint(const char *, uint32_t, uint32_t *);
 
 #endif //USB_CONSOLE_H
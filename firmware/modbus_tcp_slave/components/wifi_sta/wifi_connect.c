@@ -4,7 +4,7 @@
 
 This file handles WiFi station mode operations, including initialization,
 event handling for connection/disconnection, IP address acquisition,
-and persistent storage of WiFi credentials using NVS (Non-Volatile Storage).
+and persistent storage of WiFi credentials through the configuration store.
 
 @copyright 2025 Douglas Almeida
 
@@ -14,47 +14,88 @@ It is subject to the terms of the MIT License, which can be found in the LICENSE
 SPDX-License-Identifier: MIT
 */
 
+#include <stdio.h>
 #include <string.h>
+#include <inttypes.h>
+#include "sdkconfig.h"
 #include "esp_check.h"
 #include "esp_log.h"
 #include "esp_event.h"
 #include "esp_wifi.h"
 #include "esp_wifi_default.h"
 #include "esp_netif.h"
-#include "nvs_flash.h"
-#include "nvs.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
 #include "esp_system.h"
+#include "esp_random.h"
 
 #include "wifi_connect.h"
+#include "config_store.h"
 
-#define ESP32_RIO_NVS_NAMESPACE "wifi_config"
-#define ESP32_RIO_NVS_KEY_SSID "ssid"
-#define ESP32_RIO_NVS_KEY_PASSWORD "password"
+_Static_assert(ESP32_RIO_SSID_MAX_LENGTH == ESP32_RIO_CONFIG_SSID_MAX_LENGTH &&
+               ESP32_RIO_PASSWORD_MAX_LENGTH == ESP32_RIO_CONFIG_PASSWORD_MAX_LENGTH,
+               "Stored WiFi credentials must match the station configuration");
 
-#define ESP32_RIO_WIFI_CONN_MAX_RETRY 10
+#define ESP32_RIO_WIFI_BACKOFF_MIN_MS 250 //Delay before the second reconnection attempt (the first is immediate)
+#define ESP32_RIO_WIFI_BACKOFF_MAX_MS 30000
 #define ESP32_RIO_NETIF_DESC_STA "esp32_rio_netif_sta"
 
-static esp_err_t esp32_rio_wifi_sta_do_connect(wifi_config_t, bool);
+//Modem sleep of the power profile. Minimum modem sleep wakes for every DTIM beacon, maximum modem sleep only every listen interval
+#if CONFIG_ESP32_RIO_POWER_PROFILE_LOW_POWER
+#define ESP32_RIO_WIFI_PS_MODE WIFI_PS_MAX_MODEM
+#define ESP32_RIO_WIFI_LISTEN_INTERVAL CONFIG_ESP32_RIO_POWER_LISTEN_INTERVAL
+#elif CONFIG_ESP32_RIO_POWER_PROFILE_BALANCED
+#define ESP32_RIO_WIFI_PS_MODE WIFI_PS_MIN_MODEM
+#define ESP32_RIO_WIFI_LISTEN_INTERVAL 0 //Driver default
+#else
+#define ESP32_RIO_WIFI_PS_MODE WIFI_PS_NONE
+#define ESP32_RIO_WIFI_LISTEN_INTERVAL 0
+#endif
+
+static esp_err_t esp32_rio_wifi_sta_do_connect(wifi_config_t);
 static esp_err_t esp32_rio_wifi_sta_do_disconnect(void);
 static void esp32_rio_print_netif_ip_info(void);
+static esp_err_t esp32_rio_apply_static_ip(void);
+static esp_err_t esp32_rio_wifi_nv_ap_load(uint8_t *, uint8_t *);
+static void esp32_rio_wifi_nv_ap_save(void);
+static uint32_t esp32_rio_wifi_backoff_ms(uint32_t);
+static void esp32_rio_reconnect_timer_callback(void *);
 
 static const char *TAG = "ESP32_RIO_WIFI";
 
 static esp_netif_t *s_esp32_rio_sta_netif = NULL;
-static SemaphoreHandle_t s_semph_get_ip_addrs = NULL;
-static int s_retry_num = 0;
+static esp_timer_handle_t s_reconnect_timer = NULL;
+static uint32_t s_retry_num = 0; //Failed attempts since the link was last up
+static uint32_t s_link_losses = 0;
+static bool s_connected = false;
+static bool s_link_down_reported = false;
+static bool s_handlers_registered = false;
+static int64_t s_link_down_since_us = 0;
 static connection_lost_cb_t s_connection_lost_callback = NULL;
+static connection_restored_cb_t s_connection_restored_callback = NULL;
+static bool s_fast_connect = false; //Station configured for the last AP joined, skipping the full scan
+static uint8_t s_cached_bssid[6] = { 0 };
+static uint8_t s_cached_channel = 0; //No AP cached
 
 
 /*
  Initializes WiFi service
 */
-esp_err_t esp32_rio_wifi_init(connection_lost_cb_t connection_lost_callback) {
+esp_err_t esp32_rio_wifi_init(connection_lost_cb_t connection_lost_callback, connection_restored_cb_t connection_restored_callback) {
     wifi_config_t wifi_config = { 0 };
     wifi_init_config_t init_cfg = WIFI_INIT_CONFIG_DEFAULT();
     esp_netif_inherent_config_t esp_netif_config = ESP_NETIF_INHERENT_DEFAULT_WIFI_STA();
+    const esp_timer_create_args_t reconnect_timer_args = {
+        .callback = &esp32_rio_reconnect_timer_callback,
+        .name = "wifi_reconnect"
+    };
     
     s_connection_lost_callback = connection_lost_callback;
+    s_connection_restored_callback = connection_restored_callback;
+    
+    ESP_RETURN_ON_ERROR(esp_timer_create(&reconnect_timer_args, &s_reconnect_timer),
+                        TAG,
+                        "esp_timer_create fail.");
     
     ESP_RETURN_ON_ERROR(esp_wifi_init(&init_cfg),
                         TAG,
@@ -86,11 +127,12 @@ esp_err_t esp32_rio_wifi_init(connection_lost_cb_t connection_lost_callback) {
     wifi_config.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
     wifi_config.sta.threshold.rssi = -127;
     wifi_config.sta.threshold.authmode = WIFI_AUTH_OPEN;
+    wifi_config.sta.listen_interval = ESP32_RIO_WIFI_LISTEN_INTERVAL; //Kept by later configurations, which start from this one
     ESP_RETURN_ON_ERROR(esp_wifi_set_config(WIFI_IF_STA, &wifi_config),
                         TAG,
                         "esp_wifi_set_config fail.");
     
-    ESP_RETURN_ON_ERROR(esp_wifi_set_ps(WIFI_PS_NONE),
+    ESP_RETURN_ON_ERROR(esp_wifi_set_ps(ESP32_RIO_WIFI_PS_MODE),
                         TAG,
                         "esp_wifi_set_ps fail.");
     
@@ -103,6 +145,11 @@ esp_err_t esp32_rio_wifi_init(connection_lost_cb_t connection_lost_callback) {
 */
 esp_err_t esp32_rio_wifi_deinit(void) {
     s_connection_lost_callback = NULL;
+    s_connection_restored_callback = NULL;
+    
+    esp_timer_stop(s_reconnect_timer);
+    esp_timer_delete(s_reconnect_timer);
+    s_reconnect_timer = NULL;
     
     ESP_RETURN_ON_ERROR(esp_wifi_stop(),
                         TAG,
@@ -124,7 +171,8 @@ esp_err_t esp32_rio_wifi_deinit(void) {
 
 
 /*
- Initial WiFi configuration check and connection attempt
+ Initial WiFi configuration check and connection start.
+ Returns once the first attempt is under way, reconnecting in the background from then on
 */
 bool esp32_rio_connect(void) {
     wifi_config_t wifi_config = { 0 };
@@ -134,16 +182,27 @@ bool esp32_rio_connect(void) {
     // Try to load WiFi network info from NVS
     err = esp32_rio_wifi_nv_params_load(wifi_config.sta.ssid, wifi_config.sta.password);
     if (err == ESP_OK) {
+        // Target the last AP joined on its channel first, falling back to a full scan if it doesn't answer
+        if (esp32_rio_wifi_nv_ap_load(s_cached_bssid, &s_cached_channel) == ESP_OK) {
+            ESP_LOGI(TAG, "Trying last AP " MACSTR " on channel %u first.", MAC2STR(s_cached_bssid), s_cached_channel);
+            memcpy(wifi_config.sta.bssid, s_cached_bssid, sizeof(wifi_config.sta.bssid));
+            wifi_config.sta.bssid_set = true;
+            wifi_config.sta.channel = s_cached_channel;
+            wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+            s_fast_connect = true;
+        }
+        // Static addressing skips waiting for DHCP
+        if (esp32_rio_apply_static_ip() != ESP_OK) {
+            ESP_LOGW(TAG, "Static IP configuration failed, using DHCP.");
+            esp_netif_dhcpc_start(s_esp32_rio_sta_netif);
+        }
         // Connection info loaded, try to connect
         ESP_LOGI(TAG, "Attempting to connect with stored network info...");
-        err = esp32_rio_wifi_sta_do_connect(wifi_config, true);
+        err = esp32_rio_wifi_sta_do_connect(wifi_config);
         if (err == ESP_OK) {
-            // Connection successful
-            ESP_LOGI(TAG, "Successfully connected to WiFi with stored network info.");
-            esp32_rio_print_netif_ip_info();
             return true;
         } else {
-            // Connection failed
+            // Connection could not be started
             ESP_LOGW(TAG, "WiFi connection failed.");
         }
     } else {
@@ -172,95 +231,230 @@ esp_netif_t *esp32_rio_get_netif(void) {
 
 
 /*
- Retrieve SSID and password from NVS
+ Reports whether the station holds an IP address
+*/
+bool esp32_rio_wifi_connected(void) {
+    return s_connected;
+}
+
+
+/*
+ Retrieve number of link losses since boot and of failed reconnection attempts since the link was last up
+*/
+void esp32_rio_wifi_get_link_stats(uint32_t *losses, uint32_t *attempts) {
+    *losses = s_link_losses;
+    *attempts = s_retry_num;
+}
+
+
+/*
+ Retrieve stored SSID and password
 */
 esp_err_t esp32_rio_wifi_nv_params_load(unsigned char *ssid, unsigned char *password) {
-    nvs_handle_t nvs_handle;
+    esp32_rio_config_wifi_t config = { 0 };
     esp_err_t err;
 
-    // Ensure NVS is initialized
-    err = nvs_flash_init();
-    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        err = nvs_flash_init();
+    err = esp32_rio_config_read(ESP32_RIO_CONFIG_WIFI, &config, sizeof(config));
+    if (err == ESP_OK && config.ssid[0] == '\0') {
+        err = ESP_ERR_NOT_FOUND; // Only addressing stored so far
     }
-    
-    err = nvs_open(ESP32_RIO_NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
     if (err != ESP_OK) {
-        ESP_LOGI(TAG, "NVS namespace '%s' not found or error opening: %s", ESP32_RIO_NVS_NAMESPACE, esp_err_to_name(err));
+        ESP_LOGI(TAG, "No stored WiFi credentials: %s", esp_err_to_name(err));
         return err;
     }
 
-    // Get stored SSID
-    size_t ssid_len = ESP32_RIO_SSID_MAX_LENGTH;
-    err = nvs_get_str(nvs_handle, ESP32_RIO_NVS_KEY_SSID, (char *)ssid, &ssid_len);
+    memcpy(ssid, config.ssid, ESP32_RIO_SSID_MAX_LENGTH);
+    memcpy(password, config.password, ESP32_RIO_PASSWORD_MAX_LENGTH);
+    ESP_LOGI(TAG, "WiFi credentials for SSID '%s' loaded.", config.ssid);
+    return ESP_OK;
+}
+
+
+/*
+ Store referred SSID and password
+*/
+esp_err_t esp32_rio_wifi_nv_params_save(const unsigned char *ssid, const unsigned char *password) {
+    esp32_rio_config_wifi_t config = { 0 };
+    esp32_rio_config_wifi_ap_t ap_config = { 0 };
+    esp_err_t err;
+    
+    esp32_rio_config_read(ESP32_RIO_CONFIG_WIFI, &config, sizeof(config)); // Keeps the stored addressing
+    snprintf(config.ssid, sizeof(config.ssid), "%s", (const char *)ssid);
+    snprintf(config.password, sizeof(config.password), "%s", (const char *)password);
+    
+    // The cached AP belongs to the previous network, dropped in the same commit
+    esp32_rio_config_hold();
+    err = esp32_rio_config_write(ESP32_RIO_CONFIG_WIFI, &config, sizeof(config));
+    if (err == ESP_OK) {
+        err = esp32_rio_config_write(ESP32_RIO_CONFIG_WIFI_AP, &ap_config, sizeof(ap_config));
+    }
+    esp_err_t release_err = esp32_rio_config_release();
+    if (err == ESP_OK) {
+        err = release_err;
+    }
     if (err != ESP_OK) {
-        ESP_LOGI(TAG, "Failed to read SSID from NVS: %s", esp_err_to_name(err));
-        nvs_close(nvs_handle);
-        return err;
+        ESP_LOGE(TAG, "Error storing WiFi credentials: %s", esp_err_to_name(err));
+    } else {
+        ESP_LOGI(TAG, "WiFi credentials for SSID '%s' saved.", config.ssid);
     }
+    return err;
+}
+
 
-    // Get stored password
-    size_t password_len = ESP32_RIO_PASSWORD_MAX_LENGTH;
-    err = nvs_get_str(nvs_handle, ESP32_RIO_NVS_KEY_PASSWORD, (char *)password, &password_len);
+/*
+ Retrieve stored static IP configuration (ESP_ERR_NOT_FOUND when DHCP is used)
+*/
+esp_err_t esp32_rio_wifi_nv_static_ip_load(esp_netif_ip_info_t *ip_info) {
+    esp32_rio_config_wifi_t config = { 0 };
+    esp_err_t err;
+    
+    err = esp32_rio_config_read(ESP32_RIO_CONFIG_WIFI, &config, sizeof(config));
     if (err != ESP_OK) {
-        ESP_LOGI(TAG, "Failed to read Password from NVS: %s", esp_err_to_name(err));
-        nvs_close(nvs_handle);
         return err;
     }
-
-    nvs_close(nvs_handle);
-    ESP_LOGI(TAG, "WiFi credentials for SSID '%s' loaded from NVS.", ssid);
+    if (config.static_ip[0] == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    
+    ip_info->ip.addr = config.static_ip[0];
+    ip_info->netmask.addr = config.static_ip[1];
+    ip_info->gw.addr = config.static_ip[2];
     return ESP_OK;
 }
 
 
 /*
- Store referred SSID and password on NVS
+ Store static IP configuration, or revert to DHCP if NULL (effective on next connection)
 */
-esp_err_t esp32_rio_wifi_nv_params_save(const unsigned char *ssid, const unsigned char *password) {
-    nvs_handle_t nvs_handle;
+esp_err_t esp32_rio_wifi_nv_static_ip_save(const esp_netif_ip_info_t *ip_info) {
+    esp32_rio_config_wifi_t config = { 0 };
     esp_err_t err;
     
-    // Ensure NVS is initialized
-    err = nvs_flash_init();
-    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        err = nvs_flash_init();
-    }
-
-    err = nvs_open(ESP32_RIO_NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    esp32_rio_config_read(ESP32_RIO_CONFIG_WIFI, &config, sizeof(config)); // Keeps the stored credentials
+    config.static_ip[0] = ip_info ? ip_info->ip.addr : 0;
+    config.static_ip[1] = ip_info ? ip_info->netmask.addr : 0;
+    config.static_ip[2] = ip_info ? ip_info->gw.addr : 0;
+    
+    err = esp32_rio_config_write(ESP32_RIO_CONFIG_WIFI, &config, sizeof(config));
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error opening NVS namespace for write: %s", esp_err_to_name(err));
-        return err;
+        ESP_LOGE(TAG, "Error storing static IP configuration: %s", esp_err_to_name(err));
     }
+    return err;
+}
 
-    // Store SSID
-    err = nvs_set_str(nvs_handle, ESP32_RIO_NVS_KEY_SSID, (const char *)ssid);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error storing SSID to NVS: %s", esp_err_to_name(err));
-        nvs_close(nvs_handle);
+
+/*
+ Reports whether the current connection was made without scanning all channels
+*/
+bool esp32_rio_wifi_fast_connected(void) {
+    return s_fast_connect;
+}
+
+
+/*
+ Configures the station interface with the stored static IP, if any, with the gateway as DNS server
+*/
+static esp_err_t esp32_rio_apply_static_ip(void) {
+    esp_netif_ip_info_t ip_info;
+    if (esp32_rio_wifi_nv_static_ip_load(&ip_info) != ESP_OK) {
+        return ESP_OK; //DHCP
+    }
+    
+    esp_err_t err = esp_netif_dhcpc_stop(s_esp32_rio_sta_netif);
+    if (err != ESP_OK && err != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED) {
         return err;
     }
+    ESP_RETURN_ON_ERROR(esp_netif_set_ip_info(s_esp32_rio_sta_netif, &ip_info),
+                        TAG,
+                        "esp_netif_set_ip_info fail.");
+    
+    esp_netif_dns_info_t dns_info = { 0 };
+    dns_info.ip.u_addr.ip4.addr = ip_info.gw.addr;
+    dns_info.ip.type = ESP_IPADDR_TYPE_V4;
+    ESP_RETURN_ON_ERROR(esp_netif_set_dns_info(s_esp32_rio_sta_netif, ESP_NETIF_DNS_MAIN, &dns_info),
+                        TAG,
+                        "esp_netif_set_dns_info fail.");
+    
+    ESP_LOGI(TAG, "Using static IP " IPSTR ".", IP2STR(&ip_info.ip));
+    return ESP_OK;
+}
 
-    // Store Password
-    err = nvs_set_str(nvs_handle, ESP32_RIO_NVS_KEY_PASSWORD, (const char *)password);
+
+/*
+ Retrieve stored BSSID and channel of the last AP joined
+*/
+static esp_err_t esp32_rio_wifi_nv_ap_load(uint8_t *bssid, uint8_t *channel) {
+    esp32_rio_config_wifi_ap_t config = { 0 };
+    esp_err_t err;
+    
+    err = esp32_rio_config_read(ESP32_RIO_CONFIG_WIFI_AP, &config, sizeof(config));
+    if (err == ESP_OK && config.channel == 0) {
+        err = ESP_ERR_NOT_FOUND; // Dropped along with the previous network
+    } else if (err == ESP_OK && config.channel > 14) {
+        ESP_LOGW(TAG, "Ignoring invalid stored AP information.");
+        err = ESP_ERR_INVALID_SIZE;
+    }
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error storing Password to NVS: %s", esp_err_to_name(err));
-        nvs_close(nvs_handle);
+        *channel = 0;
         return err;
     }
+    
+    memcpy(bssid, config.bssid, sizeof(config.bssid));
+    *channel = config.channel;
+    return ESP_OK;
+}
+
 
-    // Commit changes
-    err = nvs_commit(nvs_handle);
+/*
+ Store BSSID and channel of the AP just joined, if they differ from the ones stored
+*/
+static void esp32_rio_wifi_nv_ap_save(void) {
+    wifi_ap_record_t ap_info;
+    esp32_rio_config_wifi_ap_t config = { 0 };
+    esp_err_t err;
+    
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK ||
+        (ap_info.primary == s_cached_channel && memcmp(ap_info.bssid, s_cached_bssid, sizeof(s_cached_bssid)) == 0)) {
+        return;
+    }
+    
+    memcpy(config.bssid, ap_info.bssid, sizeof(config.bssid));
+    config.channel = ap_info.primary;
+    err = esp32_rio_config_write(ESP32_RIO_CONFIG_WIFI_AP, &config, sizeof(config));
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error committing NVS changes: %s", esp_err_to_name(err));
+        ESP_LOGE(TAG, "Error storing AP information: %s", esp_err_to_name(err));
     } else {
-        ESP_LOGI(TAG, "WiFi credentials for SSID '%s' saved to NVS.", ssid);
+        memcpy(s_cached_bssid, ap_info.bssid, sizeof(s_cached_bssid));
+        s_cached_channel = ap_info.primary;
+        ESP_LOGI(TAG, "AP " MACSTR " on channel %u cached for fast connection.", MAC2STR(s_cached_bssid), s_cached_channel);
     }
+}
 
-    nvs_close(nvs_handle);
-    return err;
+
+/*
+ Delay before a reconnection attempt: immediate at first, then doubling up to the maximum,
+ with half of it random so that devices dropped together don't retry in lockstep
+*/
+static uint32_t esp32_rio_wifi_backoff_ms(uint32_t attempt) {
+    if (attempt <= 1) {
+        return 0;
+    }
+    uint32_t backoff_ms = ESP32_RIO_WIFI_BACKOFF_MIN_MS;
+    for (uint32_t i = 2; i < attempt && backoff_ms < ESP32_RIO_WIFI_BACKOFF_MAX_MS; i++) {
+        backoff_ms *= 2;
+    }
+    if (backoff_ms > ESP32_RIO_WIFI_BACKOFF_MAX_MS) {
+        backoff_ms = ESP32_RIO_WIFI_BACKOFF_MAX_MS;
+    }
+    return backoff_ms / 2 + esp_random() % (backoff_ms / 2 + 1);
+}
+
+
+static void esp32_rio_reconnect_timer_callback(void *arg) {
+    esp_err_t err = esp_wifi_connect();
+    if (err != ESP_OK && err != ESP_ERR_WIFI_NOT_STARTED) {
+        ESP_LOGW(TAG, "esp_wifi_connect fail: %s", esp_err_to_name(err));
+    }
 }
 
 
@@ -280,33 +474,44 @@ static void esp32_rio_print_netif_ip_info(void) {
 
 
 static void esp32_rio_handler_on_wifi_disconnect(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
-    s_retry_num++;
-    if (s_retry_num > ESP32_RIO_WIFI_CONN_MAX_RETRY) {
-        ESP_LOGI(TAG, "WiFi Connect failed %d times, stop reconnect.", s_retry_num);
-        if (s_semph_get_ip_addrs) {
-            // Let esp32_rio_wifi_sta_do_connect() return
-            xSemaphoreGive(s_semph_get_ip_addrs);
-        }
-        esp32_rio_wifi_sta_do_disconnect();
-        
-        // Notify main task
-        if (s_connection_lost_callback) {
-            s_connection_lost_callback();
-        }
-        
-        return;
-    }
     wifi_event_sta_disconnected_t *disconn = event_data;
     if (disconn->reason == WIFI_REASON_ROAMING) {
         ESP_LOGD(TAG, "station roaming, do nothing.");
         return;
     }
-    ESP_LOGI(TAG, "Wi-Fi disconnected %d, trying to reconnect...", disconn->reason);
-    esp_err_t err = esp_wifi_connect();
-    if (err == ESP_ERR_WIFI_NOT_STARTED) {
-        return;
+    if (s_connected) {
+        s_connected = false;
+        s_link_losses++;
+        s_link_down_since_us = esp_timer_get_time();
+    }
+    if (!s_link_down_reported) {
+        // Notify main task once per outage, services stay up meanwhile
+        s_link_down_reported = true;
+        if (s_connection_lost_callback) {
+            s_connection_lost_callback();
+        }
+    }
+    s_retry_num++;
+    if (s_fast_connect && s_retry_num > 1) {
+        // The cached AP failed twice in a row: scan all channels for any AP of the network
+        wifi_config_t wifi_config;
+        s_fast_connect = false;
+        if (esp_wifi_get_config(WIFI_IF_STA, &wifi_config) == ESP_OK) {
+            wifi_config.sta.bssid_set = false;
+            wifi_config.sta.channel = 0;
+            wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+            esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+        }
+        ESP_LOGW(TAG, "Last AP not reachable, scanning all channels.");
+    }
+    uint32_t backoff_ms = esp32_rio_wifi_backoff_ms(s_retry_num);
+    ESP_LOGI(TAG, "Wi-Fi disconnected %d, reconnecting in %" PRIu32 " ms (attempt %" PRIu32 ")...", disconn->reason, backoff_ms, s_retry_num);
+    if (backoff_ms == 0) {
+        esp32_rio_reconnect_timer_callback(NULL);
+    } else {
+        esp_timer_stop(s_reconnect_timer); //Not running unless events overlap
+        ESP_ERROR_CHECK(esp_timer_start_once(s_reconnect_timer, (uint64_t)backoff_ms * 1000));
     }
-    ESP_ERROR_CHECK(err);
 }
 
 
@@ -314,26 +519,30 @@ static void esp32_rio_handler_on_wifi_connect(void *esp_netif, esp_event_base_t
 
 
 static void esp32_rio_handler_on_sta_got_ip(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
-    s_retry_num = 0;
-    if (s_semph_get_ip_addrs) {
-        xSemaphoreGive(s_semph_get_ip_addrs);
-    }
     ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
     ESP_LOGD(TAG, "Got IP event: Interface \"%s\" address: " IPSTR, esp_netif_get_desc(event->esp_netif), IP2STR(&event->ip_info.ip));
+    ESP_LOGI(TAG, "Connected to WiFi after %d attempt(s) in %d ms.", (int)s_retry_num + 1,
+             (int)((esp_timer_get_time() - s_link_down_since_us) / 1000));
+    esp32_rio_print_netif_ip_info();
+    s_retry_num = 0;
+    s_connected = true;
+    esp32_rio_wifi_nv_ap_save();
+    if (s_link_down_reported) {
+        s_link_down_reported = false;
+        if (s_connection_restored_callback) {
+            s_connection_restored_callback();
+        }
+    }
 }
 
 
-static esp_err_t esp32_rio_wifi_sta_do_connect(wifi_config_t wifi_config, bool wait) {
-    if (wait) {
-        s_semph_get_ip_addrs = xSemaphoreCreateBinary();
-        if (s_semph_get_ip_addrs == NULL) {
-            return ESP_ERR_NO_MEM;
-        }
-    }
+static esp_err_t esp32_rio_wifi_sta_do_connect(wifi_config_t wifi_config) {
     s_retry_num = 0;
+    s_link_down_since_us = esp_timer_get_time();
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, &esp32_rio_handler_on_wifi_connect, s_esp32_rio_sta_netif));
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &esp32_rio_handler_on_wifi_disconnect, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &esp32_rio_handler_on_sta_got_ip, NULL));
+    s_handlers_registered = true;
     
     ESP_LOGI(TAG, "Connecting to '%s'...", wifi_config.sta.ssid);
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
@@ -342,20 +551,16 @@ static esp_err_t esp32_rio_wifi_sta_do_connect(wifi_config_t wifi_config, bool w
         ESP_LOGE(TAG, "WiFi connect failed! ret:%x", ret);
         return ret;
     }
-    if (wait) {
-        ESP_LOGI(TAG, "Waiting for IP...");
-        xSemaphoreTake(s_semph_get_ip_addrs, portMAX_DELAY);
-        vSemaphoreDelete(s_semph_get_ip_addrs);
-        s_semph_get_ip_addrs = NULL;
-        if (s_retry_num > ESP32_RIO_WIFI_CONN_MAX_RETRY) {
-            return ESP_FAIL;
-        }
-    }
     return ESP_OK;
 }
 
 
 static esp_err_t esp32_rio_wifi_sta_do_disconnect(void) {
+    if (!s_handlers_registered) {
+        return ESP_OK; //Never connected
+    }
+    s_handlers_registered = false;
+    esp_timer_stop(s_reconnect_timer);
     ESP_ERROR_CHECK(esp_event_handler_unregister(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, &esp32_rio_handler_on_wifi_connect));
     ESP_ERROR_CHECK(esp_event_handler_unregister(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &esp32_rio_handler_on_wifi_disconnect));
     ESP_ERROR_CHECK(esp_event_handler_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, &esp32_rio_handler_on_sta_got_ip));
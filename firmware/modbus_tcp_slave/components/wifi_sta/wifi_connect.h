@@ -17,6 +17,8 @@ SPDX-License-Identifier: MIT
 #ifndef WIFI_CONNECT_H
 #define WIFI_CONNECT_H
 
+#include <stdint.h>
+#include <stdbool.h>
 #include "esp_err.h"
 #include "esp_netif.h"
 
@@ -24,15 +26,21 @@ SPDX-License-Identifier: MIT
 #define ESP32_RIO_PASSWORD_MAX_LENGTH 64
 
 typedef void (*connection_lost_cb_t)(void);
+typedef void (*connection_restored_cb_t)(void);
 
-esp_err_t esp32_rio_wifi_init(connection_lost_cb_t);
+esp_err_t esp32_rio_wifi_init(connection_lost_cb_t, connection_restored_cb_t);
 esp_err_t esp32_rio_wifi_deinit(void);
 
 bool esp32_rio_connect(void);
 esp_err_t esp32_rio_disconnect(void);
 esp_netif_t *esp32_rio_get_netif(void);
+bool esp32_rio_wifi_connected(void);
+void esp32_rio_wifi_get_link_stats(uint32_t *, uint32_t *);
 
 esp_err_t esp32_rio_wifi_nv_params_load(unsigned char *, unsigned char *);
 esp_err_t esp32_rio_wifi_nv_params_save(const unsigned char *, const unsigned char *);
+esp_err_t esp32_rio_wifi_nv_static_ip_load(esp_netif_ip_info_t *);
+esp_err_t esp32_rio_wifi_nv_static_ip_save(const esp_netif_ip_info_t *);
+bool esp32_rio_wifi_fast_connected(void);
 
 #endif //WIFI_CONNECT_H
@@ -14,107 +14,550 @@ It is subject to the terms of the MIT License, which can be found in the LICENSE
 SPDX-License-Identifier: MIT
 */
 
+#include <stdio.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include "sdkconfig.h"
 #include "esp_log.h"
 #include "esp_event.h"
-#include "nvs_flash.h"
 #include "esp_netif.h"
+#include "esp_timer.h"
 
+#include "config_store.h"
 #include "remote_io.h"
 #include "usb_console.h"
 #include "wifi_connect.h"
+#include "eth_connect.h"
+#include "diagnostics.h"
+#include "trace_log.h"
+#include "mb_frontend.h"
+#include "rbe_publisher.h"
+#include "logic_engine.h"
+#include "power_mgmt.h"
+#include "mb_gateway.h"
 #include "modbus_params.h"
+#include "mb_reg_image.h"
+#include "output_retain.h"
+#include "io_bench.h"
 #include "mbcontroller.h"
 
 #define MB_SLAVE_ADDR 1
 #define MB_TCP_PORT_NUMBER 502
+#define MB_TCP_STACK_PORT_NUMBER 1502 //Loopback port of the stack, served through the connection front-end
 
 #define MB_PAR_INFO_GET_TOUT 10 //Timeout for getting parameter info
-#define MB_READ_MASK (MB_EVENT_DISCRETE_RD | MB_EVENT_COILS_RD)
-#define MB_WRITE_MASK MB_EVENT_COILS_WR
+
+// Exception codes of requests answered for gateway units
+#define MB_GW_EXCEPTION_ILLEGAL_FUNCTION     0x01
+#define MB_GW_EXCEPTION_ILLEGAL_ADDRESS      0x02
+#define MB_GW_EXCEPTION_ILLEGAL_VALUE        0x03
+#define MB_GW_EXCEPTION_TARGET_NO_RESPONSE   0x0B
+#define MB_GW_MAX_READ_BITS 2000
+#define MB_GW_MAX_READ_REGISTERS 125
+
+#define MB_SLAVE_TASK_CORE CONFIG_ESP32_RIO_RT_CORE //Keep Modbus processing off the core running the WiFi stack
+#define MB_SLAVE_TASK_PRIORITY CONFIG_ESP32_RIO_MB_TASK_PRIORITY
+#define MB_SLAVE_TASK_STACK_SIZE CONFIG_ESP32_RIO_MB_TASK_STACK_SIZE
+#define OUTPUT_TASK_PRIORITY CONFIG_ESP32_RIO_OUTPUT_TASK_PRIORITY
+#define OUTPUT_TASK_STACK_SIZE CONFIG_ESP32_RIO_OUTPUT_TASK_STACK_SIZE
+
+// Task plan checks, sdkconfig.defaults setting the plan for the default cores
+#if (CONFIG_ESP32_RIO_RT_CORE == 0 && defined(CONFIG_ESP_WIFI_TASK_PINNED_TO_CORE_0)) || \
+    (CONFIG_ESP32_RIO_RT_CORE == 1 && defined(CONFIG_ESP_WIFI_TASK_PINNED_TO_CORE_1))
+#warning "The WiFi task shares the core of the I/O and Modbus tasks (see ESP32 RIO Task Plan in menuconfig)."
+#endif
+#if (CONFIG_ESP32_RIO_RT_CORE == 0 && defined(CONFIG_LWIP_TCPIP_TASK_AFFINITY_CPU0)) || \
+    (CONFIG_ESP32_RIO_RT_CORE == 1 && defined(CONFIG_LWIP_TCPIP_TASK_AFFINITY_CPU1))
+#warning "The lwIP task shares the core of the I/O and Modbus tasks (see ESP32 RIO Task Plan in menuconfig)."
+#endif
+#if !(CONFIG_ESP32_RIO_RT_CORE == 0 && defined(CONFIG_FMB_PORT_TASK_AFFINITY_CPU0)) && \
+    !(CONFIG_ESP32_RIO_RT_CORE == 1 && defined(CONFIG_FMB_PORT_TASK_AFFINITY_CPU1))
+#warning "The Modbus port task is not pinned to the core of the I/O and Modbus tasks (see ESP32 RIO Task Plan in menuconfig)."
+#endif
+
+// Output task notification bits
+#define OUTPUT_NOTIFY_COILS_WRITTEN     (1UL << 0)
+#define OUTPUT_NOTIFY_WATCHDOG_EXPIRED  (1UL << 1)
+#define OUTPUT_NOTIFY_LOGIC_CHANGED     (1UL << 2)
+#define MB_READ_MASK (MB_EVENT_DISCRETE_RD | MB_EVENT_COILS_RD | MB_EVENT_INPUT_REG_RD | MB_EVENT_HOLDING_REG_RD)
+#define MB_WRITE_MASK (MB_EVENT_COILS_WR | MB_EVENT_HOLDING_REG_WR)
 #define MB_READ_WRITE_MASK (MB_READ_MASK | MB_WRITE_MASK)
 
 static void on_oe_button_toggle(void);
-static void on_di_level_change(unsigned int);
+static void on_di_level_change(uint16_t);
+static void on_counter_update(const uint32_t *, const uint32_t *);
+static void on_output_watchdog_expiry(void);
+static void on_diag_update(const esp32_rio_diag_snapshot_t *);
+static void on_diag_console_report(void);
+static void on_diag_console_reset(void);
+static void register_console_commands(void);
 static void on_connection_lost(void);
+static void on_connection_restored(void);
 static void update_digital_outputs(void);
+static void on_coils_written(void);
+static bool enable_outputs_if_free(void);
+static bool on_bench_claim_outputs(void);
+static void on_bench_release_outputs(void);
+static void on_outputs_safe_state(void);
+static void refresh_io_image(void);
+static void update_io_image(mb_reg_image_t *);
+static void set_oe_coil(mb_reg_image_t *, bool);
+static void mirror_coil_banks(mb_reg_image_t *, uint16_t, size_t);
+static void fill_soe_window(void);
+static void drain_soe_window(uint16_t, size_t);
+static void on_dq_modes_write(uint16_t, size_t);
+static void on_logic_write(uint16_t, size_t);
+static void fill_logic_image(uint16_t);
+static void on_logic_inputs_read(esp32_rio_logic_inputs_t *);
+static void on_logic_outputs_change(void);
+static void on_logic_program_change(esp_err_t, size_t);
+static void on_gateway_image_read(esp32_rio_gateway_image_t *);
+static size_t on_unit_request(uint8_t, const uint8_t *, size_t, uint8_t *);
+static size_t gateway_read_bits(const uint16_t *, size_t, uint16_t, uint16_t, uint8_t *);
+static size_t gateway_read_registers(const uint16_t *, size_t, uint16_t, uint16_t, uint8_t *);
 static esp_err_t init_services(void);
 static esp_err_t destroy_services(void);
 static void setup_reg_data(void);
 static esp_err_t mb_slave_init(void);
 static esp_err_t slave_destroy(void);
 static void mb_slave_run(void *);
+static void on_coils_write(uint32_t);
+static void output_task(void *);
 
 static const char *TAG = "ESP32RIO_MB_SLAVE";
 
-static coil_reg_params_t coil_reg_params = { 0 };
-static discrete_reg_params_t discrete_reg_params = { 0 };
-
-// For concurrent access to Modbus registers
-static portMUX_TYPE param_lock = portMUX_INITIALIZER_UNLOCKED;
+_Static_assert(sizeof(((input_counter_reg_params_t *)0)->counts) == ESP32_RIO_NUM_DI_CHANNELS * sizeof(uint32_t),
+               "Counter register area must match the number of digital inputs");
+_Static_assert(sizeof(((holding_io_reg_params_t *)0)->counts) == sizeof(((input_counter_reg_params_t *)0)->counts),
+               "Holding register counter mirror must match the counter register area");
+_Static_assert(MB_DIAG_HISTOGRAM_BUCKETS == ESP32_RIO_DIAG_HISTOGRAM_BUCKETS,
+               "Diagnostic register histograms must match the diagnostics component");
+_Static_assert(sizeof(esp32_rio_dq_mode_config_t) == MB_DQ_MODE_BLOCK_SIZE * sizeof(uint16_t),
+               "Output mode register blocks must match the output mode settings");
+_Static_assert(sizeof(coil_reg_params_t) <= sizeof(((esp32_rio_gateway_image_t *)0)->coils) &&
+               sizeof(input_io_reg_params_t) == sizeof(((esp32_rio_gateway_image_t *)0)->io_image) &&
+               ESP32_RIO_NUM_DI_CHANNELS <= ESP32_RIO_GATEWAY_MAX_DI,
+               "Gateway images must hold the register areas they are served as");
 
 static bool outputs_enabled = false;
+static bool outputs_safe_state = false; //Outputs driven to their safe states by the watchdog
+static bool s_coils_restored = false; //Coils retained across the reset, to be applied once the output task runs
+static portMUX_TYPE s_outputs_owner_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool s_outputs_benched = false; //Output path taken by the I/O benchmark, outputs cannot be enabled. Under s_outputs_owner_lock
+
+static TaskHandle_t s_output_task_handle = NULL;
+static atomic_uint s_coil_write_pending_since = 0; //Timestamp (us, bit 0 set) of the oldest coil write not yet applied, 0 if none
+
+// Read requests served since boot, per register type. Counted by the Modbus slave task only, shown by the diag command
+static uint32_t s_mb_discrete_reads = 0;
+static uint32_t s_mb_coil_reads = 0;
+static uint32_t s_mb_input_reads = 0;
+static uint32_t s_mb_holding_reads = 0;
+
+static uint16_t s_logic_load_status = 0; //Status of the last logic program load, kept to undo writes to its register. Under the image writer mutex
 
 
 static void on_oe_button_toggle(void) {
+    mb_reg_image_t *image;
     if (outputs_enabled) {
         outputs_enabled = false;
-        MB_TURN_COIL_OFF(OE_COIL_ADDR);
+        esp32_rio_disarm_output_watchdog();
+        image = mb_reg_image_write_begin();
+        set_oe_coil(image, false);
+        update_io_image(image);
+        mb_reg_image_write_end();
         esp32_rio_disable_outputs();
         esp32_rio_turn_status_led_off(); //Alert operator
-    } else {
+    } else if (enable_outputs_if_free()) {
+        esp32_rio_arm_output_watchdog();
         update_digital_outputs();
-        outputs_enabled = true;
-        MB_TURN_COIL_ON(OE_COIL_ADDR);
+        outputs_safe_state = false;
+        image = mb_reg_image_write_begin();
+        set_oe_coil(image, true);
+        update_io_image(image);
+        mb_reg_image_write_end();
         esp32_rio_turn_status_led_on(); //Alert operator
     }
     ESP_LOGI(TAG, "Digital outputs %s.", outputs_enabled ? "enabled" : "disabled");
 }
 
 
-static void on_di_level_change(unsigned int input_number) {
-    portENTER_CRITICAL(&param_lock);
-    if (esp32_rio_is_input_on(input_number)) {
-        discrete_reg_params.discrete_inputs |= (1U << input_number);
-    } else {
-        discrete_reg_params.discrete_inputs &= ~(1U << input_number);
+static void on_di_level_change(uint16_t inputs) {
+    mb_reg_image_t *image = mb_reg_image_write_begin();
+    image->discrete.discrete_inputs = inputs;
+    image->input_io.discrete_inputs = inputs;
+    image->holding_io.discrete_inputs = inputs;
+    mb_reg_image_write_end();
+    esp32_rio_rbe_publish_levels(inputs); //Push to the subscriber, if any
+}
+
+
+static void on_counter_update(const uint32_t *counts, const uint32_t *rates) {
+    mb_reg_image_t *image = mb_reg_image_write_begin();
+    // Whole-word stores, so the stack never serves a half-updated value
+    for (int i = 0; i < ESP32_RIO_NUM_DI_CHANNELS; i++) {
+        image->counters.counts[i] = counts[i];
+        image->counters.rates[i] = rates[i];
+        image->holding_io.counts[i] = counts[i];
+    }
+    mb_reg_image_write_end();
+}
+
+
+/*
+ Called from the I/O task once the output watchdog has driven the outputs to their safe states
+*/
+static void on_output_watchdog_expiry(void) {
+    xTaskNotify(s_output_task_handle, OUTPUT_NOTIFY_WATCHDOG_EXPIRED, eSetBits);
+}
+
+
+/*
+ Publish a diagnostics snapshot, along with I/O queue figures, to the diagnostic input registers
+*/
+static void on_diag_update(const esp32_rio_diag_snapshot_t *snapshot) {
+    uint32_t di_edges, di_edges_coalesced, di_events_lost, isr_high_water, filter_high_water;
+    esp32_rio_get_di_event_stats(&di_edges, &di_edges_coalesced);
+    esp32_rio_get_di_event_count(&di_events_lost);
+    esp32_rio_get_di_queue_stats(&isr_high_water, &filter_high_water);
+    
+    mb_reg_image_t *image = mb_reg_image_write_begin();
+    image->diag.uptime_s = snapshot->uptime_s;
+    image->diag.requests = snapshot->counters[ESP32_RIO_DIAG_MB_REQUESTS];
+    image->diag.request_rate = snapshot->request_rate;
+    image->diag.coil_writes = snapshot->counters[ESP32_RIO_DIAG_MB_COIL_WRITES];
+    image->diag.output_updates = snapshot->counters[ESP32_RIO_DIAG_OUTPUT_UPDATES];
+    image->diag.output_noops = snapshot->counters[ESP32_RIO_DIAG_OUTPUT_NOOPS];
+    image->diag.di_edges = di_edges;
+    image->diag.di_edges_coalesced = di_edges_coalesced;
+    image->diag.di_events_lost = di_events_lost;
+    image->diag.di_isr_queue_high_water = isr_high_water;
+    image->diag.di_filter_queue_high_water = filter_high_water;
+    input_latency_reg_params_t *latency_regs[ESP32_RIO_DIAG_NUM_LATENCIES] = {
+        [ESP32_RIO_DIAG_COIL_TO_OUTPUT] = &image->diag.coil_to_output,
+        [ESP32_RIO_DIAG_DI_TO_REGISTER] = &image->diag.di_to_register
+    };
+    for (int i = 0; i < ESP32_RIO_DIAG_NUM_LATENCIES; i++) {
+        const esp32_rio_diag_latency_stats_t *stats = &snapshot->latencies[i];
+        latency_regs[i]->count = stats->count;
+        latency_regs[i]->min_us = stats->min_us;
+        latency_regs[i]->mean_us = stats->mean_us;
+        latency_regs[i]->max_us = stats->max_us;
+        latency_regs[i]->p99_us = stats->p99_us;
+        for (int bucket = 0; bucket < MB_DIAG_HISTOGRAM_BUCKETS; bucket++) {
+            latency_regs[i]->buckets[bucket] = stats->buckets[bucket];
+        }
+    }
+    mb_reg_image_write_end();
+}
+
+
+/*
+ Add the I/O queue, settings store and trace log figures to the diag command, on the console task
+*/
+static void on_diag_console_report(void) {
+    char output_buf[160];
+    uint32_t di_edges, di_edges_coalesced, di_events_lost, isr_high_water, filter_high_water;
+    uint32_t trace_written, trace_dropped, config_commits, config_skipped;
+    esp32_rio_get_di_event_stats(&di_edges, &di_edges_coalesced);
+    esp32_rio_get_di_event_count(&di_events_lost);
+    esp32_rio_get_di_queue_stats(&isr_high_water, &filter_high_water);
+    esp32_rio_trace_get_stats(&trace_written, &trace_dropped);
+    esp32_rio_config_get_stats(&config_commits, &config_skipped);
+    
+    snprintf(output_buf, sizeof(output_buf), "  Modbus reads: coils %" PRIu32 ", discrete inputs %" PRIu32
+             ", input registers %" PRIu32 ", holding registers %" PRIu32 "\n",
+             s_mb_coil_reads, s_mb_discrete_reads, s_mb_input_reads, s_mb_holding_reads);
+    esp32_rio_console_write_str(output_buf);
+    snprintf(output_buf, sizeof(output_buf), "  DI edges: %" PRIu32 ", coalesced: %" PRIu32 ", events lost: %" PRIu32 "\n",
+             di_edges, di_edges_coalesced, di_events_lost);
+    esp32_rio_console_write_str(output_buf);
+    snprintf(output_buf, sizeof(output_buf), "  DI event buffer high-water marks: %" PRIu32 " (unfiltered), %" PRIu32 " (filtered)\n",
+             isr_high_water, filter_high_water);
+    esp32_rio_console_write_str(output_buf);
+    snprintf(output_buf, sizeof(output_buf), "  Settings writes: %" PRIu32 ", skipped as unchanged: %" PRIu32 "\n",
+             config_commits, config_skipped);
+    esp32_rio_console_write_str(output_buf);
+#if CONFIG_ESP32_RIO_TRACE_ENABLED
+    snprintf(output_buf, sizeof(output_buf), "  Trace records: %" PRIu32 ", dropped: %" PRIu32 "\n", trace_written, trace_dropped);
+    esp32_rio_console_write_str(output_buf);
+#endif
+}
+
+
+static void on_diag_console_reset(void) {
+    esp32_rio_reset_di_queue_stats();
+}
+
+
+/*
+ Add the commands of the components to the console, which must not be started yet. The console still works
+ without any of them
+*/
+static void register_console_commands(void) {
+    if (esp32_rio_diag_console_register(on_diag_console_report, on_diag_console_reset) != ESP_OK) {
+        ESP_LOGW(TAG, "Diagnostics commands not available.");
+    }
+    if (esp32_rio_logic_console_register() != ESP_OK) {
+        ESP_LOGW(TAG, "Logic engine command not available.");
+    }
+    if (esp32_rio_gateway_console_register() != ESP_OK) {
+        ESP_LOGW(TAG, "Gateway command not available.");
+    }
+    if (esp32_rio_power_console_register() != ESP_OK) {
+        ESP_LOGW(TAG, "Power command not available.");
+    }
+    if (io_bench_register(on_bench_claim_outputs, on_bench_release_outputs) != ESP_OK) {
+        ESP_LOGW(TAG, "I/O benchmark not available.");
     }
-    portEXIT_CRITICAL(&param_lock);
 }
 
 
+/*
+ Called on loss of either link, alerting only once neither Ethernet nor WiFi is left
+*/
 static void on_connection_lost(void) {
-    esp32_rio_start_morse_blinker(); //Alert user
+    if (!esp32_rio_eth_connected() && !esp32_rio_wifi_connected()) {
+        esp32_rio_start_morse_blinker(); //Alert user while reconnecting in the background
+    }
+}
+
+
+static void on_connection_restored(void) {
+    esp32_rio_stop_morse_blinker();
+    if (outputs_enabled) {
+        esp32_rio_turn_status_led_on();
+    }
 }
 
 
 static void update_digital_outputs(void) {
-    for (int i = 0; i < ESP32_RIO_NUM_IO_CHANNELS; i++) {
-        // Bank 0 (coil i corresponds to output i of bank 0)
-        if (MB_IS_COIL_ON(i)) {
-            esp32_rio_turn_output_on(0, i);
-        } else {
-            esp32_rio_turn_output_off(0, i);
-        }
-        // Bank 1 (coil i + 16 corresponds to output i of bank 1)
-        if (MB_IS_COIL_ON(i + 16)) {
-            esp32_rio_turn_output_on(1, i);
+    // Snapshot the coil image once (coil i of each bank corresponds to output i of that bank)
+    coil_reg_params_t coils;
+    mb_reg_image_read(&coils, &mb_reg_image_get()->coils, sizeof(coils));
+    
+    // Outputs driven by the logic program follow it instead of their coils
+    uint32_t logic_mask, logic_levels;
+    esp32_rio_logic_get_outputs(&logic_mask, &logic_levels);
+    uint32_t levels = ((uint32_t)coils.coils_bank0 | ((uint32_t)coils.coils_bank1 << 16)) & ~logic_mask;
+    levels |= logic_levels & logic_mask;
+    esp32_rio_apply_outputs((uint16_t)levels, (uint16_t)(levels >> 16));
+    esp32_rio_diag_count(ESP32_RIO_DIAG_OUTPUT_UPDATES);
+}
+
+
+/*
+ Act on a coil image change, honoring the Output Enable coil
+*/
+static void on_coils_written(void) {
+    bool oe_coil_on = mb_reg_image_is_coil_on(OE_COIL_ADDR);
+    if (outputs_enabled) {
+        if (!oe_coil_on) {
+            // Outputs disabled by Modbus master
+            esp32_rio_disarm_output_watchdog();
+            esp32_rio_disable_outputs();
+            outputs_enabled = false;
+            esp32_rio_turn_status_led_off(); //Alert operator
+            ESP_LOGI(TAG, "Digital outputs disabled.");
         } else {
-            esp32_rio_turn_output_off(1, i);
+            // Update digital outputs based on corresponding coil values
+            update_digital_outputs();
         }
+    } else if (oe_coil_on && enable_outputs_if_free()) {
+        // Outputs enabled by Modbus master. Update digital outputs based on corresponding coil values
+        esp32_rio_arm_output_watchdog();
+        update_digital_outputs();
+        outputs_safe_state = false;
+        esp32_rio_turn_status_led_on(); //Alert operator
+        ESP_LOGI(TAG, "Digital outputs enabled.");
     }
+    refresh_io_image();
 }
 
 
-static esp_err_t init_services(void) {
-    // NVS (needed for WiFi and other configuration storage)
-    esp_err_t err = nvs_flash_init();
-    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        err = nvs_flash_init();
+/*
+ Mark outputs enabled, unless the I/O benchmark drives them. Refusing clears the Output Enable coil, so that it
+ never reads on while outputs stay disabled
+*/
+static bool enable_outputs_if_free(void) {
+    portENTER_CRITICAL(&s_outputs_owner_lock);
+    bool allowed = !s_outputs_benched;
+    if (allowed) {
+        outputs_enabled = true;
+    }
+    portEXIT_CRITICAL(&s_outputs_owner_lock);
+    if (!allowed) {
+        mb_reg_image_t *image = mb_reg_image_write_begin();
+        set_oe_coil(image, false);
+        update_io_image(image);
+        mb_reg_image_write_end();
+        ESP_LOGW(TAG, "Digital outputs not enabled: I/O benchmark running.");
     }
+    return allowed;
+}
+
+
+/*
+ Hand the output path over to the I/O benchmark, on the console task. Refused while outputs are enabled, about
+ to be, or held in their safe states
+*/
+static bool on_bench_claim_outputs(void) {
+    bool oe_coil_on = mb_reg_image_is_coil_on(OE_COIL_ADDR); //Turned on later, the enabling is refused
+    portENTER_CRITICAL(&s_outputs_owner_lock);
+    bool claimed = !outputs_enabled && !outputs_safe_state && !oe_coil_on;
+    s_outputs_benched = claimed;
+    portEXIT_CRITICAL(&s_outputs_owner_lock);
+    return claimed;
+}
+
+
+static void on_bench_release_outputs(void) {
+    portENTER_CRITICAL(&s_outputs_owner_lock);
+    s_outputs_benched = false;
+    portEXIT_CRITICAL(&s_outputs_owner_lock);
+}
+
+
+/*
+ Take over from the output watchdog: outputs stay in their safe states, disabled, until re-enabled
+*/
+static void on_outputs_safe_state(void) {
+    if (!outputs_enabled) {
+        return; //Disabled meanwhile by the master or the OE button
+    }
+    outputs_enabled = false;
+    outputs_safe_state = true;
+    mb_reg_image_t *image = mb_reg_image_write_begin();
+    set_oe_coil(image, false);
+    update_io_image(image);
+    mb_reg_image_write_end();
+    esp32_rio_turn_status_led_off(); //Alert operator
+    
+    uint32_t latency_us;
+    esp32_rio_get_output_watchdog_stats(NULL, &latency_us, NULL);
+    ESP_LOGW(TAG, "No output writes for %" PRIu32 " ms. Outputs set to safe states in %" PRIu32 " us and disabled.",
+             esp32_rio_get_output_watchdog(), latency_us);
+}
+
+
+/*
+ Update the packed I/O image registers on their own. The coil words of the holding view are left alone: a master
+ write to them may still wait to be applied
+*/
+static void refresh_io_image(void) {
+    update_io_image(mb_reg_image_write_begin());
+    mb_reg_image_write_end();
+}
+
+
+/*
+ Bring the packed I/O image registers in line with the coils, discrete inputs and status. The holding view takes its
+ coil words only where the coils change, see mirror_coil_banks(). Called within an image update
+*/
+static void update_io_image(mb_reg_image_t *image) {
+    uint16_t status = outputs_enabled ? MB_STATUS_OUTPUTS_ENABLED : 0;
+    if (outputs_safe_state) {
+        status |= MB_STATUS_OUTPUTS_SAFE_STATE;
+    }
+    if (image->soe.window_count > 0 || image->soe.pending_count > 0) {
+        status |= MB_STATUS_DI_EVENTS_PENDING;
+    }
+    if (image->soe.overrun_count > 0) {
+        status |= MB_STATUS_DI_EVENTS_LOST;
+    }
+    image->input_io.coils_bank0 = image->coils.coils_bank0;
+    image->input_io.coils_bank1 = image->coils.coils_bank1;
+    image->input_io.discrete_inputs = image->holding_io.discrete_inputs = image->discrete.discrete_inputs;
+    image->input_io.status = image->holding_io.status = status;
+    for (int i = 0; i < ESP32_RIO_NUM_DI_CHANNELS; i++) {
+        image->holding_io.counts[i] = image->counters.counts[i];
+    }
+    output_retain_store(&image->coils, outputs_enabled);
+}
+
+
+/*
+ Switch the Output Enable coil, in the holding view too when it lies in a coil bank. Called within an image update
+*/
+static void set_oe_coil(mb_reg_image_t *image, bool on) {
+    if (on) {
+        image->coils.MB_OE_COIL_WORD |= MB_OE_COIL_BIT;
+    } else {
+        image->coils.MB_OE_COIL_WORD &= ~MB_OE_COIL_BIT;
+    }
+#if ESP32_RIO_NUM_DQ_CHANNELS < 16
+    // Only this bit: the rest of the word may hold a master write still to be applied
+    if (on) {
+        image->holding_io.coils_bank1 |= MB_OE_COIL_BIT;
+    } else {
+        image->holding_io.coils_bank1 &= ~MB_OE_COIL_BIT;
+    }
+#endif
+}
+
+
+/*
+ Copy the coil banks covered by coils [first_coil, first_coil + coil_count) to the holding view. Called within an
+ image update
+*/
+static void mirror_coil_banks(mb_reg_image_t *image, uint16_t first_coil, size_t coil_count) {
+    if (first_coil < 16) {
+        image->holding_io.coils_bank0 = image->coils.coils_bank0;
+    }
+    if (first_coil < 32 && first_coil + coil_count > 16) {
+        image->holding_io.coils_bank1 = image->coils.coils_bank1;
+    }
+}
+
+
+static void fill_soe_window(void) {
+    esp32_rio_di_event_t events[MB_SOE_WINDOW_RECORDS];
+    uint32_t overrun_count;
+    
+    size_t event_count = esp32_rio_peek_di_events(events, MB_SOE_WINDOW_RECORDS);
+    size_t pending_count = esp32_rio_get_di_event_count(&overrun_count) - event_count;
+    
+    mb_reg_image_t *image = mb_reg_image_write_begin();
+    image->soe.window_count = event_count;
+    image->soe.pending_count = pending_count > UINT16_MAX ? UINT16_MAX : pending_count;
+    image->soe.overrun_count = (uint16_t)overrun_count;
+    for (size_t i = 0; i < MB_SOE_WINDOW_RECORDS; i++) {
+        uint64_t timestamp = i < event_count ? (uint64_t)events[i].timestamp_us : 0;
+        image->soe.records[i][0] = (uint16_t)timestamp;
+        image->soe.records[i][1] = (uint16_t)(timestamp >> 16);
+        image->soe.records[i][2] = (uint16_t)(timestamp >> 32);
+        image->soe.records[i][3] = i < event_count ? (events[i].level << 8) | events[i].channel : 0;
+    }
+    update_io_image(image); //Event flags in status word
+    mb_reg_image_write_end();
+}
+
+
+static void drain_soe_window(uint16_t read_offset, size_t read_size) {
+    if (read_offset != MB_REG_INPUT_SOE_START) {
+        return; //Only a read from the start of the window consumes records
+    }
+    size_t covered_records = read_size > MB_SOE_HEADER_SIZE ? (read_size - MB_SOE_HEADER_SIZE) / MB_SOE_RECORD_SIZE : 0;
+    size_t served_records = mb_reg_image_get()->soe.window_count; //Only ever updated by this task
+    esp32_rio_consume_di_events(covered_records < served_records ? covered_records : served_records);
+    fill_soe_window();
+}
+
+
+static esp_err_t init_services(void) {
+    // Power profile, before any path takes its lock
+    esp_err_t err = esp32_rio_power_init();
+    MB_RETURN_ON_FALSE((err == ESP_OK), ESP_ERR_INVALID_STATE,
+                       TAG,
+                       "esp32_rio_power_init fail, returns(0x%x).",
+                       (int)err);
+    
+    // NVS and all stored settings, read once (needed for WiFi and other configuration)
+    err = esp32_rio_config_init();
     MB_RETURN_ON_FALSE((err == ESP_OK), ESP_ERR_INVALID_STATE,
                        TAG,
-                       "nvs_flash_init fail, returns(0x%x).",
+                       "esp32_rio_config_init fail, returns(0x%x).",
                        (int)err);
     
     // TCP/IP stack
@@ -132,25 +575,64 @@ static esp_err_t init_services(void) {
                        (int)err);
     
     // WiFi
-    err = esp32_rio_wifi_init(on_connection_lost);
+    err = esp32_rio_wifi_init(on_connection_lost, on_connection_restored);
     MB_RETURN_ON_FALSE((err == ESP_OK), ESP_ERR_INVALID_STATE,
                        TAG,
                        "esp32_rio_wifi_init fail, returns(0x%x).",
                        (int)err);
     
+    // Modbus register image (written from I/O callbacks)
+    mb_reg_image_init();
+    
+    // Diagnostics (recorded from I/O services on)
+    err = esp32_rio_diag_init(on_diag_update);
+    MB_RETURN_ON_FALSE((err == ESP_OK), ESP_ERR_INVALID_STATE,
+                       TAG,
+                       "esp32_rio_diag_init fail, returns(0x%x).",
+                       (int)err);
+    
+    // Hot-path trace log (written from I/O services on)
+    if (esp32_rio_trace_start() != ESP_OK) {
+        ESP_LOGW(TAG, "Trace log not available."); //Trace records pile up and get dropped
+    }
+    
     // I/O
-    err = esp32_rio_io_services_init(on_oe_button_toggle, on_di_level_change);
+    err = esp32_rio_io_services_init(on_oe_button_toggle, on_di_level_change, on_counter_update, on_output_watchdog_expiry);
     MB_RETURN_ON_FALSE((err == ESP_OK), ESP_ERR_INVALID_STATE,
                        TAG,
                        "esp32_rio_io_services_init fail, returns(0x%x).",
                        (int)err);
     
+    // Ethernet (optional, needs the GPIO ISR service of the I/O services)
+    err = esp32_rio_eth_init(on_connection_lost, on_connection_restored);
+    if (err != ESP_OK && err != ESP_ERR_NOT_SUPPORTED) {
+        ESP_LOGW(TAG, "Ethernet not available, returns(0x%x). Using WiFi only.", (int)err);
+    }
+    
     return ESP_OK;
 }
 
 
 static esp_err_t destroy_services(void) {
-    esp_err_t err = esp32_rio_wifi_deinit();
+    esp_err_t err = esp32_rio_mb_frontend_stop(); //First, as it hands requests to the gateway
+    MB_RETURN_ON_FALSE((err == ESP_OK), ESP_ERR_INVALID_STATE,
+                       TAG,
+                       "esp32_rio_mb_frontend_stop fail, returns(0x%x).",
+                       (int)err);
+    
+    err = esp32_rio_gateway_stop();
+    MB_RETURN_ON_FALSE((err == ESP_OK), ESP_ERR_INVALID_STATE,
+                       TAG,
+                       "esp32_rio_gateway_stop fail, returns(0x%x).",
+                       (int)err);
+    
+    err = esp32_rio_eth_deinit();
+    MB_RETURN_ON_FALSE((err == ESP_OK), ESP_ERR_INVALID_STATE,
+                       TAG,
+                       "esp32_rio_eth_deinit fail, returns(0x%x).",
+                       (int)err);
+    
+    err = esp32_rio_wifi_deinit();
     MB_RETURN_ON_FALSE((err == ESP_OK), ESP_ERR_INVALID_STATE,
                        TAG,
                        "esp32_rio_wifi_deinit fail, returns(0x%x).",
@@ -168,11 +650,7 @@ static esp_err_t destroy_services(void) {
                        "esp_netif_deinit fail, returns(0x%x).",
                        (int)err);
     
-    err = nvs_flash_deinit();
-    MB_RETURN_ON_FALSE((err == ESP_OK), ESP_ERR_INVALID_STATE,
-                       TAG,
-                       "nvs_flash_deinit fail, returns(0x%x).",
-                       (int)err);
+    // The config store stays open: the console left running still stores settings, WiFi credentials included
     
     err = esp32_rio_io_services_deinit();
     MB_RETURN_ON_FALSE((err == ESP_OK), ESP_ERR_INVALID_STATE,
@@ -185,18 +663,31 @@ static esp_err_t destroy_services(void) {
 
 
 static void setup_reg_data(void) {
-    // Define initial default state of coils
-    coil_reg_params.coils_bank0 = 0x0000;
-    coil_reg_params.coils_bank1 = 0x0000;
+    // Define initial state of coils: cleared, unless retained across the reset
+    coil_reg_params_t coils = { 0 };
+    s_coils_restored = output_retain_restore(&coils);
+    mb_reg_image_t *image = mb_reg_image_write_begin();
+    image->coils = coils;
+    mirror_coil_banks(image, 0, 32);
+    mb_reg_image_write_end();
     
     // Probe current state of discrete inputs corresponding to digital inputs
-    for (int i = 0; i < ESP32_RIO_NUM_IO_CHANNELS; i++) {
-        if (esp32_rio_is_input_on(i)) {
-            discrete_reg_params.discrete_inputs |= (1U << i);
-        } else {
-            discrete_reg_params.discrete_inputs &= ~(1U << i);
+    on_di_level_change(esp32_rio_read_inputs());
+    
+    // Expose DI events recorded so far
+    fill_soe_window();
+    
+    // Expose the output modes in use
+    image = mb_reg_image_write_begin();
+    for (int bank = 0; bank < 2; bank++) {
+        for (int i = 0; i < ESP32_RIO_NUM_DQ_CHANNELS; i++) {
+            esp32_rio_get_dq_mode(bank, i, &image->dq_modes.modes[bank][i]);
         }
     }
+    mb_reg_image_write_end();
+    
+    // Mirror everything into the packed I/O image
+    refresh_io_image();
 }
 
 
@@ -204,6 +695,7 @@ static esp_err_t mb_slave_init(void) {
     mb_communication_info_t comm_info = { 0 };
     
     mb_register_area_descriptor_t reg_area;
+    mb_reg_image_t *image = mb_reg_image_get();
     void* slave_handler = NULL;
     
     // Initialization of Modbus controller
@@ -215,9 +707,9 @@ static esp_err_t mb_slave_init(void) {
     // Setup communication parameters and start stack
     comm_info.ip_addr_type = MB_IPV4;
     comm_info.ip_mode = MB_MODE_TCP;
-    comm_info.ip_port = MB_TCP_PORT_NUMBER;
-    comm_info.ip_addr = NULL; //Bind to any address
-    comm_info.ip_netif_ptr = (void*)esp32_rio_get_netif();
+    comm_info.ip_port = MB_TCP_STACK_PORT_NUMBER;
+    comm_info.ip_addr = "127.0.0.1"; //Only reachable through the front-end
+    comm_info.ip_netif_ptr = (void*)esp32_rio_get_netif(); //Unused on loopback: the front-end accepts masters on every link
     comm_info.slave_uid = MB_SLAVE_ADDR;
     err = mbc_slave_setup((void*)&comm_info);
     MB_RETURN_ON_FALSE((err == ESP_OK),
@@ -229,8 +721,8 @@ static esp_err_t mb_slave_init(void) {
     // Initialization of Coils register area
     reg_area.type = MB_PARAM_COIL;
     reg_area.start_offset = MB_REG_COILS_START;
-    reg_area.address = (void*)&coil_reg_params;
-    reg_area.size = sizeof(coil_reg_params);
+    reg_area.address = (void*)&image->coils;
+    reg_area.size = sizeof(image->coils);
     err = mbc_slave_set_descriptor(reg_area);
     MB_RETURN_ON_FALSE((err == ESP_OK),
                        ESP_ERR_INVALID_STATE,
@@ -241,8 +733,92 @@ static esp_err_t mb_slave_init(void) {
     // Initialization of Discrete Inputs register area
     reg_area.type = MB_PARAM_DISCRETE;
     reg_area.start_offset = MB_REG_DISCRETE_INPUT_START;
-    reg_area.address = (void*)&discrete_reg_params;
-    reg_area.size = sizeof(discrete_reg_params);
+    reg_area.address = (void*)&image->discrete;
+    reg_area.size = sizeof(image->discrete);
+    err = mbc_slave_set_descriptor(reg_area);
+    MB_RETURN_ON_FALSE((err == ESP_OK),
+                       ESP_ERR_INVALID_STATE,
+                       TAG,
+                       "mbc_slave_set_descriptor fail, returns(0x%x).",
+                       (int)err);
+    
+    // Initialization of Input Registers area (pulse counters)
+    reg_area.type = MB_PARAM_INPUT;
+    reg_area.start_offset = MB_REG_INPUT_COUNTERS_START;
+    reg_area.address = (void*)&image->counters;
+    reg_area.size = sizeof(image->counters);
+    err = mbc_slave_set_descriptor(reg_area);
+    MB_RETURN_ON_FALSE((err == ESP_OK),
+                       ESP_ERR_INVALID_STATE,
+                       TAG,
+                       "mbc_slave_set_descriptor fail, returns(0x%x).",
+                       (int)err);
+    
+    // Initialization of Input Registers area (DI sequence of events window)
+    reg_area.type = MB_PARAM_INPUT;
+    reg_area.start_offset = MB_REG_INPUT_SOE_START;
+    reg_area.address = (void*)&image->soe;
+    reg_area.size = sizeof(image->soe);
+    err = mbc_slave_set_descriptor(reg_area);
+    MB_RETURN_ON_FALSE((err == ESP_OK),
+                       ESP_ERR_INVALID_STATE,
+                       TAG,
+                       "mbc_slave_set_descriptor fail, returns(0x%x).",
+                       (int)err);
+    
+    // Initialization of Input Registers area (I/O image)
+    reg_area.type = MB_PARAM_INPUT;
+    reg_area.start_offset = MB_REG_INPUT_IO_START;
+    reg_area.address = (void*)&image->input_io;
+    reg_area.size = sizeof(image->input_io);
+    err = mbc_slave_set_descriptor(reg_area);
+    MB_RETURN_ON_FALSE((err == ESP_OK),
+                       ESP_ERR_INVALID_STATE,
+                       TAG,
+                       "mbc_slave_set_descriptor fail, returns(0x%x).",
+                       (int)err);
+    
+    // Initialization of Input Registers area (diagnostics)
+    reg_area.type = MB_PARAM_INPUT;
+    reg_area.start_offset = MB_REG_INPUT_DIAG_START;
+    reg_area.address = (void*)&image->diag;
+    reg_area.size = sizeof(image->diag);
+    err = mbc_slave_set_descriptor(reg_area);
+    MB_RETURN_ON_FALSE((err == ESP_OK),
+                       ESP_ERR_INVALID_STATE,
+                       TAG,
+                       "mbc_slave_set_descriptor fail, returns(0x%x).",
+                       (int)err);
+    
+    // Initialization of Holding Registers area (I/O image)
+    reg_area.type = MB_PARAM_HOLDING;
+    reg_area.start_offset = MB_REG_HOLDING_IO_START;
+    reg_area.address = (void*)&image->holding_io;
+    reg_area.size = sizeof(image->holding_io);
+    err = mbc_slave_set_descriptor(reg_area);
+    MB_RETURN_ON_FALSE((err == ESP_OK),
+                       ESP_ERR_INVALID_STATE,
+                       TAG,
+                       "mbc_slave_set_descriptor fail, returns(0x%x).",
+                       (int)err);
+    
+    // Initialization of Holding Registers area (output modes)
+    reg_area.type = MB_PARAM_HOLDING;
+    reg_area.start_offset = MB_REG_HOLDING_DQ_MODE_START;
+    reg_area.address = (void*)&image->dq_modes;
+    reg_area.size = sizeof(image->dq_modes);
+    err = mbc_slave_set_descriptor(reg_area);
+    MB_RETURN_ON_FALSE((err == ESP_OK),
+                       ESP_ERR_INVALID_STATE,
+                       TAG,
+                       "mbc_slave_set_descriptor fail, returns(0x%x).",
+                       (int)err);
+    
+    // Initialization of Holding Registers area (logic program)
+    reg_area.type = MB_PARAM_HOLDING;
+    reg_area.start_offset = MB_REG_HOLDING_LOGIC_START;
+    reg_area.address = (void*)&image->logic;
+    reg_area.size = sizeof(image->logic);
     err = mbc_slave_set_descriptor(reg_area);
     MB_RETURN_ON_FALSE((err == ESP_OK),
                        ESP_ERR_INVALID_STATE,
@@ -261,6 +837,15 @@ static esp_err_t mb_slave_init(void) {
                        "mbc_slave_start fail, returns(0x%x).",
                        (int)err);
     
+    // Accept masters on the public port, on behalf of the stack, answering the units of boards behind this gateway
+    esp32_rio_mb_set_unit_handler(MB_SLAVE_ADDR, on_unit_request);
+    err = esp32_rio_mb_frontend_start(MB_TCP_PORT_NUMBER, MB_TCP_STACK_PORT_NUMBER);
+    MB_RETURN_ON_FALSE((err == ESP_OK),
+                       ESP_ERR_INVALID_STATE,
+                       TAG,
+                       "esp32_rio_mb_frontend_start fail, returns(0x%x).",
+                       (int)err);
+    
     vTaskDelay(5);
     ESP_LOGI(TAG, "Modbus slave stack initialized.");
     return err;
@@ -281,54 +866,342 @@ static esp_err_t slave_destroy(void) {
 static void mb_slave_run(void *arg) {
     mb_param_info_t reg_info; //Keeps the Modbus registers access information
     
-    ESP_LOGI(TAG, "Modbus slave running.");
+    ESP_LOGI(TAG, "Modbus slave running on core %d.", xPortGetCoreID());
     while (1) {
-        // Check for read/write events of Modbus master for certain events
+        // Block until the Modbus master accesses any of the register areas
         (void)mbc_slave_check_event(MB_READ_WRITE_MASK);
-        ESP_ERROR_CHECK_WITHOUT_ABORT(mbc_slave_get_param_info(&reg_info, MB_PAR_INFO_GET_TOUT));
-        // Filter events and process them accordingly
-        if (reg_info.type & MB_EVENT_DISCRETE_RD) {
-            ESP_LOGI(TAG, "DISCRETE READ (%" PRIu32 " us), ADDR:%u, TYPE:%u, INST_ADDR:0x%" PRIx32 ", SIZE:%u",
-                     reg_info.time_stamp,
-                     (unsigned)reg_info.mb_offset,
-                     (unsigned)reg_info.type,
-                     (uint32_t)reg_info.address,
-                     (unsigned)reg_info.size);
-        } else if (reg_info.type & MB_EVENT_COILS_RD) {
-            ESP_LOGI(TAG, "COILS READ (%" PRIu32 " us), ADDR:%u, TYPE:%u, INST_ADDR:0x%" PRIx32 ", SIZE:%u",
-                     reg_info.time_stamp,
-                     (unsigned)reg_info.mb_offset,
-                     (unsigned)reg_info.type,
-                     (uint32_t)reg_info.address,
-                     (unsigned)reg_info.size);
-        } else if (reg_info.type & MB_EVENT_COILS_WR) {
-            ESP_LOGI(TAG, "COILS WRITE (%" PRIu32 " us), ADDR:%u, TYPE:%u, INST_ADDR:0x%" PRIx32 ", SIZE:%u",
-                     reg_info.time_stamp,
-                     (unsigned)reg_info.mb_offset,
-                     (unsigned)reg_info.type,
-                     (uint32_t)reg_info.address,
-                     (unsigned)reg_info.size);
+        esp32_rio_power_acquire(ESP32_RIO_POWER_PATH_MODBUS);
+        // Process every access queued so far, so bursts are handled in one wake-up
+        TickType_t info_timeout = MB_PAR_INFO_GET_TOUT;
+        while (mbc_slave_get_param_info(&reg_info, info_timeout) == ESP_OK) {
+            info_timeout = 0;
+            esp32_rio_diag_count(ESP32_RIO_DIAG_MB_REQUESTS);
+            if (reg_info.type & MB_READ_MASK) {
+                // Reads are served by the stack itself; only keep count of them
+                if (reg_info.type & MB_EVENT_DISCRETE_RD) {
+                    s_mb_discrete_reads++;
+                } else if (reg_info.type & MB_EVENT_COILS_RD) {
+                    s_mb_coil_reads++;
+                } else if (reg_info.type & MB_EVENT_INPUT_REG_RD) {
+                    s_mb_input_reads++;
+                    drain_soe_window(reg_info.mb_offset, reg_info.size);
+                } else {
+                    s_mb_holding_reads++;
+                }
+                continue;
+            }
             
-            bool oe_coil_on = MB_IS_COIL_ON(OE_COIL_ADDR);
-            if (outputs_enabled) {
-                if (!oe_coil_on) {
-                    // Outputs disabled by Modbus master
-                    esp32_rio_disable_outputs();
-                    outputs_enabled = false;
-                    esp32_rio_turn_status_led_off(); //Alert operator
-                    ESP_LOGI(TAG, "Digital outputs disabled.");
-                    continue;
+            ESP32_RIO_TRACE(ESP32_RIO_TRACE_MB_WRITE, (reg_info.type & MB_EVENT_COILS_WR) != 0,
+                            reg_info.time_stamp, reg_info.mb_offset, reg_info.size);
+            if (reg_info.type & MB_EVENT_COILS_WR) {
+                mb_reg_image_t *image = mb_reg_image_write_begin();
+                mirror_coil_banks(image, reg_info.mb_offset, reg_info.size);
+                mb_reg_image_write_end();
+                on_coils_write(reg_info.time_stamp);
+            } else if (reg_info.type & MB_EVENT_HOLDING_REG_WR) {
+                // Holding registers 0 and 1 stand for the coil banks
+                if (reg_info.mb_offset >= MB_REG_HOLDING_LOGIC_START) {
+                    on_logic_write(reg_info.mb_offset, reg_info.size);
+                } else if (reg_info.mb_offset >= MB_REG_HOLDING_DQ_MODE_START) {
+                    on_dq_modes_write(reg_info.mb_offset, reg_info.size);
+                } else if (reg_info.mb_offset <= MB_REG_HOLDING_IO_START + 1) {
+                    mb_reg_image_t *image = mb_reg_image_write_begin();
+                    image->coils.coils_bank0 = image->holding_io.coils_bank0;
+                    image->coils.coils_bank1 = image->holding_io.coils_bank1;
+                    mb_reg_image_write_end();
+                    on_coils_write(reg_info.time_stamp);
+                } else {
+                    refresh_io_image(); //Undo writes to read-only registers
                 }
-                // Update digital outputs based on corresponding coil values
-                update_digital_outputs();
-            } else if (oe_coil_on) {
-                // Outputs enabled by Modbus master. Update digital outputs based on corresponding coil values
-                update_digital_outputs();
-                outputs_enabled = true;
-                esp32_rio_turn_status_led_on(); //Alert operator
-                ESP_LOGI(TAG, "Digital outputs enabled.");
             }
         }
+        esp32_rio_power_release(ESP32_RIO_POWER_PATH_MODBUS);
+    }
+}
+
+
+/*
+ Apply the output mode blocks covered by a write and store them, on the Modbus slave task. Blocks with invalid
+ values read back as the mode left in place
+*/
+static void on_dq_modes_write(uint16_t write_offset, size_t write_size) {
+    holding_dq_mode_reg_params_t dq_modes;
+    mb_reg_image_read(&dq_modes, &mb_reg_image_get()->dq_modes, sizeof(dq_modes));
+    
+    size_t first_block = (write_offset - MB_REG_HOLDING_DQ_MODE_START) / MB_DQ_MODE_BLOCK_SIZE;
+    size_t end_block = (write_offset - MB_REG_HOLDING_DQ_MODE_START + write_size + MB_DQ_MODE_BLOCK_SIZE - 1) / MB_DQ_MODE_BLOCK_SIZE;
+    for (size_t block = first_block; block < end_block && block < 2 * ESP32_RIO_NUM_DQ_CHANNELS; block++) {
+        unsigned int bank = block / ESP32_RIO_NUM_DQ_CHANNELS;
+        unsigned int output = block % ESP32_RIO_NUM_DQ_CHANNELS;
+        if (esp32_rio_set_dq_mode(bank, output, &dq_modes.modes[bank][output]) != ESP_OK) {
+            ESP_LOGW(TAG, "Invalid mode written for DQ%u%u.", bank, output);
+        }
+        esp32_rio_get_dq_mode(bank, output, &dq_modes.modes[bank][output]);
+    }
+    mb_reg_image_t *image = mb_reg_image_write_begin();
+    image->dq_modes = dq_modes;
+    mb_reg_image_write_end();
+    
+    esp32_rio_io_nv_params_save(); //Written only if a mode changed
+    xTaskNotify(s_output_task_handle, OUTPUT_NOTIFY_COILS_WRITTEN, eSetBits); //Outputs take up their new modes
+}
+
+
+/*
+ Load the logic program staged in the block registers when a write covers the block count, on the Modbus slave
+ task. Other writes only stage blocks
+*/
+static void on_logic_write(uint16_t write_offset, size_t write_size) {
+    if (write_offset != MB_REG_HOLDING_LOGIC_START) {
+        // Undo writes to the load status, leaving the blocks staged so far in place
+        mb_reg_image_t *image = mb_reg_image_write_begin();
+        image->logic.load_status = s_logic_load_status;
+        mb_reg_image_write_end();
+        return;
+    }
+    holding_logic_reg_params_t logic;
+    mb_reg_image_read(&logic, &mb_reg_image_get()->logic, sizeof(logic));
+    
+    esp32_rio_logic_block_t blocks[ESP32_RIO_LOGIC_MAX_BLOCKS];
+    for (size_t i = 0; i < logic.block_count && i < ESP32_RIO_LOGIC_MAX_BLOCKS; i++) {
+        blocks[i] = (esp32_rio_logic_block_t){
+            .op = logic.blocks[i][0] >> 8,
+            .destination = logic.blocks[i][0] & 0xFF,
+            .source_a = logic.blocks[i][1] >> 8,
+            .source_b = logic.blocks[i][1] & 0xFF,
+            .time_ms = logic.blocks[i][2]
+        };
+    }
+    size_t invalid_block = ESP32_RIO_LOGIC_MAX_BLOCKS;
+    esp_err_t err = esp32_rio_logic_load(blocks, logic.block_count, &invalid_block); //Counts over the maximum not read
+    if (err == ESP_ERR_INVALID_ARG) {
+        ESP_LOGW(TAG, "Invalid logic program, block %u.", (unsigned int)invalid_block);
+    } else if (err == ESP_ERR_INVALID_STATE) {
+        fill_logic_image(0); //No logic engine, nothing running
+    } //Otherwise exposed by on_logic_program_change
+}
+
+
+/*
+ Expose the running logic program and the status of the last load. Loads run one at a time, and the program is
+ read under the image writer mutex, so the registers always end up showing the last load, whichever its origin
+*/
+static void fill_logic_image(uint16_t load_status) {
+    esp32_rio_logic_block_t blocks[ESP32_RIO_LOGIC_MAX_BLOCKS];
+    
+    mb_reg_image_t *image = mb_reg_image_write_begin();
+    s_logic_load_status = load_status;
+    size_t block_count = esp32_rio_logic_get_program(blocks, ESP32_RIO_LOGIC_MAX_BLOCKS); //Never takes the image mutex
+    image->logic.block_count = block_count;
+    image->logic.load_status = load_status;
+    for (size_t i = 0; i < block_count; i++) {
+        image->logic.blocks[i][0] = (uint16_t)(blocks[i].op << 8) | blocks[i].destination;
+        image->logic.blocks[i][1] = (uint16_t)(blocks[i].source_a << 8) | blocks[i].source_b;
+        image->logic.blocks[i][2] = blocks[i].time_ms;
+    }
+    mb_reg_image_write_end();
+}
+
+
+/*
+ Feed the logic scan with the discrete inputs and coils as Modbus sees them, on the logic task
+*/
+static void on_logic_inputs_read(esp32_rio_logic_inputs_t *inputs) {
+    const mb_reg_image_t *image = mb_reg_image_get();
+    discrete_reg_params_t discrete;
+    coil_reg_params_t coils;
+    mb_reg_image_read(&discrete, &image->discrete, sizeof(discrete));
+    mb_reg_image_read(&coils, &image->coils, sizeof(coils));
+    inputs->inputs = discrete.discrete_inputs;
+    inputs->coils[0] = coils.coils_bank0;
+    inputs->coils[1] = coils.coils_bank1;
+}
+
+
+/*
+ Hand outputs changed by the logic program over to the output task, on the logic task
+*/
+static void on_logic_outputs_change(void) {
+    if (s_output_task_handle != NULL) {
+        xTaskNotify(s_output_task_handle, OUTPUT_NOTIFY_LOGIC_CHANGED, eSetBits);
+    }
+}
+
+
+/*
+ Expose the outcome of a load from Modbus or from the console, on the loading task. A console load replaces the
+ blocks a master may have staged without loading them yet
+*/
+static void on_logic_program_change(esp_err_t err, size_t invalid_block) {
+    fill_logic_image(err == ESP_OK ? 0 : invalid_block + 1);
+}
+
+
+/*
+ Report the register areas a gateway serves this board's unit from, on the gateway task
+*/
+static void on_gateway_image_read(esp32_rio_gateway_image_t *gateway_image) {
+    const mb_reg_image_t *image = mb_reg_image_get();
+    coil_reg_params_t coils;
+    discrete_reg_params_t discrete;
+    input_counter_reg_params_t counters;
+    mb_reg_image_read(&coils, &image->coils, sizeof(coils));
+    mb_reg_image_read(&discrete, &image->discrete, sizeof(discrete));
+    mb_reg_image_read(&counters, &image->counters, sizeof(counters));
+    mb_reg_image_read(gateway_image->io_image, &image->input_io, sizeof(gateway_image->io_image));
+    
+    memcpy(gateway_image->coils, &coils, sizeof(coils));
+    gateway_image->discrete_inputs = discrete.discrete_inputs;
+    gateway_image->coil_count = sizeof(coils) * 8;
+    gateway_image->di_count = ESP32_RIO_NUM_DI_CHANNELS;
+    memcpy(gateway_image->counts, counters.counts, sizeof(counters.counts));
+    memcpy(gateway_image->rates_mhz, counters.rates, sizeof(counters.rates));
+}
+
+
+/*
+ Answer a request for a unit served as a gateway, on the front-end task, from the image its board last reported.
+ Reads of the coils, discrete inputs, counter and I/O image input registers and I/O image holding registers are
+ served as the board itself would. Other requests get an exception, and units not served go to the stack
+*/
+static size_t on_unit_request(uint8_t unit, const uint8_t *pdu, size_t pdu_length, uint8_t *response) {
+    esp32_rio_gateway_image_t peer;
+    esp_err_t err = esp32_rio_gateway_get_image(unit, &peer);
+    if (err == ESP_ERR_NOT_FOUND) {
+        return 0;
+    }
+    
+    uint8_t function = pdu[0];
+    uint8_t exception = MB_GW_EXCEPTION_ILLEGAL_FUNCTION;
+    size_t length = 0;
+    if (err != ESP_OK) {
+        exception = MB_GW_EXCEPTION_TARGET_NO_RESPONSE;
+    } else if (function >= 0x01 && function <= 0x04) {
+        uint16_t start = ((uint16_t)pdu[1] << 8) | pdu[2];
+        uint16_t quantity = ((uint16_t)pdu[3] << 8) | pdu[4];
+        size_t counter_count = (peer.di_count <= ESP32_RIO_GATEWAY_MAX_DI) ? peer.di_count : ESP32_RIO_GATEWAY_MAX_DI;
+        size_t coil_count = (peer.coil_count <= sizeof(peer.coils) * 8) ? peer.coil_count : sizeof(peer.coils) * 8;
+        uint16_t registers[4 * ESP32_RIO_GATEWAY_MAX_DI]; //Aligned copies of the packed image, also for bit reads
+        if (pdu_length != 5) {
+            exception = MB_GW_EXCEPTION_ILLEGAL_VALUE;
+        } else if (function == 0x01) {
+            memcpy(registers, peer.coils, sizeof(peer.coils));
+            length = gateway_read_bits(registers, coil_count, start, quantity, response);
+        } else if (function == 0x02) {
+            registers[0] = peer.discrete_inputs;
+            length = gateway_read_bits(registers, sizeof(discrete_reg_params_t) * 8, start, quantity, response);
+        } else if (function == 0x04 && start >= MB_REG_INPUT_IO_START) {
+            memcpy(registers, peer.io_image, sizeof(peer.io_image));
+            length = gateway_read_registers(registers, 4, start - MB_REG_INPUT_IO_START, quantity, response);
+        } else if (function == 0x04) {
+            // Counts then rates, 32-bit values with the low-order word first
+            for (size_t i = 0; i < counter_count; i++) {
+                registers[2 * i] = (uint16_t)peer.counts[i];
+                registers[2 * i + 1] = (uint16_t)(peer.counts[i] >> 16);
+                registers[2 * (counter_count + i)] = (uint16_t)peer.rates_mhz[i];
+                registers[2 * (counter_count + i) + 1] = (uint16_t)(peer.rates_mhz[i] >> 16);
+            }
+            length = gateway_read_registers(registers, 4 * counter_count, start - MB_REG_INPUT_COUNTERS_START, quantity, response);
+        } else {
+            // I/O image then counts, as in the holding registers of the board
+            memcpy(registers, peer.io_image, sizeof(peer.io_image));
+            for (size_t i = 0; i < counter_count; i++) {
+                registers[4 + 2 * i] = (uint16_t)peer.counts[i];
+                registers[4 + 2 * i + 1] = (uint16_t)(peer.counts[i] >> 16);
+            }
+            length = gateway_read_registers(registers, 4 + 2 * counter_count, start - MB_REG_HOLDING_IO_START, quantity, response);
+        }
+        if (length == 0 && exception != MB_GW_EXCEPTION_ILLEGAL_VALUE) {
+            bool quantity_valid = (function <= 0x02) ? (quantity >= 1 && quantity <= MB_GW_MAX_READ_BITS) :
+                                                        (quantity >= 1 && quantity <= MB_GW_MAX_READ_REGISTERS);
+            exception = quantity_valid ? MB_GW_EXCEPTION_ILLEGAL_ADDRESS : MB_GW_EXCEPTION_ILLEGAL_VALUE;
+        }
+    }
+    
+    if (length == 0) {
+        response[0] = function | 0x80;
+        response[1] = exception;
+        return 2;
+    }
+    response[0] = function;
+    return length;
+}
+
+
+/*
+ Build the response PDU of a bit read over an area of bit_count bits, packed into 16-bit words. Returns its length,
+ 0 if the read is out of the area or too long
+*/
+static size_t gateway_read_bits(const uint16_t *words, size_t bit_count, uint16_t start, uint16_t quantity, uint8_t *response) {
+    if (quantity < 1 || quantity > MB_GW_MAX_READ_BITS || (size_t)start + quantity > bit_count) {
+        return 0;
+    }
+    size_t byte_count = (quantity + 7) / 8;
+    response[1] = (uint8_t)byte_count;
+    memset(&response[2], 0, byte_count);
+    for (uint16_t i = 0; i < quantity; i++) {
+        size_t bit = (size_t)start + i;
+        if ((words[bit / 16] >> (bit % 16)) & 1U) {
+            response[2 + i / 8] |= 1U << (i % 8);
+        }
+    }
+    return 2 + byte_count;
+}
+
+
+/*
+ Build the response PDU of a register read over an area of register_count registers. Returns its length, 0 if
+ the read is out of the area or too long
+*/
+static size_t gateway_read_registers(const uint16_t *registers, size_t register_count, uint16_t start, uint16_t quantity,
+                                     uint8_t *response) {
+    if (quantity < 1 || quantity > MB_GW_MAX_READ_REGISTERS || (size_t)start + quantity > register_count) {
+        return 0;
+    }
+    response[1] = (uint8_t)(2 * quantity);
+    for (uint16_t i = 0; i < quantity; i++) {
+        response[2 + 2 * i] = (uint8_t)(registers[start + i] >> 8);
+        response[3 + 2 * i] = (uint8_t)registers[start + i];
+    }
+    return 2 + 2 * quantity;
+}
+
+
+/*
+ Hand a coil image write over to the output task, on the Modbus slave task
+*/
+static void on_coils_write(uint32_t time_stamp) {
+    esp32_rio_diag_count(ESP32_RIO_DIAG_MB_COIL_WRITES);
+    unsigned int none = 0;
+    atomic_compare_exchange_strong(&s_coil_write_pending_since, &none, time_stamp | 1U); //Latency measured from the oldest write
+    esp32_rio_feed_output_watchdog();
+    xTaskNotify(s_output_task_handle, OUTPUT_NOTIFY_COILS_WRITTEN, eSetBits);
+}
+
+
+/*
+ Apply coil image changes to the outputs, woken by the Modbus slave task on coil writes, by the I/O task
+ on output watchdog expiry and by the logic task on logic output changes
+*/
+static void output_task(void *arg) {
+    uint32_t events;
+    while (1) {
+        // Writes arriving while outputs are being updated are coalesced into a single pass
+        if (xTaskNotifyWait(0, ULONG_MAX, &events, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        if (events & OUTPUT_NOTIFY_WATCHDOG_EXPIRED) {
+            on_outputs_safe_state();
+        }
+        if (events & OUTPUT_NOTIFY_COILS_WRITTEN) {
+            uint32_t write_since = atomic_exchange(&s_coil_write_pending_since, 0);
+            on_coils_written();
+            if (outputs_enabled && write_since != 0) {
+                esp32_rio_diag_record_latency(ESP32_RIO_DIAG_COIL_TO_OUTPUT, ((uint32_t)esp_timer_get_time() | 1U) - write_since);
+            }
+        } else if ((events & OUTPUT_NOTIFY_LOGIC_CHANGED) && outputs_enabled) {
+            update_digital_outputs(); //Still subject to Output Enable and the watchdog
+        }
     }
 }
 
@@ -337,25 +1210,47 @@ void app_main(void) {
     esp32_rio_configure_gpio();
     esp_log_level_set(TAG, ESP_LOG_INFO);
     ESP_ERROR_CHECK(init_services());
+    register_console_commands();
     ESP_ERROR_CHECK(esp32_rio_start_usb_console());
     
-    bool wifi_connected = esp32_rio_connect();
-    if (wifi_connected) {
-        ESP_LOGI(TAG, "Initializing Modbus slave...");
-        esp_err_t err = mb_slave_init();
-        if (err == ESP_OK) {
-            mb_slave_run(NULL);
-            
-            ESP_ERROR_CHECK(slave_destroy()); //Safeguard. Should not be reached
-        } else {
-            ESP_LOGE(TAG, "Failed to initialize Modbus slave.");
+    // Connection proceeds in the background, Modbus and I/O services stay up across link losses
+    if (!esp32_rio_connect() && !esp32_rio_eth_available()) {
+        ESP_LOGE(TAG, "No WiFi network to connect to. Configure one from the USB console.");
+        esp32_rio_start_morse_blinker(); //Alert user
+    }
+    ESP_LOGI(TAG, "Initializing Modbus slave...");
+    esp_err_t err = mb_slave_init();
+    if (err == ESP_OK) {
+        if (esp32_rio_rbe_start() != ESP_OK) {
+            ESP_LOGW(TAG, "DI change publisher not available."); //Polling still works
+        }
+        if (esp32_rio_gateway_start(MB_SLAVE_ADDR, on_gateway_image_read) != ESP_OK) {
+            ESP_LOGW(TAG, "Gateway not available."); //This board's own unit still works
+        }
+        if (xTaskCreatePinnedToCore(output_task, "output_task", OUTPUT_TASK_STACK_SIZE, NULL,
+                                    OUTPUT_TASK_PRIORITY, &s_output_task_handle, MB_SLAVE_TASK_CORE) == pdPASS &&
+            xTaskCreatePinnedToCore(mb_slave_run, "mb_slave_task", MB_SLAVE_TASK_STACK_SIZE, NULL,
+                                    MB_SLAVE_TASK_PRIORITY, NULL, MB_SLAVE_TASK_CORE) == pdPASS) {
+            if (s_coils_restored) {
+                // Apply the retained coils as a coil write, re-enabling outputs if the Output Enable coil is on
+                xTaskNotify(s_output_task_handle, OUTPUT_NOTIFY_COILS_WRITTEN, eSetBits);
+            }
+            if (esp32_rio_logic_start(on_logic_inputs_read, on_logic_outputs_change, on_logic_program_change) != ESP_OK) {
+                ESP_LOGW(TAG, "Logic engine not available."); //Outputs still follow their coils
+            }
+            fill_logic_image(0);
+            return; //Modbus service runs on its own task from here on
+        }
+        ESP_LOGE(TAG, "Failed to create Modbus service tasks.");
+        if (s_output_task_handle != NULL) {
+            vTaskDelete(s_output_task_handle);
         }
-        ESP_ERROR_CHECK(esp32_rio_disconnect());
-        ESP_ERROR_CHECK(destroy_services());
+        ESP_ERROR_CHECK(slave_destroy());
     } else {
-        ESP_LOGE(TAG, "Failed to establish WiFi connection.");
-        ESP_ERROR_CHECK(destroy_services());
-        // Only USB serial console and morse blinker shall remain from here on
-        esp32_rio_start_morse_blinker();
+        ESP_LOGE(TAG, "Failed to initialize Modbus slave.");
     }
+    ESP_ERROR_CHECK(esp32_rio_disconnect());
+    ESP_ERROR_CHECK(destroy_services());
+    // Only USB serial console and morse blinker shall remain from here on
+    esp32_rio_start_morse_blinker();
 }
@@ -0,0 +1,346 @@
+/*
+@file io_bench.c
+@brief Implementation of the on-target benchmark of the I/O hot paths.
+
+This file times, with the CPU cycle counter, the output writes, the coil image reads
+and the output updates of the coil write path, then measures the DI interrupt and
+io_task latencies through an output wired back to an input. Every figure is reported
+as minimum, mean, 99th percentile and maximum over the iterations run.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+
+#include "remote_io.h"
+#include "logic_engine.h"
+#include "usb_console.h"
+#include "io_bench.h"
+#include "mb_reg_image.h"
+#include "modbus_params.h"
+
+#define BENCH_DEFAULT_ITERATIONS 500
+#define BENCH_MIN_ITERATIONS 10
+#define BENCH_MAX_ITERATIONS 1000
+#define BENCH_LOOPBACK_TIMEOUT_US 10000 //For the input to follow its output, per iteration
+#define BENCH_OUTPUT_LENGTH 160
+
+typedef enum {
+    BENCH_PATH_TURN_OUTPUT = 0, //esp32_rio_turn_output_on/off
+    BENCH_PATH_APPLY_CHANGE, //esp32_rio_apply_outputs switching the output
+    BENCH_PATH_APPLY_NOOP, //esp32_rio_apply_outputs left with nothing to switch
+    BENCH_PATH_COIL_SNAPSHOT, //Coil image and logic outputs read, as for every output update
+    BENCH_PATH_COIL_TEST, //mb_reg_image_is_coil_on
+    BENCH_NUM_PATHS
+} bench_path_t;
+
+typedef enum {
+    BENCH_LOOP_OUTPUT_TO_EDGE = 0, //Output written to edge interrupt
+    BENCH_LOOP_EDGE_TO_TASK, //Edge interrupt to io_task woken
+    BENCH_LOOP_OUTPUT_TO_REGISTER, //Output written to discrete input register updated
+    BENCH_NUM_LOOP_LATENCIES
+} bench_loop_latency_t;
+
+typedef struct {
+    uint32_t min;
+    uint32_t mean;
+    uint32_t p99;
+    uint32_t max;
+} bench_stats_t;
+
+static void cmd_bench(int, char **);
+static bool parse_bench_arg(const char *, uint32_t, uint32_t *);
+static uint32_t bench_time_path(bench_path_t, unsigned int, unsigned int, size_t);
+static size_t bench_loopback(unsigned int, unsigned int, unsigned int, size_t, uint32_t **, size_t *);
+static bool bench_di_register_on(unsigned int);
+static void bench_stats(uint32_t *, size_t, bench_stats_t *);
+static int bench_compare(const void *, const void *);
+static uint32_t bench_cycles_to_ns(uint32_t, uint32_t);
+
+static io_bench_claim_outputs_cb_t s_claim_outputs_callback = NULL;
+static io_bench_release_outputs_cb_t s_release_outputs_callback = NULL;
+
+static const char *s_path_names[BENCH_NUM_PATHS] = { //Indexed by bench_path_t
+    "turn output on/off",
+    "apply outputs, switching",
+    "apply outputs, unchanged",
+    "coil image snapshot",
+    "coil test"
+};
+
+static const char *s_loop_names[BENCH_NUM_LOOP_LATENCIES] = { //Indexed by bench_loop_latency_t
+    "output to DI interrupt",
+    "DI interrupt to io_task",
+    "output to discrete input"
+};
+
+static const esp32_rio_console_cmd_t s_bench_cmd = {
+    "bench", "OUTPUT INPUT [ITERATIONS]",
+    "Time the I/O paths on an output wired to an input, with outputs disabled.", cmd_bench
+};
+
+
+/*
+ Add the bench command to the console, which drives the outputs only while holding the output path through the
+ callbacks given. Must run before the console starts
+*/
+esp_err_t io_bench_register(io_bench_claim_outputs_cb_t claim_outputs_cb, io_bench_release_outputs_cb_t release_outputs_cb) {
+    s_claim_outputs_callback = claim_outputs_cb;
+    s_release_outputs_callback = release_outputs_cb;
+    return esp32_rio_console_register_command(&s_bench_cmd);
+}
+
+
+/*
+ Run the benchmark on output OUTPUT (bank 0 first) wired to input INPUT, which must be unfiltered and in normal
+ mode. Outputs must be disabled, all of them in normal mode and no logic program loaded, as the benchmark drives
+ OUTPUT on its own: it holds the output path throughout, outputs cannot be enabled until it is done. Runs at full
+ CPU speed, the console holding its power management lock
+*/
+static void cmd_bench(int arg_count, char **args) {
+    char output_buf[BENCH_OUTPUT_LENGTH];
+    uint32_t dq, di, iterations = BENCH_DEFAULT_ITERATIONS;
+    if (arg_count < 2 || arg_count > 3 ||
+        !parse_bench_arg(args[0], 2 * ESP32_RIO_NUM_DQ_CHANNELS - 1, &dq) ||
+        !parse_bench_arg(args[1], ESP32_RIO_NUM_DI_CHANNELS - 1, &di) ||
+        (arg_count == 3 && (!parse_bench_arg(args[2], BENCH_MAX_ITERATIONS, &iterations) || iterations < BENCH_MIN_ITERATIONS))) {
+        snprintf(output_buf, sizeof(output_buf), "\n[bench] Error: Takes an output (0-%d), an input (0-%d) and optionally %d-%d iterations.\n",
+                 2 * ESP32_RIO_NUM_DQ_CHANNELS - 1, ESP32_RIO_NUM_DI_CHANNELS - 1, BENCH_MIN_ITERATIONS, BENCH_MAX_ITERATIONS);
+        esp32_rio_console_write_str(output_buf);
+        return;
+    }
+    unsigned int bank_number = dq / ESP32_RIO_NUM_DQ_CHANNELS;
+    unsigned int output_number = dq % ESP32_RIO_NUM_DQ_CHANNELS;
+    esp32_rio_dq_mode_config_t dq_mode;
+    esp32_rio_get_dq_mode(bank_number, output_number, &dq_mode);
+    if (dq_mode.mode != ESP32_RIO_DQ_MODE_NORMAL || esp32_rio_get_di_mode(di) != ESP32_RIO_DI_MODE_NORMAL ||
+        esp32_rio_get_di_filter(di) != 0) {
+        esp32_rio_console_write_str("\n[bench] Error: Output must be in normal mode, input in normal mode and unfiltered.\n");
+        return;
+    }
+    // Nothing else may switch outputs once they are disabled: no timed modes or PWM, no logic program
+    for (unsigned int bank = 0; bank < 2; bank++) {
+        for (unsigned int i = 0; i < ESP32_RIO_NUM_DQ_CHANNELS; i++) {
+            esp32_rio_get_dq_mode(bank, i, &dq_mode);
+            if (dq_mode.mode != ESP32_RIO_DQ_MODE_NORMAL) {
+                esp32_rio_console_write_str("\n[bench] Error: All outputs must be in normal mode.\n");
+                return;
+            }
+        }
+    }
+    esp32_rio_logic_block_t block;
+    if (esp32_rio_logic_get_program(&block, 1) != 0) {
+        esp32_rio_console_write_str("\n[bench] Error: Stop the logic program first.\n");
+        return;
+    }
+    uint32_t *samples = malloc(BENCH_NUM_LOOP_LATENCIES * iterations * sizeof(uint32_t));
+    if (samples == NULL) {
+        esp32_rio_console_write_str("\n[bench] Error: Out of memory.\n");
+        return;
+    }
+    if (s_claim_outputs_callback == NULL || !s_claim_outputs_callback()) {
+        esp32_rio_console_write_str("\n[bench] Error: Disable outputs first, or enable and disable them again out of their safe states.\n");
+        free(samples);
+        return;
+    }
+    
+    // Hot paths, in CPU cycles less the cost of reading the counter, after a first untimed call
+    uint32_t mhz = esp_rom_get_cpu_ticks_per_us();
+    uint32_t overhead = UINT32_MAX;
+    for (size_t i = 0; i < iterations; i++) {
+        esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+        uint32_t cycles = (uint32_t)(esp_cpu_get_cycle_count() - start);
+        overhead = cycles < overhead ? cycles : overhead;
+    }
+    snprintf(output_buf, sizeof(output_buf), "\n[bench] CPU at %" PRIu32 " MHz, %" PRIu32 " iterations. Times in ns (cycles):\n", mhz, iterations);
+    esp32_rio_console_write_str(output_buf);
+    esp32_rio_disable_outputs(); //Every path starts from all outputs off
+    for (int path = 0; path < BENCH_NUM_PATHS; path++) {
+        bench_time_path((bench_path_t)path, bank_number, output_number, 1);
+        for (size_t i = 0; i < iterations; i++) {
+            uint32_t cycles = bench_time_path((bench_path_t)path, bank_number, output_number, i);
+            samples[i] = cycles > overhead ? cycles - overhead : 0;
+        }
+        bench_stats_t stats;
+        bench_stats(samples, iterations, &stats);
+        snprintf(output_buf, sizeof(output_buf), "  %-26s min %5" PRIu32 " (%5" PRIu32 "), mean %5" PRIu32 ", p99 %5" PRIu32 ", max %6" PRIu32 "\n",
+                 s_path_names[path], bench_cycles_to_ns(stats.min, mhz), stats.min, bench_cycles_to_ns(stats.mean, mhz),
+                 bench_cycles_to_ns(stats.p99, mhz), bench_cycles_to_ns(stats.max, mhz));
+        esp32_rio_console_write_str(output_buf);
+    }
+    esp32_rio_disable_outputs();
+    
+    // Loopback, in microseconds
+    uint32_t *loop_samples[BENCH_NUM_LOOP_LATENCIES];
+    for (int i = 0; i < BENCH_NUM_LOOP_LATENCIES; i++) {
+        loop_samples[i] = &samples[i * iterations];
+    }
+    size_t timeouts;
+    size_t count = bench_loopback(bank_number, output_number, di, iterations, loop_samples, &timeouts);
+    esp32_rio_disable_outputs(); //Left off, as the output path is handed back
+    if (s_release_outputs_callback) {
+        s_release_outputs_callback();
+    }
+    if (count == 0) {
+        snprintf(output_buf, sizeof(output_buf), "[bench] Loopback: DI%" PRIu32 " did not follow the output. Check the wiring.\n", di);
+        esp32_rio_console_write_str(output_buf);
+    } else {
+        snprintf(output_buf, sizeof(output_buf), "  Loopback to DI%" PRIu32 ", %u edges (%u timed out). Times in us:\n", di,
+                 (unsigned int)count, (unsigned int)timeouts);
+        esp32_rio_console_write_str(output_buf);
+        for (int i = 0; i < BENCH_NUM_LOOP_LATENCIES; i++) {
+            bench_stats_t stats;
+            bench_stats(loop_samples[i], count, &stats);
+            snprintf(output_buf, sizeof(output_buf), "  %-26s min %5" PRIu32 ", mean %5" PRIu32 ", p99 %5" PRIu32 ", max %6" PRIu32 "\n",
+                     s_loop_names[i], stats.min, stats.mean, stats.p99, stats.max);
+            esp32_rio_console_write_str(output_buf);
+        }
+    }
+    free(samples);
+}
+
+
+static bool parse_bench_arg(const char *arg, uint32_t max_value, uint32_t *value) {
+    char *end;
+    if (!isdigit((int)arg[0])) {
+        return false;
+    }
+    unsigned long parsed = strtoul(arg, &end, 10);
+    if (*end != '\0' || parsed > max_value) {
+        return false;
+    }
+    *value = (uint32_t)parsed;
+    return true;
+}
+
+
+/*
+ Run one iteration of a path, returning the cycles it took. Paths alternate the output on and off where they
+ drive it
+*/
+static uint32_t bench_time_path(bench_path_t path, unsigned int bank_number, unsigned int output_number, size_t iteration) {
+    uint16_t patterns[2] = { 0, 0 };
+    if (path == BENCH_PATH_APPLY_CHANGE && (iteration & 1U) == 0) {
+        patterns[bank_number] = 1U << output_number;
+    }
+    bool on = (iteration & 1U) == 0;
+    coil_reg_params_t coils;
+    uint32_t logic_mask, logic_levels;
+    esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+    switch (path) {
+        case BENCH_PATH_TURN_OUTPUT:
+            if (on) {
+                esp32_rio_turn_output_on(bank_number, output_number);
+            } else {
+                esp32_rio_turn_output_off(bank_number, output_number);
+            }
+            break;
+        case BENCH_PATH_APPLY_CHANGE:
+        case BENCH_PATH_APPLY_NOOP:
+            esp32_rio_apply_outputs(patterns[0], patterns[1]);
+            break;
+        case BENCH_PATH_COIL_SNAPSHOT:
+            mb_reg_image_read(&coils, &mb_reg_image_get()->coils, sizeof(coils));
+            esp32_rio_logic_get_outputs(&logic_mask, &logic_levels);
+            break;
+        case BENCH_PATH_COIL_TEST:
+            mb_reg_image_is_coil_on(OE_COIL_ADDR);
+            break;
+        default:
+            break;
+    }
+    return (uint32_t)(esp_cpu_get_cycle_count() - start);
+}
+
+
+/*
+ Toggle the output through the output update path, waiting each time for the input to follow, and record the
+ latencies of every edge seen. Returns the number of edges recorded
+*/
+static size_t bench_loopback(unsigned int bank_number, unsigned int output_number, unsigned int input_number, size_t iterations,
+                             uint32_t **samples, size_t *timeouts) {
+    uint16_t patterns[2] = { 0, 0 };
+    size_t count = 0;
+    *timeouts = 0;
+    esp32_rio_apply_outputs(0, 0);
+    vTaskDelay(2);
+    if (bench_di_register_on(input_number)) {
+        return 0; //Input not following its output
+    }
+    for (size_t i = 0; i < iterations; i++) {
+        bool level = (i & 1U) == 0;
+        patterns[bank_number] = level ? (1U << output_number) : 0;
+        vTaskDelay(1); //Input settled, and lower priority tasks of this core get to run
+        uint32_t start_us = (uint32_t)esp_timer_get_time();
+        esp32_rio_apply_outputs(patterns[0], patterns[1]);
+        bool followed;
+        uint32_t elapsed_us;
+        do {
+            followed = bench_di_register_on(input_number) == level;
+            elapsed_us = (uint32_t)esp_timer_get_time() - start_us;
+        } while (!followed && elapsed_us < BENCH_LOOPBACK_TIMEOUT_US);
+        uint32_t edge_us, update_us;
+        esp32_rio_get_di_edge_times(input_number, &edge_us, &update_us);
+        if (!followed || edge_us - start_us > elapsed_us || update_us - edge_us > elapsed_us) {
+            (*timeouts)++; //Also an edge missed or coalesced with another
+            continue;
+        }
+        samples[BENCH_LOOP_OUTPUT_TO_EDGE][count] = edge_us - start_us;
+        samples[BENCH_LOOP_EDGE_TO_TASK][count] = update_us - edge_us;
+        samples[BENCH_LOOP_OUTPUT_TO_REGISTER][count] = elapsed_us;
+        count++;
+    }
+    return count;
+}
+
+
+/*
+ Level of an input as Modbus reads it
+*/
+static bool bench_di_register_on(unsigned int input_number) {
+    discrete_reg_params_t discrete;
+    mb_reg_image_read(&discrete, &mb_reg_image_get()->discrete, sizeof(discrete));
+    return (discrete.discrete_inputs >> input_number) & 1U;
+}
+
+
+/*
+ Summarize samples, sorting them in place
+*/
+static void bench_stats(uint32_t *samples, size_t count, bench_stats_t *stats) {
+    qsort(samples, count, sizeof(uint32_t), bench_compare);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += samples[i];
+    }
+    stats->min = samples[0];
+    stats->mean = (uint32_t)(sum / count);
+    stats->p99 = samples[(count * 99 + 99) / 100 - 1]; //Nearest rank
+    stats->max = samples[count - 1];
+}
+
+
+static int bench_compare(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+
+static uint32_t bench_cycles_to_ns(uint32_t cycles, uint32_t mhz) {
+    return (uint32_t)((uint64_t)cycles * 1000 / mhz);
+}
@@ -0,0 +1,28 @@
+/*
+@file io_bench.h
+@brief On-target benchmark of the I/O hot paths.
+
+This file declares the registration of the `bench` console command, which times the
+output, coil image and DI paths on the board itself, for a baseline to compare
+firmware releases against.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#ifndef IO_BENCH_H
+#define IO_BENCH_H
+
+#include <stdbool.h>
+#include "esp_err.h"
+
+typedef bool (*io_bench_claim_outputs_cb_t)(void); //Takes the output path for the benchmark, false while outputs are in use
+typedef void (*io_bench_release_outputs_cb_t)(void); //Hands the output path back, outputs disabled
+
+esp_err_t io_bench_register(io_bench_claim_outputs_cb_t, io_bench_release_outputs_cb_t);
+
+#endif //IO_BENCH_H
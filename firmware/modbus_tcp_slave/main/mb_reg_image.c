@@ -0,0 +1,93 @@
+/*
+@file mb_reg_image.c
+@brief Implementation of the Modbus register image.
+
+This file implements the register image shared by the application and the Modbus stack.
+Application writers are serialized by a mutex and bracket their updates with a sequence
+counter, so readers can take consistent snapshots without locking. Every value is stored
+as a whole aligned word, which the stack (reading the image directly) never sees torn.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "mb_reg_image.h"
+
+#define MB_REG_IMAGE_READ_ATTEMPTS 4 //Lock-free read attempts before waiting for the writer
+
+static mb_reg_image_t s_image = { 0 };
+
+static StaticSemaphore_t s_writer_mutex_buffer;
+static SemaphoreHandle_t s_writer_mutex = NULL;
+static atomic_uint s_sequence = 0; //Odd while an update is in progress
+
+
+void mb_reg_image_init(void) {
+    s_writer_mutex = xSemaphoreCreateMutexStatic(&s_writer_mutex_buffer);
+}
+
+
+/*
+ Register image areas, for registration with the Modbus stack
+*/
+mb_reg_image_t *mb_reg_image_get(void) {
+    return &s_image;
+}
+
+
+/*
+ Start an update of the register image, returning it for writing. Must be paired with mb_reg_image_write_end
+*/
+mb_reg_image_t *mb_reg_image_write_begin(void) {
+    xSemaphoreTake(s_writer_mutex, portMAX_DELAY);
+    atomic_store_explicit(&s_sequence, atomic_load_explicit(&s_sequence, memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release); //Sequence marked odd before any data is stored
+    return &s_image;
+}
+
+
+void mb_reg_image_write_end(void) {
+    atomic_store_explicit(&s_sequence, atomic_load_explicit(&s_sequence, memory_order_relaxed) + 1, memory_order_release);
+    xSemaphoreGive(s_writer_mutex);
+}
+
+
+/*
+ Copy a consistent snapshot of part of the register image
+*/
+void mb_reg_image_read(void *dest, const void *src, size_t size) {
+    for (int attempt = 0; attempt < MB_REG_IMAGE_READ_ATTEMPTS; attempt++) {
+        unsigned sequence = atomic_load_explicit(&s_sequence, memory_order_acquire);
+        if ((sequence & 1) == 0) {
+            memcpy(dest, src, size);
+            atomic_thread_fence(memory_order_acquire); //Data loaded before the sequence is checked again
+            if (atomic_load_explicit(&s_sequence, memory_order_relaxed) == sequence) {
+                return;
+            }
+        }
+    }
+    // The writer keeps getting in the way, possibly preempted by this very task. Wait for it instead
+    xSemaphoreTake(s_writer_mutex, portMAX_DELAY);
+    memcpy(dest, src, size);
+    xSemaphoreGive(s_writer_mutex);
+}
+
+
+bool mb_reg_image_is_coil_on(uint16_t address) {
+    coil_reg_params_t coils;
+    mb_reg_image_read(&coils, &s_image.coils, sizeof(coils));
+    const uint16_t *words = (const uint16_t *)&coils; //Coil words in address order, 16 coils each
+    if (address < sizeof(coils) * 8) {
+        return (words[address / 16] & (1U << (address % 16))) != 0;
+    }
+    return false;
+}
@@ -0,0 +1,44 @@
+/*
+@file mb_reg_image.h
+@brief Modbus register image shared by the application and the Modbus stack.
+
+This file declares the register image holding every Modbus register area of the slave,
+and the seqlock-based access functions giving consistent multi-word reads without
+masking interrupts.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#ifndef MB_REG_IMAGE_H
+#define MB_REG_IMAGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "modbus_params.h"
+
+typedef struct {
+    coil_reg_params_t coils;
+    discrete_reg_params_t discrete;
+    input_counter_reg_params_t counters;
+    input_soe_reg_params_t soe;
+    input_io_reg_params_t input_io;
+    holding_io_reg_params_t holding_io;
+    holding_dq_mode_reg_params_t dq_modes;
+    holding_logic_reg_params_t logic;
+    input_diag_reg_params_t diag;
+} mb_reg_image_t;
+
+void mb_reg_image_init(void);
+mb_reg_image_t *mb_reg_image_get(void);
+mb_reg_image_t *mb_reg_image_write_begin(void);
+void mb_reg_image_write_end(void);
+void mb_reg_image_read(void *, const void *, size_t);
+bool mb_reg_image_is_coil_on(uint16_t);
+
+#endif //MB_REG_IMAGE_H
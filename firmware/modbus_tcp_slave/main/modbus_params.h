@@ -2,8 +2,7 @@
 @file modbus_params.h
 @brief Modbus parameter definitions and register mapping for the Modbus TCP Slave.
 
-This file defines Modbus register addresses, data structures for coils and discrete inputs,
-and utility macros for accessing and manipulating Modbus parameters with critical section protection.
+This file defines Modbus register addresses and data structures for coils, discrete inputs, input and holding registers.
 
 @copyright 2025 Douglas Almeida
 
@@ -16,52 +15,53 @@ SPDX-License-Identifier: MIT
 #ifndef MODBUS_PARAMS_H
 #define MODBUS_PARAMS_H
 
+#include <stdint.h>
+#include "remote_io.h"
+#include "logic_engine.h"
+
 #define MB_REG_DISCRETE_INPUT_START 0x0000
 #define MB_REG_COILS_START          0x0000
+#define MB_REG_INPUT_COUNTERS_START 0x0000
+#define MB_REG_INPUT_SOE_START      0x0100
+#define MB_REG_INPUT_IO_START       0x0200
+#define MB_REG_INPUT_DIAG_START     0x0300
+#define MB_REG_HOLDING_IO_START     0x0000
+#define MB_REG_HOLDING_DQ_MODE_START 0x0100
+#define MB_REG_HOLDING_LOGIC_START  0x0200
+
+#define MB_SOE_HEADER_SIZE      4   //Registers
+#define MB_SOE_RECORD_SIZE      4   //Registers
+#define MB_SOE_WINDOW_RECORDS   30  //Header plus records fit in a single Read Input Registers request (125 registers)
+
+#define MB_DQ_MODE_BLOCK_SIZE   4   //Registers per output
+#define MB_LOGIC_HEADER_SIZE    4   //Registers
+#define MB_LOGIC_BLOCK_SIZE     3   //Registers per block
+
+#define MB_DIAG_HISTOGRAM_BUCKETS 16
 
-#define OE_COIL_ADDR 31 //Coil for enabling/disabling outputs
-
-#define MB_IS_COIL_ON(address) \
-    ({ \
-        uint16_t addr = (address); \
-        bool result = false; \
-        portENTER_CRITICAL(&param_lock); \
-        if (addr < 16) { \
-            result = (coil_reg_params.coils_bank0 & (1U << addr)) != 0; \
-        } else if (addr >= 16 && addr < 32) { \
-            result = (coil_reg_params.coils_bank1 & (1U << (addr - 16))) != 0; \
-        } \
-        portEXIT_CRITICAL(&param_lock); \
-        result; /* Return the result of the expression */ \
-    })
-
-#define MB_TURN_COIL_ON(address) \
-    do { \
-        uint16_t addr = (address); \
-        portENTER_CRITICAL(&param_lock); \
-        if (addr < 16) { \
-            coil_reg_params.coils_bank0 |= (1U << addr); \
-        } else if (addr >= 16 && addr < 32) { \
-            coil_reg_params.coils_bank1 |= (1U << (addr - 16)); \
-        } \
-        portEXIT_CRITICAL(&param_lock); \
-    } while(0)
-
-#define MB_TURN_COIL_OFF(address) \
-    do { \
-        uint16_t addr = (address); \
-        portENTER_CRITICAL(&param_lock); \
-        if (addr < 16) { \
-            coil_reg_params.coils_bank0 &= ~(1ULL << addr); \
-        } else if (addr >= 16 && addr < 32) { \
-            coil_reg_params.coils_bank1 &= ~(1ULL << (addr - 16)); \
-        } \
-        portEXIT_CRITICAL(&param_lock); \
-    } while(0)
+// Coil for enabling/disabling outputs: the top coil of bank 1, or the first coil past both banks when they are full
+#if ESP32_RIO_NUM_DQ_CHANNELS < 16
+#define OE_COIL_ADDR 31
+#define MB_OE_COIL_WORD coils_bank1
+#else
+#define OE_COIL_ADDR 32
+#define MB_OE_COIL_WORD coils_control
+#endif
+#define MB_OE_COIL_BIT (1U << (OE_COIL_ADDR % 16)) //Bit of OE_COIL_ADDR in the MB_OE_COIL_WORD word of the coils
+
+// Status word bits
+#define MB_STATUS_OUTPUTS_ENABLED    (1U << 0)
+#define MB_STATUS_DI_EVENTS_PENDING  (1U << 1) //DI event records waiting to be read
+#define MB_STATUS_DI_EVENTS_LOST     (1U << 2) //DI event records were lost since boot
+#define MB_STATUS_OUTPUTS_SAFE_STATE (1U << 3) //Outputs held in their safe states by the watchdog
 
 /*
  Modbus parameters declaring modbus address space for each modbus register type (coils, discrete inputs, holding registers, input registers)
  
+ The address tables show the ESP32 RIO board. Other boards get as many channels as their pin map defines
+ (ESP32_RIO_NUM_DI_CHANNELS inputs, ESP32_RIO_NUM_DQ_CHANNELS outputs per bank) at the same addresses. With
+ 16 outputs per bank, Output Enable moves to coil 32 and the packed I/O image carries outputs only.
+ 
  Coils bank 0:
  Address    Assignment
  0          DQ00
@@ -123,10 +123,209 @@ SPDX-License-Identifier: MIT
 typedef struct {
     uint16_t coils_bank0;
     uint16_t coils_bank1;
+#if ESP32_RIO_NUM_DQ_CHANNELS == 16
+    uint16_t coils_control; //Bit 0: Output Enable (coil 32)
+#endif
 } coil_reg_params_t;
 
 typedef struct {
     uint16_t discrete_inputs;
 } discrete_reg_params_t;
 
+/*
+ Input registers (counters):
+ Address    Assignment
+ 0-1        DI0 pulse count
+ 2-3        DI1 pulse count
+ ...
+ 18-19      DI9 pulse count
+ 20-21      DI0 pulse rate (mHz)
+ 22-23      DI1 pulse rate (mHz)
+ ...
+ 38-39      DI9 pulse rate (mHz)
+ 
+ Each value is an unsigned 32-bit integer, low-order word at the lower address. Only inputs in counter mode
+ count; the others read as zero.
+*/
+
+typedef struct {
+    uint32_t counts[ESP32_RIO_NUM_DI_CHANNELS];
+    uint32_t rates[ESP32_RIO_NUM_DI_CHANNELS];
+} input_counter_reg_params_t;
+
+/*
+ Input registers (DI sequence of events FIFO window):
+ Address        Assignment
+ 256            Number of records in the window (0 to 30)
+ 257            Number of further records waiting behind the window (saturates at 65535)
+ 258            Records lost to a full event buffer (low word, wraps around)
+ 259            (Reserved)
+ 260-263        Record 0 (oldest)
+ 264-267        Record 1
+ ...
+ 376-379        Record 29
+ 
+ Record layout:
+ Offset     Assignment
+ 0          Timestamp, bits 0-15 (microseconds since boot)
+ 1          Timestamp, bits 16-31
+ 2          Timestamp, bits 32-47
+ 3          DI channel number (bits 0-7) and new level (bit 8)
+ 
+ Reading the window from its first register consumes every record fully covered by the read. The window then
+ refills with the next records, which show up on the following read.
+*/
+
+/*
+ Input registers (I/O image):
+ Address    Assignment
+ 512        Coils bank 0 (bit n = DQ0n)
+ 513        Coils bank 1 (bit n = DQ1n, bit 15 = Output Enable)
+ 514        Discrete inputs (bit n = DIn)
+ 515        Status word
+ 
+ Holding registers (I/O image):
+ Address    Assignment
+ 0          Coils bank 0 (bit n = DQ0n)
+ 1          Coils bank 1 (bit n = DQ1n, bit 15 = Output Enable)
+ 2          Discrete inputs (bit n = DIn)
+ 3          Status word
+ 4-23       DI0-DI9 pulse counts, as in the counter input registers
+ 
+ Writing holding registers 0 and 1 is equivalent to writing the corresponding coils. Registers from 2 on are
+ read-only: anything written to them is overwritten on the next update. With Read/Write Multiple Registers
+ (function code 0x17) a master can set all outputs and read back all inputs in a single transaction.
+*/
+
+typedef struct {
+    uint16_t coils_bank0;
+    uint16_t coils_bank1;
+    uint16_t discrete_inputs;
+    uint16_t status;
+} input_io_reg_params_t;
+
+typedef struct {
+    uint16_t coils_bank0;
+    uint16_t coils_bank1;
+    uint16_t discrete_inputs;
+    uint16_t status;
+    uint32_t counts[ESP32_RIO_NUM_DI_CHANNELS];
+} holding_io_reg_params_t;
+
+/*
+ Holding registers (output modes), four per output:
+ Address    Assignment
+ 256-259    DQ00 mode block
+ 260-263    DQ01 mode block
+ ...
+ 292-295    DQ09 mode block
+ 296-299    DQ10 mode block
+ ...
+ 332-335    DQ19 mode block
+ 
+ Mode block layout:
+ Offset     Assignment
+ 0          Mode: 0 normal, 1 pulse, 2 on-delay, 3 off-delay, 4 PWM
+ 1          Pulse or delay time (1-65535 ms)
+ 2          PWM frequency (10-40000 Hz)
+ 3          PWM duty cycle (0-1000 per mille)
+ 
+ Blocks follow in output order, bank 0 first, as many per bank as the board has outputs. Written blocks take
+ effect at once and are stored; a block with invalid values reads back as the mode left in place.
+*/
+
+typedef struct {
+    esp32_rio_dq_mode_config_t modes[2][ESP32_RIO_NUM_DQ_CHANNELS];
+} holding_dq_mode_reg_params_t;
+
+/*
+ Holding registers (logic program), three per block:
+ Address    Assignment
+ 512        Block count: writing it loads that many blocks from the registers below, 0 stops the program
+ 513        Load status: 0 loaded, n > 0 for block n - 1 invalid (33 for a count over 32)
+ 514-515    Reserved
+ 516-518    Block 0
+ 519-521    Block 1
+ ...
+ 609-611    Block 31
+ 
+ Block layout:
+ Offset     Assignment
+ 0          Operation (high byte) and destination operand (low byte)
+ 1          Source A operand (high byte) and source B operand (low byte)
+ 2          Timer block time (ms)
+ 
+ Blocks may be written in any number of requests before the block count. Once loaded, the program runs and is
+ stored, and the blocks read back as the program running; a failed load leaves the running program in place.
+ See logic_engine.h for operations and operands.
+*/
+
+typedef struct {
+    uint16_t block_count;
+    uint16_t load_status;
+    uint16_t reserved[MB_LOGIC_HEADER_SIZE - 2];
+    uint16_t blocks[ESP32_RIO_LOGIC_MAX_BLOCKS][MB_LOGIC_BLOCK_SIZE];
+} holding_logic_reg_params_t;
+
+/*
+ Input registers (diagnostics), all values 32-bit:
+ Address    Assignment
+ 768        Uptime (s)
+ 770        Modbus requests served (register area accesses)
+ 772        Modbus requests per second (last second)
+ 774        Coil writes
+ 776        Output updates (coil writes coalesced while outputs were being updated are applied together)
+ 778        DI edges interrupted
+ 780        DI edges coalesced into an earlier input update
+ 782        DI event records lost to full buffers
+ 784        DI event buffer high-water mark, unfiltered inputs
+ 786        DI event buffer high-water mark, filtered inputs
+ 788-829    Coil write to outputs driven latency (see below)
+ 830-871    DI edge to discrete input register updated latency (unfiltered inputs, see below)
+ 872        Output updates changing no output (skipped)
+ 
+ Latency blocks:
+ Offset     Assignment
+ 0          Samples
+ 2          Minimum (us)
+ 4          Mean (us)
+ 6          Maximum (us)
+ 8          99th percentile (us, upper bound of its histogram bucket)
+ 10-41      Histogram: sample count of bucket n (0-15) at offset 10 + 2n. Bucket 0 holds 0 us,
+            bucket n from 2^(n-1) to 2^n - 1 us, bucket 15 everything from 16384 us on
+*/
+
+typedef struct {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t mean_us;
+    uint32_t max_us;
+    uint32_t p99_us;
+    uint32_t buckets[MB_DIAG_HISTOGRAM_BUCKETS];
+} input_latency_reg_params_t;
+
+typedef struct {
+    uint32_t uptime_s;
+    uint32_t requests;
+    uint32_t request_rate;
+    uint32_t coil_writes;
+    uint32_t output_updates;
+    uint32_t di_edges;
+    uint32_t di_edges_coalesced;
+    uint32_t di_events_lost;
+    uint32_t di_isr_queue_high_water;
+    uint32_t di_filter_queue_high_water;
+    input_latency_reg_params_t coil_to_output;
+    input_latency_reg_params_t di_to_register;
+    uint32_t output_noops;
+} input_diag_reg_params_t;
+
+typedef struct {
+    uint16_t window_count;
+    uint16_t pending_count;
+    uint16_t overrun_count;
+    uint16_t reserved;
+    uint16_t records[MB_SOE_WINDOW_RECORDS][MB_SOE_RECORD_SIZE];
+} input_soe_reg_params_t;
+
 #endif //MODBUS_PARAMS_H
@@ -0,0 +1,147 @@
+/*
+@file output_retain.c
+@brief Implementation of the coil image and output enable state retained across resets.
+
+This file keeps the last coil image and output enable state in RTC memory, which is
+left uninitialized by the boot, and hands them back after the resets the configuration
+selects. A checksum rejects the record after power-on or any corruption.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#include <stddef.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "esp_rom_crc.h"
+
+#include "output_retain.h"
+
+#if CONFIG_ESP32_RIO_RETAIN_OUTPUTS
+
+#define RETAIN_MAGIC 0x5254 //"RT"
+
+// What a reset leaves of the retained state
+#define RETAIN_NONE 0
+#define RETAIN_COILS 1
+#define RETAIN_ALL 2
+
+#if CONFIG_ESP32_RIO_RETAIN_SW_RESET_ALL
+#define RETAIN_SW_RESET RETAIN_ALL
+#elif CONFIG_ESP32_RIO_RETAIN_SW_RESET_COILS
+#define RETAIN_SW_RESET RETAIN_COILS
+#else
+#define RETAIN_SW_RESET RETAIN_NONE
+#endif
+
+#if CONFIG_ESP32_RIO_RETAIN_FAULT_RESET_ALL
+#define RETAIN_FAULT_RESET RETAIN_ALL
+#elif CONFIG_ESP32_RIO_RETAIN_FAULT_RESET_COILS
+#define RETAIN_FAULT_RESET RETAIN_COILS
+#else
+#define RETAIN_FAULT_RESET RETAIN_NONE
+#endif
+
+#if CONFIG_ESP32_RIO_RETAIN_BROWNOUT_RESET_ALL
+#define RETAIN_BROWNOUT_RESET RETAIN_ALL
+#elif CONFIG_ESP32_RIO_RETAIN_BROWNOUT_RESET_COILS
+#define RETAIN_BROWNOUT_RESET RETAIN_COILS
+#else
+#define RETAIN_BROWNOUT_RESET RETAIN_NONE
+#endif
+
+typedef struct {
+    uint16_t magic;
+    uint16_t outputs_enabled;
+    coil_reg_params_t coils;
+    uint32_t crc; //Over everything above
+} retain_record_t;
+
+static int retain_policy(esp_reset_reason_t);
+static uint32_t retain_crc(const retain_record_t *);
+
+static const char *TAG = "ESP32_RIO_RETAIN";
+
+static RTC_NOINIT_ATTR retain_record_t s_record;
+
+
+/*
+ Keep the coil image and output enable state for the next boot. Calls must be serialized
+*/
+void output_retain_store(const coil_reg_params_t *coils, bool outputs_enabled) {
+    if (s_record.magic == RETAIN_MAGIC && s_record.outputs_enabled == outputs_enabled &&
+        memcmp(&s_record.coils, coils, sizeof(*coils)) == 0) {
+        return; //Unchanged, spare the checksum
+    }
+    s_record.magic = RETAIN_MAGIC;
+    s_record.outputs_enabled = outputs_enabled;
+    s_record.coils = *coils;
+    s_record.crc = retain_crc(&s_record);
+}
+
+
+/*
+ Retrieve the coil image retained before the reset, if the reset reason allows it. The Output Enable
+ coil reports whether outputs should be enabled again
+*/
+bool output_retain_restore(coil_reg_params_t *coils) {
+    esp_reset_reason_t reason = esp_reset_reason();
+    int policy = retain_policy(reason);
+    if (policy == RETAIN_NONE) {
+        return false;
+    }
+    if (s_record.magic != RETAIN_MAGIC || s_record.crc != retain_crc(&s_record)) {
+        ESP_LOGW(TAG, "No valid retained coils after reset reason %d.", (int)reason);
+        return false;
+    }
+    *coils = s_record.coils;
+    if (policy == RETAIN_ALL && s_record.outputs_enabled) {
+        coils->MB_OE_COIL_WORD |= MB_OE_COIL_BIT;
+    } else {
+        coils->MB_OE_COIL_WORD &= ~MB_OE_COIL_BIT;
+    }
+    ESP_LOGI(TAG, "Coils restored after reset reason %d, outputs %s.", (int)reason,
+             (coils->MB_OE_COIL_WORD & MB_OE_COIL_BIT) ? "enabled" : "disabled");
+    return true;
+}
+
+
+static int retain_policy(esp_reset_reason_t reason) {
+    switch (reason) {
+        case ESP_RST_SW:
+            return RETAIN_SW_RESET;
+        case ESP_RST_PANIC:
+        case ESP_RST_INT_WDT:
+        case ESP_RST_TASK_WDT:
+        case ESP_RST_WDT:
+            return RETAIN_FAULT_RESET;
+        case ESP_RST_BROWNOUT:
+            return RETAIN_BROWNOUT_RESET;
+        default:
+            return RETAIN_NONE; //Power-on, external reset, deep sleep and the like start afresh
+    }
+}
+
+
+static uint32_t retain_crc(const retain_record_t *record) {
+    return esp_rom_crc32_le(0, (const uint8_t *)record, offsetof(retain_record_t, crc));
+}
+
+#else //CONFIG_ESP32_RIO_RETAIN_OUTPUTS
+
+void output_retain_store(const coil_reg_params_t *coils, bool outputs_enabled) {
+}
+
+
+bool output_retain_restore(coil_reg_params_t *coils) {
+    return false; //Coils always start cleared
+}
+
+#endif //CONFIG_ESP32_RIO_RETAIN_OUTPUTS
@@ -0,0 +1,25 @@
+/*
+@file output_retain.h
+@brief Coil image and output enable state retained across resets.
+
+This file declares the functions keeping a copy of the coils and of the output enable
+state in RTC memory, and restoring them on boot according to the reset reason.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+*/
+
+#ifndef OUTPUT_RETAIN_H
+#define OUTPUT_RETAIN_H
+
+#include <stdbool.h>
+#include "modbus_params.h"
+
+void output_retain_store(const coil_reg_params_t *, bool);
+bool output_retain_restore(coil_reg_params_t *);
+
+#endif //OUTPUT_RETAIN_H
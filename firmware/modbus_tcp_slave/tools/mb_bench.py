@@ -0,0 +1,439 @@
+#!/usr/bin/env python3
+"""
+@file mb_bench.py
+@brief Host-side load test and latency benchmark for the Modbus TCP Slave.
+
+Drives the slave with a configurable mix of Modbus function codes over concurrent
+connections, measuring round-trip percentiles, sustained transactions per second and
+error rate. Also times coil write -> DQ pin -> DI pin through a wired jumper.
+Results are written as JSON so runs against different firmware builds can be compared.
+Only the Python 3 standard library is required.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+"""
+
+import argparse
+import json
+import random
+import socket
+import struct
+import sys
+import threading
+import time
+
+MB_TCP_PORT_NUMBER = 502
+MB_SLAVE_ADDR = 1
+
+FC_READ_COILS = 0x01
+FC_READ_DISCRETE_INPUTS = 0x02
+FC_WRITE_SINGLE_COIL = 0x05
+FC_WRITE_MULTIPLE_COILS = 0x0F
+
+FC_NAMES = {
+    "fc01": FC_READ_COILS,
+    "fc02": FC_READ_DISCRETE_INPUTS,
+    "fc05": FC_WRITE_SINGLE_COIL,
+    "fc0f": FC_WRITE_MULTIPLE_COILS,
+}
+
+PERCENTILES = (50, 90, 99, 99.9)
+
+# Coil map of the slave (see README, Modbus Register Map and Board Variants)
+COILS_PER_BANK = 16
+ESP32_RIO_OUTPUTS_PER_BANK = 10  # Outputs per bank of the ESP32 RIO board
+
+
+def oe_coil_address(outputs_per_bank):
+    """Output Enable coil: 31, or 32 on boards with a full 16 outputs per bank."""
+    return 2 * COILS_PER_BANK - 1 if outputs_per_bank < COILS_PER_BANK else 2 * COILS_PER_BANK
+
+
+def unused_coils(outputs_per_bank):
+    """Bank 0 coils past the last output, driving nothing: a safe target for write load."""
+    return range(outputs_per_bank, COILS_PER_BANK)
+
+
+class ModbusError(Exception):
+    """Exception response or malformed reply from the slave."""
+
+
+class ModbusClient:
+    """Minimal blocking Modbus TCP client, one outstanding transaction at a time."""
+
+    def __init__(self, host, port, unit_id, timeout):
+        self.unit_id = unit_id
+        self.transaction_id = 0
+        self.sock = socket.create_connection((host, port), timeout=timeout)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
+    def close(self):
+        self.sock.close()
+
+    def _recv_exact(self, size):
+        data = b""
+        while len(data) < size:
+            chunk = self.sock.recv(size - len(data))
+            if not chunk:
+                raise ConnectionError("connection closed by slave")
+            data += chunk
+        return data
+
+    def transact(self, pdu):
+        self.transaction_id = (self.transaction_id + 1) & 0xFFFF
+        mbap = struct.pack(">HHHB", self.transaction_id, 0, len(pdu) + 1, self.unit_id)
+        self.sock.sendall(mbap + pdu)
+        transaction_id, protocol_id, length, _ = struct.unpack(">HHHB", self._recv_exact(7))
+        response = self._recv_exact(length - 1)
+        if transaction_id != self.transaction_id or protocol_id != 0:
+            raise ModbusError("mismatched transaction or protocol identifier")
+        if response[0] & 0x80:
+            raise ModbusError("exception code 0x%02x for function 0x%02x" % (response[1], response[0] & 0x7F))
+        if response[0] != pdu[0]:
+            raise ModbusError("unexpected function code 0x%02x" % response[0])
+        return response
+
+    def read_bits(self, function_code, address, count):
+        response = self.transact(struct.pack(">BHH", function_code, address, count))
+        if response[1] != (count + 7) // 8:
+            raise ModbusError("unexpected byte count")
+        return [bool(response[2 + i // 8] & (1 << (i % 8))) for i in range(count)]
+
+    def write_coil(self, address, value):
+        self.transact(struct.pack(">BHH", FC_WRITE_SINGLE_COIL, address, 0xFF00 if value else 0x0000))
+
+    def write_coils(self, address, values):
+        packed = bytearray((len(values) + 7) // 8)
+        for i, value in enumerate(values):
+            if value:
+                packed[i // 8] |= 1 << (i % 8)
+        self.transact(struct.pack(">BHHB", FC_WRITE_MULTIPLE_COILS, address, len(values), len(packed)) + bytes(packed))
+
+
+def percentile(sorted_samples, pct):
+    if not sorted_samples:
+        return None
+    rank = (len(sorted_samples) - 1) * pct / 100.0
+    lower = int(rank)
+    upper = min(lower + 1, len(sorted_samples) - 1)
+    return sorted_samples[lower] + (sorted_samples[upper] - sorted_samples[lower]) * (rank - lower)
+
+
+def summarize(samples_us):
+    """Latency statistics in microseconds."""
+    ordered = sorted(samples_us)
+    summary = {"samples": len(ordered)}
+    if ordered:
+        summary["min_us"] = ordered[0]
+        summary["mean_us"] = sum(ordered) / len(ordered)
+        summary["max_us"] = ordered[-1]
+        for pct in PERCENTILES:
+            summary["p%s_us" % str(pct).replace(".", "_")] = percentile(ordered, pct)
+    return summary
+
+
+def parse_mix(text):
+    """Parse a function code mix such as 'fc01:4,fc02:4,fc05:1,fc0f:1' into (name, weight) pairs."""
+    mix = []
+    for item in text.split(","):
+        name, _, weight = item.strip().lower().partition(":")
+        if name not in FC_NAMES:
+            raise argparse.ArgumentTypeError("unknown function code '%s' (use %s)" % (name, ", ".join(FC_NAMES)))
+        mix.append((name, float(weight) if weight else 1.0))
+    if not mix or sum(weight for _, weight in mix) <= 0:
+        raise argparse.ArgumentTypeError("mix needs at least one positive weight")
+    return mix
+
+
+def load_worker(args, mix, results, lock, start_barrier):
+    names = [name for name, _ in mix]
+    weights = [weight for _, weight in mix]
+    latencies = {name: [] for name in names}
+    errors = {name: 0 for name in names}
+    connection_errors = 0
+    rng = random.Random()
+    client = None
+    write_value = False
+    interval = 1.0 / args.rate if args.rate > 0 else 0.0
+
+    try:
+        start_barrier.wait()
+    except threading.BrokenBarrierError:
+        return
+    next_request = time.perf_counter()
+    deadline = next_request + args.duration
+    while time.perf_counter() < deadline:
+        if client is None:
+            try:
+                client = ModbusClient(args.host, args.port, args.unit, args.timeout)
+            except OSError:
+                connection_errors += 1
+                time.sleep(0.1)
+                continue
+        name = rng.choices(names, weights)[0]
+        write_value = not write_value
+        started = time.perf_counter()
+        try:
+            if name == "fc01":
+                client.read_bits(FC_READ_COILS, 0, 32)
+            elif name == "fc02":
+                client.read_bits(FC_READ_DISCRETE_INPUTS, 0, 10)
+            elif name == "fc05":
+                client.write_coil(args.write_coil, write_value)
+            else:
+                client.write_coils(args.write_coil, [write_value] * args.write_count)
+            latencies[name].append((time.perf_counter() - started) * 1e6)
+        except ModbusError:
+            errors[name] += 1
+        except OSError:
+            errors[name] += 1
+            client.close()
+            client = None
+        if interval:
+            next_request += interval
+            delay = next_request - time.perf_counter()
+            if delay > 0:
+                time.sleep(delay)
+    if client is not None:
+        client.close()
+
+    with lock:
+        for name in names:
+            results["latencies"][name].extend(latencies[name])
+            results["errors"][name] += errors[name]
+        results["connection_errors"] += connection_errors
+
+
+def run_load(args):
+    mix = parse_mix(args.mix)
+    results = {
+        "latencies": {name: [] for name, _ in mix},
+        "errors": {name: 0 for name, _ in mix},
+        "connection_errors": 0,
+    }
+    lock = threading.Lock()
+    start_barrier = threading.Barrier(args.connections + 1)
+    workers = [threading.Thread(target=load_worker, args=(args, mix, results, lock, start_barrier))
+               for _ in range(args.connections)]
+    for worker in workers:
+        worker.start()
+    start_barrier.wait()  # Start all connections together
+    started = time.perf_counter()
+    for worker in workers:
+        worker.join()
+    elapsed = time.perf_counter() - started
+
+    per_function = {}
+    all_latencies = []
+    total_errors = 0
+    for name, _ in mix:
+        samples = results["latencies"][name]
+        all_latencies.extend(samples)
+        total_errors += results["errors"][name]
+        per_function[name] = summarize(samples)
+        per_function[name]["errors"] = results["errors"][name]
+    transactions = len(all_latencies)
+    attempted = transactions + total_errors
+    return {
+        "test": "load",
+        "config": {
+            "host": args.host, "port": args.port, "unit": args.unit, "mix": args.mix,
+            "connections": args.connections, "duration_s": args.duration, "rate_per_connection": args.rate,
+            "write_coil": args.write_coil, "write_count": args.write_count,
+        },
+        "elapsed_s": elapsed,
+        "transactions": transactions,
+        "tps": transactions / elapsed if elapsed > 0 else 0.0,
+        "errors": total_errors,
+        "error_rate": total_errors / attempted if attempted else 0.0,
+        "connection_errors": results["connection_errors"],
+        "round_trip": summarize(all_latencies),
+        "per_function": per_function,
+    }
+
+
+def coil_address(output, outputs_per_bank):
+    """Coil address of an output numbered from 0, bank 0 first (DQ1n is coil 16 + n)."""
+    if output < outputs_per_bank:
+        return output
+    return COILS_PER_BANK + (output - outputs_per_bank)
+
+
+def run_loopback(args):
+    oe_coil = oe_coil_address(args.outputs_per_bank)
+    client = ModbusClient(args.host, args.port, args.unit, args.timeout)
+    coil = coil_address(args.dq, args.outputs_per_bank)
+    samples = []
+    timeouts = 0
+    try:
+        if args.enable_outputs:
+            client.write_coil(oe_coil, True)
+        if not client.read_bits(FC_READ_COILS, oe_coil, 1)[0]:
+            raise ModbusError("outputs are disabled (use --enable-outputs or the OE button)")
+        level = client.read_bits(FC_READ_DISCRETE_INPUTS, args.di, 1)[0]
+        for _ in range(args.iterations):
+            level = not level
+            started = time.perf_counter()
+            client.write_coil(coil, level)
+            poll_deadline = started + args.timeout
+            while True:
+                if client.read_bits(FC_READ_DISCRETE_INPUTS, args.di, 1)[0] == level:
+                    samples.append((time.perf_counter() - started) * 1e6)
+                    break
+                if time.perf_counter() > poll_deadline:
+                    timeouts += 1
+                    level = client.read_bits(FC_READ_DISCRETE_INPUTS, args.di, 1)[0]
+                    break
+            time.sleep(args.settle)
+        client.write_coil(coil, False)
+    finally:
+        client.close()
+    return {
+        "test": "loopback",
+        "config": {
+            "host": args.host, "port": args.port, "unit": args.unit, "dq": args.dq, "di": args.di,
+            "iterations": args.iterations, "settle_s": args.settle,
+        },
+        "timeouts": timeouts,
+        "coil_to_di": summarize(samples),
+    }
+
+
+def flatten(report, prefix=""):
+    """Numeric figures of a report keyed by dotted path, configuration excluded."""
+    figures = {}
+    for key, value in report.items():
+        if key == "config":
+            continue
+        path = prefix + key
+        if isinstance(value, dict):
+            figures.update(flatten(value, path + "."))
+        elif isinstance(value, (int, float)) and not isinstance(value, bool):
+            figures[path] = value
+    return figures
+
+
+def run_compare(args):
+    with open(args.baseline) as baseline_file, open(args.candidate) as candidate_file:
+        baseline_report = json.load(baseline_file)
+        candidate_report = json.load(candidate_file)
+    if baseline_report.get("test") != candidate_report.get("test"):
+        sys.exit("Reports are from different tests (%s, %s)" % (baseline_report.get("test"), candidate_report.get("test")))
+    baseline = flatten(baseline_report)
+    candidate = flatten(candidate_report)
+    regressions = []
+    comparison = {}
+    for path in sorted(set(baseline) & set(candidate)):
+        before, after = baseline[path], candidate[path]
+        change = (after - before) / before if before else None
+        comparison[path] = {"baseline": before, "candidate": after, "change": change}
+        # Throughput should not drop; latencies and errors should not grow
+        if path.endswith(("errors", "error_rate", "timeouts")) and before == 0:
+            if after > 0:
+                regressions.append(path)
+        elif change is not None and path.endswith(("_us", "tps", "error_rate", "errors", "timeouts")):
+            worse = -change if path == "tps" else change
+            if worse > args.tolerance:
+                regressions.append(path)
+    return {"test": "compare", "tolerance": args.tolerance, "figures": comparison, "regressions": regressions}
+
+
+def print_summary(report):
+    if report["test"] == "load":
+        print("%d transactions in %.1f s: %.1f tps, %d errors (%.3f%%), %d connection errors" % (
+            report["transactions"], report["elapsed_s"], report["tps"], report["errors"],
+            100.0 * report["error_rate"], report["connection_errors"]), file=sys.stderr)
+        rows = [("all", report["round_trip"])] + sorted(report["per_function"].items())
+    elif report["test"] == "loopback":
+        print("Coil write -> DQ%02d -> DI%d, %d timeouts" % (
+            report["config"]["dq"], report["config"]["di"], report["timeouts"]), file=sys.stderr)
+        rows = [("loopback", report["coil_to_di"])]
+    else:
+        for path in report["regressions"]:
+            figure = report["figures"][path]
+            print("REGRESSION %s: %s -> %s" % (path, figure["baseline"], figure["candidate"]), file=sys.stderr)
+        print("%d regressions beyond %.0f%%" % (len(report["regressions"]), 100 * report["tolerance"]), file=sys.stderr)
+        return
+    for name, stats in rows:
+        if stats["samples"] == 0:
+            print("  %-8s no samples" % name, file=sys.stderr)
+            continue
+        print("  %-8s n=%-7d min %8.0f  p50 %8.0f  p90 %8.0f  p99 %8.0f  p99.9 %8.0f  max %8.0f us" % (
+            name, stats["samples"], stats["min_us"], stats["p50_us"], stats["p90_us"], stats["p99_us"],
+            stats["p99_9_us"], stats["max_us"]), file=sys.stderr)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Load test and latency benchmark for the ESP32 RIO Modbus TCP slave.")
+    parser.add_argument("--label", default="", help="free-form tag stored in the report (e.g. firmware version)")
+    parser.add_argument("--output", help="write the JSON report to this file instead of standard output")
+    subparsers = parser.add_subparsers(dest="command", required=True)
+
+    def add_connection_args(subparser):
+        subparser.add_argument("host", help="slave IP address or host name")
+        subparser.add_argument("--port", type=int, default=MB_TCP_PORT_NUMBER)
+        subparser.add_argument("--unit", type=int, default=MB_SLAVE_ADDR, help="Modbus unit identifier")
+        subparser.add_argument("--timeout", type=float, default=1.0, help="response timeout, seconds")
+        subparser.add_argument("--outputs-per-bank", type=int, default=ESP32_RIO_OUTPUTS_PER_BANK, choices=range(1, 17),
+                               metavar="1-16", help="outputs per bank of the board pin map (default: %(default)s)")
+
+    load = subparsers.add_parser("load", help="sustained load with a function code mix")
+    add_connection_args(load)
+    load.add_argument("--mix", default="fc01:4,fc02:4,fc05:1,fc0f:1",
+                      help="weighted function codes among fc01, fc02, fc05, fc0f (default: %(default)s)")
+    load.add_argument("--connections", type=int, default=1, help="concurrent TCP connections")
+    load.add_argument("--duration", type=float, default=10.0, help="test duration, seconds")
+    load.add_argument("--rate", type=float, default=0.0, help="requests per second per connection (0 = back to back)")
+    load.add_argument("--write-coil", type=int,
+                      help="first coil written by fc05/fc0f (default: the first coil past the bank 0 outputs, driving none)")
+    load.add_argument("--write-count", type=int, default=6, help="coils written by each fc0f request")
+
+    loopback = subparsers.add_parser("loopback", help="coil write to DI latency through a DQ-DI jumper")
+    add_connection_args(loopback)
+    loopback.add_argument("--dq", type=int, required=True, help="jumpered output, from 0, bank 0 first")
+    loopback.add_argument("--di", type=int, required=True, choices=range(10), metavar="0-9", help="jumpered input")
+    loopback.add_argument("--iterations", type=int, default=200)
+    loopback.add_argument("--settle", type=float, default=0.02, help="pause between toggles, seconds")
+    loopback.add_argument("--enable-outputs", action="store_true", help="set the Output Enable coil first")
+
+    compare = subparsers.add_parser("compare", help="compare two reports of the same test")
+    compare.add_argument("baseline")
+    compare.add_argument("candidate")
+    compare.add_argument("--tolerance", type=float, default=0.10, help="relative degradation flagged (default: 0.10)")
+
+    args = parser.parse_args()
+    if args.command == "load" and args.write_coil is None:
+        names = [name for name, _ in parse_mix(args.mix)]
+        needed = args.write_count if "fc0f" in names else 1 if "fc05" in names else 0
+        unused = unused_coils(args.outputs_per_bank)
+        if len(unused) < needed:
+            parser.error("%d outputs per bank leave %d unused coils for %d written, give --write-coil"
+                         % (args.outputs_per_bank, len(unused), needed))
+        args.write_coil = unused[0] if needed else None
+    if args.command == "loopback" and args.dq >= 2 * args.outputs_per_bank:
+        parser.error("--dq must be below %d with %d outputs per bank" % (2 * args.outputs_per_bank, args.outputs_per_bank))
+    if args.command == "load":
+        report = run_load(args)
+    elif args.command == "loopback":
+        report = run_loopback(args)
+    else:
+        report = run_compare(args)
+    report["label"] = args.label
+    report["timestamp"] = time.strftime("%Y-%m-%dT%H:%M:%SZ", time.gmtime())
+
+    text = json.dumps(report, indent=2)
+    if args.output:
+        with open(args.output, "w") as output_file:
+            output_file.write(text + "\n")
+    else:
+        print(text)
+    print_summary(report)
+    return 1 if report["test"] == "compare" and report["regressions"] else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
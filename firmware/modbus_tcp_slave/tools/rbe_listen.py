@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+"""
+@file rbe_listen.py
+@brief Reference UDP subscriber for the DI change publisher of the Modbus TCP Slave.
+
+Receives report-by-exception messages, checks sequence numbers and dropped record
+counts, and prints every digital input change along with heartbeats.
+Only the Python 3 standard library is required.
+
+@copyright 2025 Douglas Almeida
+
+This file is part of the ESP32 Remote IO Modbus TCP Slave project.
+It is subject to the terms of the MIT License, which can be found in the LICENSE file.
+
+SPDX-License-Identifier: MIT
+"""
+
+import argparse
+import socket
+import struct
+
+HEADER = struct.Struct("<2sBBIQHHI")  # magic, version, type, sequence, timestamp_us, levels, record_count, dropped
+RECORD = struct.Struct("<IH")  # offset_us, levels
+MSG_CHANGES = 0
+MSG_HEARTBEAT = 1
+NUM_INPUTS = 10
+
+
+def format_levels(levels):
+    return "".join("1" if levels & (1 << i) else "0" for i in range(NUM_INPUTS))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Print DI changes pushed by the ESP32 RIO Modbus TCP slave (udp://HOST:PORT).")
+    parser.add_argument("--bind", default="0.0.0.0", help="local address to listen on")
+    parser.add_argument("--port", type=int, default=5020, help="local UDP port (the PORT of the rbe target)")
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind((args.bind, args.port))
+    print("Listening on %s:%d, levels shown as DI0..DI9" % (args.bind, args.port))
+    expected_sequence = {}
+    last_dropped = {}
+    while True:
+        data, (sender, _) = sock.recvfrom(1024)
+        if len(data) < HEADER.size:
+            continue
+        magic, version, msg_type, sequence, timestamp_us, levels, record_count, dropped = HEADER.unpack_from(data)
+        if magic != b"RB" or version != 1 or len(data) != HEADER.size + record_count * RECORD.size:
+            print("%s: malformed message" % sender)
+            continue
+
+        if sender in expected_sequence and sequence != expected_sequence[sender]:
+            print("%s: %d messages lost" % (sender, (sequence - expected_sequence[sender]) & 0xFFFFFFFF))
+        expected_sequence[sender] = (sequence + 1) & 0xFFFFFFFF
+        if dropped != last_dropped.get(sender, dropped):
+            print("%s: %d change records dropped by the publisher" % (sender, dropped - last_dropped[sender]))
+        last_dropped[sender] = dropped
+
+        if msg_type == MSG_HEARTBEAT:
+            print("%s: #%d %.6f s heartbeat  %s" % (sender, sequence, timestamp_us / 1e6, format_levels(levels)))
+        elif msg_type == MSG_CHANGES:
+            for i in range(record_count):
+                offset_us, record_levels = RECORD.unpack_from(data, HEADER.size + i * RECORD.size)
+                print("%s: #%d %.6f s change     %s" % (sender, sequence, (timestamp_us + offset_us) / 1e6,
+                                                       format_levels(record_levels)))
+
+
+if __name__ == "__main__":
+    main()